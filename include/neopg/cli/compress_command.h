@@ -26,6 +26,7 @@ class CompressCommand : public Command {
   std::string m_algo{"gz"};
   int m_level = 0;
   bool m_decode = false;
+  unsigned int m_threads = 1;
   const std::string group = "Commands";
   ListCompressCommand cmd_list;
 
@@ -40,6 +41,10 @@ class CompressCommand : public Command {
     m_cmd.add_option("file", m_files, "file to hash");
     m_cmd.add_option("--algo", m_algo, "compression function", true);
     m_cmd.add_option("--level", m_level, "compression level (0 default, 1-9)");
+    m_cmd.add_option("--threads", m_threads,
+                     "compress independent blocks in parallel (0 for one "
+                     "thread per CPU; gzip and bzip2 only)",
+                     true);
   }
 };
 
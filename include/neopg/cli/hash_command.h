@@ -7,6 +7,7 @@
 #pragma once
 
 #include <neopg/cli/command.h>
+#include <neopg/crypto/tree_hash.h>
 
 namespace NeoPG {
 namespace CLI {
@@ -25,9 +26,14 @@ class HashCommand : public Command {
   std::vector<std::string> m_files;
   std::string m_algo{"SHA-256"};
   bool m_raw = false;
+  unsigned int m_jobs = 1;
+  bool m_tree = false;
+  size_t m_chunk_size = Crypto::TreeHash::default_chunk_size;
   const std::string group = "Commands";
   ListHashCommand cmd_list;
 
+  void run_parallel();
+  void run_tree(bool multi_files);
   void run() override;
   HashCommand(CLI::App& app, const std::string& flag,
               const std::string& description,
@@ -37,6 +43,14 @@ class HashCommand : public Command {
     m_cmd.add_option("file", m_files, "file to hash");
     m_cmd.add_option("--algo", m_algo, "hash function", true);
     m_cmd.add_flag("--raw", m_raw, "output as binary instead hex encoded");
+    m_cmd.add_option("-j,--jobs", m_jobs,
+                     "number of files to hash in parallel (0 for one per CPU)",
+                     true);
+    m_cmd.add_flag("--tree", m_tree,
+                   "compute a Merkle tree hash (RFC 6962) over chunks of each "
+                   "file in parallel; this is not the plain digest");
+    m_cmd.add_option("--chunk-size", m_chunk_size,
+                     "chunk size in bytes for --tree", true);
   }
   virtual ~HashCommand() {}
 };
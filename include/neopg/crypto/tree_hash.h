@@ -0,0 +1,79 @@
+/* Parallel tree hash
+   Copyright 2017 The NeoPG developers
+
+   NeoPG is released under the Simplified BSD License (see license.txt)
+*/
+
+#pragma once
+
+#include <neopg/common.h>
+#include <neopg/utils/input_source.h>
+
+#include <botan/hash.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <vector>
+
+namespace NeoPG {
+namespace Crypto {
+
+/**
+   A Merkle tree hash over fixed-size chunks of the input, so that the
+   chunks can be hashed in parallel.  The tree is the one defined for
+   Certificate Transparency (RFC 6962, section 2.1), using any hash
+   function H:
+
+   - A leaf is H(0x00 || chunk), where all chunks have chunk_size octets
+     except for the last one, which may be shorter.
+   - A tree with n > 1 leaves is split after the first k leaves, where k
+     is the largest power of two smaller than n.  Its hash is
+     H(0x01 || left || right).
+   - The hash of a single leaf is the leaf itself.  The hash of the
+     empty input is H().
+
+   The result depends on the chunk size, but not on the number of
+   threads.  It is not the same as the plain digest of the input.
+*/
+class NEOPG_DLL TreeHash {
+ public:
+  static const size_t default_chunk_size = 1024 * 1024;
+
+  /* If threads is 0, one thread per CPU is used.  */
+  TreeHash(const std::string& algo, size_t chunk_size = default_chunk_size,
+           unsigned int threads = 0);
+
+  std::vector<uint8_t> process(const uint8_t* data, size_t len);
+
+  /* Hash all data from the stream.  The next batch of chunks is read
+     while the current one is hashed.  */
+  std::vector<uint8_t> process(std::istream& in);
+
+  /* Hash all data from the input source, which must use a block size
+     that is a multiple of the chunk size (see batch_size()).  */
+  std::vector<uint8_t> process(InputSource& in);
+
+  /* The amount of data that is hashed in parallel.  */
+  size_t batch_size() const { return m_chunk_size * m_threads; }
+
+  /* A label that identifies the construction and its parameters, for
+     example "Tree(SHA-256,1048576)".  */
+  std::string name() const;
+
+ private:
+  void hash_leaves(const uint8_t* data, size_t len,
+                   std::vector<uint8_t>& leaves);
+  void hash_tree(const uint8_t* leaves, size_t count, uint8_t* out,
+                 Botan::HashFunction& hash);
+  std::vector<uint8_t> root(const std::vector<uint8_t>& leaves);
+
+  std::string m_algo;
+  size_t m_chunk_size;
+  unsigned int m_threads;
+  size_t m_output_length;
+};
+
+}  // namespace Crypto
+}  // namespace NeoPG
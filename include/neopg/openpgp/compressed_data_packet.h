@@ -7,6 +7,7 @@
 #pragma once
 
 #include <neopg/openpgp/packet.h>
+#include <istream>
 #include <vector>
 
 namespace NeoPG {
@@ -33,8 +34,10 @@ enum class CompressionAlgorithm : uint8_t {
 struct CompressedDataPacket : Packet {
   void write_body(std::ostream& out) const override;
   PacketType type() const override;
+  uint32_t body_length() const override;
 
   virtual void write_compressed_data(std::ostream& out) const = 0;
+  virtual uint32_t compressed_data_length() const = 0;
   virtual CompressionAlgorithm compression_algorithm() const = 0;
 };
 
@@ -43,6 +46,7 @@ struct CompressedDataPacket : Packet {
 struct UncompressedDataPacket : CompressedDataPacket {
   std::vector<uint8_t> m_data;
   void write_compressed_data(std::ostream& out) const override;
+  uint32_t compressed_data_length() const override;
   CompressionAlgorithm compression_algorithm() const override;
 };
 
@@ -51,6 +55,7 @@ struct UncompressedDataPacket : CompressedDataPacket {
 struct DeflateCompressedDataPacket : CompressedDataPacket {
   std::vector<uint8_t> m_data;
   void write_compressed_data(std::ostream& out) const override;
+  uint32_t compressed_data_length() const override;
   CompressionAlgorithm compression_algorithm() const override;
 };
 
@@ -59,6 +64,7 @@ struct DeflateCompressedDataPacket : CompressedDataPacket {
 struct ZlibCompressedDataPacket : CompressedDataPacket {
   std::vector<uint8_t> m_data;
   void write_compressed_data(std::ostream& out) const override;
+  uint32_t compressed_data_length() const override;
   CompressionAlgorithm compression_algorithm() const override;
 };
 
@@ -67,6 +73,49 @@ struct ZlibCompressedDataPacket : CompressedDataPacket {
 struct Bzip2CompressedDataPacket : CompressedDataPacket {
   std::vector<uint8_t> m_data;
   void write_compressed_data(std::ostream& out) const override;
+  uint32_t compressed_data_length() const override;
+  CompressionAlgorithm compression_algorithm() const override;
+};
+
+/* Streaming Compressed Data Packets.  These read the uncompressed data
+   from m_source and compress it while the packet is written, so memory
+   use does not depend on the size of the data.  The compressed length
+   is not known in advance, so these packets are written with partial
+   body lengths.  */
+
+struct StreamingCompressedDataPacket : CompressedDataPacket {
+  /* Size of the blocks read from the source.  */
+  static const size_t block_size = 64 * 1024;
+
+  std::istream& m_source;
+  /* Compression level (0 default, 1-9).  */
+  size_t m_level;
+
+  StreamingCompressedDataPacket(std::istream& source, size_t level = 0)
+      : m_source(source), m_level(level) {}
+
+  void write_compressed_data(std::ostream& out) const override;
+  uint32_t compressed_data_length() const override;
+  bool has_body_length() const override { return false; }
+};
+
+struct StreamingUncompressedDataPacket : StreamingCompressedDataPacket {
+  using StreamingCompressedDataPacket::StreamingCompressedDataPacket;
+  CompressionAlgorithm compression_algorithm() const override;
+};
+
+struct StreamingDeflateCompressedDataPacket : StreamingCompressedDataPacket {
+  using StreamingCompressedDataPacket::StreamingCompressedDataPacket;
+  CompressionAlgorithm compression_algorithm() const override;
+};
+
+struct StreamingZlibCompressedDataPacket : StreamingCompressedDataPacket {
+  using StreamingCompressedDataPacket::StreamingCompressedDataPacket;
+  CompressionAlgorithm compression_algorithm() const override;
+};
+
+struct StreamingBzip2CompressedDataPacket : StreamingCompressedDataPacket {
+  using StreamingCompressedDataPacket::StreamingCompressedDataPacket;
   CompressionAlgorithm compression_algorithm() const override;
 };
 
@@ -50,6 +50,7 @@ enum class PacketLengthType : uint8_t {
 
 struct PacketHeader {
   virtual void write(std::ostream& out) = 0;
+  virtual PacketType type() const = 0;
 };
 
 struct OldPacketHeader : PacketHeader {
@@ -70,6 +71,7 @@ struct OldPacketHeader : PacketHeader {
                   PacketLengthType length_type = PacketLengthType::Default);
 
   void write(std::ostream& out) override;
+  PacketType type() const override { return m_packet_type; }
 };
 
 struct NewPacketTag {
@@ -79,6 +81,10 @@ struct NewPacketTag {
 
   NewPacketTag(PacketType packet_type);
 
+  /*! Return the tag octet.
+   */
+  uint8_t encode() const;
+
   void write(std::ostream& out);
 };
 
@@ -96,6 +102,15 @@ struct NewPacketLength {
   NewPacketLength(uint32_t length,
                   PacketLengthType length_type = PacketLengthType::Default);
 
+  /*! Return the number of octets written by write.
+   */
+  uint32_t encoded_size() const;
+
+  /*! Store the encoded length in buf, which must have room for 5 octets,
+      and return the number of octets used.
+   */
+  size_t encode(uint8_t* buf) const;
+
   void write(std::ostream& out);
 };
 
@@ -111,6 +126,7 @@ struct NewPacketHeader : PacketHeader {
       : m_tag(packet_type), m_length(length, length_type) {}
 
   void write(std::ostream& out) override;
+  PacketType type() const override { return m_tag.m_packet_type; }
 };
 
 }  // namespace OpenPGP
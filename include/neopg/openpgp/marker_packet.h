@@ -14,6 +14,7 @@ namespace OpenPGP {
 struct MarkerPacket : Packet {
   void write_body(std::ostream& out) const override;
   PacketType type() const override;
+  uint32_t body_length() const override;
 };
 
 }  // namespace OpenPGP
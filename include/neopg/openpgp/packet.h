@@ -20,6 +20,18 @@ struct Packet {
   void write(std::ostream& out) const;
   virtual void write_body(std::ostream& out) const = 0;
   virtual PacketType type() const = 0;
+
+  /*! Return the number of octets written by write_body.  The default
+      implementation measures it with a dry run of write_body, so
+      subclasses should override it to compute the length from their
+      members instead.
+   */
+  virtual uint32_t body_length() const;
+
+  /*! Return false if the body length is not known before the body is
+      written.  Such packets are written with partial body lengths.
+   */
+  virtual bool has_body_length() const { return true; }
 };
 
 }  // namespace OpenPGP
@@ -0,0 +1,64 @@
+/* OpenPGP format
+   Copyright 2017 The NeoPG developers
+
+   NeoPG is released under the Simplified BSD License (see license.txt)
+*/
+
+#pragma once
+
+#include <neopg/openpgp/header.h>
+
+#include <iostream>
+#include <streambuf>
+#include <vector>
+
+namespace NeoPG {
+namespace OpenPGP {
+
+/*! A stream buffer that writes everything put into it as the body of a
+    single new format packet with partial body lengths (RFC 4880,
+    section 4.2.2.4).  At most one chunk of data is buffered, so packets
+    of any size can be written in one pass without knowing their length
+    in advance.  close must be called after the body was written, to
+    emit the final chunk.
+ */
+class PartialLengthStreamBuf : public std::streambuf {
+ public:
+  /* The first partial length must be at least 512 octets.  */
+  static const uint32_t min_chunk_size = 512;
+  static const uint32_t default_chunk_size = 8192;
+
+  PartialLengthStreamBuf(std::ostream& out, PacketType packet_type,
+                         uint32_t chunk_size = default_chunk_size);
+
+  void close();
+
+ protected:
+  std::streamsize xsputn(const char_type* s, std::streamsize n) override;
+  int_type overflow(int_type ch) override;
+
+ private:
+  std::ostream& m_out;
+  std::vector<char> m_buffer;
+  bool m_closed = false;
+
+  void write_chunk(const char* data, uint32_t length,
+                   PacketLengthType length_type);
+};
+
+class PartialLengthStream : public std::ostream {
+ public:
+  PartialLengthStream(
+      std::ostream& out, PacketType packet_type,
+      uint32_t chunk_size = PartialLengthStreamBuf::default_chunk_size);
+
+  /*! Write the final chunk.  No more data can be written afterwards.
+   */
+  void close();
+
+ private:
+  PartialLengthStreamBuf m_partial_length_stream_buf;
+};
+
+}  // namespace OpenPGP
+}  // namespace NeoPG
@@ -17,6 +17,7 @@ struct SymmetricallyEncryptedDataPacket : Packet {
 
   void write_body(std::ostream& out) const override;
   PacketType type() const override;
+  uint32_t body_length() const override;
 };
 
 }  // namespace OpenPGP
@@ -30,8 +30,10 @@ enum class UserAttributeType : uint8_t {
 struct UserAttributePacket : Packet {
   void write_body(std::ostream& out) const override;
   PacketType type() const override;
+  uint32_t body_length() const override;
 
   virtual void write_attribute(std::ostream& out) const = 0;
+  virtual uint32_t attribute_length() const = 0;
   virtual UserAttributeType attribute_type() const = 0;
 };
 
@@ -55,6 +57,7 @@ enum class ImageEncoding : uint8_t {
 struct ImageAttributeSubpacket : UserAttributePacket {
   std::vector<uint8_t> m_data;
   void write_attribute(std::ostream& out) const override;
+  uint32_t attribute_length() const override;
   UserAttributeType attribute_type() const override;
 };
 
@@ -9,8 +9,17 @@
 // Protect our use of PEGTL from other library users.
 #define TAOCPP_PEGTL_NAMESPACE neopg_pegtl
 
+#include <neopg/openpgp/header.h>
+
+#include <algorithm>
 #include <cstdint>
+#include <istream>
+#include <limits>
+#include <string>
+
 #include <tao/pegtl.hpp>
+#include <tao/pegtl/file_input.hpp>
+#include <tao/pegtl/istream_input.hpp>
 
 using namespace tao::neopg_pegtl;
 
@@ -18,234 +27,274 @@ namespace NeoPG {
 namespace Parser {
 namespace OpenPGP {
 
-struct packet : one<(char)0x80> {};
-
-struct packets : until<eof, packet> {};
-
-struct grammar : packets {};
-
-struct state {
-  std::vector<std::string> packets;
+/*! Receives the packets found by the parser.  The parser does not copy
+    packet data: the pointers passed to continue_packet point directly
+    into the input (the mapped file or the current input buffer), and
+    are only valid for the duration of the call.  A packet body can be
+    delivered in any number of pieces, independent of how it was split
+    into partial body lengths in the input.
+ */
+class RawPacketSink {
+ public:
+  virtual void start_packet(const NeoPG::OpenPGP::PacketHeader& header) = 0;
+  virtual void continue_packet(const char* data, std::size_t length) = 0;
+  virtual void finish_packet() = 0;
+  virtual ~RawPacketSink() {}
 };
 
-template <typename Rule>
-struct action : nothing<Rule> {};
+/* Default size of the input buffer for stream inputs, and thus the
+   upper limit for the size of a body piece passed to the sink.  */
+static const std::size_t default_buffer_size = 64 * 1024;
 
-template <>
-struct action<packet> {
-  template <typename Input>
-  static void apply(const Input& in, state& st) {
-    st.packets.push_back(in.string());
+struct state {
+  RawPacketSink& m_sink;
+
+  /* Upper limit for the size of a single body piece.  This must not
+     exceed the buffer size of buffered inputs.  */
+  std::size_t m_max_chunk;
+
+  /* The header of the current packet, depending on its format.  */
+  NeoPG::OpenPGP::OldPacketHeader m_old_header;
+  NeoPG::OpenPGP::NewPacketHeader m_new_header;
+  bool m_new_format = false;
+
+  /* Number of body bytes left in the current (partial) body chunk.  */
+  uint32_t m_remaining = 0;
+
+  /* True if the current body chunk is followed by another length.  */
+  bool m_partial = false;
+
+  state(RawPacketSink& sink,
+        std::size_t max_chunk = std::numeric_limits<std::size_t>::max())
+      : m_sink(sink),
+        m_max_chunk(max_chunk),
+        m_old_header(NeoPG::OpenPGP::PacketType::Reserved, 0),
+        m_new_header(NeoPG::OpenPGP::PacketType::Reserved, 0) {}
+
+  const NeoPG::OpenPGP::PacketHeader& header() const {
+    if (m_new_format)
+      return m_new_header;
+    else
+      return m_old_header;
   }
 };
 
-#if 0
+/* The packet framing depends on values read from the input, which can
+   not be expressed with the PEGTL combinators.  The following custom
+   rules read these values into the state.  */
 
-// To avoid many forward declarations, the grammer is written bottom-up.
+template <typename Input>
+uint32_t parse_be(Input& in, std::size_t offset, std::size_t len) {
+  uint32_t val = 0;
+  for (std::size_t i = 0; i < len; i++)
+    val = (val << 8) | in.peek_byte(offset + i);
+  return val;
+}
 
-/* To handle old packet tags, which encode the length type, we special case on
-  each combination of
-struct old_packet_length_one : bytes<1>;
-struct old_packet_length_two : bytes<2>;
-struct old_packet_length_four : bytes<4>;
-/* Not supported.  */
-struct old_packet_length_na : failure;
-
-template <uint8_t TAG>
-struct old_packet_header_with_tag
-    : sor<seq<one<0x80 | (TAG << 2) | 0x00>, old_packet_length_one>,
-          seq<one<0x80 | (TAG << 2) | 0x01>, old_packet_length_two>,
-          seq<one<0x80 | (TAG << 2) | 0x02>, old_packet_length_four>,
-          seq<one<0x80 | (TAG << 2) | 0x03>, old_packet_length_na> > {};
-
-template <uint8_t TAG>
-struct new_packet_header_with_tag
-    : seq<one<0x80 | 0x40 | TAG>, new_packet_length>;
-
-/* For most tags, we only support new packet headers.  */
-template <uint8_t TAG>
-struct packet_header_with_tag : new_packet_header_with_tag<TAG>;
-
-/* For tags 0-15, we allow old packet headers.  */
+struct binary_rule {
+  using analyze_t = analysis::generic<analysis::rule_type::ANY>;
+};
 
-struct packet_header_with_tag<0>
-    : sor<new_packet_header_with_tag<0>, old_packet_header_with_tag<0> > {};
+// Old packet format (RFC 4880, section 4.2.1).
+struct old_packet_header : binary_rule {
+  template <apply_mode A, rewind_mode M, template <typename...> class Action,
+            template <typename...> class Control, typename Input>
+  static bool match(Input& in, state& st) {
+    using namespace NeoPG::OpenPGP;
+    if (in.size(1) < 1) return false;
+    uint8_t tag = in.peek_byte();
+    if ((tag & 0xc0) != 0x80) return false;
+
+    /* Packets with indeterminate length are rejected (see openpgp.md).  */
+    static const std::size_t length_octets[4] = {1, 2, 4, 0};
+    std::size_t len = length_octets[tag & 0x03];
+    if (len == 0 or in.size(1 + len) < 1 + len) return false;
+
+    static const PacketLengthType length_types[4] = {
+        PacketLengthType::OneOctet, PacketLengthType::TwoOctet,
+        PacketLengthType::FourOctet, PacketLengthType::Indeterminate};
+    st.m_old_header.set_packet_type((PacketType)((tag >> 2) & 0x0f));
+    st.m_old_header.set_length(parse_be(in, 1, len), length_types[tag & 0x03]);
+    st.m_new_format = false;
+    st.m_remaining = st.m_old_header.m_length;
+    st.m_partial = false;
+    in.bump_in_this_line(1 + len);
+    return true;
+  }
+};
 
-struct packet_header_with_tag<1>
-    : sor<new_packet_header_with_tag<1>, old_packet_header_with_tag<1> > {};
+/* A new format packet length, which is also used between the chunks of a
+   body with partial lengths (RFC 4880, section 4.2.2).  */
+struct new_packet_length : binary_rule {
+  template <apply_mode A, rewind_mode M, template <typename...> class Action,
+            template <typename...> class Control, typename Input>
+  static bool match(Input& in, state& st) {
+    using namespace NeoPG::OpenPGP;
+    if (in.size(1) < 1) return false;
+    uint8_t len0 = in.peek_byte();
+    uint32_t length;
+    PacketLengthType length_type;
+    std::size_t octets;
+
+    if (len0 < 0xc0) {
+      length = len0;
+      length_type = PacketLengthType::OneOctet;
+      octets = 1;
+    } else if (len0 < 0xe0) {
+      if (in.size(2) < 2) return false;
+      length = ((len0 - 0xc0) << 8) + in.peek_byte(1) + 192;
+      length_type = PacketLengthType::TwoOctet;
+      octets = 2;
+    } else if (len0 < 0xff) {
+      length = 1U << (len0 & 0x1f);
+      length_type = PacketLengthType::Partial;
+      octets = 1;
+    } else {
+      if (in.size(5) < 5) return false;
+      length = parse_be(in, 1, 4);
+      length_type = PacketLengthType::FiveOctet;
+      octets = 5;
+    }
+
+    st.m_new_header.m_length.set_length(length, length_type);
+    st.m_remaining = length;
+    st.m_partial = (length_type == PacketLengthType::Partial);
+    in.bump_in_this_line(octets);
+    return true;
+  }
+};
 
-struct packet_header_with_tag<2>
-    : sor<new_packet_header_with_tag<2>, old_packet_header_with_tag<2> > {};
+struct new_packet_tag : binary_rule {
+  template <apply_mode A, rewind_mode M, template <typename...> class Action,
+            template <typename...> class Control, typename Input>
+  static bool match(Input& in, state& st) {
+    if (in.size(1) < 1) return false;
+    uint8_t tag = in.peek_byte();
+    if ((tag & 0xc0) != 0xc0) return false;
+    st.m_new_header.m_tag.set_packet_type(
+        (NeoPG::OpenPGP::PacketType)(tag & 0x3f));
+    st.m_new_format = true;
+    in.bump_in_this_line(1);
+    return true;
+  }
+};
 
-struct packet_header_with_tag<3>
-    : sor<new_packet_header_with_tag<3>, old_packet_header_with_tag<3> > {};
+struct new_packet_header : seq<new_packet_tag, must<new_packet_length>> {};
 
-struct packet_header_with_tag<4>
-    : sor<new_packet_header_with_tag<4>, old_packet_header_with_tag<4> > {};
+struct packet_header : sor<new_packet_header, old_packet_header> {};
 
-struct packet_header_with_tag<5>
-    : sor<new_packet_header_with_tag<5>, old_packet_header_with_tag<5> > {};
+/* Consumes the next piece of the current body chunk, limited by the
+   available input and st.m_max_chunk.  */
+struct packet_body_data : binary_rule {
+  template <apply_mode A, rewind_mode M, template <typename...> class Action,
+            template <typename...> class Control, typename Input>
+  static bool match(Input& in, state& st) {
+    if (st.m_remaining == 0) return false;
+    std::size_t want =
+        std::min<std::size_t>(st.m_remaining, st.m_max_chunk);
+    std::size_t avail = std::min(in.size(want), want);
+    if (avail == 0) return false;
+    st.m_remaining -= avail;
+    in.bump_in_this_line(avail);
+    return true;
+  }
+};
 
-struct packet_header_with_tag<6>
-    : sor<new_packet_header_with_tag<6>, old_packet_header_with_tag<6> > {};
+struct packet_body_chunk_complete : binary_rule {
+  template <apply_mode A, rewind_mode M, template <typename...> class Action,
+            template <typename...> class Control, typename Input>
+  static bool match(Input& in, state& st) {
+    return st.m_remaining == 0;
+  }
+};
 
-struct packet_header_with_tag<7>
-    : sor<new_packet_header_with_tag<7>, old_packet_header_with_tag<7> > {};
+struct packet_body_partial : binary_rule {
+  template <apply_mode A, rewind_mode M, template <typename...> class Action,
+            template <typename...> class Control, typename Input>
+  static bool match(Input& in, state& st) {
+    return st.m_partial;
+  }
+};
 
-struct packet_header_with_tag<8>
-    : sor<new_packet_header_with_tag<8>, old_packet_header_with_tag<8> > {};
+/* Data that was passed on to the sink is discarded, so that buffered
+   inputs stay bounded no matter how large a packet is.  */
+struct packet_body_chunk
+    : seq<star<packet_body_data, discard>, packet_body_chunk_complete> {};
 
-struct packet_header_with_tag<9>
-    : sor<new_packet_header_with_tag<9>, old_packet_header_with_tag<9> > {};
+/* The length octets of a partial chunk are discarded like the packet
+   header, so that the next chunk can use the whole input buffer.  */
+struct packet_body
+    : seq<packet_body_chunk,
+          star<packet_body_partial, must<new_packet_length>, discard,
+               must<packet_body_chunk>>> {};
 
-struct packet_header_with_tag<10>
-    : sor<new_packet_header_with_tag<10>, old_packet_header_with_tag<10> > {};
+struct packet_end : success {};
 
-struct packet_header_with_tag<11>
-    : sor<new_packet_header_with_tag<11>, old_packet_header_with_tag<11> > {};
+struct packet
+    : seq<packet_header, discard, must<packet_body>, packet_end> {};
 
-struct packet_header_with_tag<12>
-    : sor<new_packet_header_with_tag<12>, old_packet_header_with_tag<12> > {};
+struct packets : until<eof, must<packet>> {};
 
-struct packet_header_with_tag<13>
-    : sor<new_packet_header_with_tag<13>, old_packet_header_with_tag<13> > {};
+struct grammar : packets {};
 
-struct packet_header_with_tag<14>
-    : sor<new_packet_header_with_tag<14>, old_packet_header_with_tag<14> > {};
+template <typename Rule>
+struct action : nothing<Rule> {};
 
-struct packet_header_with_tag<15>
-    : sor<new_packet_header_with_tag<15>, old_packet_header_with_tag<15> > {};
+template <>
+struct action<packet_header> {
+  template <typename Input>
+  static void apply(const Input& in, state& st) {
+    st.m_sink.start_packet(st.header());
+  }
+};
 
-/* Note that most of these variants can not match because they
-   match earlier for supported packet types.  */
-struct old_packet_header
-    : sor<old_packet_header_with_tag<0>, old_packet_header_with_tag<1>,
-          old_packet_header_with_tag<2>, old_packet_header_with_tag<3>,
-          old_packet_header_with_tag<4>, old_packet_header_with_tag<5>,
-          old_packet_header_with_tag<6>, old_packet_header_with_tag<7>,
-          old_packet_header_with_tag<8>, old_packet_header_with_tag<9>,
-          old_packet_header_with_tag<10>, old_packet_header_with_tag<11>,
-          old_packet_header_with_tag<12>,
-          // uid_packet: old_packet_header_with_tag<13>,
-          old_packet_header_with_tag<14>, old_packet_header_with_tag<15> > {};
+template <>
+struct action<packet_body_data> {
+  template <typename Input>
+  static void apply(const Input& in, state& st) {
+    st.m_sink.continue_packet(in.begin(), in.size());
+  }
+};
 
-// New packet length.
-struct new_packet_length_one : range<0x00, 0xbf> {};
-struct new_packet_length_two : seq<range<0xc0, 0xdf>, any> {};
-struct new_packet_length_partial : range<0xe0, 0xfe> {};
-struct new_packet_length_five : seq<one<0xff>, rep<4, any> > {};
-struct new_packet_length : seq<star<new_packet_length_partial, packet_body>,
-                               sor<new_packet_length_one, new_packet_length_two,
-                                   new_packet_length_five> > {};
-struct new_packet_tag : range<0x80 | 0x40 | 0x00, 0x80 | 0x40 | 0x3f> {};
-struct new_packet_header : seq<new_packet_tag, new_packet_length> {};
+template <>
+struct action<packet_end> {
+  template <typename Input>
+  static void apply(const Input& in, state& st) {
+    st.m_sink.finish_packet();
+  }
+};
 
-struct packet_header : sor<new_packet_header, old_packet_header> {};
+/*! Parse all packets in memory.  Body data is passed to the sink in one
+    piece per (partial) body chunk.
+ */
+inline void parse_packets(const char* data, std::size_t length,
+                          RawPacketSink& sink,
+                          const std::string& source = "memory") {
+  memory_input<> in(data, length, source);
+  state st(sink);
+  parse<grammar, action>(in, st);
+}
+
+/*! Parse all packets in a file, which is mapped into memory where
+    supported, so that scanning large files doesn't copy any data.
+ */
+inline void parse_packets(const std::string& filename, RawPacketSink& sink) {
+  file_input<> in(filename);
+  state st(sink);
+  parse<grammar, action>(in, st);
+}
+
+/*! Parse all packets from a stream, using a bounded input buffer of
+    buffer_size bytes regardless of the size of the packets.
+ */
+inline void parse_packets(std::istream& stream, RawPacketSink& sink,
+                          std::size_t buffer_size = default_buffer_size,
+                          const std::string& source = "stream") {
+  istream_input<> in(stream, buffer_size, source);
+  state st(sink, buffer_size);
+  parse<grammar, action>(in, st);
+}
 
-/* FIXME */
-struct packet_body : success {};
-
-/* The length of the body from the header is captured in a state
-     variable.  */
-struct unknown_packet : seq<packet_header, packet_body> {};
-
-struct uid_packet : seq<packet_header_with_tag<13>, packet_body> {};
-
-/* A weak attempt to fail early with better diagnostics.  */
-struct verify_packet_tag : at<range<0x80, 0xff> > {};
-
-struct packet : seq<verify_packet_tag, sor<uid_packet, unknown_packet> > {};
-
-#endif
-
-#if 0
-
-   template< typename Rule >
-   struct action
-      : nothing< Rule >
-   {};
-
-   template<>
-     struct action< integer >
-     {
-     template< typename Input >
-	static void apply( const Input& in, std::string& v )
-      {
-         v = in.string();
-      }
-   };
-
-   struct long_literal_id
-     : plus< not_one< '[' > > {};
-
-   struct long_literal_mark
-   {
-     template< apply_mode A,
-       rewind_mode M,
-       template< typename... > class Action,
-       template< typename... > class Control,
-       typename Input >
-       static bool match( Input& in,
-			  const std::string& id,
-			  const std::string& )
-     {
-       if( in.size( id.size() ) >= id.size() ) {
-	 if( std::memcmp( in.current(), id.data(), id.size() ) == 0 ) {
-	   in.bump( id.size() );
-	   return true;
-	 }
-       }
-       return false;
-     }
-   };
-
-    template<>
-     struct action< long_literal_id >
-     {
-       template< typename Input >
-	 static void apply( const Input& in,
-			    std::string& id,
-			    const std::string& )
-	 {
-	   id = in.string();
-	 }
-     };
-
-   template<> struct action< long_literal_body >
-     {
-       template< typename Input >
-	 static void apply( const Input& in,
-			    const std::string&,
-			    std::string& body )
-	 {
-	   body += in.string();
-	 }
-     };
-
-    struct Tag {
-      Tag(char tag_) { tag = (uint8_t) tag_; }
-      void verify() {
-	if (get_bit (tag, 7))
-	  throw PARSE_ERR_INVALID_TAG;
-	if (is_old_format() && old_format_length_type == LENGTH_NA)
-	  throw PARSE_ERR_INDETERMINATE_LENGTH;
-      }
-      bool is_old_format() {
-	return get_bit(tag, 6) == 0;
-      }
-      tag_type_t old_format_tag() {
-	return (tag_type_t) get_bits(tag, 2, 5);
-      }
-      tag_type_t new_format_tag() {
-	return (tag_type_t) get_bits(tag, 0, 5);
-      }
-      uint32_t old_format_length_type() {
-	return (length_type_t) get_bits(tag, 0, 1);
-      }
-      uint8_t tag;
-    };
-  }
-#endif
 }  // namespace OpenPGP
 }  // namespace Parser
 }  // namespace NeoPG
@@ -0,0 +1,45 @@
+/* Base64 encoding
+   Copyright 2017 The NeoPG developers
+
+   NeoPG is released under the Simplified BSD License (see license.txt)
+*/
+
+#pragma once
+
+#include <neopg/common.h>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace NeoPG {
+
+/**
+   Return the number of characters needed to encode len octets with
+   base64, including padding and, if line_length is not zero, a line
+   break after each line (including the last one).
+*/
+size_t NEOPG_DLL base64_encoded_size(size_t len, size_t line_length = 0);
+
+/**
+   Encode len octets from in as base64 (RFC 4648) with padding.  If
+   line_length is not zero, it must be a multiple of 4, and a line break
+   is inserted after every line_length characters and at the end.  out
+   must have room for base64_encoded_size(len, line_length) characters.
+   Returns the number of characters written.
+
+   SSSE3 or AVX2 is used if the CPU supports it.
+*/
+size_t NEOPG_DLL base64_encode(const uint8_t* in, size_t len, char* out,
+                               size_t line_length = 0);
+
+/**
+   Decode len base64 characters from in (without any whitespace) into
+   out, which must have room for len / 4 * 3 + 2 octets.  Padding is
+   optional, but only allowed at the end.  Returns the number of octets
+   written, and throws std::invalid_argument for invalid input.
+
+   SSSE3 or AVX2 is used if the CPU supports it.
+*/
+size_t NEOPG_DLL base64_decode(const char* in, size_t len, uint8_t* out);
+
+}  // namespace NeoPG
@@ -0,0 +1,38 @@
+/* CRC24 checksum
+   Copyright 2017 The NeoPG developers
+
+   NeoPG is released under the Simplified BSD License (see license.txt)
+*/
+
+#pragma once
+
+#include <neopg/common.h>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace NeoPG {
+
+/**
+   The CRC24 checksum used by OpenPGP ASCII armor (RFC 4880, section
+   6.1).  The data is processed eight octets at a time with a sliced
+   table.
+*/
+class NEOPG_DLL Crc24 {
+ public:
+  static const uint32_t init = 0xb704ce;
+
+  void update(const uint8_t* data, size_t len);
+
+  /* The checksum of all data so far.  */
+  uint32_t value() const;
+
+  /* Store the checksum as three big-endian octets in out.  */
+  void final(uint8_t* out) const;
+
+ private:
+  /* The CRC register, left-aligned in 32 bits.  */
+  uint32_t m_crc = init << 8;
+};
+
+}  // namespace NeoPG
@@ -0,0 +1,68 @@
+/* Input sources
+   Copyright 2017 The NeoPG developers
+
+   NeoPG is released under the Simplified BSD License (see license.txt)
+*/
+
+#pragma once
+
+#include <neopg/common.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace NeoPG {
+
+/*! Reads a file as a sequence of contiguous spans of block_size octets
+    (except for the last span, which may be shorter).  Regular files are
+    mapped into memory, so that the spans point directly into the page
+    cache without copying.  Other files, like pipes, are read with large
+    read() calls into a single buffer.  A span is only valid until the
+    next call to next().
+
+    Mapped files must not be truncated while they are read.
+ */
+class NEOPG_DLL InputSource {
+ public:
+  static const size_t default_block_size = 1024 * 1024;
+
+  /* Open the file, or standard input if filename is "-".  Throws
+     std::system_error if the file can not be opened.  */
+  explicit InputSource(const std::string& filename,
+                       size_t block_size = default_block_size);
+
+  /* Read from fd starting at its current offset.  The file descriptor is
+     not closed.  */
+  explicit InputSource(int fd, size_t block_size = default_block_size);
+
+  ~InputSource();
+
+  InputSource(const InputSource&) = delete;
+  InputSource& operator=(const InputSource&) = delete;
+
+  /* Return the next span in data and len, or false at the end of the
+     input.  Throws std::system_error on read errors.  */
+  bool next(const uint8_t*& data, size_t& len);
+
+  size_t block_size() const { return m_block_size; }
+
+  /* True if the input is mapped into memory.  */
+  bool mapped() const { return m_map != nullptr; }
+
+ private:
+  void init();
+
+  int m_fd;
+  bool m_owned{false};
+  size_t m_block_size;
+
+  const uint8_t* m_map{nullptr};
+  size_t m_map_size{0};
+  size_t m_pos{0};
+
+  std::vector<uint8_t> m_buffer;
+};
+
+}  // namespace NeoPG
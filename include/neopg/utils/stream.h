@@ -8,8 +8,10 @@
 
 #include <gtest/gtest_prod.h>
 #include <neopg/common.h>
+#include <cstdint>
 #include <iostream>
 #include <streambuf>
+#include <vector>
 
 namespace NeoPG {
 
@@ -35,4 +37,44 @@ class CountingStream : public std::ostream {
   CountingStreamBuf m_counting_stream_buf;
 };
 
+/*! A stream buffer that writes into contiguous memory, either by
+    appending to a growable vector, or into a fixed span provided by the
+    caller.  Data is copied directly into the memory without any
+    intermediate buffering.  A vector is only resized to the data
+    actually written on sync (or destruction); a span that is full
+    causes the stream to fail.
+ */
+class ByteBufferStreamBuf : public std::streambuf {
+ public:
+  explicit ByteBufferStreamBuf(std::vector<uint8_t>& buffer);
+  ByteBufferStreamBuf(uint8_t* data, size_t size);
+  ~ByteBufferStreamBuf();
+
+  size_t bytes_written();
+
+ protected:
+  std::streamsize xsputn(const char_type* s, std::streamsize n) override;
+  int_type overflow(int_type ch) override;
+  int sync() override;
+
+ private:
+  std::vector<uint8_t>* m_vector = nullptr;
+  char* m_begin;
+  size_t m_offset = 0;
+
+  /* Make room for at least n more bytes in the vector.  */
+  bool grow(size_t n);
+  size_t offset();
+};
+
+class ByteBufferStream : public std::ostream {
+ public:
+  explicit ByteBufferStream(std::vector<uint8_t>& buffer);
+  ByteBufferStream(uint8_t* data, size_t size);
+  size_t bytes_written();
+
+ private:
+  ByteBufferStreamBuf m_byte_buffer_stream_buf;
+};
+
 }  // namespace NeoPG
@@ -47,6 +47,20 @@ const std::map<int, std::string> algo_to_spec{{COMPRESS_ALGO_ZIP, "deflate"},
                                               {COMPRESS_ALGO_ZLIB, "zlib"},
                                               {COMPRESS_ALGO_BZIP2, "bz2"}};
 
+/* Default number of compressed bytes read at a time when decompressing
+   (see --compress-window).  */
+#define COMPRESS_WINDOW_SIZE 65536
+
+/* The decompression state.  The decompressed data in OUTPUT is handed
+   out from POS on, so that no data has to be moved, no matter how far a
+   small input expands.  */
+struct decompress_state {
+  Botan::Decompression_Algorithm *decompressor;
+  Botan::secure_vector<uint8_t> output;
+  size_t pos;
+  size_t window;
+};
+
 int compress_filter(void *opaque, int control, IOBUF a, byte *buf,
                     size_t *ret_len) {
   size_t size = *ret_len;
@@ -57,37 +71,38 @@ int compress_filter(void *opaque, int control, IOBUF a, byte *buf,
     if (!zfx->status) {
       /* We just found out we are used as a decompressor.  */
       std::string algo = algo_to_spec.at(zfx->algo);
-      auto decompressor = Botan::make_decompressor(algo);
-      auto input = new Botan::secure_vector<uint8_t>;
-      zfx->opaque =
-          new std::pair<Botan::Decompression_Algorithm *,
-                        Botan::secure_vector<uint8_t> *>(decompressor, input);
-      decompressor->start();
+      auto state = new decompress_state;
+      state->decompressor = Botan::make_decompressor(algo);
+      state->pos = 0;
+      state->window =
+          opt.compress_window ? opt.compress_window : COMPRESS_WINDOW_SIZE;
+      zfx->opaque = state;
+      state->decompressor->start();
       zfx->status = 1;
     }
-    auto *opaque_ = (std::pair<Botan::Decompression_Algorithm *,
-                               Botan::secure_vector<uint8_t> *> *)zfx->opaque;
-    auto decompressor = opaque_->first;
-    auto input = opaque_->second;
-    while (input->empty() && decompressor) {
-      input->resize(2048);
-      int nread = iobuf_read(a, input->data(), input->size());
+    auto state = (decompress_state *)zfx->opaque;
+    auto &output = state->output;
+    while (state->pos == output.size() && state->decompressor) {
+      /* The decompressor replaces the input with its output in place,
+         so the buffer is reused for the next window.  */
+      output.resize(state->window);
+      state->pos = 0;
+      int nread = iobuf_read(a, output.data(), output.size());
       if (nread <= 0) {
-        input->clear();
-        decompressor->finish(*input);
-        delete decompressor;
-        decompressor = nullptr;
-        opaque_->first = nullptr;
+        output.clear();
+        state->decompressor->finish(output);
+        delete state->decompressor;
+        state->decompressor = nullptr;
       } else {
-        input->resize(nread);
-        decompressor->update(*input);
+        output.resize(nread);
+        state->decompressor->update(output);
       }
     }
-    if (!input->empty()) {
-      size_t amount = std::min(input->size(), size);
-      memcpy(buf, input->data(), amount);
+    if (state->pos < output.size()) {
+      size_t amount = std::min(output.size() - state->pos, size);
+      memcpy(buf, output.data() + state->pos, amount);
       *ret_len = amount;
-      input->erase(input->begin(), input->begin() + amount);
+      state->pos += amount;
     } else {
       *ret_len = 0;
       rc = -1;
@@ -122,13 +137,9 @@ int compress_filter(void *opaque, int control, IOBUF a, byte *buf,
     }
   } else if (control == IOBUFCTRL_FREE) {
     if (zfx->status == 1) {
-      auto opaque_ = (std::pair<Botan::Decompression_Algorithm *,
-                                Botan::secure_vector<uint8_t> *> *)zfx->opaque;
-      auto decompressor = opaque_->first;
-      auto input = opaque_->second;
-      if (decompressor) delete decompressor;
-      delete input;
-      delete opaque_;
+      auto state = (decompress_state *)zfx->opaque;
+      if (state->decompressor) delete state->decompressor;
+      delete state;
       zfx->opaque = NULL;
     } else if (zfx->status == 2) {
       Botan::secure_vector<uint8_t> input;
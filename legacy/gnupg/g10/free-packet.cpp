@@ -162,6 +162,7 @@ PKT_signature *copy_signature(PKT_signature *d, PKT_signature *s) {
 
   if (!d) d = (PKT_signature *)xmalloc(sizeof *d);
   memcpy(d, s, sizeof *d);
+  memset(&d->precheck, 0, sizeof d->precheck);
   n = pubkey_get_nsig((pubkey_algo_t)(s->pubkey_algo));
   if (!n)
     d->data[0] = my_mpi_copy(s->data[0]);
@@ -19,6 +19,10 @@
  * along with this program; if not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+#include <list>
+#include <string>
+#include <unordered_map>
 #include <unordered_set>
 
 #include <config.h>
@@ -42,11 +46,13 @@
 #include "packet.h"
 #include "trustdb.h"
 
-#define MAX_PK_CACHE_ENTRIES PK_UID_CACHE_SIZE
-#define MAX_UID_CACHE_ENTRIES PK_UID_CACHE_SIZE
+/* The key creation needs a few entries in the public key cache, and
+   the user id cache also needs some.  Smaller capacities given with
+   --key-cache-size are raised to this value.  */
+#define MIN_PK_UID_CACHE_ENTRIES 8
 
-#if MAX_PK_CACHE_ENTRIES < 2
-#error We need the cache for key creation
+#if PK_UID_CACHE_SIZE < MIN_PK_UID_CACHE_ENTRIES
+#error We need the caches for key creation
 #endif
 
 /* Flags values returned by the lookup code.  Note that the values are
@@ -93,34 +99,78 @@ struct getkey_ctx_s {
   std::vector<KEYDB_SEARCH_DESC> items;
 };
 
-typedef struct keyid_list {
-  struct keyid_list *next;
-  char fpr[MAX_FINGERPRINT_LEN];
-  u32 keyid[2];
-} * keyid_list_t;
+/* The public key cache and the user id cache map key ids to copies of
+   public keys and to primary user ids.  Both keep their entries in a
+   list ordered by the last use, with the most recently used entry at
+   the front, and an index into that list.  If a cache is full, the
+   least recently used entry is dropped.  */
 
-#if MAX_PK_CACHE_ENTRIES
-typedef struct pk_cache_entry {
-  struct pk_cache_entry *next;
-  u32 keyid[2];
-  PKT_public_key *pk;
-} * pk_cache_entry_t;
-static pk_cache_entry_t pk_cache;
-static int pk_cache_entries; /* Number of entries in pk cache.  */
+typedef std::list<std::pair<uint64_t, PKT_public_key *>> pk_cache_list_t;
+static pk_cache_list_t pk_cache;
+static std::unordered_map<uint64_t, pk_cache_list_t::iterator> pk_cache_index;
 static int pk_cache_disabled;
-#endif
 
-#if MAX_UID_CACHE_ENTRIES < 5
-#error we really need the userid cache
-#endif
-typedef struct user_id_db {
-  struct user_id_db *next;
-  keyid_list_t keyids;
-  int len;
-  char name[1];
-} * user_id_db_t;
-static user_id_db_t user_id_db;
-static int uid_cache_entries; /* Number of entries in uid cache. */
+/* The user id cache has one entry per keyblock, which is found by the
+   key id or fingerprint of the primary key or any subkey.  */
+struct user_id_db_entry {
+  std::vector<std::pair<uint64_t, std::string>> keys; /* kid, fpr */
+  std::string name;
+};
+typedef std::list<user_id_db_entry> user_id_db_list_t;
+static user_id_db_list_t user_id_db;
+static std::unordered_map<uint64_t, user_id_db_list_t::iterator>
+    user_id_db_by_keyid;
+static std::unordered_map<std::string, user_id_db_list_t::iterator>
+    user_id_db_by_fpr;
+
+static struct {
+  unsigned int pk_hits;       /* Number of keys found in the cache.  */
+  unsigned int pk_misses;     /* Number of keys not found.  */
+  unsigned int pk_evictions;  /* Number of keys dropped from the cache.  */
+  unsigned int uid_hits;      /* Number of user ids found in the cache.  */
+  unsigned int uid_misses;    /* Number of user ids not found.  */
+  unsigned int uid_evictions; /* Number of user ids dropped.  */
+} getkey_stats;
+
+/* Return the capacity of the public key and user id caches.  */
+static size_t pk_uid_cache_capacity(void) {
+  size_t capacity = opt.key_cache_size ? opt.key_cache_size : PK_UID_CACHE_SIZE;
+  return std::max<size_t>(capacity, MIN_PK_UID_CACHE_ENTRIES);
+}
+
+static uint64_t keyid_to_u64(const u32 *keyid) {
+  return ((uint64_t)keyid[0] << 32) | keyid[1];
+}
+
+/* Return the cached public key with the key id KEYID and mark it as
+   most recently used, or NULL if it is not in the cache.  */
+static PKT_public_key *pk_cache_lookup(const u32 *keyid) {
+  auto it = pk_cache_index.find(keyid_to_u64(keyid));
+  if (it == pk_cache_index.end()) return NULL;
+  pk_cache.splice(pk_cache.begin(), pk_cache, it->second);
+  return it->second->second;
+}
+
+/* Return the cached user id for the key with the key id KEYID (if FPR
+   is NULL) or the fingerprint FPR and mark it as most recently used,
+   or NULL if it is not in the cache.  */
+static const user_id_db_entry *user_id_db_lookup(const u32 *keyid,
+                                                 const byte *fpr) {
+  user_id_db_list_t::iterator r;
+
+  if (fpr) {
+    auto it = user_id_db_by_fpr.find(
+        std::string((const char *)fpr, MAX_FINGERPRINT_LEN));
+    if (it == user_id_db_by_fpr.end()) return NULL;
+    r = it->second;
+  } else {
+    auto it = user_id_db_by_keyid.find(keyid_to_u64(keyid));
+    if (it == user_id_db_by_keyid.end()) return NULL;
+    r = it->second;
+  }
+  user_id_db.splice(user_id_db.begin(), user_id_db, r);
+  return &*r;
+}
 
 static void merge_selfsigs(ctrl_t ctrl, kbnode_t keyblock);
 static int lookup(ctrl_t ctrl, getkey_ctx_t ctx, int want_secret,
@@ -142,8 +192,6 @@ static void print_status_key_considered(kbnode_t keyblock, unsigned int flags);
  * This cache is filled by get_pubkey and is read by get_pubkey and
  * get_pubkey_fast.  */
 void cache_public_key(PKT_public_key *pk) {
-#if MAX_PK_CACHE_ENTRIES
-  pk_cache_entry_t ce, ce2;
   u32 keyid[2];
 
   if (pk_cache_disabled) return;
@@ -158,39 +206,19 @@ void cache_public_key(PKT_public_key *pk) {
   } else
     return; /* Don't know how to get the keyid.  */
 
-  for (ce = pk_cache; ce; ce = ce->next)
-    if (ce->keyid[0] == keyid[0] && ce->keyid[1] == keyid[1]) {
-      if (DBG_CACHE) log_debug("cache_public_key: already in cache\n");
-      return;
-    }
+  if (pk_cache_lookup(keyid)) {
+    if (DBG_CACHE) log_debug("cache_public_key: already in cache\n");
+    return;
+  }
 
-  if (pk_cache_entries >= MAX_PK_CACHE_ENTRIES) {
-    int n;
-
-    /* Remove the last 50% of the entries.  */
-    for (ce = pk_cache, n = 0; ce && n < pk_cache_entries / 2; n++)
-      ce = ce->next;
-    if (ce && ce != pk_cache && ce->next) {
-      ce2 = ce->next;
-      ce->next = NULL;
-      ce = ce2;
-      for (; ce; ce = ce2) {
-        ce2 = ce->next;
-        free_public_key(ce->pk);
-        xfree(ce);
-        pk_cache_entries--;
-      }
-    }
-    log_assert(pk_cache_entries < MAX_PK_CACHE_ENTRIES);
-  }
-  pk_cache_entries++;
-  ce = (pk_cache_entry_t)xmalloc(sizeof *ce);
-  ce->next = pk_cache;
-  pk_cache = ce;
-  ce->pk = copy_public_key(NULL, pk);
-  ce->keyid[0] = keyid[0];
-  ce->keyid[1] = keyid[1];
-#endif
+  if (pk_cache.size() >= pk_uid_cache_capacity()) {
+    free_public_key(pk_cache.back().second);
+    pk_cache_index.erase(pk_cache.back().first);
+    pk_cache.pop_back();
+    getkey_stats.pk_evictions++;
+  }
+  pk_cache.emplace_front(keyid_to_u64(keyid), copy_public_key(NULL, pk));
+  pk_cache_index[pk_cache.front().first] = pk_cache.begin();
 }
 
 /* Return a const utf-8 string with the text "[User ID not found]".
@@ -222,93 +250,80 @@ static const char *get_primary_uid(KBNODE keyblock, size_t *uidlen) {
   return s;
 }
 
-static void release_keyid_list(keyid_list_t k) {
-  while (k) {
-    keyid_list_t k2 = k->next;
-    xfree(k);
-    k = k2;
-  }
-}
-
 /****************
  * Store the association of keyid and userid
  * Feed only public keys to this function.
  */
 static void cache_user_id(KBNODE keyblock) {
-  user_id_db_t r;
+  user_id_db_entry r;
   const char *uid;
   size_t uidlen;
-  keyid_list_t keyids = NULL;
   KBNODE k;
 
   for (k = keyblock; k; k = k->next) {
     if (k->pkt->pkttype == PKT_PUBLIC_KEY ||
         k->pkt->pkttype == PKT_PUBLIC_SUBKEY) {
-      keyid_list_t a = (keyid_list_t)xmalloc_clear(sizeof *a);
-      /* Hmmm: For a long list of keyids it might be an advantage
-       * to append the keys.  */
-      fingerprint_from_pk(k->pkt->pkt.public_key, (byte *)(a->fpr), NULL);
-      keyid_from_pk(k->pkt->pkt.public_key, a->keyid);
+      byte fpr[MAX_FINGERPRINT_LEN] = {0};
+      u32 keyid[2];
+
+      fingerprint_from_pk(k->pkt->pkt.public_key, fpr, NULL);
+      keyid_from_pk(k->pkt->pkt.public_key, keyid);
       /* First check for duplicates.  */
-      for (r = user_id_db; r; r = r->next) {
-        keyid_list_t b;
-
-        for (b = r->keyids; b; b = b->next) {
-          if (!memcmp(b->fpr, a->fpr, MAX_FINGERPRINT_LEN)) {
-            if (DBG_CACHE) log_debug("cache_user_id: already in cache\n");
-            release_keyid_list(keyids);
-            xfree(a);
-            return;
-          }
-        }
+      if (user_id_db_lookup(NULL, fpr)) {
+        if (DBG_CACHE) log_debug("cache_user_id: already in cache\n");
+        return;
       }
-      /* Now put it into the cache.  */
-      a->next = keyids;
-      keyids = a;
+      r.keys.emplace_back(keyid_to_u64(keyid),
+                          std::string((const char *)fpr, sizeof fpr));
     }
   }
-  if (!keyids) BUG(); /* No key no fun.  */
+  if (r.keys.empty()) BUG(); /* No key no fun.  */
 
   uid = get_primary_uid(keyblock, &uidlen);
+  r.name.assign(uid, uidlen);
+
+  if (user_id_db.size() >= pk_uid_cache_capacity()) {
+    user_id_db_list_t::iterator old = std::prev(user_id_db.end());
 
-  if (uid_cache_entries >= MAX_UID_CACHE_ENTRIES) {
-    /* fixme: use another algorithm to free some cache slots */
-    r = user_id_db;
-    user_id_db = r->next;
-    release_keyid_list(r->keyids);
-    xfree(r);
-    uid_cache_entries--;
-  }
-  r = (user_id_db_t)xmalloc(sizeof *r + uidlen - 1);
-  r->keyids = keyids;
-  r->len = uidlen;
-  memcpy(r->name, uid, r->len);
-  r->next = user_id_db;
-  user_id_db = r;
-  uid_cache_entries++;
+    /* A newer entry may have taken over a key id.  */
+    for (const auto &key : old->keys) {
+      auto it = user_id_db_by_keyid.find(key.first);
+      if (it != user_id_db_by_keyid.end() && it->second == old)
+        user_id_db_by_keyid.erase(it);
+      user_id_db_by_fpr.erase(key.second);
+    }
+    user_id_db.erase(old);
+    getkey_stats.uid_evictions++;
+  }
+  user_id_db.push_front(std::move(r));
+  for (const auto &key : user_id_db.front().keys) {
+    user_id_db_by_keyid[key.first] = user_id_db.begin();
+    user_id_db_by_fpr[key.second] = user_id_db.begin();
+  }
 }
 
 /* Disable and drop the public key cache (which is filled by
    cache_public_key and get_pubkey).  Note: there is currently no way
    to re-enable this cache.  */
 void getkey_disable_caches() {
-#if MAX_PK_CACHE_ENTRIES
-  {
-    pk_cache_entry_t ce, ce2;
-
-    for (ce = pk_cache; ce; ce = ce2) {
-      ce2 = ce->next;
-      free_public_key(ce->pk);
-      xfree(ce);
-    }
-    pk_cache_disabled = 1;
-    pk_cache_entries = 0;
-    pk_cache = NULL;
-  }
-#endif
+  for (auto &ce : pk_cache) free_public_key(ce.second);
+  pk_cache.clear();
+  pk_cache_index.clear();
+  pk_cache_disabled = 1;
   /* fixme: disable user id cache ? */
 }
 
+/* Print the hit and miss counts of the public key and user id caches
+   (see keydb_dump_stats).  */
+void getkey_dump_stats(void) {
+  log_info("pk_cache: hits=%u misses=%u evictions=%u entries=%u\n",
+           getkey_stats.pk_hits, getkey_stats.pk_misses,
+           getkey_stats.pk_evictions, (unsigned int)pk_cache.size());
+  log_info("uid_cache: hits=%u misses=%u evictions=%u entries=%u\n",
+           getkey_stats.uid_hits, getkey_stats.uid_misses,
+           getkey_stats.uid_evictions, (unsigned int)user_id_db.size());
+}
+
 void pubkey_free(pubkey_t key) {
   if (key) {
     xfree(key->pk);
@@ -593,23 +608,21 @@ int get_pubkey(ctrl_t ctrl, PKT_public_key *pk, u32 *keyid) {
   int internal = 0;
   int rc = 0;
 
-#if MAX_PK_CACHE_ENTRIES
   if (pk) {
     /* Try to get it from the cache.  We don't do this when pk is
        NULL as it does not guarantee that the user IDs are
        cached. */
-    pk_cache_entry_t ce;
-    for (ce = pk_cache; ce; ce = ce->next) {
-      if (ce->keyid[0] == keyid[0] && ce->keyid[1] == keyid[1])
-      /* XXX: We don't check PK->REQ_USAGE here, but if we don't
-         read from the cache, we do check it!  */
-      {
-        copy_public_key(pk, ce->pk);
-        return 0;
-      }
+    PKT_public_key *cached = pk_cache_lookup(keyid);
+    if (cached)
+    /* XXX: We don't check PK->REQ_USAGE here, but if we don't
+       read from the cache, we do check it!  */
+    {
+      getkey_stats.pk_hits++;
+      copy_public_key(pk, cached);
+      return 0;
     }
+    getkey_stats.pk_misses++;
   }
-#endif
   /* More init stuff.  */
   if (!pk) {
     pk = (PKT_public_key *)xmalloc_clear(sizeof *pk);
@@ -676,22 +689,19 @@ int get_pubkey_fast(PKT_public_key *pk, u32 *keyid) {
   u32 pkid[2];
 
   log_assert(pk);
-#if MAX_PK_CACHE_ENTRIES
   {
     /* Try to get it from the cache */
-    pk_cache_entry_t ce;
-
-    for (ce = pk_cache; ce; ce = ce->next) {
-      if (ce->keyid[0] == keyid[0] && ce->keyid[1] == keyid[1]
-          /* Only consider primary keys.  */
-          && ce->pk->keyid[0] == ce->pk->main_keyid[0] &&
-          ce->pk->keyid[1] == ce->pk->main_keyid[1]) {
-        if (pk) copy_public_key(pk, ce->pk);
-        return 0;
-      }
+    PKT_public_key *cached = pk_cache_lookup(keyid);
+
+    /* Only consider primary keys.  */
+    if (cached && cached->keyid[0] == cached->main_keyid[0] &&
+        cached->keyid[1] == cached->main_keyid[1]) {
+      getkey_stats.pk_hits++;
+      if (pk) copy_public_key(pk, cached);
+      return 0;
     }
+    getkey_stats.pk_misses++;
   }
-#endif
 
   hd = keydb_new();
   if (!hd) return gpg_error_from_syserror();
@@ -3399,36 +3409,36 @@ gpg_error_t get_seckey_default_or_card(ctrl_t ctrl, PKT_public_key *pk,
  * this string must be freed by xfree.   */
 static char *get_user_id_string(ctrl_t ctrl, u32 *keyid, int mode,
                                 size_t *r_len) {
-  user_id_db_t r;
-  keyid_list_t a;
+  const user_id_db_entry *r;
   int pass = 0;
   char *p;
 
   /* Try it two times; second pass reads from the database.  */
   do {
-    for (r = user_id_db; r; r = r->next) {
-      for (a = r->keyids; a; a = a->next) {
-        if (a->keyid[0] == keyid[0] && a->keyid[1] == keyid[1]) {
-          if (mode == 2) {
-            /* An empty string as user id is possible.  Make
-               sure that the malloc allocates one byte and
-               does not bail out.  */
-            p = (char *)xmalloc(r->len ? r->len : 1);
-            memcpy(p, r->name, r->len);
-            if (r_len) *r_len = r->len;
-          } else {
-            if (mode)
-              p = xasprintf("%08lX%08lX %.*s", (unsigned long)keyid[0],
-                            (unsigned long)keyid[1], r->len, r->name);
-            else
-              p = xasprintf("%s %.*s", keystr(keyid), r->len, r->name);
-            if (r_len) *r_len = strlen(p);
-          }
-
-          return p;
-        }
+    r = user_id_db_lookup(keyid, NULL);
+    if (r) {
+      int len = r->name.size();
+
+      getkey_stats.uid_hits++;
+      if (mode == 2) {
+        /* An empty string as user id is possible.  Make
+           sure that the malloc allocates one byte and
+           does not bail out.  */
+        p = (char *)xmalloc(len ? len : 1);
+        memcpy(p, r->name.data(), len);
+        if (r_len) *r_len = len;
+      } else {
+        if (mode)
+          p = xasprintf("%08lX%08lX %.*s", (unsigned long)keyid[0],
+                        (unsigned long)keyid[1], len, r->name.data());
+        else
+          p = xasprintf("%s %.*s", keystr(keyid), len, r->name.data());
+        if (r_len) *r_len = strlen(p);
       }
+
+      return p;
     }
+    getkey_stats.uid_misses++;
   } while (++pass < 2 && !get_pubkey(ctrl, NULL, keyid));
 
   if (mode == 2)
@@ -3474,26 +3484,24 @@ char *get_user_id_native(ctrl_t ctrl, u32 *keyid) {
    terminated.  To determine the length of the string, you must use
    *RN.  */
 char *get_user_id_byfpr(ctrl_t ctrl, const byte *fpr, size_t *rn) {
-  user_id_db_t r;
+  const user_id_db_entry *r;
   char *p;
   int pass = 0;
 
   /* Try it two times; second pass reads from the database.  */
   do {
-    for (r = user_id_db; r; r = r->next) {
-      keyid_list_t a;
-      for (a = r->keyids; a; a = a->next) {
-        if (!memcmp(a->fpr, fpr, MAX_FINGERPRINT_LEN)) {
-          /* An empty string as user id is possible.  Make
-             sure that the malloc allocates one byte and does
-             not bail out.  */
-          p = (char *)xmalloc(r->len ? r->len : 1);
-          memcpy(p, r->name, r->len);
-          *rn = r->len;
-          return p;
-        }
-      }
+    r = user_id_db_lookup(NULL, fpr);
+    if (r) {
+      getkey_stats.uid_hits++;
+      /* An empty string as user id is possible.  Make
+         sure that the malloc allocates one byte and does
+         not bail out.  */
+      p = (char *)xmalloc(r->name.size() ? r->name.size() : 1);
+      memcpy(p, r->name.data(), r->name.size());
+      *rn = r->name.size();
+      return p;
     }
+    getkey_stats.uid_misses++;
   } while (++pass < 2 &&
            !get_pubkey_byfprint(ctrl, NULL, NULL, fpr, MAX_FINGERPRINT_LEN));
   p = xstrdup(user_id_not_found_utf8());
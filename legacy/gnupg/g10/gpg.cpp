@@ -229,6 +229,8 @@ enum cmd_and_opt_values {
   oDigestAlgo,
   oCertDigestAlgo,
   oCompressAlgo,
+  oCompressWindow,
+  oKeyCacheSize,
   oPassphrase,
   oPassphraseFD,
   oPassphraseFile,
@@ -534,6 +536,8 @@ const static ARGPARSE_OPTS opts[] = {
     ARGPARSE_s_s(oCertDigestAlgo, "cert-digest-algo", "@"),
     ARGPARSE_s_s(oCompressAlgo, "compress-algo", "@"),
     ARGPARSE_s_s(oCompressAlgo, "compression-algo", "@"), /* Alias */
+    ARGPARSE_s_u(oCompressWindow, "compress-window", "@"),
+    ARGPARSE_s_u(oKeyCacheSize, "key-cache-size", "@"),
     ARGPARSE_s_n(oThrowKeyids, "throw-keyids", "@"),
     ARGPARSE_s_n(oNoThrowKeyids, "no-throw-keyids", "@"),
     ARGPARSE_s_s(oSetNotation, "set-notation", "@"),
@@ -2188,6 +2192,12 @@ next_pass:
       case oDigestAlgo:
         def_digest_string = xstrdup(pargs.r.ret_str);
         break;
+      case oCompressWindow:
+        opt.compress_window = pargs.r.ret_ulong;
+        break;
+      case oKeyCacheSize:
+        opt.key_cache_size = pargs.r.ret_ulong;
+        break;
       case oCompressAlgo:
         /* If it is all digits, stick a Z in front of it for
            later.  This is for backwards compatibility with
@@ -3522,6 +3532,7 @@ void g10_exit(int rc) {
 
   if ((opt.debug & DBG_MEMSTAT_VALUE)) {
     keydb_dump_stats();
+    getkey_dump_stats();
     sig_check_dump_stats();
     gcry_control(GCRYCTL_DUMP_MEMORY_STATS);
   }
@@ -23,6 +23,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+
+#include <vector>
 
 #include "../common/init.h"
 #include "../common/mbox-util.h"
@@ -71,6 +74,14 @@ struct import_stats_s {
 /* A node flag used to temporary mark a node. */
 #define NODE_FLAG_A 8
 
+/* The number of keys written together with --import-options
+ * import-batch.  */
+#define IMPORT_BATCH_SIZE 1000
+
+/* The number of keyblocks which are read in advance, so that their
+ * self-signatures can be verified in parallel.  */
+#define IMPORT_READ_AHEAD 64
+
 /* An object and a global instance to store selectors created from
  * --import-filter keep-uid=EXPR.
  * --import-filter drop-sig=EXPR.
@@ -162,6 +173,9 @@ int parse_import_options(char *str, unsigned int *options, int noisy) {
 
       {"repair-keys", IMPORT_REPAIR_KEYS, NULL, N_("repair keys on import")},
 
+      {"import-batch", IMPORT_BATCH, NULL,
+       N_("write imported keys to the keyring in batches")},
+
       /* Aliases for backward compatibility */
       {"allow-local-sigs", IMPORT_LOCAL_SIGS, NULL, NULL},
       {"repair-hkp-subkey-bug", IMPORT_REPAIR_PKS_SUBKEY_BUG, NULL, NULL},
@@ -454,6 +468,68 @@ int import_keys_es_stream(ctrl_t ctrl, estream_t fp,
   return rc;
 }
 
+/* Return the time in seconds from a monotonic clock.  */
+static double import_clock(void) {
+  struct timespec ts;
+
+  if (clock_gettime(CLOCK_MONOTONIC, &ts)) return 0;
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Commit the keys imported through the batch of HD and report the
+   progress.  START_COUNT and START_TIME describe the start of the
+   import.  */
+static gpg_error_t import_batch_commit(KEYDB_HANDLE hd,
+                                       struct import_stats_s *stats,
+                                       unsigned long start_count,
+                                       double start_time) {
+  gpg_error_t err;
+  double elapsed;
+  unsigned long rate = 0;
+
+  err = keydb_batch_commit(hd);
+  if (err) {
+    log_error(_("error writing keyring '%s': %s\n"),
+              keydb_get_resource_name(hd), gpg_strerror(err));
+    return err;
+  }
+
+  elapsed = import_clock() - start_time;
+  if (elapsed > 0) rate = (stats->count - start_count) / elapsed;
+  if (!opt.quiet)
+    log_info(_("%lu keys processed so far (%lu keys/s)\n"), stats->count,
+             rate);
+  write_status_printf(STATUS_PROGRESS, "import ? %lu 0", stats->count);
+  return 0;
+}
+
+/* Compute the key IDs of all primary keys and subkeys in the
+   NKEYBLOCKS keyblocks at KEYBLOCKS with one call, so that the
+   fingerprints are hashed in parallel.  A single keyblock has too few
+   keys for that.  */
+static void prepare_keyids(kbnode_t *keyblocks, size_t nkeyblocks) {
+  std::vector<PKT_public_key *> pks;
+  std::vector<byte> fprs;
+  kbnode_t node;
+  PKT_public_key *pk;
+  size_t i;
+
+  for (i = 0; i < nkeyblocks; i++)
+    for (node = keyblocks[i]; node; node = node->next) {
+      if (node->pkt->pkttype != PKT_PUBLIC_KEY &&
+          node->pkt->pkttype != PKT_PUBLIC_SUBKEY &&
+          node->pkt->pkttype != PKT_SECRET_KEY &&
+          node->pkt->pkttype != PKT_SECRET_SUBKEY)
+        continue;
+      pk = node->pkt->pkt.public_key;
+      if (!pk->keyid[0] && !pk->keyid[1]) pks.push_back(pk);
+    }
+  if (pks.size() < 2) return;
+
+  fprs.resize(pks.size() * 20);
+  fingerprints_from_pks(pks.data(), pks.size(), fprs.data());
+}
+
 static int import(ctrl_t ctrl, IOBUF inp, const char *fname,
                   struct import_stats_s *stats, unsigned char **fpr,
                   size_t *fpr_len, unsigned int options,
@@ -463,10 +539,25 @@ static int import(ctrl_t ctrl, IOBUF inp, const char *fname,
                                grasp the return semantics of
                                read_block. */
   int rc = 0;
+  int read_rc = 0;
+  gpg_error_t err = 0;
   int v3keys;
+  std::vector<kbnode_t> queue;
+  size_t next = 0;
+  KEYDB_HANDLE batch_hd = NULL;
+  unsigned long start_count = stats->count;
+  double start_time = 0;
 
   getkey_disable_caches();
 
+  /* In batch mode the keyring stays locked while a number of keys is
+     imported, and the changes are synced to disk only once.  */
+  if ((options & IMPORT_BATCH)) {
+    batch_hd = keydb_new();
+    if (!batch_hd) return gpg_error_from_syserror();
+    start_time = import_clock();
+  }
+
   if (!opt.no_armor) /* Armored reading is not disabled.  */
   {
     armor_filter_context_t *afx;
@@ -477,9 +568,33 @@ static int import(ctrl_t ctrl, IOBUF inp, const char *fname,
     release_armor_context(afx);
   }
 
-  while (!(rc = read_block(inp, !!(options & IMPORT_RESTORE), &pending_pkt,
-                           &keyblock, &v3keys))) {
-    stats->v3keys += v3keys;
+  for (;;) {
+    if (next == queue.size()) {
+      queue.clear();
+      next = 0;
+      while (!read_rc && queue.size() < IMPORT_READ_AHEAD) {
+        read_rc = read_block(inp, !!(options & IMPORT_RESTORE), &pending_pkt,
+                             &keyblock, &v3keys);
+        if (!read_rc) {
+          stats->v3keys += v3keys;
+          queue.push_back(keyblock);
+        }
+      }
+      if (queue.empty()) {
+        rc = read_rc;
+        break;
+      }
+      prepare_keyids(queue.data(), queue.size());
+      precheck_self_sigs(ctrl, queue.data(), queue.size());
+    }
+    keyblock = queue[next++];
+
+    if (batch_hd && (err = keydb_batch_begin(batch_hd))) {
+      log_error(_("error writing keyring '%s': %s\n"),
+                keydb_get_resource_name(batch_hd), gpg_strerror(err));
+      release_kbnode(keyblock);
+      break;
+    }
     if (keyblock->pkt->pkttype == PKT_PUBLIC_KEY)
       rc = import_one(ctrl, keyblock, stats, fpr, fpr_len, options, 0, 0,
                       screener, screener_arg);
@@ -503,15 +618,29 @@ static int import(ctrl_t ctrl, IOBUF inp, const char *fname,
     } else if (rc)
       break;
 
-    if (!(++stats->count % 100) && !opt.quiet)
+    ++stats->count;
+    if (batch_hd) {
+      if (!((stats->count - start_count) % IMPORT_BATCH_SIZE) &&
+          (err = import_batch_commit(batch_hd, stats, start_count,
+                                     start_time)))
+        break;
+    } else if (!(stats->count % 100) && !opt.quiet)
       log_info(_("%lu keys processed so far\n"), stats->count);
   }
+  for (; next < queue.size(); next++) release_kbnode(queue[next]);
   stats->v3keys += v3keys;
   if (rc == -1)
     rc = 0;
   else if (rc && rc != GPG_ERR_INV_KEYRING)
     log_error(_("error reading '%s': %s\n"), fname, gpg_strerror(rc));
 
+  if (batch_hd) {
+    if (!err && (stats->count - start_count) % IMPORT_BATCH_SIZE)
+      err = import_batch_commit(batch_hd, stats, start_count, start_time);
+    keydb_release(batch_hd);
+  }
+  if (!rc) rc = err;
+
   return rc;
 }
 
@@ -1324,7 +1453,14 @@ static int import_one(ctrl_t ctrl, kbnode_t keyblock,
          importing and locally exported key. */
 
       clear_ownertrusts(ctrl, pk);
-      if (non_self) revalidation_mark(ctrl);
+      if (non_self) {
+        /* Without a check in this process, another one needs to do
+           a full check.  */
+        if ((options & IMPORT_FAST))
+          revalidation_mark(ctrl);
+        else
+          revalidation_mark_key(ctrl, pk);
+      }
     }
     keydb_release(hd);
 
@@ -1404,8 +1540,10 @@ static int import_one(ctrl_t ctrl, kbnode_t keyblock,
       if (rc)
         log_error(_("error writing keyring '%s': %s\n"),
                   keydb_get_resource_name(hd), gpg_strerror(rc));
-      else if (non_self)
+      else if (non_self && (options & IMPORT_FAST))
         revalidation_mark(ctrl);
+      else if (non_self)
+        revalidation_mark_key(ctrl, pk);
 
       /* We are ready.  */
       if (!opt.quiet && !silent) {
@@ -18,6 +18,9 @@
  * along with this program; if not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <list>
+#include <vector>
+
 #include <config.h>
 #include <errno.h>
 #include <stdio.h>
@@ -61,11 +64,20 @@ static void *primary_keydb;
 /* Whether we have successfully registered any resource.  */
 static int any_registered;
 
-/* This is a simple cache used to return the last result of a
-   successful fingerprint search.  This works only for keybox resources
-   because (due to lack of a copy_keyblock function) we need to store
-   an image of the keyblock which is fortunately instantly available
-   for keyboxes.  */
+/* This is a small cache of the results of successful fingerprint
+   searches, which is shared by all handles.  This works only for
+   keybox resources because (due to lack of a copy_keyblock function)
+   we need to store an image of the keyblock which is fortunately
+   instantly available for keyboxes.  An entry is identified by the
+   fingerprint, the resource and the offset of the keyblock in it.
+   The least recently used entry is dropped if the cache is full, and
+   the whole cache is flushed if a keybox is changed.
+
+   Each handle remembers whether its last search result is in the
+   cache (or is to be put into it by keydb_get_keyblock) in its
+   struct keyblock_cache.  */
+#define KEYBLOCK_CACHE_SIZE 16
+
 enum keyblock_cache_states {
   KEYBLOCK_CACHE_EMPTY,
   KEYBLOCK_CACHE_PREPARED,
@@ -75,14 +87,21 @@ enum keyblock_cache_states {
 struct keyblock_cache {
   enum keyblock_cache_states state;
   byte fpr[MAX_FINGERPRINT_LEN];
-  iobuf_t iobuf; /* Image of the keyblock.  */
-  int pk_no;
-  int uid_no;
   /* Offset of the record in the keybox.  */
   int resource;
   off_t offset;
 };
 
+struct keyblock_cache_entry {
+  byte fpr[MAX_FINGERPRINT_LEN];
+  void *token; /* The resource (see struct resource_item).  */
+  off_t offset;
+  iobuf_t iobuf; /* Image of the keyblock.  */
+  int pk_no;
+  int uid_no;
+};
+static std::list<keyblock_cache_entry> keyblock_images;
+
 struct keydb_handle {
   /* When we locked all of the resources in ACTIVE (using keyring_lock
      / keybox_lock, as appropriate).  */
@@ -103,6 +122,10 @@ struct keydb_handle {
   /* If set, this disables the use of the keyblock cache.  */
   int no_caching;
 
+  /* Whether a batch of changes has been started with this handle
+     (see keydb_batch_begin).  */
+  int in_batch;
+
   /* Whether the next search will be from the beginning of the
      database (and thus consider all records).  */
   int is_reset;
@@ -127,30 +150,43 @@ struct keydb_handle {
    exist, we don't have to spend time looking it up.  This
    particularly helps the --list-sigs and --check-sigs commands.
 
-   The cache stores the results in a hash using separate chaining.
-   Concretely: we use the LSB of the keyid to index the hash table and
-   each bucket consists of a linked list of entries.  An entry
-   consists of the 64-bit key id.  If a key id is not in the cache,
-   then we don't know whether it is in the DB or not.
+   The cache stores the results in a hash table using open addressing
+   with linear probing.  An entry consists of the 64-bit key id and is
+   placed at the slot given by the low bits of the key id (which come
+   straight from the fingerprint) or the next free one after it.  If a
+   key id is not in the cache, then we don't know whether it is in the
+   DB or not.
+
+   The table starts with KID_NOT_FOUND_CACHE_MIN slots and is doubled
+   whenever it becomes three quarters full.  Once it would grow beyond
+   KID_NOT_FOUND_CACHE_MAX slots, it is flushed instead.
 
-   To simplify the cache consistency protocol, we simply flush the
-   whole cache whenever a key is inserted or updated.  */
+   When a key is inserted or updated, the key ids of its primary key
+   and subkeys are removed from the cache.  Deleting a key does not
+   invalidate any entry.  */
 
-#define KID_NOT_FOUND_CACHE_BUCKETS 256
-static struct kid_not_found_cache_bucket
-    *kid_not_found_cache[KID_NOT_FOUND_CACHE_BUCKETS];
+#define KID_NOT_FOUND_CACHE_MIN 256
+#define KID_NOT_FOUND_CACHE_MAX (1 << 20)
 
-struct kid_not_found_cache_bucket {
-  struct kid_not_found_cache_bucket *next;
+struct kid_not_found_cache_slot {
   u32 kid[2];
+  int used;
 };
+static std::vector<kid_not_found_cache_slot> kid_not_found_cache;
 
 struct {
   unsigned int count;   /* The current number of entries in the hash table.  */
   unsigned int peak;    /* The peak of COUNT.  */
   unsigned int flushes; /* The number of flushes.  */
+  unsigned int removed; /* The number of entries removed by an update.  */
 } kid_not_found_stats;
 
+struct {
+  unsigned int hits;    /* Number of searches answered from the cache.  */
+  unsigned int misses;  /* Number of searches not answered.  */
+  unsigned int flushes; /* Number of flushes.  */
+} keyblock_cache_stats;
+
 struct {
   unsigned int handles;          /* Number of handles created.  */
   unsigned int locks;            /* Number of locks taken.  */
@@ -170,6 +206,20 @@ struct {
 static int lock_all(KEYDB_HANDLE hd);
 static void unlock_all(KEYDB_HANDLE hd);
 
+/* Return the slot of the key id KID in the kid_not_found_cache, or the
+   free slot where it would be inserted.  The table must not be
+   empty.  */
+static size_t kid_not_found_slot(const u32 *kid) {
+  size_t mask = kid_not_found_cache.size() - 1;
+  size_t i = kid[1] & mask;
+
+  while (kid_not_found_cache[i].used &&
+         (kid_not_found_cache[i].kid[0] != kid[0] ||
+          kid_not_found_cache[i].kid[1] != kid[1]))
+    i = (i + 1) & mask;
+  return i;
+}
+
 /* Check whether the keyid KID is in key id is definitely not in the
    database.
 
@@ -183,16 +233,13 @@ static void unlock_all(KEYDB_HANDLE hd);
          We searched for a key with this key id previously, but we
          didn't find it in the database.  */
 static int kid_not_found_p(u32 *kid) {
-  struct kid_not_found_cache_bucket *k;
-
-  for (k = kid_not_found_cache[kid[0] % KID_NOT_FOUND_CACHE_BUCKETS]; k;
-       k = k->next)
-    if (k->kid[0] == kid[0] && k->kid[1] == kid[1]) {
-      if (DBG_CACHE)
-        log_debug("keydb: kid_not_found_p (%08lx%08lx) => not in DB\n",
-                  (unsigned long)kid[0], (unsigned long)kid[1]);
-      return 1;
-    }
+  if (!kid_not_found_cache.empty() &&
+      kid_not_found_cache[kid_not_found_slot(kid)].used) {
+    if (DBG_CACHE)
+      log_debug("keydb: kid_not_found_p (%08lx%08lx) => not in DB\n",
+                (unsigned long)kid[0], (unsigned long)kid[1]);
+    return 1;
+  }
 
   if (DBG_CACHE)
     log_debug("keydb: kid_not_found_p (%08lx%08lx) => indeterminate\n",
@@ -200,55 +247,199 @@ static int kid_not_found_p(u32 *kid) {
   return 0;
 }
 
+/* Flush the kid not found cache.  */
+static void kid_not_found_flush(void) {
+  if (DBG_CACHE) log_debug("keydb: kid_not_found_flush\n");
+
+  if (!kid_not_found_stats.count) return;
+
+  std::vector<kid_not_found_cache_slot>().swap(kid_not_found_cache);
+  kid_not_found_stats.count = 0;
+  kid_not_found_stats.flushes++;
+}
+
+/* Rehash the kid_not_found_cache into a table with SIZE slots, which
+   must be a power of two.  */
+static void kid_not_found_resize(size_t size) {
+  std::vector<kid_not_found_cache_slot> old;
+
+  old.swap(kid_not_found_cache);
+  kid_not_found_cache.resize(size);
+  for (auto &slot : old)
+    if (slot.used) kid_not_found_cache[kid_not_found_slot(slot.kid)] = slot;
+}
+
 /* Insert the keyid KID into the kid_not_found_cache.  FOUND is whether
    the key is in the key database or not.
 
    Note this function does not check whether the key id is already in
    the cache.  As such, kid_not_found_p() should be called first.  */
 static void kid_not_found_insert(u32 *kid) {
-  struct kid_not_found_cache_bucket *k;
+  kid_not_found_cache_slot *k;
+  size_t size = kid_not_found_cache.size();
 
   if (DBG_CACHE)
     log_debug("keydb: kid_not_found_insert (%08lx%08lx)\n",
               (unsigned long)kid[0], (unsigned long)kid[1]);
-  k = (kid_not_found_cache_bucket *)xmalloc(sizeof *k);
+
+  if (4 * (kid_not_found_stats.count + 1) > 3 * size) {
+    if (2 * size > KID_NOT_FOUND_CACHE_MAX) {
+      kid_not_found_flush();
+      size = 0;
+    }
+    kid_not_found_resize(size ? 2 * size : KID_NOT_FOUND_CACHE_MIN);
+  }
+
+  k = &kid_not_found_cache[kid_not_found_slot(kid)];
   k->kid[0] = kid[0];
   k->kid[1] = kid[1];
-  k->next = kid_not_found_cache[kid[0] % KID_NOT_FOUND_CACHE_BUCKETS];
-  kid_not_found_cache[kid[0] % KID_NOT_FOUND_CACHE_BUCKETS] = k;
+  k->used = 1;
   kid_not_found_stats.count++;
+  if (kid_not_found_stats.count > kid_not_found_stats.peak)
+    kid_not_found_stats.peak = kid_not_found_stats.count;
 }
 
-/* Flush the kid not found cache.  */
-static void kid_not_found_flush(void) {
-  struct kid_not_found_cache_bucket *k, *knext;
-  int i;
+/* Remove the keyid KID from the kid_not_found_cache.  */
+static void kid_not_found_remove(const u32 *kid) {
+  size_t mask, i, j, home;
 
-  if (DBG_CACHE) log_debug("keydb: kid_not_found_flush\n");
+  if (kid_not_found_cache.empty()) return;
 
-  if (!kid_not_found_stats.count) return;
+  i = kid_not_found_slot(kid);
+  if (!kid_not_found_cache[i].used) return;
 
-  for (i = 0; i < DIM(kid_not_found_cache); i++) {
-    for (k = kid_not_found_cache[i]; k; k = knext) {
-      knext = k->next;
-      xfree(k);
+  if (DBG_CACHE)
+    log_debug("keydb: kid_not_found_remove (%08lx%08lx)\n",
+              (unsigned long)kid[0], (unsigned long)kid[1]);
+  kid_not_found_stats.count--;
+  kid_not_found_stats.removed++;
+
+  /* Close the gap by moving back the following entries of the probe
+     sequence, so that no tombstones are needed.  An entry at J can be
+     moved to the gap at I unless its home slot lies cyclically in
+     (I, J].  */
+  mask = kid_not_found_cache.size() - 1;
+  j = i;
+  for (;;) {
+    kid_not_found_cache[i].used = 0;
+    for (;;) {
+      j = (j + 1) & mask;
+      if (!kid_not_found_cache[j].used) return;
+      home = kid_not_found_cache[j].kid[1] & mask;
+      if (i <= j ? (i < home && home <= j) : (i < home || home <= j))
+        continue;
+      break;
     }
-    kid_not_found_cache[i] = NULL;
+    kid_not_found_cache[i] = kid_not_found_cache[j];
+    i = j;
   }
-  if (kid_not_found_stats.count > kid_not_found_stats.peak)
-    kid_not_found_stats.peak = kid_not_found_stats.count;
-  kid_not_found_stats.count = 0;
-  kid_not_found_stats.flushes++;
+}
+
+/* Remove the key ids of all keys in the keyblock KB from the
+   kid_not_found_cache, as they are about to be stored.  */
+static void kid_not_found_invalidate(kbnode_t kb) {
+  kbnode_t node;
+  u32 kid[2];
+
+  if (!kid_not_found_stats.count) return;
+
+  for (node = kb; node; node = node->next)
+    if (node->pkt->pkttype == PKT_PUBLIC_KEY ||
+        node->pkt->pkttype == PKT_PUBLIC_SUBKEY) {
+      keyid_from_pk(node->pkt->pkt.public_key, kid);
+      kid_not_found_remove(kid);
+    }
 }
 
 static void keyblock_cache_clear(struct keydb_handle *hd) {
   hd->keyblock_cache.state = KEYBLOCK_CACHE_EMPTY;
-  iobuf_close(hd->keyblock_cache.iobuf);
-  hd->keyblock_cache.iobuf = NULL;
   hd->keyblock_cache.resource = -1;
   hd->keyblock_cache.offset = -1;
 }
 
+/* Drop all entries of the shared keyblock cache.  This is done
+   whenever a keybox is changed, which might move the keyblocks.  */
+static void keyblock_cache_flush(void) {
+  if (keyblock_images.empty()) return;
+
+  for (auto &entry : keyblock_images) iobuf_close(entry.iobuf);
+  keyblock_images.clear();
+  keyblock_cache_stats.flushes++;
+}
+
+/* Return the entry of the shared keyblock cache for the search result
+   described by HD->KEYBLOCK_CACHE, or NULL.  */
+static keyblock_cache_entry *keyblock_cache_find(struct keydb_handle *hd) {
+  void *token = hd->active[hd->keyblock_cache.resource].token;
+
+  for (auto &entry : keyblock_images)
+    if (entry.token == token && entry.offset == hd->keyblock_cache.offset &&
+        !memcmp(entry.fpr, hd->keyblock_cache.fpr, 20))
+      return &entry;
+  return NULL;
+}
+
+/* Look up a keyblock with the fingerprint FPR in the shared keyblock
+   cache which the search of HD would reach next, that is, one which
+   is in the current resource after the current file position or in a
+   later resource.  If one is found, select it in the keybox as the
+   search result, mark it as most recently used and return true.  */
+static int keyblock_cache_search(struct keydb_handle *hd, const byte *fpr) {
+  int i;
+
+  if (hd->current < 0) return 0;
+
+  for (auto it = keyblock_images.begin(); it != keyblock_images.end(); ++it) {
+    if (memcmp(it->fpr, fpr, 20)) continue;
+
+    for (i = hd->current; i < hd->used; i++)
+      if (hd->active[i].type == KEYDB_RESOURCE_TYPE_KEYBOX &&
+          hd->active[i].token == it->token)
+        break;
+    if (i == hd->used ||
+        (i == hd->current && keybox_offset(hd->active[i].u.kb) > it->offset))
+      continue;
+
+    if (keybox_select_fpr(hd->active[i].u.kb, it->offset, fpr)) {
+      /* The keybox has been changed by someone else.  */
+      iobuf_close(it->iobuf);
+      keyblock_images.erase(it);
+      return 0;
+    }
+
+    hd->current = hd->found = i;
+    hd->keyblock_cache.state = KEYBLOCK_CACHE_FILLED;
+    hd->keyblock_cache.resource = i;
+    hd->keyblock_cache.offset = it->offset;
+    memcpy(hd->keyblock_cache.fpr, fpr, 20);
+    keyblock_images.splice(keyblock_images.begin(), keyblock_images, it);
+    return 1;
+  }
+  return 0;
+}
+
+/* Put the image IOBUF of the keyblock found by the last search of HD
+   into the shared keyblock cache.  The cache takes ownership of
+   IOBUF.  */
+static void keyblock_cache_insert(struct keydb_handle *hd, iobuf_t iobuf,
+                                  int pk_no, int uid_no) {
+  keyblock_cache_entry entry;
+
+  if (keyblock_images.size() >= KEYBLOCK_CACHE_SIZE) {
+    iobuf_close(keyblock_images.back().iobuf);
+    keyblock_images.pop_back();
+  }
+
+  memcpy(entry.fpr, hd->keyblock_cache.fpr, sizeof entry.fpr);
+  entry.token = hd->active[hd->keyblock_cache.resource].token;
+  entry.offset = hd->keyblock_cache.offset;
+  entry.iobuf = iobuf;
+  entry.pk_no = pk_no;
+  entry.uid_no = uid_no;
+  keyblock_images.push_front(entry);
+  hd->keyblock_cache.state = KEYBLOCK_CACHE_FILLED;
+}
+
 /* Handle the creation of a keyring or a keybox if it does not yet
    exist.  Take into account that other processes might have the
    keyring/keybox already locked.  This lock check does not work if
@@ -646,8 +837,21 @@ gpg_error_t keydb_add_resource(const char *url, unsigned int flags) {
           all_resources[used_resources].u.kb = NULL; /* Not used here */
           all_resources[used_resources].token = token;
 
-          /* FIXME: Do a compress run if needed and no other
-             user is currently using the keybox. */
+          /* Do a compress run if needed and no other user is
+             currently using the keybox.  Updates only append to
+             the keybox, so this is what removes the old blobs.  */
+          {
+            KEYBOX_HANDLE kbxhd = keybox_new_openpgp(token, 0);
+
+            if (kbxhd) {
+              if (!keybox_lock(kbxhd, 1, 0)) {
+                keybox_compress(kbxhd);
+                keyblock_cache_flush();
+                keybox_lock(kbxhd, 0, 0);
+              }
+              keybox_release(kbxhd);
+            }
+          }
 
           used_resources++;
         }
@@ -686,9 +890,12 @@ void keydb_dump_stats(void) {
   log_info("       reset=%u found=%u not=%u cache=%u not=%u\n",
            keydb_stats.search_resets, keydb_stats.found, keydb_stats.notfound,
            keydb_stats.found_cached, keydb_stats.notfound_cached);
-  log_info("kid_not_found_cache: count=%u peak=%u flushes=%u\n",
+  log_info("kid_not_found_cache: count=%u peak=%u flushes=%u removed=%u\n",
            kid_not_found_stats.count, kid_not_found_stats.peak,
-           kid_not_found_stats.flushes);
+           kid_not_found_stats.flushes, kid_not_found_stats.removed);
+  log_info("keyblock_cache: hits=%u misses=%u flushes=%u entries=%u\n",
+           keyblock_cache_stats.hits, keyblock_cache_stats.misses,
+           keyblock_cache_stats.flushes, (unsigned int)keyblock_images.size());
 }
 
 /* Create a new database handle.  A database handle is similar to a
@@ -755,6 +962,7 @@ void keydb_release(KEYDB_HANDLE hd) {
   log_assert(active_handles > 0);
   active_handles--;
 
+  keydb_batch_commit(hd);
   unlock_all(hd);
   for (i = 0; i < hd->used; i++) {
     switch (hd->active[i].type) {
@@ -825,7 +1033,7 @@ static int lock_all(KEYDB_HANDLE hd) {
       case KEYDB_RESOURCE_TYPE_NONE:
         break;
       case KEYDB_RESOURCE_TYPE_KEYBOX:
-        rc = keybox_lock(hd->active[i].u.kb, 1);
+        rc = keybox_lock(hd->active[i].u.kb, 1, -1);
         break;
     }
   }
@@ -837,7 +1045,7 @@ static int lock_all(KEYDB_HANDLE hd) {
         case KEYDB_RESOURCE_TYPE_NONE:
           break;
         case KEYDB_RESOURCE_TYPE_KEYBOX:
-          keybox_lock(hd->active[i].u.kb, 0);
+          keybox_lock(hd->active[i].u.kb, 0, 0);
           break;
       }
     }
@@ -859,7 +1067,7 @@ static void unlock_all(KEYDB_HANDLE hd) {
       case KEYDB_RESOURCE_TYPE_NONE:
         break;
       case KEYDB_RESOURCE_TYPE_KEYBOX:
-        keybox_lock(hd->active[i].u.kb, 0);
+        keybox_lock(hd->active[i].u.kb, 0, 0);
         break;
     }
   }
@@ -1056,20 +1264,22 @@ gpg_error_t keydb_get_keyblock(KEYDB_HANDLE hd, KBNODE *ret_kb) {
   if (DBG_CLOCK) log_clock("keydb_get_keybock enter");
 
   if (hd->keyblock_cache.state == KEYBLOCK_CACHE_FILLED) {
-    err = iobuf_seek(hd->keyblock_cache.iobuf, 0);
-    if (err) {
+    keyblock_cache_entry *entry = keyblock_cache_find(hd);
+
+    if (!entry)
+      ; /* Dropped from the cache meanwhile; read it from the keybox.  */
+    else if (iobuf_seek(entry->iobuf, 0))
       log_error("keydb_get_keyblock: failed to rewind iobuf for cache\n");
-      keyblock_cache_clear(hd);
-    } else {
-      err = parse_keyblock_image(hd->keyblock_cache.iobuf,
-                                 hd->keyblock_cache.pk_no,
-                                 hd->keyblock_cache.uid_no, ret_kb);
-      if (err) keyblock_cache_clear(hd);
+    else {
+      err = parse_keyblock_image(entry->iobuf, entry->pk_no, entry->uid_no,
+                                 ret_kb);
+      if (err) keyblock_cache_flush();
       if (DBG_CLOCK)
         log_clock(err ? "keydb_get_keyblock leave (cached, failed)"
                       : "keydb_get_keyblock leave (cached)");
       return err;
     }
+    keyblock_cache_clear(hd);
   }
 
   if (hd->found < 0 || hd->found >= hd->used) return GPG_ERR_VALUE_NOT_FOUND;
@@ -1086,14 +1296,10 @@ gpg_error_t keydb_get_keyblock(KEYDB_HANDLE hd, KBNODE *ret_kb) {
                                 &uid_no);
       if (!err) {
         err = parse_keyblock_image(iobuf, pk_no, uid_no, ret_kb);
-        if (!err && hd->keyblock_cache.state == KEYBLOCK_CACHE_PREPARED) {
-          hd->keyblock_cache.state = KEYBLOCK_CACHE_FILLED;
-          hd->keyblock_cache.iobuf = iobuf;
-          hd->keyblock_cache.pk_no = pk_no;
-          hd->keyblock_cache.uid_no = uid_no;
-        } else {
+        if (!err && hd->keyblock_cache.state == KEYBLOCK_CACHE_PREPARED)
+          keyblock_cache_insert(hd, iobuf, pk_no, uid_no);
+        else
           iobuf_close(iobuf);
-        }
       }
     } break;
   }
@@ -1172,8 +1378,9 @@ gpg_error_t keydb_update_keyblock(ctrl_t ctrl, KEYDB_HANDLE hd, kbnode_t kb) {
 
   if (!hd) return GPG_ERR_INV_ARG;
 
-  kid_not_found_flush();
+  kid_not_found_invalidate(kb);
   keyblock_cache_clear(hd);
+  keyblock_cache_flush();
 
   if (opt.dry_run) return 0;
 
@@ -1230,8 +1437,9 @@ gpg_error_t keydb_insert_keyblock(KEYDB_HANDLE hd, kbnode_t kb) {
 
   if (!hd) return GPG_ERR_INV_ARG;
 
-  kid_not_found_flush();
+  kid_not_found_invalidate(kb);
   keyblock_cache_clear(hd);
+  keyblock_cache_flush();
 
   if (opt.dry_run) return 0;
 
@@ -1284,8 +1492,8 @@ gpg_error_t keydb_delete_keyblock(KEYDB_HANDLE hd) {
 
   if (!hd) return GPG_ERR_INV_ARG;
 
-  kid_not_found_flush();
   keyblock_cache_clear(hd);
+  keyblock_cache_flush();
 
   if (hd->found < 0 || hd->found >= hd->used) return GPG_ERR_VALUE_NOT_FOUND;
 
@@ -1308,6 +1516,69 @@ gpg_error_t keydb_delete_keyblock(KEYDB_HANDLE hd) {
   return rc;
 }
 
+/* Start a batch of changes.  This locks all resources of HD and
+ * keeps them locked until keydb_batch_commit is called.  In the
+ * meantime all changes to the keyboxes, also through other handles,
+ * are collected and made durable together, which is much faster than
+ * syncing them one by one.  If the process dies before the commit,
+ * the changes of the batch may be lost, but all keyblocks are kept in
+ * either their old or their new version.
+ *
+ * Note: this doesn't do anything if --dry-run was specified.
+ *
+ * Returns 0 on success or an error code, if an error occurs.  */
+gpg_error_t keydb_batch_begin(KEYDB_HANDLE hd) {
+  gpg_error_t err;
+  int i;
+
+  if (!hd) return GPG_ERR_INV_ARG;
+  if (hd->in_batch || opt.dry_run) return 0;
+
+  err = lock_all(hd);
+  if (err) return err;
+
+  hd->in_batch = 1;
+  for (i = 0; !err && i < hd->used; i++) {
+    switch (hd->active[i].type) {
+      case KEYDB_RESOURCE_TYPE_NONE:
+        break;
+      case KEYDB_RESOURCE_TYPE_KEYBOX:
+        err = keybox_batch_begin(hd->active[i].u.kb);
+        break;
+    }
+  }
+
+  if (err) keydb_batch_commit(hd);
+  return err;
+}
+
+/* Commit the batch of changes started with keydb_batch_begin on HD
+ * and release the locks.
+ *
+ * Returns 0 on success or an error code, if an error occurs.  */
+gpg_error_t keydb_batch_commit(KEYDB_HANDLE hd) {
+  gpg_error_t err = 0, rc;
+  int i;
+
+  if (!hd) return GPG_ERR_INV_ARG;
+  if (!hd->in_batch) return 0;
+
+  for (i = 0; i < hd->used; i++) {
+    switch (hd->active[i].type) {
+      case KEYDB_RESOURCE_TYPE_NONE:
+        break;
+      case KEYDB_RESOURCE_TYPE_KEYBOX:
+        rc = keybox_batch_commit(hd->active[i].u.kb);
+        if (!err) err = rc;
+        break;
+    }
+  }
+
+  hd->in_batch = 0;
+  unlock_all(hd);
+  return err;
+}
+
 /* A database may consists of multiple keyrings / key boxes.  This
  * sets the "file position" to the start of the first keyring / key
  * box that is writable (i.e., doesn't have the read-only flag set).
@@ -1455,24 +1726,15 @@ gpg_error_t keydb_search(KEYDB_HANDLE hd, KEYDB_SEARCH_DESC *desc, size_t ndesc,
      have been disabled for the handle.  */
   if (!hd->no_caching && ndesc == 1 &&
       (desc[0].mode == KEYDB_SEARCH_MODE_FPR20 ||
-       desc[0].mode == KEYDB_SEARCH_MODE_FPR) &&
-      hd->keyblock_cache.state == KEYBLOCK_CACHE_FILLED &&
-      !memcmp(hd->keyblock_cache.fpr, desc[0].u.fpr, 20)
-      /* Make sure the current file position occurs before the cached
-         result to avoid an infinite loop.  */
-      && (hd->current < hd->keyblock_cache.resource ||
-          (hd->current == hd->keyblock_cache.resource &&
-           (keybox_offset(hd->active[hd->current].u.kb) <=
-            hd->keyblock_cache.offset)))) {
-    /* (DESCINDEX is already set).  */
-    if (DBG_CLOCK) log_clock("keydb_search leave (cached)");
-
-    hd->current = hd->keyblock_cache.resource;
-    /* HD->KEYBLOCK_CACHE.OFFSET is the last byte in the record.
-       Seek just beyond that.  */
-    keybox_seek(hd->active[hd->current].u.kb, hd->keyblock_cache.offset + 1);
-    keydb_stats.found_cached++;
-    return 0;
+       desc[0].mode == KEYDB_SEARCH_MODE_FPR)) {
+    if (keyblock_cache_search(hd, desc[0].u.fpr)) {
+      if (DBG_CLOCK) log_clock("keydb_search leave (cached)");
+      hd->is_reset = 0;
+      keyblock_cache_stats.hits++;
+      keydb_stats.found_cached++;
+      return 0;
+    }
+    keyblock_cache_stats.misses++;
   }
 
   rc = -1;
@@ -1522,10 +1784,8 @@ gpg_error_t keydb_search(KEYDB_HANDLE hd, KEYDB_SEARCH_DESC *desc, size_t ndesc,
       hd->active[hd->current].type == KEYDB_RESOURCE_TYPE_KEYBOX) {
     hd->keyblock_cache.state = KEYBLOCK_CACHE_PREPARED;
     hd->keyblock_cache.resource = hd->current;
-    /* The current offset is at the start of the next record.  Since
-       a record is at least 1 byte, we just use offset - 1, which is
-       within the record.  */
-    hd->keyblock_cache.offset = keybox_offset(hd->active[hd->current].u.kb) - 1;
+    hd->keyblock_cache.offset =
+        keybox_found_offset(hd->active[hd->current].u.kb);
     memcpy(hd->keyblock_cache.fpr, desc[0].u.fpr, 20);
   }
 
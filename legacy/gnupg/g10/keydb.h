@@ -169,6 +169,10 @@ gpg_error_t keydb_insert_keyblock(KEYDB_HANDLE hd, kbnode_t kb);
 /* Delete the currently selected keyblock.  */
 gpg_error_t keydb_delete_keyblock(KEYDB_HANDLE hd);
 
+/* Start and commit a batch of changes to all resources of HD.  */
+gpg_error_t keydb_batch_begin(KEYDB_HANDLE hd);
+gpg_error_t keydb_batch_commit(KEYDB_HANDLE hd);
+
 /* Find the first writable resource.  */
 gpg_error_t keydb_locate_writable(KEYDB_HANDLE hd);
 
@@ -257,6 +261,9 @@ void cache_public_key(PKT_public_key *pk);
 /* Disable and drop the public key cache.  */
 void getkey_disable_caches(void);
 
+/* Print the statistics of the public key and user id caches.  */
+void getkey_dump_stats(void);
+
 /* Return the public key with the key id KEYID and store it at PK.  */
 int get_pubkey(ctrl_t ctrl, PKT_public_key *pk, u32 *keyid);
 
@@ -437,6 +444,7 @@ const char *colon_datestr_from_pk(PKT_public_key *pk);
 const char *colon_datestr_from_sig(PKT_signature *sig);
 const char *colon_expirestr_from_sig(PKT_signature *sig);
 byte *fingerprint_from_pk(PKT_public_key *pk, byte *buf, size_t *ret_len);
+void fingerprints_from_pks(PKT_public_key **pks, int npks, byte *fprs);
 char *hexfingerprint(PKT_public_key *pk, char *buffer, size_t buflen);
 char *format_hexfingerprint(const char *fingerprint, char *buffer,
                             size_t buflen);
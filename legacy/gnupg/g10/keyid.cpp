@@ -133,12 +133,15 @@ char *pubkey_string(PKT_public_key *pk, char *buffer, size_t bufsize) {
   return buffer;
 }
 
-/* Hash a public key.  This function is useful for v4 fingerprints and
-   for v3 or v4 key signing. */
-void hash_public_key(gcry_md_hd_t md, PKT_public_key *pk) {
+/* Store the key material of PK at PP and NN in the format in which
+   it is hashed for v4 fingerprints and for v3 or v4 key signing.
+   Returns the length of the packet body and stores the number of
+   parts at R_NPARTS.  If R_OWNED is set on return, the parts must be
+   released with xfree.  */
+static unsigned int public_key_parts(PKT_public_key *pk, byte **pp,
+                                     unsigned int *nn, int *r_nparts,
+                                     int *r_owned) {
   unsigned int n = 6;
-  unsigned int nn[PUBKEY_MAX_NPKEY];
-  byte *pp[PUBKEY_MAX_NPKEY];
   int i;
   unsigned int nbits;
   size_t nbytes;
@@ -154,6 +157,8 @@ void hash_public_key(gcry_md_hd_t md, PKT_public_key *pk) {
     pp[0] = (byte *)gcry_mpi_get_opaque(pk->pkey[0], &nbits);
     nn[0] = (nbits + 7) / 8;
     n += nn[0];
+    *r_nparts = 1;
+    *r_owned = 0;
   } else {
     for (i = 0; i < npkey; i++) {
       if (!pk->pkey[i]) {
@@ -184,8 +189,23 @@ void hash_public_key(gcry_md_hd_t md, PKT_public_key *pk) {
         n += nn[i];
       }
     }
+    *r_nparts = npkey;
+    *r_owned = 1;
   }
 
+  return n;
+}
+
+/* Hash a public key.  This function is useful for v4 fingerprints and
+   for v3 or v4 key signing. */
+void hash_public_key(gcry_md_hd_t md, PKT_public_key *pk) {
+  unsigned int nn[PUBKEY_MAX_NPKEY];
+  byte *pp[PUBKEY_MAX_NPKEY];
+  unsigned int n;
+  int i, nparts, owned;
+
+  n = public_key_parts(pk, pp, nn, &nparts, &owned);
+
   gcry_md_putc(md, 0x99); /* ctb */
   /* What does it mean if n is greater than 0xFFFF ? */
   gcry_md_putc(md, n >> 8); /* 2 byte length header */
@@ -199,15 +219,44 @@ void hash_public_key(gcry_md_hd_t md, PKT_public_key *pk) {
 
   gcry_md_putc(md, pk->pubkey_algo);
 
-  if (npkey == 0 && pk->pkey[0] &&
-      gcry_mpi_get_flag(pk->pkey[0], GCRYMPI_FLAG_OPAQUE)) {
-    if (pp[0]) gcry_md_write(md, pp[0], nn[0]);
-  } else {
-    for (i = 0; i < npkey; i++) {
-      if (pp[i]) gcry_md_write(md, pp[i], nn[i]);
-      xfree(pp[i]);
+  for (i = 0; i < nparts; i++) {
+    if (pp[i]) gcry_md_write(md, pp[i], nn[i]);
+    if (owned) xfree(pp[i]);
+  }
+}
+
+/* Return the data hashed by hash_public_key for PK in a buffer, which
+   must be released with xfree.  Its length is stored at R_LEN.  */
+static byte *public_key_blob(PKT_public_key *pk, size_t *r_len) {
+  unsigned int nn[PUBKEY_MAX_NPKEY];
+  byte *pp[PUBKEY_MAX_NPKEY];
+  unsigned int n;
+  int i, nparts, owned;
+  byte *blob, *bp;
+
+  n = public_key_parts(pk, pp, nn, &nparts, &owned);
+
+  blob = bp = (byte *)xmalloc(3 + n);
+  *bp++ = 0x99;
+  *bp++ = n >> 8;
+  *bp++ = n;
+  *bp++ = pk->version;
+  *bp++ = pk->timestamp >> 24;
+  *bp++ = pk->timestamp >> 16;
+  *bp++ = pk->timestamp >> 8;
+  *bp++ = pk->timestamp;
+  *bp++ = pk->pubkey_algo;
+
+  for (i = 0; i < nparts; i++) {
+    if (pp[i]) {
+      memcpy(bp, pp[i], nn[i]);
+      bp += nn[i];
     }
+    if (owned) xfree(pp[i]);
   }
+
+  *r_len = bp - blob;
+  return blob;
 }
 
 static gcry_md_hd_t do_fingerprint_md(PKT_public_key *pk) {
@@ -651,6 +700,32 @@ byte *fingerprint_from_pk(PKT_public_key *pk, byte *array, size_t *ret_len) {
   return array;
 }
 
+/* Compute the fingerprints of the NPKS keys PKS and store them one
+   after the other at FPRS, which must have room for NPKS * 20 bytes.
+   The key IDs of the keys are set as well.  This is much faster than
+   calling fingerprint_from_pk for each key if there are many keys,
+   because the keys are hashed in parallel.  */
+void fingerprints_from_pks(PKT_public_key **pks, int npks, byte *fprs) {
+  gcry_buffer_t *bufs;
+  int i;
+
+  bufs = (gcry_buffer_t *)xcalloc(npks, sizeof *bufs);
+  for (i = 0; i < npks; i++) {
+    bufs[i].data = public_key_blob(pks[i], &bufs[i].len);
+    bufs[i].size = bufs[i].len;
+  }
+
+  if (gcry_md_hash_buffers_multi(DIGEST_ALGO_SHA1, 0, fprs, bufs, npks))
+    BUG();
+
+  for (i = 0; i < npks; i++) {
+    pks[i]->keyid[0] = buf32_to_u32(fprs + 20 * i + 12);
+    pks[i]->keyid[1] = buf32_to_u32(fprs + 20 * i + 16);
+    xfree(bufs[i].data);
+  }
+  xfree(bufs);
+}
+
 /* Return an allocated buffer with the fingerprint of PK formatted as
    a plain hexstring.  If BUFFER is NULL the result is a malloc'd
    string.  If BUFFER is not NULL the result will be copied into this
@@ -281,6 +281,10 @@ gpg_error_t check_signature_over_key_or_uid(ctrl_t ctrl, PKT_public_key *signer,
                                             PACKET *packet, int *is_selfsig,
                                             PKT_public_key *ret_pk);
 
+/* Verify the self-signatures of several keyblocks in advance, so that
+   later checks of them are cheap.  */
+void precheck_self_sigs(ctrl_t ctrl, kbnode_t *keyblocks, size_t nkeyblocks);
+
 /*-- delkey.c --*/
 gpg_error_t delete_keys(ctrl_t ctrl, const std::vector<std::string> &names,
                         int secret, int allow_both);
@@ -121,6 +121,7 @@ extern int memory_stat_debug_mode;
 #define IMPORT_EXPORT (1 << 9)
 #define IMPORT_RESTORE (1 << 10)
 #define IMPORT_REPAIR_KEYS (1 << 11)
+#define IMPORT_BATCH (1 << 12)
 
 #define EXPORT_LOCAL_SIGS (1 << 0)
 #define EXPORT_ATTRIBUTES (1 << 1)
@@ -198,6 +199,8 @@ struct options {
   int def_digest_algo{0};
   int cert_digest_algo{0};
   int compress_algo{-1}; /* defaults to DEFAULT_COMPRESS_ALGO */
+  size_t compress_window{0}; /* decompression input size, 0 for default */
+  size_t key_cache_size{0}; /* key and user id cache entries, 0 for default */
   std::vector<std::pair<std::string, unsigned int>> def_secret_key;
   boost::optional<std::string> def_recipient;
   int def_recipient_self{0};
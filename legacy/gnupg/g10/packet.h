@@ -230,6 +230,14 @@ typedef struct {
      the digest's value has not been saved here.  */
   byte digest[512 / 8];
   int digest_len;
+  /* The result of verifying this self-signature in advance (see
+     precheck_self_sigs).  It is only valid for the component PACKET
+     of the primary key PK.  */
+  struct {
+    const PACKET *packet;
+    const void *pk;
+    int rc;
+  } precheck;
 } PKT_signature;
 
 #define ATTRIB_IMAGE 1
@@ -24,6 +24,10 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <algorithm>
+#include <thread>
+#include <vector>
+
 #include "../common/compliance.h"
 #include "../common/status.h"
 #include "../common/util.h"
@@ -670,7 +674,8 @@ int check_key_signature(ctrl_t ctrl, kbnode_t root, kbnode_t node,
 
    Unlike check_key_signature, this function ignores any cached
    results!  That is, it does not consider SIG->FLAGS.CHECKED and
-   SIG->FLAGS.VALID nor does it set them.
+   SIG->FLAGS.VALID nor does it set them.  It only uses the result of
+   precheck_self_sigs, which is for exactly these arguments.
 
    This doesn't check the signature's semantic mean.  Concretely, it
    doesn't check whether a non-self signed revocation signature was
@@ -789,6 +794,12 @@ gpg_error_t check_signature_over_key_or_uid(ctrl_t ctrl, PKT_public_key *signer,
     }
   }
 
+  if (signer == pripk && sig->precheck.packet == packet &&
+      sig->precheck.pk == pripk) {
+    rc = sig->precheck.rc;
+    goto out;
+  }
+
   /* We checked above that we supported this algo, so an error here is
      a bug.  */
   if (gcry_md_open(&md, sig->digest_algo, 0)) BUG();
@@ -846,6 +857,125 @@ out:
   return rc;
 }
 
+/* A self-signature which is verified by precheck_self_sigs.  */
+struct precheck_task {
+  kbnode_t root;
+  PKT_signature *sig;
+  PACKET *packet;
+};
+
+/* Return true if SIG over a component of type PKTTYPE can be verified
+   in advance with the primary key PK.  Signatures which can't be over
+   the component, and those whose verification prints diagnostics,
+   are left to the normal checks.  */
+static int precheck_possible(PKT_public_key *pk, PKT_signature *sig,
+                             int pkttype) {
+  size_t qbits;
+
+  switch (sig->sig_class) {
+    case 0x1f:
+    case 0x20:
+      if (pkttype != PKT_PUBLIC_KEY) return 0;
+      break;
+    case 0x18:
+    case 0x28:
+      if (pkttype != PKT_PUBLIC_SUBKEY) return 0;
+      break;
+    case 0x10:
+    case 0x11:
+    case 0x12:
+    case 0x13:
+    case 0x30:
+      if (pkttype != PKT_USER_ID) return 0;
+      break;
+    default:
+      return 0;
+  }
+
+  if (sig->flags.checked || sig->flags.unknown_critical) return 0;
+  if (openpgp_pk_test_algo((pubkey_algo_t)(sig->pubkey_algo)) ||
+      openpgp_md_test_algo((digest_algo_t)(sig->digest_algo)))
+    return 0;
+  if (opt.weak_digests.count((gcry_md_algos)sig->digest_algo)) return 0;
+
+  /* See encode_md_value.  */
+  if (pk->pubkey_algo == PUBKEY_ALGO_DSA ||
+      pk->pubkey_algo == PUBKEY_ALGO_ECDSA) {
+    qbits = gcry_mpi_get_nbits(pk->pkey[1]);
+    if (pk->pubkey_algo == PUBKEY_ALGO_ECDSA) qbits = ecdsa_qbits_from_Q(qbits);
+    if ((qbits % 8) || qbits < 160) return 0;
+    qbits = std::min<size_t>(qbits, 512);
+    if (gcry_md_get_algo_dlen(sig->digest_algo) < qbits / 8) return 0;
+  }
+
+  return 1;
+}
+
+/* Verify the self-signatures of the NKEYBLOCKS keyblocks in KEYBLOCKS
+ * over their user IDs, subkeys and primary keys in parallel.  The
+ * results are stored in the signature packets and used by
+ * check_signature_over_key_or_uid as long as the signature is checked
+ * against the same component, so that the checks done later one by
+ * one (e.g., during an import) don't need any public key operations.
+ * Other keyblocks, like secret keys, are ignored.  */
+void precheck_self_sigs(ctrl_t ctrl, kbnode_t *keyblocks, size_t nkeyblocks) {
+  std::vector<precheck_task> tasks;
+  kbnode_t root, node, component;
+  PKT_public_key *pk;
+  PKT_signature *sig;
+  unsigned int threads;
+  size_t i;
+
+  if (opt.no_sig_cache) return;
+
+  for (i = 0; i < nkeyblocks; i++) {
+    root = keyblocks[i];
+    if (!root || root->pkt->pkttype != PKT_PUBLIC_KEY) continue;
+    pk = root->pkt->pkt.public_key;
+    /* The key ID is computed on first use.  */
+    keyid_from_pk(pk, NULL);
+
+    component = root;
+    for (node = root->next; node; node = node->next) {
+      if (node->pkt->pkttype == PKT_PUBLIC_SUBKEY ||
+          node->pkt->pkttype == PKT_USER_ID) {
+        component = node;
+        continue;
+      }
+      if (node->pkt->pkttype != PKT_SIGNATURE) continue;
+
+      sig = node->pkt->pkt.signature;
+      if (sig->keyid[0] != pk->keyid[0] || sig->keyid[1] != pk->keyid[1])
+        continue;
+      if (!precheck_possible(pk, sig, component->pkt->pkttype)) continue;
+      tasks.push_back({root, sig, component->pkt});
+    }
+  }
+  if (tasks.empty()) return;
+
+  /* Each thread uses its own hash contexts, and public key operations
+     of libgcrypt are thread safe.  */
+  threads = std::max(1U, std::thread::hardware_concurrency());
+  threads = (unsigned int)std::min<size_t>(threads, tasks.size());
+
+  auto worker = [&](unsigned int first) {
+    for (size_t idx = first; idx < tasks.size(); idx += threads) {
+      precheck_task &task = tasks[idx];
+      PKT_public_key *pripk = task.root->pkt->pkt.public_key;
+
+      task.sig->precheck.rc = check_signature_over_key_or_uid(
+          ctrl, pripk, task.sig, task.root, task.packet, NULL, NULL);
+      task.sig->precheck.pk = pripk;
+      task.sig->precheck.packet = task.packet;
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (unsigned int n = 1; n < threads; n++) workers.emplace_back(worker, n);
+  worker(0);
+  for (auto &thread : workers) thread.join();
+}
+
 /* Check that a signature over a key (e.g., a key revocation, key
  * binding, user id certification, etc.) is valid.  If the function
  * detects a self-signature, it uses the public key from the specified
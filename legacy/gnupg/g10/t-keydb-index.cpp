@@ -0,0 +1,184 @@
+/* t-keydb-index.cpp - Tests for the keybox index.
+ * Copyright (C) 2017 The NeoPG developers
+ *
+ * This file is part of GnuPG.
+ *
+ * GnuPG is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GnuPG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "test.c"
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../kbx/keybox.h"
+
+/* The number of keys appended by the writer.  */
+#define NKEYS 500
+/* The number of concurrent processes rebuilding the index.  */
+#define NREADERS 4
+
+/* Store a keyblock with a made-up RSA key, which is different for
+   each SEQ, at IMAGE and its fingerprint at FPR.  Returns the length
+   of the keyblock.  */
+static size_t make_keyblock(int seq, unsigned char *image,
+                            unsigned char *fpr) {
+  unsigned char *p = image;
+  char uid[64];
+  int i;
+
+  /* Public key packet.  */
+  *p++ = 0x99;
+  *p++ = 0;
+  *p++ = 141;
+  *p++ = 4;
+  *p++ = 0x59;
+  *p++ = 0;
+  *p++ = 0;
+  *p++ = 0;
+  *p++ = 1; /* RSA */
+  *p++ = 1024 >> 8;
+  *p++ = 1024 & 0xff;
+  for (i = 0; i < 128; i++) *p++ = (i ? i : 0x80) ^ (seq >> (8 * (i % 2)));
+  *p++ = 0;
+  *p++ = 17;
+  *p++ = 0x01;
+  *p++ = 0x00;
+  *p++ = 0x01;
+  gcry_md_hash_buffer(GCRY_MD_SHA1, fpr, image, p - image);
+
+  /* User ID packet.  */
+  snprintf(uid, sizeof uid, "Test %d <test%d@example.org>", seq, seq);
+  *p++ = 0xb4;
+  *p++ = strlen(uid);
+  memcpy(p, uid, strlen(uid));
+  p += strlen(uid);
+
+  return p - image;
+}
+
+static gpg_error_t search_fpr(KEYBOX_HANDLE hd, const unsigned char *fpr) {
+  KEYDB_SEARCH_DESC desc;
+
+  memset(&desc, 0, sizeof desc);
+  desc.mode = KEYDB_SEARCH_MODE_FPR20;
+  memcpy(desc.u.fpr, fpr, 20);
+  keybox_search_reset(hd);
+  return keybox_search(hd, &desc, 1, KEYBOX_BLOBTYPE_PGP, NULL, NULL);
+}
+
+/* Append NKEYS keys to the keybox of TOKEN, under the lock.  Like an
+   import, each insert is preceded by a search, which loads the
+   index.  */
+static void append_keys(void *token) {
+  KEYBOX_HANDLE hd;
+  unsigned char image[256], fpr[20];
+  size_t len;
+  int i;
+
+  hd = keybox_new_openpgp(token, 0);
+  if (!hd) _exit(1);
+  for (i = 0; i < NKEYS; i++) {
+    len = make_keyblock(i, image, fpr);
+    if (keybox_lock(hd, 1, -1)) _exit(1);
+    if (search_fpr(hd, fpr) != -1) _exit(1);
+    if (keybox_insert_keyblock(hd, image, len)) _exit(1);
+    keybox_lock(hd, 0, 0);
+  }
+  keybox_release(hd);
+  _exit(0);
+}
+
+/* Rebuild the index of the keybox of TOKEN without the lock.  This
+   runs in a fresh process, which has no index in memory yet.  */
+static void rebuild_index(void *token, const char *idxname) {
+  KEYBOX_HANDLE hd;
+  unsigned char image[256], fpr[20];
+
+  hd = keybox_new_openpgp(token, 0);
+  if (!hd) _exit(1);
+  make_keyblock(0, image, fpr);
+  remove(idxname);
+  search_fpr(hd, fpr);
+  keybox_release(hd);
+  _exit(0);
+}
+
+static void do_test(int argc, char *argv[]) {
+  KEYBOX_HANDLE hd;
+  unsigned char image[256], fpr[20];
+  char fname[1024], idxname[1024 + 4];
+  void *token;
+  FILE *fp;
+  pid_t writer, pid;
+  int status, wstatus, i, missing;
+  int nreaders = 0;
+  unsigned long rebuilds = 0;
+
+  (void)argc;
+  (void)argv;
+
+  if (!getcwd(fname, sizeof fname - 32)) ABORT("getcwd failed");
+  strcat(fname, "/t-keydb-index.kbx");
+  snprintf(idxname, sizeof idxname, "%s.idx", fname);
+  remove(idxname);
+  fp = fopen(fname, "wb");
+  if (!fp || _keybox_write_header_blob(fp, 1) || fclose(fp))
+    ABORT("Failed to create keybox.");
+  if (keybox_register_file(fname, 0, &token))
+    ABORT("Failed to register keybox.");
+
+  /* One process appends keys, while others rebuild the index without
+     holding the lock.  A rebuild from an older keybox must not
+     replace the index of a newer one.  This depends on the timing, so
+     a broken index is not always detected.  */
+  TEST_GROUP("append during index rebuilds");
+  writer = fork();
+  if (writer == -1) ABORT("fork failed");
+  if (!writer) append_keys(token);
+
+  for (;;) {
+    if (nreaders < NREADERS) {
+      pid = fork();
+      if (pid == -1) ABORT("fork failed");
+      if (!pid) rebuild_index(token, idxname);
+      nreaders++;
+      rebuilds++;
+      continue;
+    }
+    pid = wait(&status);
+    if (pid == -1) ABORT("wait failed");
+    if (pid == writer) {
+      wstatus = status;
+      break;
+    }
+    nreaders--;
+  }
+  while (nreaders-- > 0) wait(&status);
+  TEST_P("writer succeeded", WIFEXITED(wstatus) && !WEXITSTATUS(wstatus));
+  if (verbose) printf("%lu index rebuilds\n", rebuilds);
+
+  hd = keybox_new_openpgp(token, 0);
+  if (!hd) ABORT("");
+  missing = 0;
+  for (i = 0; i < NKEYS; i++) {
+    make_keyblock(i, image, fpr);
+    if (search_fpr(hd, fpr)) missing++;
+  }
+  TEST("all keys are found", missing, 0);
+
+  keybox_release(hd);
+  remove(idxname);
+  remove(fname);
+}
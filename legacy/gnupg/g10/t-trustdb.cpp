@@ -0,0 +1,113 @@
+/* t-trustdb.cpp - Tests for trustdb.c.
+ * Copyright (C) 2017 The NeoPG developers
+ *
+ * This file is part of GnuPG.
+ *
+ * GnuPG is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GnuPG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "test.c"
+
+#include <unistd.h>
+
+#include "keydb.h"
+#include "options.h"
+#include "trustdb.h"
+
+/* The keyring has three keys.  Alice certified Carol's key, and Carol
+   certified Dave's key.  */
+#define ALICE "4A63B9ACC05267EEB3A4C4EACA018BE8D9A34720"
+#define CAROL "724EF49A15C602BA94779AEAA19B993AEC99C3D2"
+#define DAVE "F9929FF739A635094155EAB22A666AA8B0822B9A"
+
+static KBNODE get_keyblock(const char *fpr) {
+  KEYDB_HANDLE hd;
+  KEYDB_SEARCH_DESC desc;
+  KBNODE kb;
+  int rc;
+
+  rc = classify_user_id(fpr, &desc, 0);
+  if (rc) ABORT("Failed to convert fingerprint");
+
+  hd = keydb_new();
+  if (!hd) ABORT("");
+  rc = keydb_search(hd, &desc, 1, NULL);
+  if (rc) ABORT("Failed to lookup key");
+  rc = keydb_get_keyblock(hd, &kb);
+  if (rc) ABORT("Failed to get keyblock");
+  keydb_release(hd);
+
+  return kb;
+}
+
+static unsigned int validity(ctrl_t ctrl, KBNODE kb) {
+  return (tdb_get_validity_core(ctrl, kb, kb->pkt->pkt.public_key, NULL, NULL,
+                                NULL, 0) &
+          TRUST_MASK);
+}
+
+static void do_test(int argc, char *argv[]) {
+  int rc;
+  struct server_control_s ctrl_s;
+  ctrl_t ctrl = &ctrl_s;
+  KBNODE alice, carol, dave;
+  char *fname;
+  char dbname[1024];
+
+  (void)argc;
+  (void)argv;
+
+  memset(ctrl, 0, sizeof *ctrl);
+  ctrl->magic = SERVER_CONTROL_MAGIC;
+  opt.trust_model = TM_PGP;
+  opt.completes_needed = 1;
+  opt.marginals_needed = 3;
+  opt.max_cert_depth = 5;
+
+  fname = prepend_srcdir("t-trustdb-keyring.gpg");
+  rc = keydb_add_resource(fname, 0);
+  test_free(fname);
+  if (rc) ABORT("Failed to open keyring.");
+
+  if (!getcwd(dbname, sizeof dbname - 32)) ABORT("getcwd failed");
+  strcat(dbname, "/t-trustdb.gpg");
+  remove(dbname);
+  rc = setup_trustdb(1, dbname);
+  if (rc) ABORT("Failed to set up trustdb.");
+
+  alice = get_keyblock(ALICE);
+  carol = get_keyblock(CAROL);
+  dave = get_keyblock(DAVE);
+
+  /* A change of the ultimately trusted keys is a full check.  */
+  TEST_GROUP("full check");
+  tdb_update_ownertrust(ctrl, alice->pkt->pkt.public_key, TRUST_ULTIMATE);
+  check_trustdb(ctrl);
+  TEST("Carol's key is valid", validity(ctrl, carol), TRUST_FULLY);
+  TEST("Dave's key is not valid", validity(ctrl, dave), TRUST_UNKNOWN);
+
+  /* Carol's key is already valid, but was not an introducer before.
+     The incremental check must look at the keys she certified.  */
+  TEST_GROUP("incremental check after an ownertrust change");
+  tdb_update_ownertrust(ctrl, carol->pkt->pkt.public_key, TRUST_FULLY);
+  TEST_P("check pending", trustdb_pending_check());
+  check_trustdb(ctrl);
+  TEST("Carol's key is still valid", validity(ctrl, carol), TRUST_FULLY);
+  TEST("Dave's key became valid", validity(ctrl, dave), TRUST_FULLY);
+
+  release_kbnode(alice);
+  release_kbnode(carol);
+  release_kbnode(dave);
+  remove(dbname);
+}
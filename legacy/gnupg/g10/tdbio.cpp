@@ -18,6 +18,10 @@
  * along with this program; if not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+#include <map>
+#include <string>
+
 #include <config.h>
 #include <errno.h>
 #include <fcntl.h>
@@ -27,6 +31,9 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#endif
 
 #include "../common/iobuf.h"
 #include "../common/status.h"
@@ -48,31 +55,30 @@
 #endif
 
 /*
- * Yes, this is a very simple implementation. We should really
- * use a page aligned buffer and read complete pages.
- * To implement a simple trannsaction system, this is sufficient.
+ * The records are read from a shared mapping of the trustdb, so that
+ * the kernel's page cache does the caching.  Records written by
+ * tdbio_write_record are kept in DIRTY_RECORDS, which are ordered by
+ * record number, until tdbio_sync copies them into the mapping under
+ * the write lock and schedules the changed pages for writing with a
+ * single msync.  The mapping is only renewed there and when the
+ * trustdb is opened, because every new record grows the file and
+ * remapping the whole file for each of them would be expensive.
+ * Records beyond the end of the mapping are read with read() and
+ * written with write(), as are all records if the file can't be
+ * mapped.
  */
-typedef struct cache_ctrl_struct *CACHE_CTRL;
-struct cache_ctrl_struct {
-  CACHE_CTRL next;
-  struct {
-    unsigned used : 1;
-    unsigned dirty : 1;
-  } flags;
-  unsigned long recno;
-  char data[TRUST_RECORD_LEN];
-};
+static std::map<unsigned long, std::string> dirty_records;
 
-/* Size of the cache.  The SOFT value is the general one.  While in a
-   transaction this may not be sufficient and thus we may increase it
-   then up to the HARD limit.  */
-#define MAX_CACHE_ENTRIES_SOFT 200
-#define MAX_CACHE_ENTRIES_HARD 10000
+/* The number of dirty records which triggers a write outside of
+   tdbio_sync.  While in a transaction, the records are kept up to
+   the HARD limit.  */
+#define MAX_DIRTY_RECORDS_SOFT 100000
+#define MAX_DIRTY_RECORDS_HARD 1000000
 
-/* The cache is controlled by these variables.  */
-static CACHE_CTRL cache_list;
-static int cache_entries;
-static int cache_is_dirty;
+/* The mapping of the trustdb file.  */
+static byte *db_map;
+static size_t db_map_size;
+static int db_map_writable;
 
 /* An object to pass information to cmp_krec_fpr. */
 struct cmp_krec_fpr_struct {
@@ -139,225 +145,177 @@ static void release_write_lock(void) {
  ************* record cache **********
  *************************************/
 
+/* Release the mapping of the trustdb.  */
+static void unmap_db(void) {
+#ifdef HAVE_MMAP
+  if (db_map) munmap(db_map, db_map_size);
+#endif
+  db_map = NULL;
+  db_map_size = 0;
+}
+
+/* Map the trustdb file with its current size, unless that is
+   already the case.  */
+static void map_db(void) {
+#ifdef HAVE_MMAP
+  struct stat st;
+  void *map;
+  int prot = PROT_READ;
+
+  if (fstat(db_fd, &st) || !S_ISREG(st.st_mode)) return;
+  if ((size_t)st.st_size == db_map_size) return;
+
+  unmap_db();
+  if (!st.st_size) return;
+
+  db_map_writable = (fcntl(db_fd, F_GETFL) & O_ACCMODE) == O_RDWR;
+  if (db_map_writable) prot |= PROT_WRITE;
+  map = mmap(NULL, st.st_size, prot, MAP_SHARED, db_fd, 0);
+  if (map == MAP_FAILED) {
+    if (opt.debug) log_debug("tdbio: mmap failed: %s\n", strerror(errno));
+    return;
+  }
+  db_map = (byte *)map;
+  db_map_size = st.st_size;
+#endif
+}
+
+/*
+ * Return a pointer to the record RECNO in the mapping of the trustdb,
+ * or NULL if it is not mapped.
+ */
+static byte *get_mapped_record(unsigned long recno) {
+#ifdef HAVE_MMAP
+  size_t end = (recno + 1) * (size_t)TRUST_RECORD_LEN;
+
+  if (end <= db_map_size) return db_map + end - TRUST_RECORD_LEN;
+#endif
+  return NULL;
+}
+
 /*
  * Get the data from the record cache and return a pointer into that
  * cache.  Caller should copy the returned data.  NULL is returned on
  * a cache miss.
  */
 static const char *get_record_from_cache(unsigned long recno) {
-  CACHE_CTRL r;
+  auto it = dirty_records.find(recno);
 
-  for (r = cache_list; r; r = r->next) {
-    if (r->flags.used && r->recno == recno) return r->data;
-  }
-  return NULL;
+  if (it != dirty_records.end()) return it->second.data();
+  return (const char *)get_mapped_record(recno);
 }
 
 /*
- * Write a cached item back to the trustdb file.
+ * Write the dirty records back to the trustdb file.  The caller must
+ * hold the write lock.
  *
  * Returns: 0 on success or an error code.
  */
-static int write_cache_item(CACHE_CTRL r) {
+static int write_dirty_records(void) {
   gpg_error_t err;
+  size_t lo = (size_t)-1, hi = 0;
   int n;
 
-  if (lseek(db_fd, r->recno * TRUST_RECORD_LEN, SEEK_SET) == -1) {
-    err = gpg_error_from_syserror();
-    log_error(_("trustdb rec %lu: lseek failed: %s\n"), r->recno,
-              strerror(errno));
-    return err;
+  /* Pick up the records appended since the last write.  */
+  map_db();
+
+  for (auto it = dirty_records.begin(); it != dirty_records.end();
+       it = dirty_records.erase(it)) {
+    unsigned long recno = it->first;
+    byte *rec = db_map_writable ? get_mapped_record(recno) : NULL;
+
+    if (rec) {
+      memcpy(rec, it->second.data(), TRUST_RECORD_LEN);
+      lo = std::min(lo, (size_t)(rec - db_map));
+      hi = std::max(hi, (size_t)(rec - db_map) + TRUST_RECORD_LEN);
+      continue;
+    }
+
+    if (lseek(db_fd, recno * TRUST_RECORD_LEN, SEEK_SET) == -1) {
+      err = gpg_error_from_syserror();
+      log_error(_("trustdb rec %lu: lseek failed: %s\n"), recno,
+                strerror(errno));
+      return err;
+    }
+    n = write(db_fd, it->second.data(), TRUST_RECORD_LEN);
+    if (n != TRUST_RECORD_LEN) {
+      err = gpg_error_from_syserror();
+      log_error(_("trustdb rec %lu: write failed (n=%d): %s\n"), recno, n,
+                strerror(errno));
+      return err;
+    }
   }
-  n = write(db_fd, r->data, TRUST_RECORD_LEN);
-  if (n != TRUST_RECORD_LEN) {
-    err = gpg_error_from_syserror();
-    log_error(_("trustdb rec %lu: write failed (n=%d): %s\n"), r->recno, n,
-              strerror(errno));
-    return err;
+
+#ifdef HAVE_MMAP
+  /* Like write(), this only hands the pages to the kernel.  */
+  if (lo < hi) {
+    size_t pagesize = sysconf(_SC_PAGESIZE);
+
+    lo -= lo % pagesize;
+    if (msync(db_map + lo, hi - lo, MS_ASYNC)) {
+      err = gpg_error_from_syserror();
+      log_error(_("trustdb: msync failed: %s\n"), strerror(errno));
+      return err;
+    }
   }
-  r->flags.dirty = 0;
+#endif
   return 0;
 }
 
 /*
- * Put data into the cache.  This function may flush
- * some cache entries if the cache is filled up.
+ * Put data into the cache.  This function may write the dirty
+ * records if there are too many of them.
  *
  * Returns: 0 on success or an error code.
  */
 static int put_record_into_cache(unsigned long recno, const char *data) {
-  CACHE_CTRL r, unused;
-  int dirty_count = 0;
-  int clean_count = 0;
-
-  /* See whether we already cached this one.  */
-  for (unused = NULL, r = cache_list; r; r = r->next) {
-    if (!r->flags.used) {
-      if (!unused) unused = r;
-    } else if (r->recno == recno) {
-      if (!r->flags.dirty) {
-        /* Hmmm: should we use a copy and compare? */
-        if (memcmp(r->data, data, TRUST_RECORD_LEN)) {
-          r->flags.dirty = 1;
-          cache_is_dirty = 1;
-        }
-      }
-      memcpy(r->data, data, TRUST_RECORD_LEN);
-      return 0;
-    }
-    if (r->flags.used) {
-      if (r->flags.dirty)
-        dirty_count++;
-      else
-        clean_count++;
-    }
-  }
-
-  /* Not in the cache: add a new entry. */
-  if (unused) {
-    /* Reuse this entry. */
-    r = unused;
-    r->flags.used = 1;
-    r->recno = recno;
-    memcpy(r->data, data, TRUST_RECORD_LEN);
-    r->flags.dirty = 1;
-    cache_is_dirty = 1;
-    cache_entries++;
-    return 0;
-  }
-
-  /* See whether we reached the limit. */
-  if (cache_entries < MAX_CACHE_ENTRIES_SOFT) {
-    /* No: Put into cache.  */
-    r = (CACHE_CTRL)xmalloc(sizeof *r);
-    r->flags.used = 1;
-    r->recno = recno;
-    memcpy(r->data, data, TRUST_RECORD_LEN);
-    r->flags.dirty = 1;
-    r->next = cache_list;
-    cache_list = r;
-    cache_is_dirty = 1;
-    cache_entries++;
-    return 0;
-  }
-
-  /* Cache is full: discard some clean entries.  */
-  if (clean_count) {
-    int n;
-
-    /* We discard a third of the clean entries.  */
-    n = clean_count / 3;
-    if (!n) n = 1;
-
-    for (unused = NULL, r = cache_list; r; r = r->next) {
-      if (r->flags.used && !r->flags.dirty) {
-        if (!unused) unused = r;
-        r->flags.used = 0;
-        cache_entries--;
-        if (!--n) break;
-      }
-    }
-
-    /* Now put into the cache.  */
-    log_assert(unused);
-    r = unused;
-    r->flags.used = 1;
-    r->recno = recno;
-    memcpy(r->data, data, TRUST_RECORD_LEN);
-    r->flags.dirty = 1;
-    cache_is_dirty = 1;
-    cache_entries++;
-    return 0;
-  }
-
-  /* No clean entries: We have to flush some dirty entries.  */
-  if (in_transaction) {
-    /* But we can't do this while in a transaction.  Thus we
-     * increase the cache size instead.  */
-    if (cache_entries < MAX_CACHE_ENTRIES_HARD) {
-      if (opt.debug && !(cache_entries % 100))
-        log_debug("increasing tdbio cache size\n");
-      r = (CACHE_CTRL)xmalloc(sizeof *r);
-      r->flags.used = 1;
-      r->recno = recno;
-      memcpy(r->data, data, TRUST_RECORD_LEN);
-      r->flags.dirty = 1;
-      r->next = cache_list;
-      cache_list = r;
-      cache_is_dirty = 1;
-      cache_entries++;
-      return 0;
-    }
-    /* Hard limit for the cache size reached.  */
-    log_info(_("trustdb transaction too large\n"));
-    return GPG_ERR_RESOURCE_LIMIT;
-  }
-
-  if (dirty_count) {
-    int n;
-
-    /* Discard some dirty entries. */
-    n = dirty_count / 5;
-    if (!n) n = 1;
-
-    take_write_lock();
-    for (unused = NULL, r = cache_list; r; r = r->next) {
-      if (r->flags.used && r->flags.dirty) {
-        int rc;
-
-        rc = write_cache_item(r);
-        if (rc) return rc;
-        if (!unused) unused = r;
-        r->flags.used = 0;
-        cache_entries--;
-        if (!--n) break;
+  const char *current = get_record_from_cache(recno);
+  int rc, did_lock = 0;
+
+  /* Records which don't change need not be written.  */
+  if (current && !memcmp(current, data, TRUST_RECORD_LEN)) return 0;
+
+  if (dirty_records.size() >= MAX_DIRTY_RECORDS_SOFT &&
+      !dirty_records.count(recno)) {
+    if (in_transaction) {
+      /* We can't write while in a transaction.  Thus we keep more
+       * dirty records instead.  */
+      if (dirty_records.size() >= MAX_DIRTY_RECORDS_HARD) {
+        log_info(_("trustdb transaction too large\n"));
+        return GPG_ERR_RESOURCE_LIMIT;
       }
+    } else {
+      if (!take_write_lock()) did_lock = 1;
+      rc = write_dirty_records();
+      if (did_lock) release_write_lock();
+      if (rc) return rc;
     }
-    release_write_lock();
-
-    /* Now put into the cache.  */
-    log_assert(unused);
-    r = unused;
-    r->flags.used = 1;
-    r->recno = recno;
-    memcpy(r->data, data, TRUST_RECORD_LEN);
-    r->flags.dirty = 1;
-    cache_is_dirty = 1;
-    cache_entries++;
-    return 0;
   }
 
-  /* We should never reach this.  */
-  BUG();
+  dirty_records[recno].assign(data, TRUST_RECORD_LEN);
+  return 0;
 }
 
 /* Return true if the cache is dirty.  */
-int tdbio_is_dirty() { return cache_is_dirty; }
+int tdbio_is_dirty() { return !dirty_records.empty(); }
 
 /*
  * Flush the cache.  This cannot be used while in a transaction.
  */
 int tdbio_sync() {
-  CACHE_CTRL r;
+  int rc;
   int did_lock = 0;
 
   if (db_fd == -1) open_db();
   if (in_transaction) log_bug("tdbio: syncing while in transaction\n");
 
-  if (!cache_is_dirty) return 0;
+  if (dirty_records.empty()) return 0;
 
   if (!take_write_lock()) did_lock = 1;
-
-  for (r = cache_list; r; r = r->next) {
-    if (r->flags.used && r->flags.dirty) {
-      int rc = write_cache_item(r);
-      if (rc) return rc;
-    }
-  }
-  cache_is_dirty = 0;
+  rc = write_dirty_records();
   if (did_lock) release_write_lock();
 
-  return 0;
+  return rc;
 }
 
 /********************************************************
@@ -573,6 +531,7 @@ static void open_db() {
   if (db_fd == -1)
     log_fatal(_("can't open '%s': %s\n"), db_name, strerror(errno));
   register_secured_file(db_name);
+  map_db();
 
   /* Read the version record. */
   if (tdbio_read_record(0, &rec, RECTYPE_VER))
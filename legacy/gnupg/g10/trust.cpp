@@ -257,6 +257,15 @@ void revalidation_mark(ctrl_t ctrl) {
 #endif
 }
 
+/* Like revalidation_mark, but only the primary key PK changed.  */
+void revalidation_mark_key(ctrl_t ctrl, PKT_public_key *pk) {
+#ifndef NO_TRUST_MODELS
+  tdb_revalidation_mark_key(ctrl, pk);
+#else
+  (void)pk;
+#endif
+}
+
 void check_trustdb_stale(ctrl_t ctrl) {
 #ifndef NO_TRUST_MODELS
   tdb_check_trustdb_stale(ctrl);
@@ -18,6 +18,8 @@
  * along with this program; if not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <unordered_map>
+
 #include <config.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -65,6 +67,25 @@ static struct key_item *utk_list;      /* all ultimately trusted keys */
 
 static int pending_check_trustdb;
 
+/* The NEXTCHECK value which tells that the only changes since the
+   last check are those recorded in REVALIDATION.  Any other process
+   will see a due check.  */
+#define NEXTCHECK_INCREMENTAL 2
+
+/* Keys changed since the last check.  If INCREMENTAL is set, these
+   are all the changes and the check may be limited to the keys which
+   are part of the web of trust and those changed keys.  NEXTCHECK is
+   the scheduled check from before the first change.  */
+static struct {
+  int incremental;
+  unsigned long nextcheck;
+  KeyHashTable keys;
+} revalidation;
+
+/* Map from the key ID of a signer to the key IDs of the keys it
+   certified.  */
+typedef std::unordered_multimap<uint64_t, uint64_t> SigneeIndex;
+
 static int validate_keys(ctrl_t ctrl, int interactive);
 
 /**********************************************
@@ -113,6 +134,10 @@ static void release_key_hash_table(KeyHashTable tbl) {
   xfree(tbl);
 }
 
+static uint64_t kid_to_u64(const u32 *kid) {
+  return ((uint64_t)kid[0] << 32) | kid[1];
+}
+
 /*
  * Returns: True if the keyID is in the given hash table
  */
@@ -467,6 +492,52 @@ void tdb_revalidation_mark(ctrl_t ctrl) {
      so that a --update-trustdb will be scheduled.  */
   if (tdbio_write_nextcheck(ctrl, 1)) do_sync();
   pending_check_trustdb = 1;
+  revalidation.incremental = 0;
+}
+
+/*
+ * Like tdb_revalidation_mark, but only the key PK (a primary key)
+ * changed.  If that is the only kind of change until the next check,
+ * the check only needs to revisit the keys which are part of the web
+ * of trust and the changed keys.
+ */
+void tdb_revalidation_mark_key(ctrl_t ctrl, PKT_public_key *pk) {
+  u32 kid[2];
+
+  init_trustdb(ctrl, 0);
+  if (trustdb_args.no_trustdb && opt.trust_model == TM_ALWAYS) return;
+
+  keyid_from_pk(pk, kid);
+
+  /* The checks done in this process are the only ones which know
+     about the changed keys.  Changes to the ultimately trusted keys
+     always need a full check.  */
+  if (opt.no_auto_check_trustdb ||
+      (opt.trust_model != TM_PGP && opt.trust_model != TM_CLASSIC) ||
+      tdb_keyid_is_utk(kid)) {
+    tdb_revalidation_mark(ctrl);
+    return;
+  }
+
+  if (!pending_check_trustdb) {
+    unsigned long scheduled = tdbio_read_nextcheck();
+
+    if (scheduled && scheduled <= make_timestamp()) {
+      tdb_revalidation_mark(ctrl);
+      return;
+    }
+    release_key_hash_table(revalidation.keys);
+    revalidation.keys = new_key_hash_table();
+    revalidation.nextcheck = scheduled;
+    revalidation.incremental = 1;
+  } else if (!revalidation.incremental) {
+    tdb_revalidation_mark(ctrl);
+    return;
+  }
+
+  add_key_hash_table(revalidation.keys, kid);
+  if (tdbio_write_nextcheck(ctrl, NEXTCHECK_INCREMENTAL)) do_sync();
+  pending_check_trustdb = 1;
 }
 
 int trustdb_pending_check(void) { return pending_check_trustdb; }
@@ -597,9 +668,15 @@ void tdb_update_ownertrust(ctrl_t ctrl, PKT_public_key *pk,
       log_debug("update ownertrust from %u to %u\n",
                 (unsigned int)rec.r.trust.ownertrust, new_trust);
     if (rec.r.trust.ownertrust != new_trust) {
+      int ultimate = ((rec.r.trust.ownertrust & TRUST_MASK) == TRUST_ULTIMATE ||
+                      (new_trust & TRUST_MASK) == TRUST_ULTIMATE);
+
       rec.r.trust.ownertrust = new_trust;
       write_record(ctrl, &rec);
-      tdb_revalidation_mark(ctrl);
+      if (ultimate)
+        tdb_revalidation_mark(ctrl);
+      else
+        tdb_revalidation_mark_key(ctrl, pk);
       do_sync();
     }
   } else if (err == GPG_ERR_NOT_FOUND) { /* no record yet - create a new one */
@@ -613,7 +690,10 @@ void tdb_update_ownertrust(ctrl_t ctrl, PKT_public_key *pk,
     fingerprint_from_pk(pk, rec.r.trust.fingerprint, &dummy);
     rec.r.trust.ownertrust = new_trust;
     write_record(ctrl, &rec);
-    tdb_revalidation_mark(ctrl);
+    if ((new_trust & TRUST_MASK) == TRUST_ULTIMATE)
+      tdb_revalidation_mark(ctrl);
+    else
+      tdb_revalidation_mark_key(ctrl, pk);
     do_sync();
   } else {
     tdbio_invalid();
@@ -1361,6 +1441,61 @@ static int search_skipfnc(void *opaque, u32 *kid, int dummy_uid_no) {
   return test_key_hash_table((KeyHashTable)opaque, kid);
 }
 
+/*
+ * Validate KEYBLOCK against KLIST and append it to the key_array
+ * KEYS if any of its user IDs is signed by a key in KLIST.  Takes
+ * ownership of KEYBLOCK.
+ */
+static void validate_key_list_item(ctrl_t ctrl, kbnode_t keyblock,
+                                   KeyHashTable full_trust,
+                                   struct key_item *klist, u32 curtime,
+                                   u32 *next_expire, struct key_array **keys,
+                                   size_t *nkeys, size_t *maxkeys) {
+  PKT_public_key *pk;
+
+  if (keyblock->pkt->pkttype != PKT_PUBLIC_KEY) {
+    log_debug("ooops: invalid pkttype %d encountered\n",
+              keyblock->pkt->pkttype);
+    dump_kbnode(keyblock);
+    release_kbnode(keyblock);
+    return;
+  }
+
+  /* prepare the keyblock for further processing */
+  merge_keys_and_selfsig(ctrl, keyblock);
+  clear_kbnode_flags(keyblock);
+  pk = keyblock->pkt->pkt.public_key;
+  if (pk->has_expired || pk->flags.revoked) {
+    /* it does not make sense to look further at those keys */
+    mark_keyblock_seen(full_trust, keyblock);
+  } else if (validate_one_keyblock(ctrl, keyblock, klist, curtime,
+                                   next_expire)) {
+    KBNODE node;
+
+    if (pk->expiredate && pk->expiredate >= curtime &&
+        pk->expiredate < *next_expire)
+      *next_expire = pk->expiredate;
+
+    if (*nkeys == *maxkeys) {
+      *maxkeys += 1000;
+      *keys = (key_array *)xrealloc(*keys, (*maxkeys + 1) * sizeof **keys);
+    }
+    (*keys)[(*nkeys)++].keyblock = keyblock;
+
+    /* Optimization - if all uids are fully trusted, then we
+       never need to consider this key as a candidate again. */
+
+    for (node = keyblock; node; node = node->next)
+      if (node->pkt->pkttype == PKT_USER_ID && !(node->flag & 4)) break;
+
+    if (node == NULL) mark_keyblock_seen(full_trust, keyblock);
+
+    keyblock = NULL;
+  }
+
+  release_kbnode(keyblock);
+}
+
 /*
  * Scan all keys and return a key_array of all suitable keys from
  * kllist.  The caller has to pass keydb handle so that we don't use
@@ -1405,63 +1540,129 @@ static struct key_array *validate_key_list(ctrl_t ctrl, KEYDB_HANDLE hd,
 
   desc.mode = KEYDB_SEARCH_MODE_NEXT; /* change mode */
   do {
-    PKT_public_key *pk;
-
     rc = keydb_get_keyblock(hd, &keyblock);
     if (rc) {
       log_error("keydb_get_keyblock failed: %s\n", gpg_strerror(rc));
       goto die;
     }
 
-    if (keyblock->pkt->pkttype != PKT_PUBLIC_KEY) {
-      log_debug("ooops: invalid pkttype %d encountered\n",
-                keyblock->pkt->pkttype);
-      dump_kbnode(keyblock);
-      release_kbnode(keyblock);
-      continue;
-    }
+    validate_key_list_item(ctrl, keyblock, full_trust, klist, curtime,
+                           next_expire, &keys, &nkeys, &maxkeys);
+    keyblock = NULL;
+  } while (!(rc = keydb_search(hd, &desc, 1, NULL)));
 
-    /* prepare the keyblock for further processing */
-    merge_keys_and_selfsig(ctrl, keyblock);
-    clear_kbnode_flags(keyblock);
-    pk = keyblock->pkt->pkt.public_key;
-    if (pk->has_expired || pk->flags.revoked) {
-      /* it does not make sense to look further at those keys */
-      mark_keyblock_seen(full_trust, keyblock);
-    } else if (validate_one_keyblock(ctrl, keyblock, klist, curtime,
-                                     next_expire)) {
-      KBNODE node;
-
-      if (pk->expiredate && pk->expiredate >= curtime &&
-          pk->expiredate < *next_expire)
-        *next_expire = pk->expiredate;
-
-      if (nkeys == maxkeys) {
-        maxkeys += 1000;
-        keys = (key_array *)xrealloc(keys, (maxkeys + 1) * sizeof *keys);
-      }
-      keys[nkeys++].keyblock = keyblock;
+  if (rc && rc != GPG_ERR_NOT_FOUND) {
+    log_error("keydb_search_next failed: %s\n", gpg_strerror(rc));
+    goto die;
+  }
+
+  keys[nkeys].keyblock = NULL;
+  return keys;
 
-      /* Optimization - if all uids are fully trusted, then we
-         never need to consider this key as a candidate again. */
+die:
+  keys[nkeys].keyblock = NULL;
+  release_key_array(keys);
+  return NULL;
+}
 
-      for (node = keyblock; node; node = node->next)
-        if (node->pkt->pkttype == PKT_USER_ID && !(node->flag & 4)) break;
+/*
+ * Read the keyblock of the primary key KID into R_KEYBLOCK.
+ */
+static gpg_error_t get_keyblock_by_kid(KEYDB_HANDLE hd, u32 *kid,
+                                       kbnode_t *r_keyblock) {
+  KEYDB_SEARCH_DESC desc;
+  kbnode_t keyblock;
+  gpg_error_t rc;
 
-      if (node == NULL) mark_keyblock_seen(full_trust, keyblock);
+  rc = keydb_search_reset(hd);
+  if (rc) {
+    log_error("keydb_search_reset failed: %s\n", gpg_strerror(rc));
+    return rc;
+  }
+
+  memset(&desc, 0, sizeof desc);
+  desc.mode = KEYDB_SEARCH_MODE_LONG_KID;
+  desc.u.kid[0] = kid[0];
+  desc.u.kid[1] = kid[1];
+  while (!(rc = keydb_search(hd, &desc, 1, NULL))) {
+    u32 main_kid[2];
 
-      keyblock = NULL;
+    rc = keydb_get_keyblock(hd, &keyblock);
+    if (rc) {
+      log_error("keydb_get_keyblock failed: %s\n", gpg_strerror(rc));
+      return rc;
     }
 
+    /* The key ID may also be the one of a subkey.  */
+    if (keyblock->pkt->pkttype == PKT_PUBLIC_KEY) {
+      keyid_from_pk(keyblock->pkt->pkt.public_key, main_kid);
+      if (main_kid[0] == kid[0] && main_kid[1] == kid[1]) {
+        *r_keyblock = keyblock;
+        return 0;
+      }
+    }
     release_kbnode(keyblock);
-    keyblock = NULL;
-  } while (!(rc = keydb_search(hd, &desc, 1, NULL)));
-
-  if (rc && rc != GPG_ERR_NOT_FOUND) {
-    log_error("keydb_search_next failed: %s\n", gpg_strerror(rc));
-    goto die;
   }
 
+  if (rc != GPG_ERR_NOT_FOUND)
+    log_error("keydb_search failed: %s\n", gpg_strerror(rc));
+  return rc;
+}
+
+/* Return true if KEYBLOCK carries a trust signature.  */
+static int has_trust_sigs(kbnode_t keyblock) {
+  for (; keyblock; keyblock = keyblock->next)
+    if (keyblock->pkt->pkttype == PKT_SIGNATURE &&
+        (keyblock->pkt->pkt.signature->trust_depth ||
+         keyblock->pkt->pkt.signature->trust_regexp))
+      return 1;
+  return 0;
+}
+
+/*
+ * Like validate_key_list, but only the keys in CANDIDATES are
+ * considered.  If a key is encountered for which this is not
+ * sufficient, NULL is returned and R_FULL is set.
+ */
+static struct key_array *validate_candidate_list(
+    ctrl_t ctrl, KEYDB_HANDLE hd, KeyHashTable full_trust,
+    KeyHashTable candidates, struct key_item *klist, u32 curtime,
+    u32 *next_expire, int *r_full) {
+  struct key_array *keys;
+  struct key_item *k;
+  size_t nkeys, maxkeys;
+  int i;
+
+  maxkeys = 1000;
+  keys = (key_array *)xmalloc((maxkeys + 1) * sizeof *keys);
+  nkeys = 0;
+
+  for (i = 0; i < KEY_HASH_TABLE_SIZE; i++)
+    for (k = candidates[i]; k; k = k->next) {
+      kbnode_t keyblock;
+      gpg_error_t rc;
+
+      if (test_key_hash_table(full_trust, k->kid)) continue;
+
+      rc = get_keyblock_by_kid(hd, k->kid, &keyblock);
+      if (rc == GPG_ERR_NOT_FOUND) continue; /* deleted meanwhile */
+      if (rc) goto die;
+
+      /* Trust signatures may change which signatures count for keys
+         outside of the candidates.  */
+      if (opt.trust_model == TM_PGP && has_trust_sigs(keyblock)) {
+        if (DBG_TRUST)
+          log_debug("key %s: trust signature found, need a full check\n",
+                    keystr(k->kid));
+        release_kbnode(keyblock);
+        *r_full = 1;
+        goto die;
+      }
+
+      validate_key_list_item(ctrl, keyblock, full_trust, klist, curtime,
+                             next_expire, &keys, &nkeys, &maxkeys);
+    }
+
   keys[nkeys].keyblock = NULL;
   return keys;
 
@@ -1471,6 +1672,115 @@ die:
   return NULL;
 }
 
+/*
+ * Fill INDEX with the certifications on the user IDs of all keys.
+ */
+static gpg_error_t build_signee_index(KEYDB_HANDLE hd, SigneeIndex &index) {
+  KEYDB_SEARCH_DESC desc;
+  kbnode_t keyblock, node;
+  gpg_error_t rc;
+
+  rc = keydb_search_reset(hd);
+  if (rc) {
+    log_error("keydb_search_reset failed: %s\n", gpg_strerror(rc));
+    return rc;
+  }
+
+  memset(&desc, 0, sizeof desc);
+  desc.mode = KEYDB_SEARCH_MODE_FIRST;
+  while (!(rc = keydb_search(hd, &desc, 1, NULL))) {
+    desc.mode = KEYDB_SEARCH_MODE_NEXT;
+
+    rc = keydb_get_keyblock(hd, &keyblock);
+    if (rc) {
+      log_error("keydb_get_keyblock failed: %s\n", gpg_strerror(rc));
+      return rc;
+    }
+
+    if (keyblock->pkt->pkttype == PKT_PUBLIC_KEY) {
+      u32 kid[2];
+
+      keyid_from_pk(keyblock->pkt->pkt.public_key, kid);
+      for (node = keyblock; node; node = node->next) {
+        PKT_signature *sig;
+
+        if (node->pkt->pkttype != PKT_SIGNATURE) continue;
+        sig = node->pkt->pkt.signature;
+        if (IS_UID_SIG(sig) &&
+            (sig->keyid[0] != kid[0] || sig->keyid[1] != kid[1]))
+          index.emplace(kid_to_u64(sig->keyid), kid_to_u64(kid));
+      }
+    }
+    release_kbnode(keyblock);
+  }
+
+  if (rc != GPG_ERR_NOT_FOUND) {
+    log_error("keydb_search failed: %s\n", gpg_strerror(rc));
+    return rc;
+  }
+  return 0;
+}
+
+/* Add all keys certified by KID according to INDEX to CANDIDATES.  */
+static void add_signees(const SigneeIndex &index, u32 *kid,
+                        KeyHashTable candidates) {
+  auto range = index.equal_range(kid_to_u64(kid));
+
+  for (auto it = range.first; it != range.second; ++it) {
+    u32 signee[2];
+
+    signee[0] = (u32)(it->second >> 32);
+    signee[1] = (u32)it->second;
+    add_key_hash_table(candidates, signee);
+  }
+}
+
+/*
+ * Add all keys which have a validity in the trustdb to CANDIDATES and
+ * those which have certainly been used to validate other keys to
+ * INTRODUCERS.  The keys in CHANGED are never introducers: a changed
+ * ownertrust may make a key an introducer for the first time, so the
+ * keys it certified need to become candidates.  This must be called
+ * before reset_trust_records.
+ */
+static void collect_valid_keys(ctrl_t ctrl, KeyHashTable changed,
+                               KeyHashTable candidates,
+                               KeyHashTable introducers) {
+  TRUSTREC rec, vrec;
+  unsigned long recnum, vrecnum;
+
+  for (recnum = 1; !tdbio_read_record(recnum, &rec, 0); recnum++) {
+    int any = 0, full = 0;
+    byte *fpr = rec.r.trust.fingerprint;
+    int fprlen;
+    u32 kid[2];
+
+    if (rec.rectype != RECTYPE_TRUST) continue;
+
+    for (vrecnum = rec.r.trust.validlist; vrecnum;
+         vrecnum = vrec.r.valid.next) {
+      read_record(vrecnum, &vrec, RECTYPE_VALID);
+      if ((vrec.r.valid.validity & TRUST_MASK) ||
+          vrec.r.valid.marginal_count || vrec.r.valid.full_count)
+        any = 1;
+      if ((vrec.r.valid.validity & TRUST_MASK) >= TRUST_FULLY) full = 1;
+    }
+    if (!any) continue;
+
+    /* See verify_own_keys.  */
+    fprlen = (!fpr[16] && !fpr[17] && !fpr[18] && !fpr[19]) ? 16 : 20;
+    keyid_from_fingerprint(ctrl, fpr, fprlen, kid);
+    add_key_hash_table(candidates, kid);
+
+    /* The depth is the last one at which the key was signed.  A key
+       which was fully valid before the last depth has been put into
+       the list of keys used for the next depth.  */
+    if (full && rec.r.trust.depth + 1 < opt.max_cert_depth &&
+        !test_key_hash_table(changed, kid))
+      add_key_hash_table(introducers, kid);
+  }
+}
+
 /* Caller must sync */
 static void reset_trust_records(ctrl_t ctrl) {
   TRUSTREC rec;
@@ -1526,8 +1836,16 @@ static void reset_trust_records(ctrl_t ctrl) {
  *           End Loop
  *         Ready
  *
+ * If CHANGED is not NULL, only the keys which had a validity before,
+ * the keys in CHANGED and the keys certified by new members of klist
+ * are looked at in step 4; all other keys can't become valid.  If
+ * that is not sufficient, R_FULL is set and an error returned.
  */
-static int validate_keys(ctrl_t ctrl, int interactive) {
+static int do_validate_keys(ctrl_t ctrl, int interactive, KeyHashTable changed,
+                            int *r_full) {
+  SigneeIndex signees;
+  int have_signees = 0;
+  KeyHashTable candidates = NULL, introducers = NULL;
   int rc = 0;
   int quit = 0;
   struct key_item *klist = NULL;
@@ -1550,6 +1868,18 @@ static int validate_keys(ctrl_t ctrl, int interactive) {
   used = new_key_hash_table();
   full_trust = new_key_hash_table();
 
+  if (changed) {
+    int i;
+
+    if (DBG_TRUST) log_debug("checking the changed keys only\n");
+    candidates = new_key_hash_table();
+    introducers = new_key_hash_table();
+    for (i = 0; i < KEY_HASH_TABLE_SIZE; i++)
+      for (k = changed[i]; k; k = k->next)
+        add_key_hash_table(candidates, k->kid);
+    collect_valid_keys(ctrl, changed, candidates, introducers);
+  }
+
   reset_trust_records(ctrl);
 
   /* Fixme: Instead of always building a UTK list, we could just build it
@@ -1653,10 +1983,14 @@ static int validate_keys(ctrl_t ctrl, int interactive) {
     }
 
     /* Find all keys which are signed by a key in kdlist */
-    keys = validate_key_list(ctrl, kdb, full_trust, klist, start_time,
-                             &next_expire);
+    if (candidates)
+      keys = validate_candidate_list(ctrl, kdb, full_trust, candidates, klist,
+                                     start_time, &next_expire, r_full);
+    else
+      keys = validate_key_list(ctrl, kdb, full_trust, klist, start_time,
+                               &next_expire);
     if (!keys) {
-      log_error("validate_key_list failed\n");
+      if (!*r_full) log_error("validate_key_list failed\n");
       rc = GPG_ERR_GENERAL;
       goto leave;
     }
@@ -1716,12 +2050,30 @@ static int validate_keys(ctrl_t ctrl, int interactive) {
     release_key_array(keys);
     keys = NULL;
     if (!klist) break; /* no need to dive in deeper */
+
+    /* Keys which were not used before may validate keys which had no
+       validity so far.  */
+    if (candidates && depth + 1 < opt.max_cert_depth)
+      for (k = klist; k; k = k->next) {
+        if (test_key_hash_table(introducers, k->kid)) continue;
+        if (!have_signees) {
+          rc = build_signee_index(kdb, signees);
+          if (rc) {
+            *r_full = 1;
+            goto leave;
+          }
+          have_signees = 1;
+        }
+        add_signees(signees, k->kid, candidates);
+      }
   }
 
 leave:
   keydb_release(kdb);
   release_key_array(keys);
   if (klist != utk_list) release_key_items(klist);
+  release_key_hash_table(introducers);
+  release_key_hash_table(candidates);
   release_key_hash_table(full_trust);
   release_key_hash_table(used);
   release_key_hash_table(stored);
@@ -1729,6 +2081,11 @@ leave:
   {
     int rc2;
 
+    /* The keys which were not looked at may expire before.  */
+    if (changed && revalidation.nextcheck &&
+        revalidation.nextcheck < next_expire)
+      next_expire = revalidation.nextcheck;
+
     if (next_expire == 0xffffffff || next_expire < start_time)
       tdbio_write_nextcheck(ctrl, 0);
     else {
@@ -1748,7 +2105,27 @@ leave:
 
     do_sync();
     pending_check_trustdb = 0;
+    revalidation.incremental = 0;
+    release_key_hash_table(revalidation.keys);
+    revalidation.keys = NULL;
   }
 
   return rc;
 }
+
+static int validate_keys(ctrl_t ctrl, int interactive) {
+  int full = 0;
+
+  /* Another process may have changed the trustdb meanwhile, and a
+     scheduled check may have become due.  */
+  if (!interactive && revalidation.incremental &&
+      tdbio_read_nextcheck() == NEXTCHECK_INCREMENTAL &&
+      (!revalidation.nextcheck ||
+       revalidation.nextcheck > make_timestamp())) {
+    int rc = do_validate_keys(ctrl, 0, revalidation.keys, &full);
+
+    if (!full) return rc;
+  }
+
+  return do_validate_keys(ctrl, interactive, NULL, &full);
+}
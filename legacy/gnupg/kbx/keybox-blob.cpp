@@ -201,6 +201,10 @@ struct keyboxblob {
   size_t bloblen;
   off_t fileoffset;
 
+  /* True if BLOB points into a mapped keybox file and is not owned by
+     this object, see _keybox_set_blob_view.  */
+  int is_view;
+
   /* stuff used only by keybox_create_blob */
   unsigned char *serialbuf;
   const unsigned char *serial;
@@ -835,9 +839,58 @@ int _keybox_new_blob(KEYBOXBLOB *r_blob, unsigned char *image, size_t imagelen,
   return 0;
 }
 
+/* Make *R_BLOB a view of the image {IMAGE,IMAGELEN} at file offset
+   OFF, without copying it.  An existing view at *R_BLOB is reused.
+   Views are not released by _keybox_release_blob, but must be freed
+   with _keybox_release_blob_view by their owner.  */
+int _keybox_set_blob_view(KEYBOXBLOB *r_blob, const unsigned char *image,
+                          size_t imagelen, off_t off) {
+  KEYBOXBLOB blob = *r_blob;
+
+  if (!blob) {
+    blob = (KEYBOXBLOB)xtrycalloc(1, sizeof *blob);
+    if (!blob) return gpg_error_from_syserror();
+    blob->is_view = 1;
+    *r_blob = blob;
+  }
+  assert(blob->is_view);
+
+  blob->blob = (byte *)image;
+  blob->bloblen = imagelen;
+  blob->fileoffset = off;
+  return 0;
+}
+
+void _keybox_release_blob_view(KEYBOXBLOB blob) {
+  if (blob) {
+    assert(blob->is_view);
+    xfree(blob);
+  }
+}
+
+/* Replace the view at *R_BLOB by a copy which does not depend on the
+   mapping.  Other blobs are left alone.  */
+int _keybox_copy_blob(KEYBOXBLOB *r_blob) {
+  KEYBOXBLOB view = *r_blob;
+  unsigned char *image;
+  int rc;
+
+  if (!view || !view->is_view) return 0;
+
+  image = (unsigned char *)xtrymalloc(view->bloblen);
+  if (!image) return gpg_error_from_syserror();
+  memcpy(image, view->blob, view->bloblen);
+  rc = _keybox_new_blob(r_blob, image, view->bloblen, view->fileoffset);
+  if (rc) {
+    xfree(image);
+    *r_blob = view;
+  }
+  return rc;
+}
+
 void _keybox_release_blob(KEYBOXBLOB blob) {
   int i;
-  if (!blob) return;
+  if (!blob || blob->is_view) return;
   if (blob->buf) {
     size_t len;
     xfree(get_membuf(blob->buf, &len));
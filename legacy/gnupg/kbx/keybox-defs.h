@@ -62,6 +62,12 @@ struct keybox_name {
   /* Not yet used.  */
   int did_full_scan;
 
+  /* The search index or NULL if not yet loaded.  */
+  struct keybox_index *index;
+
+  /* The pending changes of a batch (see keybox_batch_begin) or NULL.  */
+  struct keybox_batch *batch;
+
   /* The name of the resource file. */
   char fname[1];
 };
@@ -80,6 +86,12 @@ struct keybox_handle {
   int error;
   int ephemeral;
   int for_openpgp; /* Used by gpg.  */
+  /* The file at FP mapped into memory or NULL.  If mapped, blobs are
+     read from MAP_POS and the file position of FP is not used.  */
+  const unsigned char *map;
+  size_t map_size;
+  off_t map_pos;
+  KEYBOXBLOB map_blob; /* Reused view into the mapping.  */
   struct keybox_found_s found;
   struct keybox_found_s saved_found;
   struct {
@@ -140,6 +152,10 @@ int _keybox_create_x509_blob(KEYBOXBLOB *r_blob, ksba_cert_t cert,
 
 int _keybox_new_blob(KEYBOXBLOB *r_blob, unsigned char *image, size_t imagelen,
                      off_t off);
+int _keybox_set_blob_view(KEYBOXBLOB *r_blob, const unsigned char *image,
+                          size_t imagelen, off_t off);
+void _keybox_release_blob_view(KEYBOXBLOB blob);
+int _keybox_copy_blob(KEYBOXBLOB *r_blob);
 void _keybox_release_blob(KEYBOXBLOB blob);
 const unsigned char *_keybox_get_blob_image(KEYBOXBLOB blob, size_t *n);
 off_t _keybox_get_blob_fileoffset(KEYBOXBLOB blob);
@@ -153,11 +169,20 @@ void _keybox_destroy_openpgp_info(keybox_openpgp_info_t info);
 /*-- keybox-file.c --*/
 int _keybox_read_blob(KEYBOXBLOB *r_blob, FILE *fp, int *skipped_deleted);
 int _keybox_write_blob(KEYBOXBLOB blob, FILE *fp);
+void _keybox_map_file(KEYBOX_HANDLE hd);
+void _keybox_unmap_file(KEYBOX_HANDLE hd);
+off_t _keybox_tell(KEYBOX_HANDLE hd);
+gpg_error_t _keybox_seek(KEYBOX_HANDLE hd, off_t off);
+int _keybox_next_blob(KEYBOXBLOB *r_blob, KEYBOX_HANDLE hd);
 
 /*-- keybox-search.c --*/
 gpg_error_t _keybox_get_flag_location(const unsigned char *buffer,
                                       size_t length, int what, size_t *flag_off,
                                       size_t *flag_size);
+int _keybox_get_mailbox(const unsigned char *buffer, size_t *r_off,
+                        size_t *r_len, int x509);
+int _keybox_x509_get_keygrip(const unsigned char *buffer, size_t length,
+                             unsigned char *array);
 
 static inline int blob_get_type(KEYBOXBLOB blob) {
   const unsigned char *buffer;
@@ -169,6 +194,22 @@ static inline int blob_get_type(KEYBOXBLOB blob) {
   return buffer[4];
 }
 
+/*-- keybox-index.c --*/
+int _keybox_index_usable(KEYBOX_HANDLE hd, KEYBOX_SEARCH_DESC *desc,
+                         size_t ndesc);
+gpg_error_t _keybox_index_seek(KEYBOX_HANDLE hd, KEYBOX_SEARCH_DESC *desc,
+                               size_t ndesc);
+void _keybox_index_begin(KB_NAME kb);
+void _keybox_index_update(KB_NAME kb, off_t off, size_t oldlen,
+                          KEYBOXBLOB blob);
+void _keybox_index_delete(KB_NAME kb, off_t off);
+void _keybox_index_touch(KB_NAME kb);
+void _keybox_index_invalidate(KB_NAME kb);
+void _keybox_index_flush(KB_NAME kb);
+
+/*-- keybox-update.c --*/
+int _keybox_batch_deleted(KB_NAME kb, off_t off);
+
 /*-- keybox-dump.c --*/
 int _keybox_dump_blob(KEYBOXBLOB blob, FILE *fp);
 int _keybox_dump_file(const char *filename, int stats_only, FILE *outfp);
@@ -22,8 +22,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <time.h>
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#endif
 
+#include "../common/host2net.h"
 #include "keybox-defs.h"
 
 #define IMAGELEN_LIMIT (5 * 1024 * 1024)
@@ -94,6 +99,118 @@ again:
   return rc;
 }
 
+/* Map the file opened at HD->FP into memory, so that the search can
+   look at the blobs without copying them.  If this is not possible
+   the file is read with stdio.  The keybox is only ever replaced by
+   renaming, modified in place without changing its size, or appended
+   to, so the mapping stays valid.  */
+void _keybox_map_file(KEYBOX_HANDLE hd) {
+#ifdef HAVE_MMAP
+  struct stat st;
+  void *map;
+  off_t pos;
+
+  _keybox_unmap_file(hd);
+  if (fstat(fileno(hd->fp), &st) || !S_ISREG(st.st_mode) || !st.st_size)
+    return;
+  pos = ftello(hd->fp);
+  if (pos == (off_t)-1) return;
+
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fileno(hd->fp), 0);
+  if (map == MAP_FAILED) return;
+  hd->map = (const unsigned char *)map;
+  hd->map_size = st.st_size;
+  hd->map_pos = pos;
+#endif
+}
+
+/* Release the mapping of HD.  This invalidates all views.  */
+void _keybox_unmap_file(KEYBOX_HANDLE hd) {
+  _keybox_release_blob_view(hd->map_blob);
+  hd->map_blob = NULL;
+#ifdef HAVE_MMAP
+  if (hd->map) munmap((void *)hd->map, hd->map_size);
+#endif
+  hd->map = NULL;
+  hd->map_size = 0;
+  hd->map_pos = 0;
+}
+
+/* Return the current read position of HD.  */
+off_t _keybox_tell(KEYBOX_HANDLE hd) {
+  if (hd->map) return hd->map_pos;
+  return ftello(hd->fp);
+}
+
+/* Set the read position of HD to OFF.  */
+gpg_error_t _keybox_seek(KEYBOX_HANDLE hd, off_t off) {
+  if (hd->map) {
+    hd->map_pos = off;
+    return 0;
+  }
+  if (fseeko(hd->fp, off, SEEK_SET)) return gpg_error_from_syserror();
+  return 0;
+}
+
+/* Read the next blob of HD like _keybox_read_blob.  If the file is
+   mapped, R_BLOB is set to a view into the mapping, which is only
+   valid until the next call or until the file is closed.  Use
+   _keybox_copy_blob to keep it.  */
+int _keybox_next_blob(KEYBOXBLOB *r_blob, KEYBOX_HANDLE hd) {
+  const unsigned char *p;
+  size_t avail, imagelen;
+  int rc;
+
+  if (!hd->map) return _keybox_read_blob(r_blob, hd->fp, NULL);
+
+  *r_blob = NULL;
+  for (;;) {
+    if (hd->map_pos >= hd->map_size) {
+      /* The keybox might have grown since it was mapped.  */
+      struct stat st;
+      off_t pos = hd->map_pos;
+
+      if (fstat(fileno(hd->fp), &st) || st.st_size <= (off_t)hd->map_size)
+        return -1; /* eof */
+      _keybox_map_file(hd);
+      if (!hd->map) {
+        if (fseeko(hd->fp, pos, SEEK_SET)) return gpg_error_from_syserror();
+        return _keybox_read_blob(r_blob, hd->fp, NULL);
+      }
+      hd->map_pos = pos;
+      if (hd->map_pos >= hd->map_size) return -1; /* eof */
+    }
+
+    avail = hd->map_size - hd->map_pos;
+    p = hd->map + hd->map_pos;
+    if (avail < 5) return GPG_ERR_TOO_SHORT;
+
+    imagelen = buf32_to_size_t(p);
+    if (imagelen < 5) return GPG_ERR_TOO_SHORT;
+
+    if (!p[4]) {
+      /* Special treatment for empty blobs. */
+      hd->map_pos += imagelen;
+      continue;
+    }
+
+    if (imagelen > IMAGELEN_LIMIT) /* Sanity check. */
+    {
+      /* Skip it so that the caller may choose to ignore this
+         record.  */
+      hd->map_pos += imagelen;
+      return GPG_ERR_TOO_LARGE;
+    }
+    if (imagelen > avail) return GPG_ERR_TOO_SHORT;
+
+    rc = _keybox_set_blob_view(&hd->map_blob, p, imagelen, hd->map_pos);
+    if (rc) return rc;
+    hd->map_pos += imagelen;
+    *r_blob = hd->map_blob;
+    return 0;
+  }
+}
+
 /* Write the block to the current file position */
 int _keybox_write_blob(KEYBOXBLOB blob, FILE *fp) {
   const unsigned char *image;
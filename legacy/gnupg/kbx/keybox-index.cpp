@@ -0,0 +1,760 @@
+/* keybox-index.c - Sidecar index for keybox files
+ * Copyright (C) 2017 The NeoPG developers
+ *
+ * This file is part of GnuPG.
+ *
+ * GnuPG is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GnuPG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+* The keybox index
+
+   The index maps the exact search keys of all blobs in a keybox to
+   their file offsets, so that a search for a fingerprint, key ID,
+   keygrip or mail address does not need to read the whole keybox.
+   It is kept in memory for each resource and stored next to the
+   keybox in a file with the suffix ".idx".  All integers are stored
+   in network byte order.
+
+   - b4   Magic 'KBXi'
+   - byte Version number (1)
+   - b3   RFU
+   - u32  file_created_at of the keybox header blob
+   - u32  Nanoseconds of the modification time of the keybox
+   - u64  Size of the keybox
+   - u64  Modification time of the keybox
+   - u64  Inode number of the keybox
+
+   The header is followed by a log of changes:
+
+   - 'A' u64 offset, byte key type, u32 key length, key
+         Add a key for the blob at offset.
+   - 'D' u64 offset
+         Remove all keys of the blob at offset.
+   - 'S' u64 offset, u64 delta
+         Move all blobs after offset by delta (two's complement).
+
+   The index is only used if the header describes the current keybox,
+   otherwise it is rebuilt by a full scan.  The keybox is always
+   updated before the index, so a crash in between invalidates the
+   index instead of corrupting it.  The index may contain keys of
+   blobs which have been deleted in place, because every candidate is
+   checked against the actual blob by the search.
+*/
+
+#include <config.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../common/host2net.h"
+#include "../common/sysutils.h"
+#include "keybox-defs.h"
+
+#define INDEX_MAGIC "KBXi"
+#define INDEX_VERSION 1
+#define INDEX_HEADER_LEN 40
+#define INDEX_SUFFIX ".idx"
+
+/* Record types of the change log.  */
+#define INDEX_REC_ADD 'A'
+#define INDEX_REC_DELETE 'D'
+#define INDEX_REC_SHIFT 'S'
+
+/* Key types.  */
+#define INDEX_KEY_FPR 1
+#define INDEX_KEY_LONG_KID 2
+#define INDEX_KEY_SHORT_KID 3
+#define INDEX_KEY_GRIP 4
+#define INDEX_KEY_MAIL 5
+
+#define get32(a) buf32_to_ulong((a))
+#define get16(a) buf16_to_ulong((a))
+
+/* Identifies a version of the keybox file.  */
+struct keybox_stamp {
+  u32 created_at;
+  u32 mtime_nsec;
+  uint64_t size;
+  uint64_t mtime;
+  uint64_t ino;
+};
+
+struct keybox_index {
+  /* The version of the keybox described by the index.  */
+  struct keybox_stamp stamp;
+
+  /* All search keys (type octet followed by the key) with the offset
+     of their blob, and the keys of each blob.  */
+  std::unordered_multimap<std::string, off_t> keys;
+  std::map<off_t, std::vector<std::string>> blobs;
+
+  /* The number of records in the index file, to decide when it
+     should be rewritten.  */
+  unsigned long nrecords;
+
+  /* Records of a batch of changes which are not yet in the index
+     file.  */
+  std::string pending;
+};
+
+static int same_keybox(const struct keybox_stamp *a,
+                       const struct keybox_stamp *b) {
+  return a->size == b->size && a->mtime == b->mtime &&
+         a->mtime_nsec == b->mtime_nsec && a->ino == b->ino;
+}
+
+static int stamp_from_fd(int fd, struct keybox_stamp *stamp) {
+  struct stat st;
+
+  if (fstat(fd, &st)) return gpg_error_from_syserror();
+  stamp->size = st.st_size;
+  stamp->mtime = st.st_mtim.tv_sec;
+  stamp->mtime_nsec = st.st_mtim.tv_nsec;
+  stamp->ino = st.st_ino;
+  return 0;
+}
+
+/* Fill in the created_at field from the header blob of FP, which is
+   positioned at the start of the keybox.  */
+static int stamp_created_at(FILE *fp, struct keybox_stamp *stamp) {
+  unsigned char image[32];
+
+  stamp->created_at = 0;
+  if (fread(image, sizeof image, 1, fp) != 1)
+    return ferror(fp) ? gpg_error_from_syserror() : 0;
+  if (image[4] == KEYBOX_BLOBTYPE_HEADER && !memcmp(image + 8, "KBXf", 4))
+    stamp->created_at = buf32_to_u32(image + 16);
+  return 0;
+}
+
+static std::string index_fname(KB_NAME kb) {
+  return std::string(kb->fname) + INDEX_SUFFIX;
+}
+
+static void put64(unsigned char *p, uint64_t val) {
+  int i;
+
+  for (i = 7; i >= 0; i--, val >>= 8) p[i] = val;
+}
+
+static uint64_t get64(const unsigned char *p) {
+  return ((uint64_t)buf32_to_u32(p) << 32) | buf32_to_u32(p + 4);
+}
+
+static void put32(unsigned char *p, u32 val) {
+  p[0] = val >> 24;
+  p[1] = val >> 16;
+  p[2] = val >> 8;
+  p[3] = val;
+}
+
+static std::string make_key(int type, const void *key, size_t keylen) {
+  std::string result(1, (char)type);
+
+  result.append((const char *)key, keylen);
+  return result;
+}
+
+/* Return the search keys of the blob {BUFFER,LENGTH}.  This must
+   cover everything the exact search modes compare with.  */
+static std::vector<std::string> blob_keys(const unsigned char *buffer,
+                                          size_t length) {
+  std::vector<std::string> keys;
+  size_t pos, off, len;
+  size_t nkeys, keyinfolen;
+  size_t nuids, uidinfolen;
+  size_t nserial;
+  size_t idx;
+  int x509;
+
+  if (length < 40) return keys;
+  if (buffer[4] != KEYBOX_BLOBTYPE_PGP && buffer[4] != KEYBOX_BLOBTYPE_X509)
+    return keys;
+  x509 = buffer[4] == KEYBOX_BLOBTYPE_X509;
+
+  /*keys*/
+  nkeys = get16(buffer + 16);
+  keyinfolen = get16(buffer + 18);
+  if (keyinfolen < 28) return keys; /* invalid blob */
+  pos = 20;
+  if (pos + keyinfolen * nkeys > length) return keys; /* out of bounds */
+
+  for (idx = 0; idx < nkeys; idx++) {
+    off = pos + idx * keyinfolen;
+    keys.push_back(make_key(INDEX_KEY_FPR, buffer + off, 20));
+    keys.push_back(make_key(INDEX_KEY_LONG_KID, buffer + off + 12, 8));
+    keys.push_back(make_key(INDEX_KEY_SHORT_KID, buffer + off + 16, 4));
+  }
+
+  if (x509) {
+    unsigned char grip[20];
+
+    if (_keybox_x509_get_keygrip(buffer, length, grip))
+      keys.push_back(make_key(INDEX_KEY_GRIP, grip, 20));
+  }
+
+  pos += keyinfolen * nkeys;
+  if (pos + 2 > length) return keys; /* out of bounds */
+
+  /*serial*/
+  nserial = get16(buffer + pos);
+  pos += 2 + nserial;
+  if (pos + 4 > length) return keys; /* out of bounds */
+
+  /* user ids*/
+  nuids = get16(buffer + pos);
+  pos += 2;
+  uidinfolen = get16(buffer + pos);
+  pos += 2;
+  if (uidinfolen < 12) return keys;                   /* invalid blob */
+  if (pos + uidinfolen * nuids > length) return keys; /* out of bounds */
+
+  for (idx = !!x509; idx < nuids; idx++) {
+    std::string mail;
+
+    off = get32(buffer + pos + idx * uidinfolen);
+    len = get32(buffer + pos + idx * uidinfolen + 4);
+    if (off + len > length) break;
+    if (!_keybox_get_mailbox(buffer, &off, &len, x509)) continue;
+
+    for (; len; len--, off++) mail += (char)ascii_tolower(buffer[off]);
+    keys.push_back(make_key(INDEX_KEY_MAIL, mail.data(), mail.size()));
+  }
+
+  return keys;
+}
+
+static void index_add(struct keybox_index *index, off_t off,
+                      const std::string &key) {
+  index->keys.emplace(key, off);
+  index->blobs[off].push_back(key);
+}
+
+static void index_delete(struct keybox_index *index, off_t off) {
+  auto blob = index->blobs.find(off);
+
+  if (blob == index->blobs.end()) return;
+  for (const std::string &key : blob->second) {
+    auto range = index->keys.equal_range(key);
+    for (auto it = range.first; it != range.second;) {
+      if (it->second == off)
+        it = index->keys.erase(it);
+      else
+        ++it;
+    }
+  }
+  index->blobs.erase(blob);
+}
+
+static void index_shift(struct keybox_index *index, off_t off, off_t delta) {
+  std::map<off_t, std::vector<std::string>> moved;
+
+  if (!delta) return;
+  for (auto &entry : index->keys)
+    if (entry.second > off) entry.second += delta;
+
+  auto first = index->blobs.upper_bound(off);
+  for (auto it = first; it != index->blobs.end(); ++it)
+    moved[it->first + delta].swap(it->second);
+  index->blobs.erase(first, index->blobs.end());
+  index->blobs.insert(moved.begin(), moved.end());
+}
+
+/* Append the record for adding KEY at OFF to BUF.  */
+static void record_add(std::string &buf, off_t off, const std::string &key) {
+  unsigned char tmp[14];
+
+  tmp[0] = INDEX_REC_ADD;
+  put64(tmp + 1, off);
+  tmp[9] = key[0];
+  put32(tmp + 10, key.size() - 1);
+  buf.append((char *)tmp, sizeof tmp);
+  buf.append(key, 1, std::string::npos);
+}
+
+static void record_offset(std::string &buf, int type, off_t off) {
+  unsigned char tmp[9];
+
+  tmp[0] = type;
+  put64(tmp + 1, off);
+  buf.append((char *)tmp, sizeof tmp);
+}
+
+static void record_shift(std::string &buf, off_t off, off_t delta) {
+  unsigned char tmp[8];
+
+  record_offset(buf, INDEX_REC_SHIFT, off);
+  put64(tmp, (uint64_t)delta);
+  buf.append((char *)tmp, sizeof tmp);
+}
+
+static void make_header(unsigned char *image,
+                        const struct keybox_stamp *stamp) {
+  memset(image, 0, INDEX_HEADER_LEN);
+  memcpy(image, INDEX_MAGIC, 4);
+  image[4] = INDEX_VERSION;
+  put32(image + 8, stamp->created_at);
+  put32(image + 12, stamp->mtime_nsec);
+  put64(image + 16, stamp->size);
+  put64(image + 24, stamp->mtime);
+  put64(image + 32, stamp->ino);
+}
+
+/* Replay the change log in {P,LENGTH} into INDEX.  */
+static int index_replay(struct keybox_index *index, const unsigned char *p,
+                        size_t length) {
+  size_t pos = 0;
+
+  while (pos < length) {
+    int type = p[pos];
+    off_t off;
+
+    if (pos + 9 > length) return GPG_ERR_TOO_SHORT;
+    off = get64(p + pos + 1);
+    pos += 9;
+    switch (type) {
+      case INDEX_REC_ADD: {
+        size_t keylen;
+
+        if (pos + 5 > length) return GPG_ERR_TOO_SHORT;
+        keylen = buf32_to_size_t(p + pos + 1);
+        if (keylen > length - pos - 5) return GPG_ERR_TOO_SHORT;
+        index_add(index, off,
+                  make_key(p[pos], p + pos + 5, keylen));
+        pos += 5 + keylen;
+        break;
+      }
+      case INDEX_REC_DELETE:
+        index_delete(index, off);
+        break;
+      case INDEX_REC_SHIFT:
+        if (pos + 8 > length) return GPG_ERR_TOO_SHORT;
+        index_shift(index, off, (off_t)get64(p + pos));
+        pos += 8;
+        break;
+      default:
+        return GPG_ERR_INV_KEYRING;
+    }
+    index->nrecords++;
+  }
+  return 0;
+}
+
+/* Write the complete index of KB to its index file.  This may run
+   without the keybox lock, e.g. when a search rebuilds the index.
+   Thus every writer uses its own temporary file, and the index is
+   removed again if the keybox changed in the meantime, because the
+   rename may have replaced a newer index.  */
+static int write_index(KB_NAME kb) {
+  struct keybox_index *index = kb->index;
+  std::string fname = index_fname(kb);
+  std::string tmpfname = fname + ".XXXXXX";
+  std::string buf;
+  unsigned char header[INDEX_HEADER_LEN];
+  struct keybox_stamp stamp;
+  FILE *fp;
+  int fd;
+  int rc = 0;
+
+  make_header(header, &index->stamp);
+  buf.append((char *)header, sizeof header);
+  index->nrecords = 0;
+  for (const auto &blob : index->blobs)
+    for (const std::string &key : blob.second) {
+      record_add(buf, blob.first, key);
+      index->nrecords++;
+    }
+
+  fd = mkstemp(&tmpfname[0]);
+  if (fd == -1) return gpg_error_from_syserror();
+  fp = fdopen(fd, "wb");
+  if (!fp) {
+    rc = gpg_error_from_syserror();
+    close(fd);
+    gnupg_remove(tmpfname.c_str());
+    return rc;
+  }
+  if (fwrite(buf.data(), buf.size(), 1, fp) != 1)
+    rc = gpg_error_from_syserror();
+  if (fclose(fp) && !rc) rc = gpg_error_from_syserror();
+  if (!rc) rc = gnupg_rename_file(tmpfname.c_str(), fname.c_str());
+  if (rc) {
+    gnupg_remove(tmpfname.c_str());
+    return rc;
+  }
+
+  fp = fopen(kb->fname, "rb");
+  if (!fp) rc = gpg_error_from_syserror();
+  if (!rc) rc = stamp_from_fd(fileno(fp), &stamp);
+  if (!rc) rc = stamp_created_at(fp, &stamp);
+  if (fp) fclose(fp);
+  if (!rc && (!same_keybox(&index->stamp, &stamp) ||
+              index->stamp.created_at != stamp.created_at))
+    rc = GPG_ERR_TRY_LATER;
+  if (rc) gnupg_remove(fname.c_str());
+  return rc;
+}
+
+/* Append the records in BUF to the index file of KB and update its
+   header to the current stamp.  */
+static int append_index(KB_NAME kb, const std::string &buf) {
+  struct keybox_index *index = kb->index;
+  unsigned char header[INDEX_HEADER_LEN];
+  FILE *fp;
+  int rc = 0;
+
+  /* Rewrite the file once most of it is history.  */
+  if (index->nrecords > 2 * index->keys.size() + 1024) return write_index(kb);
+
+  fp = fopen(index_fname(kb).c_str(), "r+b");
+  if (!fp) return gpg_error_from_syserror();
+
+  make_header(header, &index->stamp);
+  if (!buf.empty() &&
+      (fseeko(fp, 0, SEEK_END) || fwrite(buf.data(), buf.size(), 1, fp) != 1 ||
+       fflush(fp)))
+    rc = gpg_error_from_syserror();
+  else if (fseeko(fp, 0, SEEK_SET) || fwrite(header, sizeof header, 1, fp) != 1)
+    rc = gpg_error_from_syserror();
+  if (fclose(fp) && !rc) rc = gpg_error_from_syserror();
+  return rc;
+}
+
+/* Try to load the index of KB from its index file.  STAMP describes
+   the current keybox.  */
+static int read_index(KB_NAME kb, const struct keybox_stamp *stamp) {
+  std::vector<unsigned char> image;
+  unsigned char header[INDEX_HEADER_LEN];
+  FILE *fp;
+  size_t nread;
+  int rc;
+
+  fp = fopen(index_fname(kb).c_str(), "rb");
+  if (!fp) return gpg_error_from_syserror();
+
+  make_header(header, stamp);
+  image.resize(INDEX_HEADER_LEN);
+  if (fread(image.data(), INDEX_HEADER_LEN, 1, fp) != 1 ||
+      memcmp(image.data(), header, INDEX_HEADER_LEN)) {
+    fclose(fp);
+    return GPG_ERR_INV_KEYRING; /* Stale or broken.  */
+  }
+
+  image.clear();
+  image.resize(65536);
+  nread = 0;
+  for (;;) {
+    size_t n = fread(image.data() + nread, 1, image.size() - nread, fp);
+    nread += n;
+    if (nread < image.size()) break;
+    image.resize(2 * image.size());
+  }
+  rc = ferror(fp) ? gpg_error_from_syserror() : 0;
+  fclose(fp);
+  if (rc) return rc;
+
+  kb->index = new keybox_index();
+  kb->index->stamp = *stamp;
+  kb->index->nrecords = 0;
+  rc = index_replay(kb->index, image.data(), nread);
+  if (rc) _keybox_index_invalidate(kb);
+  return rc;
+}
+
+/* Build the index of KB by scanning the keybox.  */
+static int build_index(KB_NAME kb, FILE *fp,
+                       const struct keybox_stamp *stamp) {
+  struct keybox_stamp after;
+  KEYBOXBLOB blob;
+  int rc;
+
+  kb->index = new keybox_index();
+  kb->index->stamp = *stamp;
+  kb->index->nrecords = 0;
+
+  while (!(rc = _keybox_read_blob(&blob, fp, NULL)) ||
+         rc == GPG_ERR_TOO_LARGE) {
+    const unsigned char *buffer;
+    size_t length;
+    off_t off;
+
+    if (rc) continue; /* The search skips them too.  */
+    buffer = _keybox_get_blob_image(blob, &length);
+    off = _keybox_get_blob_fileoffset(blob);
+    for (const std::string &key : blob_keys(buffer, length))
+      index_add(kb->index, off, key);
+    _keybox_release_blob(blob);
+  }
+  if (rc == -1) rc = 0;
+
+  /* Someone modified the keybox in place while we were reading.  */
+  if (!rc) rc = stamp_from_fd(fileno(fp), &after);
+  if (!rc && !same_keybox(stamp, &after)) rc = GPG_ERR_TRY_LATER;
+
+  if (rc) {
+    _keybox_index_invalidate(kb);
+    return rc;
+  }
+
+  /* The index is useful even if it can't be stored.  */
+  write_index(kb);
+  return 0;
+}
+
+/* Make sure that KB has an index which describes the current keybox
+   file.  */
+static int load_index(KB_NAME kb) {
+  struct keybox_stamp stamp;
+  FILE *fp;
+  int rc;
+
+  _keybox_index_invalidate(kb);
+
+  fp = fopen(kb->fname, "rb");
+  if (!fp) return gpg_error_from_syserror();
+  rc = stamp_from_fd(fileno(fp), &stamp);
+  if (!rc) rc = stamp_created_at(fp, &stamp);
+  if (!rc && read_index(kb, &stamp)) {
+    rewind(fp);
+    rc = build_index(kb, fp, &stamp);
+  }
+  fclose(fp);
+  return rc;
+}
+
+/* Return true if all search descriptions in DESC can be answered by
+   the index.  In this case the index of HD has been brought up to
+   date with the file opened by HD.  */
+int _keybox_index_usable(KEYBOX_HANDLE hd, KEYBOX_SEARCH_DESC *desc,
+                         size_t ndesc) {
+  struct keybox_stamp stamp;
+  size_t n;
+
+  if (!ndesc || !hd->fp) return 0;
+  for (n = 0; n < ndesc; n++) {
+    switch (desc[n].mode) {
+      case KEYDB_SEARCH_MODE_MAIL:
+      case KEYDB_SEARCH_MODE_SHORT_KID:
+      case KEYDB_SEARCH_MODE_LONG_KID:
+      case KEYDB_SEARCH_MODE_FPR:
+      case KEYDB_SEARCH_MODE_FPR20:
+      case KEYDB_SEARCH_MODE_KEYGRIP:
+        break;
+      default:
+        return 0;
+    }
+  }
+
+  /* The keybox is locked by us during a batch, and the in-memory
+     index is kept up to date with the pending changes.  */
+  if (hd->kb->batch) return !!hd->kb->index;
+
+  if (stamp_from_fd(fileno(hd->fp), &stamp)) return 0;
+  if (hd->kb->index && same_keybox(&hd->kb->index->stamp, &stamp)) return 1;
+  if (load_index(hd->kb)) return 0;
+  return same_keybox(&hd->kb->index->stamp, &stamp);
+}
+
+/* Look up the keys for DESC in INDEX and update NEXT to the smallest
+   offset of a candidate blob at or after START.  */
+static void lookup_desc(struct keybox_index *index, KEYBOX_SEARCH_DESC *desc,
+                        off_t start, off_t *next) {
+  std::string keys[2];
+  int nkeys = 1;
+  unsigned char kid[8];
+  int i;
+
+  switch (desc->mode) {
+    case KEYDB_SEARCH_MODE_MAIL: {
+      const char *name = desc->u.name;
+      size_t namelen, j;
+      std::string mail;
+
+      /* Same as has_mail, but we don't know the blob type.  */
+      namelen = strlen(name);
+      if (namelen && name[namelen - 1] == '>') namelen--;
+      for (j = 0; j < namelen; j++) mail += (char)ascii_tolower(name[j]);
+      keys[0] = make_key(INDEX_KEY_MAIL, mail.data(), mail.size());
+      if (*name == '<') {
+        keys[1] = make_key(INDEX_KEY_MAIL, mail.data() + 1, mail.size() - 1);
+        nkeys = 2;
+      }
+      break;
+    }
+    case KEYDB_SEARCH_MODE_SHORT_KID:
+      put32(kid, desc->u.kid[1]);
+      keys[0] = make_key(INDEX_KEY_SHORT_KID, kid, 4);
+      break;
+    case KEYDB_SEARCH_MODE_LONG_KID:
+      put32(kid, desc->u.kid[0]);
+      put32(kid + 4, desc->u.kid[1]);
+      keys[0] = make_key(INDEX_KEY_LONG_KID, kid, 8);
+      break;
+    case KEYDB_SEARCH_MODE_FPR:
+    case KEYDB_SEARCH_MODE_FPR20:
+      keys[0] = make_key(INDEX_KEY_FPR, desc->u.fpr, 20);
+      break;
+    case KEYDB_SEARCH_MODE_KEYGRIP:
+      keys[0] = make_key(INDEX_KEY_GRIP, desc->u.grip, 20);
+      break;
+    default:
+      never_reached();
+      return;
+  }
+
+  for (i = 0; i < nkeys; i++) {
+    auto range = index->keys.equal_range(keys[i]);
+    for (auto it = range.first; it != range.second; ++it)
+      if (it->second >= start && (*next < 0 || it->second < *next))
+        *next = it->second;
+  }
+}
+
+/* Position the file of HD at the next blob which may match DESC.
+   Returns -1 if there is none.  */
+gpg_error_t _keybox_index_seek(KEYBOX_HANDLE hd, KEYBOX_SEARCH_DESC *desc,
+                               size_t ndesc) {
+  off_t start, next = -1;
+  size_t n;
+
+  start = _keybox_tell(hd);
+  if (start == (off_t)-1) return gpg_error_from_syserror();
+
+  for (n = 0; n < ndesc; n++)
+    lookup_desc(hd->kb->index, desc + n, start, &next);
+  if (next < 0) return -1;
+
+  return _keybox_seek(hd, next);
+}
+
+/* Called before the keybox of KB is modified.  Drops the index if it
+   does not describe the keybox anymore, because the change would
+   otherwise be recorded on top of a stale state.  This has been
+   checked once at the start of a batch.  */
+void _keybox_index_begin(KB_NAME kb) {
+  struct keybox_stamp stamp;
+  FILE *fp;
+  int rc;
+
+  if (!kb->index || kb->batch) return;
+  fp = fopen(kb->fname, "rb");
+  if (!fp) {
+    _keybox_index_invalidate(kb);
+    return;
+  }
+  rc = stamp_from_fd(fileno(fp), &stamp);
+  if (!rc) rc = stamp_created_at(fp, &stamp);
+  fclose(fp);
+  if (rc || !same_keybox(&kb->index->stamp, &stamp) ||
+      kb->index->stamp.created_at != stamp.created_at)
+    _keybox_index_invalidate(kb);
+}
+
+/* Record the changes in BUF, which have already been applied to the
+   in-memory index, after the keybox of KB has been modified.  During
+   a batch they are only collected.  */
+static void index_commit(KB_NAME kb, const std::string &buf) {
+  FILE *fp;
+  int rc;
+
+  if (kb->batch) {
+    kb->index->pending += buf;
+    return;
+  }
+
+  fp = fopen(kb->fname, "rb");
+  if (!fp) {
+    _keybox_index_invalidate(kb);
+    return;
+  }
+  rc = stamp_from_fd(fileno(fp), &kb->index->stamp);
+  if (!rc) rc = stamp_created_at(fp, &kb->index->stamp);
+  fclose(fp);
+  if (rc) {
+    _keybox_index_invalidate(kb);
+    return;
+  }
+
+  if (append_index(kb, buf)) gnupg_remove(index_fname(kb).c_str());
+}
+
+/* The blob BLOB has been written at offset OFF.  If OLDLEN is not 0,
+   it replaced a blob of that length.  */
+void _keybox_index_update(KB_NAME kb, off_t off, size_t oldlen,
+                          KEYBOXBLOB blob) {
+  const unsigned char *buffer;
+  size_t length;
+  std::string buf;
+
+  if (!kb->index) return;
+
+  buffer = _keybox_get_blob_image(blob, &length);
+  if (oldlen) {
+    index_delete(kb->index, off);
+    record_offset(buf, INDEX_REC_DELETE, off);
+    index_shift(kb->index, off, (off_t)length - (off_t)oldlen);
+    record_shift(buf, off, (off_t)length - (off_t)oldlen);
+    kb->index->nrecords += 2;
+  }
+  for (const std::string &key : blob_keys(buffer, length)) {
+    index_add(kb->index, off, key);
+    record_add(buf, off, key);
+    kb->index->nrecords++;
+  }
+  index_commit(kb, buf);
+}
+
+/* The blob at offset OFF has been deleted.  */
+void _keybox_index_delete(KB_NAME kb, off_t off) {
+  std::string buf;
+
+  if (!kb->index) return;
+  index_delete(kb->index, off);
+  record_offset(buf, INDEX_REC_DELETE, off);
+  kb->index->nrecords++;
+  index_commit(kb, buf);
+}
+
+/* The keybox has been modified without changing any search keys or
+   offsets (e.g. by setting flags).  */
+void _keybox_index_touch(KB_NAME kb) {
+  if (!kb->index) return;
+  index_commit(kb, std::string());
+}
+
+/* Drop the in-memory index of KB.  The index file is kept, as it
+   will not match a modified keybox.  */
+void _keybox_index_invalidate(KB_NAME kb) {
+  delete kb->index;
+  kb->index = NULL;
+}
+
+/* Write the changes of a batch to the index file, after the batch of
+   KB has been committed.  */
+void _keybox_index_flush(KB_NAME kb) {
+  std::string buf;
+
+  if (!kb->index) return;
+  buf.swap(kb->index->pending);
+  index_commit(kb, buf);
+}
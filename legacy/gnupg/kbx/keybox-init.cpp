@@ -51,6 +51,8 @@ gpg_error_t keybox_register_file(const char *fname, int secret,
   kr->lockhd = NULL;
   kr->is_locked = 0;
   kr->did_full_scan = 0;
+  kr->index = NULL;
+  kr->batch = NULL;
   /* keep a list of all issued pointers */
   kr->next = kb_names;
   kb_names = kr;
@@ -146,6 +148,7 @@ void keybox_release(KEYBOX_HANDLE hd) {
   _keybox_release_blob(hd->found.blob);
   _keybox_release_blob(hd->saved_found.blob);
   if (hd->fp) {
+    _keybox_unmap_file(hd);
     fclose(hd->fp);
     hd->fp = NULL;
   }
@@ -198,6 +201,7 @@ void _keybox_close_file(KEYBOX_HANDLE hd) {
   for (idx = 0; idx < hd->kb->handle_table_size; idx++)
     if ((roverhd = hd->kb->handle_table[idx])) {
       if (roverhd->fp) {
+        _keybox_unmap_file(roverhd);
         fclose(roverhd->fp);
         roverhd->fp = NULL;
       }
@@ -206,9 +210,13 @@ void _keybox_close_file(KEYBOX_HANDLE hd) {
 }
 
 /*
- * Lock the keybox at handle HD, or unlock if YES is false.
+ * Lock the keybox at handle HD, or unlock if YES is false.  TIMEOUT
+ * is the time in milliseconds to wait for the lock; -1 waits forever
+ * and 0 returns an error at once if the keybox is locked.  While a
+ * batch of changes is pending the lock is only released by the
+ * caller of keybox_batch_commit.
  */
-gpg_error_t keybox_lock(KEYBOX_HANDLE hd, int yes) {
+gpg_error_t keybox_lock(KEYBOX_HANDLE hd, int yes, long timeout) {
   gpg_error_t err = 0;
   KB_NAME kb = hd->kb;
 
@@ -236,19 +244,21 @@ gpg_error_t keybox_lock(KEYBOX_HANDLE hd, int yes) {
        * open, keybox_file_rename will never succeed as we are
        * in a deadlock.  */
       if (hd->fp) {
+        _keybox_unmap_file(hd);
         fclose(hd->fp);
         hd->fp = NULL;
       }
 #endif /*HAVE_W32_SYSTEM*/
-      if (dotlock_take(kb->lockhd, -1)) {
+      if (dotlock_take(kb->lockhd, timeout)) {
         err = gpg_error_from_syserror();
-        log_info("can't lock '%s'\n", kb->fname);
+        if (timeout) /* No diagnostic if we only tried to lock.  */
+          log_info("can't lock '%s'\n", kb->fname);
       } else
         kb->is_locked = 1;
     }
   } else /* Release the lock.  */
   {
-    if (kb->is_locked) {
+    if (kb->is_locked && !kb->batch) {
       if (dotlock_release(kb->lockhd)) {
         err = gpg_error_from_syserror();
         log_info("can't unlock '%s'\n", kb->fname);
@@ -326,6 +326,56 @@ static int blob_cmp_name(KEYBOXBLOB blob, int idx, const char *name,
   return 0; /* not found */
 }
 
+/* Narrow the user ID {BUFFER+*R_OFF,*R_LEN} to its mail address.
+   Returns false if the user ID does not contain a mail address.  The
+   X509 flag indicates whether this is an X.509 blob.  */
+int _keybox_get_mailbox(const unsigned char *buffer, size_t *r_off,
+                        size_t *r_len, int x509) {
+  size_t off = *r_off;
+  size_t len = *r_len;
+  size_t mypos, mylen;
+
+  if (x509) {
+    if (len < 2 || buffer[off] != '<')
+      return 0; /* empty name or trailing 0 not stored */
+    len--;      /* one back */
+    if (len < 3 || buffer[off + len] != '>')
+      return 0; /* not a proper email address */
+    off++;
+    len--;
+  } else /* OpenPGP.  */
+  {
+    /* We need to forward to the mailbox part.  */
+    mypos = off;
+    mylen = len;
+    for (; len && buffer[off] != '<'; len--, off++)
+      ;
+    if (len < 2 || buffer[off] != '<') {
+      /* Mailbox not explicitly given or too short.  Restore
+         OFF and LEN and check whether the entire string
+         resembles a mailbox without the angle brackets.  */
+      off = mypos;
+      len = mylen;
+      if (!is_valid_mailbox_mem(buffer + off, len))
+        return 0; /* Not a mail address. */
+    } else        /* Seems to be standard user id with mail address.  */
+    {
+      off++; /* Point to first char of the mail address.  */
+      len--;
+      /* Search closing '>'.  */
+      for (mypos = off; len && buffer[mypos] != '>'; len--, mypos++)
+        ;
+      if (!len || buffer[mypos] != '>' || off == mypos)
+        return 0; /* Not a proper mail address.  */
+      len = mypos - off;
+    }
+  }
+
+  *r_off = off;
+  *r_len = len;
+  return 1;
+}
+
 /* Compare all email addresses of the subject.  With SUBSTR given as
    True a substring search is done in the mail address.  The X509 flag
    indicated whether the search is done on an X.509 blob.  */
@@ -370,48 +420,13 @@ static int blob_cmp_mail(KEYBOXBLOB blob, const char *name, size_t namelen,
      for the issuer name.  */
   for (idx = !!x509; idx < nuids; idx++) {
     size_t mypos = pos;
-    size_t mylen;
 
     mypos += idx * uidinfolen;
     off = get32(buffer + mypos);
     len = get32(buffer + mypos + 4);
     if (off + len > length)
       return 0; /* error: better stop here - out of bounds */
-    if (x509) {
-      if (len < 2 || buffer[off] != '<')
-        continue; /* empty name or trailing 0 not stored */
-      len--;      /* one back */
-      if (len < 3 || buffer[off + len] != '>')
-        continue; /* not a proper email address */
-      off++;
-      len--;
-    } else /* OpenPGP.  */
-    {
-      /* We need to forward to the mailbox part.  */
-      mypos = off;
-      mylen = len;
-      for (; len && buffer[off] != '<'; len--, off++)
-        ;
-      if (len < 2 || buffer[off] != '<') {
-        /* Mailbox not explicitly given or too short.  Restore
-           OFF and LEN and check whether the entire string
-           resembles a mailbox without the angle brackets.  */
-        off = mypos;
-        len = mylen;
-        if (!is_valid_mailbox_mem(buffer + off, len))
-          continue; /* Not a mail address. */
-      } else        /* Seems to be standard user id with mail address.  */
-      {
-        off++; /* Point to first char of the mail address.  */
-        len--;
-        /* Search closing '>'.  */
-        for (mypos = off; len && buffer[mypos] != '>'; len--, mypos++)
-          ;
-        if (!len || buffer[mypos] != '>' || off == mypos)
-          continue; /* Not a proper mail address.  */
-        len = mypos - off;
-      }
-    }
+    if (!_keybox_get_mailbox(buffer, &off, &len, x509)) continue;
 
     if (substr) {
       if (ascii_memcasemem(buffer + off, len, name, namelen))
@@ -424,24 +439,21 @@ static int blob_cmp_mail(KEYBOXBLOB blob, const char *name, size_t namelen,
   return 0; /* not found */
 }
 
-/* Return true if the key in BLOB matches the 20 bytes keygrip GRIP.
+/* Compute the keygrip of the certificate in the X.509 blob
+   {BUFFER,LENGTH} and store it at ARRAY.  Returns true on success.
    We don't have the keygrips as meta data, thus we need to parse the
-   certificate. Fixme: We might want to return proper error codes
-   instead of failing a search for invalid certificates etc.  */
-static int blob_x509_has_grip(KEYBOXBLOB blob, const unsigned char *grip) {
+   certificate.  */
+int _keybox_x509_get_keygrip(const unsigned char *buffer, size_t length,
+                             unsigned char *array) {
   int rc;
-  const unsigned char *buffer;
-  size_t length;
   size_t cert_off, cert_len;
   ksba_reader_t reader = NULL;
   ksba_cert_t cert = NULL;
   ksba_sexp_t p = NULL;
   gcry_sexp_t s_pkey;
-  unsigned char array[20];
   unsigned char *rcp;
   size_t n;
 
-  buffer = _keybox_get_blob_image(blob, &length);
   if (length < 40) return 0; /* Too short. */
   cert_off = get32(buffer + 8);
   cert_len = get32(buffer + 12);
@@ -471,7 +483,7 @@ static int blob_x509_has_grip(KEYBOXBLOB blob, const unsigned char *grip) {
   xfree(p);
   ksba_cert_release(cert);
   ksba_reader_release(reader);
-  return !memcmp(array, grip, 20);
+  return 1;
 failed:
   xfree(p);
   ksba_cert_release(cert);
@@ -479,6 +491,19 @@ failed:
   return 0;
 }
 
+/* Return true if the key in BLOB matches the 20 bytes keygrip GRIP.
+   Fixme: We might want to return proper error codes instead of
+   failing a search for invalid certificates etc.  */
+static int blob_x509_has_grip(KEYBOXBLOB blob, const unsigned char *grip) {
+  const unsigned char *buffer;
+  size_t length;
+  unsigned char array[20];
+
+  buffer = _keybox_get_blob_image(blob, &length);
+  return _keybox_x509_get_keygrip(buffer, length, array) &&
+         !memcmp(array, grip, 20);
+}
+
 /*
   The has_foo functions are used as helpers for search
 */
@@ -605,6 +630,7 @@ static gpg_error_t open_file(KEYBOX_HANDLE hd) {
     return hd->error;
   }
 
+  _keybox_map_file(hd);
   return 0;
 }
 
@@ -623,9 +649,10 @@ gpg_error_t keybox_search_reset(KEYBOX_HANDLE hd) {
   }
 
   if (hd->fp) {
-    if (fseeko(hd->fp, 0, SEEK_SET)) {
+    if (_keybox_seek(hd, 0)) {
       /* Ooops.  Seek did not work.  Close so that the search will
        * open the file again.  */
+      _keybox_unmap_file(hd);
       fclose(hd->fp);
       hd->fp = NULL;
     }
@@ -645,7 +672,7 @@ gpg_error_t keybox_search(KEYBOX_HANDLE hd, KEYBOX_SEARCH_DESC *desc,
                           size_t *r_descindex, unsigned long *r_skipped) {
   gpg_error_t rc;
   size_t n;
-  int need_words, any_skip;
+  int need_words, any_skip, use_index;
   KEYBOXBLOB blob = NULL;
   struct sn_array_s *sn_array = NULL;
   int pk_no, uid_no;
@@ -743,6 +770,9 @@ gpg_error_t keybox_search(KEYBOX_HANDLE hd, KEYBOX_SEARCH_DESC *desc,
     }
   }
 
+  /* Exact searches jump from candidate to candidate.  */
+  use_index = _keybox_index_usable(hd, desc, ndesc);
+
   pk_no = uid_no = 0;
   for (;;) {
     unsigned int blobflags;
@@ -750,7 +780,11 @@ gpg_error_t keybox_search(KEYBOX_HANDLE hd, KEYBOX_SEARCH_DESC *desc,
 
     _keybox_release_blob(blob);
     blob = NULL;
-    rc = _keybox_read_blob(&blob, hd->fp, NULL);
+    if (use_index) {
+      rc = _keybox_index_seek(hd, desc, ndesc);
+      if (rc) break;
+    }
+    rc = _keybox_next_blob(&blob, hd);
     if (rc == GPG_ERR_TOO_LARGE) {
       ++*r_skipped;
       continue; /* Skip too large records.  */
@@ -761,6 +795,9 @@ gpg_error_t keybox_search(KEYBOX_HANDLE hd, KEYBOX_SEARCH_DESC *desc,
     blobtype = blob_get_type(blob);
     if (blobtype == KEYBOX_BLOBTYPE_HEADER) continue;
     if (want_blobtype && blobtype != want_blobtype) continue;
+    if (hd->kb &&
+        _keybox_batch_deleted(hd->kb, _keybox_get_blob_fileoffset(blob)))
+      continue; /* Replaced during the current batch.  */
 
     blobflags = blob_get_blob_flags(blob);
     if (!hd->ephemeral && (blobflags & 2))
@@ -850,6 +887,9 @@ gpg_error_t keybox_search(KEYBOX_HANDLE hd, KEYBOX_SEARCH_DESC *desc,
     if (n == ndesc) break; /* got it */
   }
 
+  /* The found blob outlives the mapping.  */
+  if (!rc) rc = _keybox_copy_blob(&blob);
+
   if (!rc) {
     hd->found.blob = blob;
     hd->found.pk_no = pk_no;
@@ -979,7 +1019,7 @@ int keybox_get_flags(KEYBOX_HANDLE hd, int what, int idx, unsigned int *value) {
 
 off_t keybox_offset(KEYBOX_HANDLE hd) {
   if (!hd->fp) return 0;
-  return ftello(hd->fp);
+  return _keybox_tell(hd);
 }
 
 gpg_error_t keybox_seek(KEYBOX_HANDLE hd, off_t offset) {
@@ -998,8 +1038,60 @@ gpg_error_t keybox_seek(KEYBOX_HANDLE hd, off_t offset) {
     if (err) return err;
   }
 
-  err = fseeko(hd->fp, offset, SEEK_SET);
-  hd->error = gpg_error_from_errno(err);
+  hd->error = _keybox_seek(hd, offset);
 
   return hd->error;
 }
+
+/* Return the file offset of the blob found by the last search, or -1
+   if there is none.  */
+off_t keybox_found_offset(KEYBOX_HANDLE hd) {
+  if (!hd || !hd->found.blob) return -1;
+  return _keybox_get_blob_fileoffset(hd->found.blob);
+}
+
+/* Select the OpenPGP blob at file offset OFFSET as if keybox_search
+   had found it with a search for the fingerprint FPR, which must be
+   MAX_FINGERPRINT_LEN bytes.  The next search continues after that
+   blob.  This is used to repeat a search whose result is known.
+   Returns GPG_ERR_NOT_FOUND and leaves the read position unchanged if
+   there is no such blob at OFFSET (anymore).  */
+gpg_error_t keybox_select_fpr(KEYBOX_HANDLE hd, off_t offset,
+                              const unsigned char *fpr) {
+  gpg_error_t rc;
+  KEYBOXBLOB blob = NULL;
+  off_t pos;
+  int pk_no = 0;
+
+  if (!hd) return GPG_ERR_INV_VALUE;
+  if (hd->error) return hd->error; /* still in error state */
+
+  if (!hd->fp) {
+    rc = open_file(hd);
+    if (rc) return rc;
+  }
+
+  pos = _keybox_tell(hd);
+  rc = _keybox_seek(hd, offset);
+  if (!rc) rc = _keybox_next_blob(&blob, hd);
+  /* A deleted blob is skipped, so check that we got the one at
+     OFFSET.  */
+  if (!rc && (_keybox_get_blob_fileoffset(blob) != offset ||
+              blob_get_type(blob) != KEYBOX_BLOBTYPE_PGP ||
+              (hd->kb && _keybox_batch_deleted(hd->kb, offset)) ||
+              !(pk_no = has_fingerprint(blob, fpr))))
+    rc = GPG_ERR_NOT_FOUND;
+  if (!rc) rc = _keybox_copy_blob(&blob);
+  if (rc) {
+    _keybox_release_blob(blob);
+    _keybox_seek(hd, pos);
+    return GPG_ERR_NOT_FOUND;
+  }
+
+  _keybox_release_blob(hd->found.blob);
+  hd->found.blob = blob;
+  hd->found.pk_no = pk_no;
+  hd->found.uid_no = 0;
+  hd->eof = 0;
+  return 0;
+}
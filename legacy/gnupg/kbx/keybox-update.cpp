@@ -23,9 +23,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <time.h>
 #include <unistd.h>
 
+#include <set>
+
 #include "../common/host2net.h"
 #include "../common/sysutils.h"
 #include "keybox-defs.h"
@@ -36,6 +39,33 @@
 #define FILECOPY_DELETE 2
 #define FILECOPY_UPDATE 3
 
+/* A batch of changes to a keybox.  New blobs are appended right away
+   but only synced at the end, and old blobs are only flagged as
+   deleted after that, so that a crash leaves at least one version of
+   every keyblock.  */
+struct keybox_batch {
+  /* The keybox opened for appending.  */
+  FILE *fp;
+
+  /* The offset of the next blob.  */
+  off_t end;
+
+  /* True if the openpgp flag of the header blob has been checked.  */
+  int openpgp_checked;
+
+  /* The blobs to flag as deleted when the batch is committed.  */
+  std::set<off_t> deleted;
+};
+
+/* Flush FP and make sure that its data has reached the disk.  */
+static gpg_error_t sync_file(FILE *fp) {
+  if (fflush(fp)) return gpg_error_from_syserror();
+#ifdef HAVE_FSYNC
+  if (fsync(fileno(fp))) return gpg_error_from_syserror();
+#endif
+  return 0;
+}
+
 static int create_tmp_file(const char *tempel, char **r_bakfname,
                            char **r_tmpfname, FILE **r_fp) {
   gpg_error_t err;
@@ -105,9 +135,12 @@ leave:
 
 /* Perform insert/delete/update operation.  MODE is one of
    FILECOPY_INSERT, FILECOPY_DELETE, FILECOPY_UPDATE.  FOR_OPENPGP
-   indicates that this is called due to an OpenPGP keyblock change.  */
+   indicates that this is called due to an OpenPGP keyblock change.
+   For an insert or update, the offset of the new blob is stored at
+   R_OFFSET.  */
 static int blob_filecopy(int mode, const char *fname, KEYBOXBLOB blob,
-                         int secret, int for_openpgp, off_t start_offset) {
+                         int secret, int for_openpgp, off_t start_offset,
+                         off_t *r_offset) {
   FILE *fp, *newfp;
   int rc = 0;
   char *bakfname = NULL;
@@ -132,6 +165,7 @@ static int blob_filecopy(int mode, const char *fname, KEYBOXBLOB blob,
       return rc;
     }
 
+    *r_offset = ftello(newfp);
     rc = _keybox_write_blob(blob, newfp);
     if (rc) {
       fclose(newfp);
@@ -226,6 +260,7 @@ static int blob_filecopy(int mode, const char *fname, KEYBOXBLOB blob,
 
   /* Do an insert or update. */
   if (mode == FILECOPY_INSERT || mode == FILECOPY_UPDATE) {
+    *r_offset = ftello(newfp);
     rc = _keybox_write_blob(blob, newfp);
     if (rc) {
       fclose(fp);
@@ -252,12 +287,18 @@ static int blob_filecopy(int mode, const char *fname, KEYBOXBLOB blob,
     }
   }
 
-  /* Close both files. */
+  /* Close both files.  The new file must be on disk before it
+     replaces the old one.  */
   if (fclose(fp)) {
     rc = gpg_error_from_syserror();
     fclose(newfp);
     goto leave;
   }
+  rc = sync_file(newfp);
+  if (rc) {
+    fclose(newfp);
+    goto leave;
+  }
   if (fclose(newfp)) {
     rc = gpg_error_from_syserror();
     goto leave;
@@ -271,6 +312,192 @@ leave:
   return rc;
 }
 
+/* Turn the bytes from START to the end SIZE of the keybox FP, which
+   are what is left of an incomplete blob, into an empty blob and store
+   its end at R_END.  The keybox is never made shorter, because other
+   processes may have it mapped (see _keybox_map_file) and would fault
+   on pages past a new end.  Empty blobs are skipped by all readers and
+   dropped by keybox_compress.  The empty blob is extended past SIZE
+   if there is no room for its header.  */
+static gpg_error_t pad_incomplete_blob(FILE *fp, off_t start, off_t size,
+                                       off_t *r_end) {
+  unsigned char header[5];
+  off_t length = size - start;
+
+  if (length < (off_t)sizeof header) length = sizeof header;
+  if (length > 0xffffffff) return GPG_ERR_TOO_LARGE;
+  header[0] = length >> 24;
+  header[1] = length >> 16;
+  header[2] = length >> 8;
+  header[3] = length;
+  header[4] = KEYBOX_BLOBTYPE_EMPTY;
+  if (fseeko(fp, start, SEEK_SET) ||
+      fwrite(header, sizeof header, 1, fp) != 1 || fflush(fp))
+    return gpg_error_from_syserror();
+  *r_end = start + length;
+  return 0;
+}
+
+/* Find the end of the keybox FP of size SIZE for appending a blob.
+   A blob left incomplete by a crash during an earlier append is turned
+   into an empty blob.  This requires a scan of the keybox, unless the
+   index of KB describes it, because the index is only updated after
+   complete changes.  */
+static gpg_error_t find_append_offset(KB_NAME kb, FILE *fp, off_t size,
+                                      off_t *r_offset) {
+  off_t start = 0, pos;
+  int rc = 0;
+
+  *r_offset = size;
+  if (kb->index) return 0;
+
+  if (fseeko(fp, 0, SEEK_SET)) return gpg_error_from_syserror();
+  for (;;) {
+    pos = ftello(fp);
+    if (pos == (off_t)-1) return gpg_error_from_syserror();
+    if (pos >= size) break;
+    start = pos;
+    rc = _keybox_read_blob(NULL, fp, NULL);
+    if (rc == GPG_ERR_TOO_LARGE) continue;
+    if (rc == -1 || rc == GPG_ERR_TOO_SHORT) {
+      /* Hit the end of the file, which is only fine at the end of a
+         (deleted) blob.  */
+      pos = ftello(fp);
+      if (pos == (off_t)-1) return gpg_error_from_syserror();
+      if (rc == GPG_ERR_TOO_SHORT) {
+        if (pos < size) return rc; /* Corrupt, not cut off.  */
+        pos = size + 1;
+      }
+      break;
+    }
+    if (rc) return rc;
+  }
+  if (pos == size) return 0;
+
+  /* The blob at START is incomplete.  */
+  log_info("%s: removing incomplete blob at offset %llu\n", kb->fname,
+           (unsigned long long)start);
+  return pad_incomplete_blob(fp, start, size, r_offset);
+}
+
+/* Append BLOB to the keybox of KB as part of its batch.  */
+static gpg_error_t batch_append(KB_NAME kb, KEYBOXBLOB blob, int for_openpgp,
+                                off_t *r_offset) {
+  struct keybox_batch *batch = kb->batch;
+  unsigned char header[32];
+  size_t length;
+  gpg_error_t rc;
+
+  if (for_openpgp && !batch->openpgp_checked) {
+    if (fseeko(batch->fp, 0, SEEK_SET)) return gpg_error_from_syserror();
+    if (fread(header, sizeof header, 1, batch->fp) == 1 &&
+        header[4] == KEYBOX_BLOBTYPE_HEADER && !(header[7] & 0x02)) {
+      if (fseeko(batch->fp, 7, SEEK_SET) ||
+          putc(header[7] | 0x02, batch->fp) == EOF)
+        return gpg_error_from_syserror();
+    }
+    batch->openpgp_checked = 1;
+  }
+
+  if (fseeko(batch->fp, batch->end, SEEK_SET))
+    return gpg_error_from_syserror();
+  rc = _keybox_write_blob(blob, batch->fp);
+  /* Searches read the keybox through other file handles.  */
+  if (!rc && fflush(batch->fp)) rc = gpg_error_from_syserror();
+  if (rc) return rc;
+
+  _keybox_get_blob_image(blob, &length);
+  *r_offset = batch->end;
+  batch->end += length;
+  return 0;
+}
+
+/* Append BLOB to the keybox of KB and store its offset at R_OFFSET.
+   The blob is on disk when this returns, so that the deletion of a
+   blob it replaces can't become visible before it.  FOR_OPENPGP
+   indicates that this is called due to an OpenPGP keyblock change.  */
+static gpg_error_t blob_append(KB_NAME kb, KEYBOXBLOB blob, int for_openpgp,
+                               off_t *r_offset) {
+  FILE *fp;
+  struct stat st;
+  unsigned char header[32];
+  off_t off;
+  gpg_error_t rc;
+
+  if (kb->batch) return batch_append(kb, blob, for_openpgp, r_offset);
+
+  fp = fopen(kb->fname, "r+b");
+  if (!fp && errno == ENOENT)
+    return blob_filecopy(FILECOPY_INSERT, kb->fname, blob, kb->secret,
+                         for_openpgp, 0, r_offset);
+  if (!fp) return gpg_error_from_syserror();
+
+  if (fstat(fileno(fp), &st)) {
+    rc = gpg_error_from_syserror();
+    goto leave;
+  }
+
+  /* Make sure that the openpgp flag is set in the header.  */
+  if (for_openpgp && fread(header, sizeof header, 1, fp) == 1 &&
+      header[4] == KEYBOX_BLOBTYPE_HEADER && !(header[7] & 0x02)) {
+    if (fseeko(fp, 7, SEEK_SET) || putc(header[7] | 0x02, fp) == EOF) {
+      rc = gpg_error_from_syserror();
+      goto leave;
+    }
+  }
+
+  rc = find_append_offset(kb, fp, st.st_size, &off);
+  if (rc) goto leave;
+
+  if (fseeko(fp, off, SEEK_SET)) {
+    rc = gpg_error_from_syserror();
+    goto leave;
+  }
+  rc = _keybox_write_blob(blob, fp);
+  if (!rc) rc = sync_file(fp);
+  if (!rc) *r_offset = off;
+
+leave:
+  if (fclose(fp) && !rc) rc = gpg_error_from_syserror();
+  return rc;
+}
+
+/* Flag the blob at offset OFF of the keybox FNAME as deleted.  */
+static gpg_error_t blob_delete(const char *fname, off_t off) {
+  FILE *fp;
+  gpg_error_t rc;
+
+  fp = fopen(fname, "r+b");
+  if (!fp) return gpg_error_from_syserror();
+
+  if (fseeko(fp, off + 4, SEEK_SET) || putc(0, fp) == EOF)
+    rc = gpg_error_from_syserror();
+  else
+    rc = sync_file(fp);
+
+  if (fclose(fp)) {
+    if (!rc) rc = gpg_error_from_syserror();
+  }
+
+  return rc;
+}
+
+/* Delete the blob at offset OFF of the keybox of KB, or remember to
+   do so if a batch is pending.  */
+static gpg_error_t delete_blob(KB_NAME kb, off_t off) {
+  if (kb->batch) {
+    kb->batch->deleted.insert(off);
+    return 0;
+  }
+  return blob_delete(kb->fname, off);
+}
+
+/* Return true if the blob at offset OFF of KB is deleted by the
+   pending batch.  */
+int _keybox_batch_deleted(KB_NAME kb, off_t off) {
+  return kb->batch && kb->batch->deleted.count(off);
+}
+
 /* Insert the OpenPGP keyblock {IMAGE,IMAGELEN} into HD. */
 gpg_error_t keybox_insert_keyblock(KEYBOX_HANDLE hd, const void *image,
                                    size_t imagelen) {
@@ -298,7 +525,11 @@ gpg_error_t keybox_insert_keyblock(KEYBOX_HANDLE hd, const void *image,
       &blob, &info, (const unsigned char *)(image), imagelen, hd->ephemeral);
   _keybox_destroy_openpgp_info(&info);
   if (!err) {
-    err = blob_filecopy(FILECOPY_INSERT, fname, blob, hd->secret, 1, 0);
+    off_t off;
+
+    _keybox_index_begin(hd->kb);
+    err = blob_append(hd->kb, blob, 1, &off);
+    if (!err) _keybox_index_update(hd->kb, off, 0, blob);
     _keybox_release_blob(blob);
     /*    if (!rc && !hd->secret && kb_offtbl) */
     /*      { */
@@ -309,12 +540,13 @@ gpg_error_t keybox_insert_keyblock(KEYBOX_HANDLE hd, const void *image,
 }
 
 /* Update the current key at HD with the given OpenPGP keyblock in
-   {IMAGE,IMAGELEN}.  */
+   {IMAGE,IMAGELEN}.  The new blob is appended and the old one flagged
+   as deleted, so that a crash leaves at least one of them.  */
 gpg_error_t keybox_update_keyblock(KEYBOX_HANDLE hd, const void *image,
                                    size_t imagelen) {
   gpg_error_t err;
   const char *fname;
-  off_t off;
+  off_t off, newoff;
   KEYBOXBLOB blob;
   size_t nparsed;
   struct _keybox_openpgp_info info;
@@ -344,7 +576,14 @@ gpg_error_t keybox_update_keyblock(KEYBOX_HANDLE hd, const void *image,
 
   /* Update the keyblock.  */
   if (!err) {
-    err = blob_filecopy(FILECOPY_UPDATE, fname, blob, hd->secret, 1, off);
+    _keybox_index_begin(hd->kb);
+    err = blob_append(hd->kb, blob, 1, &newoff);
+    if (!err) err = delete_blob(hd->kb, off);
+    if (!err) {
+      _keybox_index_update(hd->kb, newoff, 0, blob);
+      _keybox_index_delete(hd->kb, off);
+    } else
+      _keybox_index_invalidate(hd->kb);
     _keybox_release_blob(blob);
   }
   return err;
@@ -368,7 +607,11 @@ int keybox_insert_cert(KEYBOX_HANDLE hd, ksba_cert_t cert,
 
   rc = _keybox_create_x509_blob(&blob, cert, sha1_digest, hd->ephemeral);
   if (!rc) {
-    rc = blob_filecopy(FILECOPY_INSERT, fname, blob, hd->secret, 0, 0);
+    off_t off;
+
+    _keybox_index_begin(hd->kb);
+    rc = blob_append(hd->kb, blob, 0, &off);
+    if (!rc) _keybox_index_update(hd->kb, off, 0, blob);
     _keybox_release_blob(blob);
     /*    if (!rc && !hd->secret && kb_offtbl) */
     /*      { */
@@ -417,6 +660,7 @@ int keybox_set_flags(KEYBOX_HANDLE hd, int what, int idx, unsigned int value) {
   off += flag_pos;
 
   _keybox_close_file(hd);
+  _keybox_index_begin(hd->kb);
   fp = fopen(hd->kb->fname, "r+b");
   if (!fp) return gpg_error_from_syserror();
 
@@ -448,13 +692,16 @@ int keybox_set_flags(KEYBOX_HANDLE hd, int what, int idx, unsigned int value) {
     if (!ec) ec = gpg_error_from_syserror();
   }
 
+  if (!ec)
+    _keybox_index_touch(hd->kb);
+  else
+    _keybox_index_invalidate(hd->kb);
   return ec;
 }
 
 int keybox_delete(KEYBOX_HANDLE hd) {
   off_t off;
   const char *fname;
-  FILE *fp;
   int rc;
 
   if (!hd) return GPG_ERR_INV_VALUE;
@@ -465,23 +712,15 @@ int keybox_delete(KEYBOX_HANDLE hd) {
 
   off = _keybox_get_blob_fileoffset(hd->found.blob);
   if (off == (off_t)-1) return GPG_ERR_GENERAL;
-  off += 4;
 
   _keybox_close_file(hd);
-  fp = fopen(hd->kb->fname, "r+b");
-  if (!fp) return gpg_error_from_syserror();
+  _keybox_index_begin(hd->kb);
+  rc = delete_blob(hd->kb, off);
 
-  if (fseeko(fp, off, SEEK_SET))
-    rc = gpg_error_from_syserror();
-  else if (putc(0, fp) == EOF)
-    rc = gpg_error_from_syserror();
+  if (!rc)
+    _keybox_index_delete(hd->kb, off);
   else
-    rc = 0;
-
-  if (fclose(fp)) {
-    if (!rc) rc = gpg_error_from_syserror();
-  }
-
+    _keybox_index_invalidate(hd->kb);
   return rc;
 }
 
@@ -504,6 +743,7 @@ int keybox_compress(KEYBOX_HANDLE hd) {
   if (hd->secret) return GPG_ERR_NOT_IMPLEMENTED;
   fname = hd->kb->fname;
   if (!fname) return GPG_ERR_INV_HANDLE;
+  if (hd->kb->batch) return 0; /* The offsets must not change now.  */
 
   _keybox_close_file(hd);
 
@@ -621,15 +861,94 @@ int keybox_compress(KEYBOX_HANDLE hd) {
 
   /* Close both files. */
   if (fclose(fp) && !rc) rc = gpg_error_from_syserror();
+  if (!rc && any_changes) rc = sync_file(newfp);
   if (fclose(newfp) && !rc) rc = gpg_error_from_syserror();
 
   /* Rename or remove the temporary file. */
   if (rc || !any_changes)
     gnupg_remove(tmpfname);
-  else
+  else {
+    /* All offsets change.  */
+    _keybox_index_invalidate(hd->kb);
     rc = rename_tmp_file(bakfname, tmpfname, fname, hd->secret);
+  }
 
   xfree(bakfname);
   xfree(tmpfname);
   return rc;
 }
+
+/* Start a batch of changes to the keybox of HD, which must be locked.
+   Until keybox_batch_commit is called, the changes of all handles of
+   this keybox are written without syncing them and the lock is not
+   released.  If the keybox does not yet exist, no batch is started
+   and changes are done one by one.  */
+gpg_error_t keybox_batch_begin(KEYBOX_HANDLE hd) {
+  struct keybox_batch *batch;
+  struct stat st;
+  FILE *fp;
+  off_t end;
+  gpg_error_t rc;
+
+  if (!hd || !hd->kb) return GPG_ERR_INV_HANDLE;
+  if (hd->kb->batch) return 0;
+
+  fp = fopen(hd->kb->fname, "r+b");
+  if (!fp && errno == ENOENT) return 0;
+  if (!fp) return gpg_error_from_syserror();
+
+  _keybox_index_begin(hd->kb);
+  if (fstat(fileno(fp), &st))
+    rc = gpg_error_from_syserror();
+  else
+    rc = find_append_offset(hd->kb, fp, st.st_size, &end);
+  if (rc) {
+    fclose(fp);
+    return rc;
+  }
+
+  batch = new keybox_batch();
+  batch->fp = fp;
+  batch->end = end;
+  batch->openpgp_checked = 0;
+  hd->kb->batch = batch;
+  return 0;
+}
+
+/* Commit the pending batch of changes to the keybox of HD.  The lock
+   has to be released by the caller.  */
+gpg_error_t keybox_batch_commit(KEYBOX_HANDLE hd) {
+  struct keybox_batch *batch;
+  struct stat st;
+  gpg_error_t rc = 0;
+
+  if (!hd || !hd->kb) return GPG_ERR_INV_HANDLE;
+  batch = hd->kb->batch;
+  if (!batch) return 0;
+  hd->kb->batch = NULL;
+
+  /* Neutralize what is left of a blob which failed to be written.  */
+  if (fstat(fileno(batch->fp), &st))
+    rc = gpg_error_from_syserror();
+  else if (st.st_size > batch->end)
+    rc = pad_incomplete_blob(batch->fp, batch->end, st.st_size, &batch->end);
+
+  /* The new blobs have to be on disk before the old ones are gone.  */
+  if (!rc) rc = sync_file(batch->fp);
+  if (!rc && !batch->deleted.empty()) {
+    for (off_t off : batch->deleted)
+      if (fseeko(batch->fp, off + 4, SEEK_SET) || putc(0, batch->fp) == EOF) {
+        rc = gpg_error_from_syserror();
+        break;
+      }
+    if (!rc) rc = sync_file(batch->fp);
+  }
+  if (fclose(batch->fp) && !rc) rc = gpg_error_from_syserror();
+
+  if (!rc)
+    _keybox_index_flush(hd->kb);
+  else
+    _keybox_index_invalidate(hd->kb);
+  delete batch;
+  return rc;
+}
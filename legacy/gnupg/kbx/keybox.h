@@ -63,7 +63,7 @@ void keybox_pop_found_state(KEYBOX_HANDLE hd);
 const char *keybox_get_resource_name(KEYBOX_HANDLE hd);
 int keybox_set_ephemeral(KEYBOX_HANDLE hd, int yes);
 
-gpg_error_t keybox_lock(KEYBOX_HANDLE hd, int yes);
+gpg_error_t keybox_lock(KEYBOX_HANDLE hd, int yes, long timeout);
 
 /*-- keybox-file.c --*/
 /* Fixme: This function does not belong here: Provide a better
@@ -83,6 +83,9 @@ gpg_error_t keybox_search(KEYBOX_HANDLE hd, KEYBOX_SEARCH_DESC *desc,
 
 off_t keybox_offset(KEYBOX_HANDLE hd);
 gpg_error_t keybox_seek(KEYBOX_HANDLE hd, off_t offset);
+off_t keybox_found_offset(KEYBOX_HANDLE hd);
+gpg_error_t keybox_select_fpr(KEYBOX_HANDLE hd, off_t offset,
+                              const unsigned char *fpr);
 
 /*-- keybox-update.c --*/
 gpg_error_t keybox_insert_keyblock(KEYBOX_HANDLE hd, const void *image,
@@ -98,6 +101,9 @@ int keybox_update_cert(KEYBOX_HANDLE hd, ksba_cert_t cert,
 int keybox_set_flags(KEYBOX_HANDLE hd, int what, int idx, unsigned int value);
 
 int keybox_delete(KEYBOX_HANDLE hd);
+
+gpg_error_t keybox_batch_begin(KEYBOX_HANDLE hd);
+gpg_error_t keybox_batch_commit(KEYBOX_HANDLE hd);
 int keybox_compress(KEYBOX_HANDLE hd);
 
 /*-- keybox-util.c --*/
@@ -40,14 +40,16 @@
 typedef struct {
   gcry_mpi_t p; /* prime */
   gcry_mpi_t g; /* group generator */
-  gcry_mpi_t y; /* g^x mod p */
+  gcry_mpi_t y;    /* g^x mod p */
+  mpi_mont_t mont; /* Montgomery context for p, set up on first use */
 } ELG_public_key;
 
 typedef struct {
   gcry_mpi_t p; /* prime */
   gcry_mpi_t g; /* group generator */
-  gcry_mpi_t y; /* g^x mod p */
-  gcry_mpi_t x; /* secret exponent */
+  gcry_mpi_t y;    /* g^x mod p */
+  gcry_mpi_t x;    /* secret exponent */
+  mpi_mont_t mont; /* Montgomery context for p, set up on first use */
 } ELG_secret_key;
 
 static const char *elg_names[] = {
@@ -132,6 +134,7 @@ static int test_keys(ELG_secret_key *sk, unsigned int nbits, int nodie) {
   pk.p = sk->p;
   pk.g = sk->g;
   pk.y = sk->y;
+  pk.mont = NULL;
 
   _gcry_mpi_randomize(test, nbits);
 
@@ -142,6 +145,9 @@ static int test_keys(ELG_secret_key *sk, unsigned int nbits, int nodie) {
   sign(out1_a, out1_b, test, sk);
   if (!verify(out1_a, out1_b, test, &pk)) failed |= 2;
 
+  mpi_mont_free(pk.mont);
+  mpi_mont_free(sk->mont);
+  sk->mont = NULL;
   _gcry_mpi_release(test);
   _gcry_mpi_release(out1_a);
   _gcry_mpi_release(out1_b);
@@ -413,6 +419,18 @@ static int check_secret_key(ELG_secret_key *sk) {
   return rc;
 }
 
+/* RES = BASE ^ EXPO mod P, with the Montgomery context for P in
+   *MONT, which is created if needed.  An operation with several
+   exponentiations modulo P thus sets up the context only once.  */
+static void elg_powm(gcry_mpi_t res, gcry_mpi_t base, gcry_mpi_t expo,
+                     gcry_mpi_t p, mpi_mont_t *mont) {
+  if (!*mont) *mont = mpi_mont_init(p);
+  if (*mont)
+    mpi_powm_mont(res, base, expo, *mont);
+  else
+    mpi_powm(res, base, expo, p);
+}
+
 static void do_encrypt(gcry_mpi_t a, gcry_mpi_t b, gcry_mpi_t input,
                        ELG_public_key *pkey) {
   gcry_mpi_t k;
@@ -423,14 +441,14 @@ static void do_encrypt(gcry_mpi_t a, gcry_mpi_t b, gcry_mpi_t input,
    */
 
   k = gen_k(pkey->p, 1);
-  mpi_powm(a, pkey->g, k, pkey->p);
+  elg_powm(a, pkey->g, k, pkey->p, &pkey->mont);
 
   /* b = (y^k * input) mod p
    *	 = ((y^k mod p) * (input mod p)) mod p
    * and because input is < p
    *	 = ((y^k mod p) * input) mod p
    */
-  mpi_powm(b, pkey->y, k, pkey->p);
+  elg_powm(b, pkey->y, k, pkey->p, &pkey->mont);
   mpi_mulm(b, b, input, pkey->p);
 #if 0
   if( DBG_CIPHER )
@@ -466,10 +484,10 @@ static void decrypt(gcry_mpi_t output, gcry_mpi_t a, gcry_mpi_t b,
   _gcry_mpi_randomize(r, nbits);
 
   /* t1 = r^x mod p */
-  mpi_powm(t1, r, skey->x, skey->p);
+  elg_powm(t1, r, skey->x, skey->p, &skey->mont);
   /* t2 = (a * r)^-x mod p */
   mpi_mulm(t2, a, r, skey->p);
-  mpi_powm(t2, t2, skey->x, skey->p);
+  elg_powm(t2, t2, skey->x, skey->p, &skey->mont);
   mpi_invm(t2, t2, skey->p);
   /* t1 = (t1 * t2) mod p*/
   mpi_mulm(t1, t1, t2, skey->p);
@@ -480,7 +498,7 @@ static void decrypt(gcry_mpi_t output, gcry_mpi_t a, gcry_mpi_t b,
 #else /*!USE_BLINDING*/
 
   /* output = b/(a^x) mod p */
-  mpi_powm(t1, a, skey->x, skey->p);
+  elg_powm(t1, a, skey->x, skey->p, &skey->mont);
   mpi_invm(t1, t1, skey->p);
 
 #endif /*!USE_BLINDING*/
@@ -756,6 +774,7 @@ leave:
   _gcry_mpi_release(pk.p);
   _gcry_mpi_release(pk.g);
   _gcry_mpi_release(pk.y);
+  mpi_mont_free(pk.mont);
   _gcry_mpi_release(data);
   _gcry_pk_util_free_encoding_ctx(&ctx);
   if (DBG_CIPHER) log_debug("elg_encrypt   => %s\n", gpg_strerror(rc));
@@ -841,6 +860,7 @@ leave:
   _gcry_mpi_release(sk.g);
   _gcry_mpi_release(sk.y);
   _gcry_mpi_release(sk.x);
+  mpi_mont_free(sk.mont);
   _gcry_mpi_release(data_a);
   _gcry_mpi_release(data_b);
   sexp_release(l1);
@@ -890,6 +890,50 @@ gpg_error_t _gcry_md_hash_buffers(int algo, unsigned int flags, void *digest,
   return 0;
 }
 
+/* Shortcut function to hash many messages with a given algo.  Each of
+   the N items of BUFS is a message of its own and the N digests are
+   stored one after the other at DIGESTS, which must have been
+   provided by the caller with an appropriate length.  For SHA-1,
+   SHA-256 and SHA-512 several messages are hashed in parallel if the
+   CPU supports it.  No flags are supported yet.  */
+gpg_error_t _gcry_md_hash_buffers_multi(int algo, unsigned int flags,
+                                        void *digests,
+                                        const gcry_buffer_t *bufs, int n) {
+  gpg_error_t rc;
+  int dlen;
+  int i;
+
+  if (!bufs || n < 0) return GPG_ERR_INV_ARG;
+  if (flags) return GPG_ERR_INV_ARG;
+
+  if (0)
+    ;
+#if USE_SHA256
+  else if (algo == GCRY_MD_SHA256)
+    _gcry_sha256_hash_multi(digests, bufs, n);
+#endif
+#if USE_SHA512
+  else if (algo == GCRY_MD_SHA512)
+    _gcry_sha512_hash_multi(digests, bufs, n);
+#endif
+#if USE_SHA1
+  else if (algo == GCRY_MD_SHA1)
+    _gcry_sha1_hash_multi(digests, bufs, n);
+#endif
+  else {
+    dlen = md_digest_length(algo);
+    if (!dlen) return GPG_ERR_DIGEST_ALGO;
+
+    for (i = 0; i < n; i++) {
+      rc = _gcry_md_hash_buffers(algo, 0, (char *)digests + i * dlen,
+                                 &bufs[i], 1);
+      if (rc) return rc;
+    }
+  }
+
+  return 0;
+}
+
 static int md_get_algo(gcry_md_hd_t a) {
   GcryDigestEntry *r = a->ctx->list;
 
@@ -0,0 +1,647 @@
+/* rijndael-aesni.cpp  -  AES-NI and VAES accelerated AES
+ * Copyright (C) 2017 The NeoPG developers
+ *
+ * This file is part of Libgcrypt.
+ *
+ * Libgcrypt is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * Libgcrypt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./cipher-internal.h"
+#include "bufhelp.h"
+#include "cipher.h"
+#include "g10lib.h"
+#include "rijndael-internal.h"
+#include "types.h"
+
+#ifdef USE_AESNI
+
+#include <immintrin.h>
+
+/* The functions in this file are only called if the CPU supports the
+   instructions, so the instruction sets are enabled per function and
+   not for the whole build.  */
+#define AESNI_FUNC __attribute__((target("aes,sse4.1")))
+#define AESNI_INLINE \
+  AESNI_FUNC __attribute__((always_inline)) static inline
+
+/* Round key R of the key schedule SCHED.  The key schedules hold the
+   round keys in the byte order used by the AES-NI instructions.  */
+#define RKEY(sched, r) _mm_load_si128((const __m128i *)(sched)[r])
+
+#define DO8(x) \
+  do {         \
+    x(0);      \
+    x(1);      \
+    x(2);      \
+    x(3);      \
+    x(4);      \
+    x(5);      \
+    x(6);      \
+    x(7);      \
+  } while (0)
+
+AESNI_INLINE __m128i load_block(const void *p) {
+  return _mm_loadu_si128((const __m128i *)p);
+}
+
+AESNI_INLINE void store_block(void *p, __m128i b) {
+  _mm_storeu_si128((__m128i *)p, b);
+}
+
+AESNI_INLINE __m128i encrypt_block(const RIJNDAEL_context *ctx, __m128i b) {
+  int rounds = ctx->rounds;
+  int r;
+
+  b = _mm_xor_si128(b, RKEY(ctx->keyschenc, 0));
+  for (r = 1; r < rounds; r++)
+    b = _mm_aesenc_si128(b, RKEY(ctx->keyschenc, r));
+  return _mm_aesenclast_si128(b, RKEY(ctx->keyschenc, rounds));
+}
+
+AESNI_INLINE __m128i decrypt_block(const RIJNDAEL_context *ctx, __m128i b) {
+  int rounds = ctx->rounds;
+  int r;
+
+  b = _mm_xor_si128(b, RKEY(ctx->keyschdec, 0));
+  for (r = 1; r < rounds; r++)
+    b = _mm_aesdec_si128(b, RKEY(ctx->keyschdec, r));
+  return _mm_aesdeclast_si128(b, RKEY(ctx->keyschdec, rounds));
+}
+
+/* Encrypt or decrypt the eight blocks in B in parallel, to hide the
+   latency of the AES instructions.  */
+AESNI_INLINE void encrypt_8blocks(const RIJNDAEL_context *ctx, __m128i *b) {
+  int rounds = ctx->rounds;
+  __m128i k;
+  int r;
+
+  k = RKEY(ctx->keyschenc, 0);
+#define XOR_KEY(i) b[i] = _mm_xor_si128(b[i], k)
+  DO8(XOR_KEY);
+  for (r = 1; r < rounds; r++) {
+    k = RKEY(ctx->keyschenc, r);
+#define ENC_ROUND(i) b[i] = _mm_aesenc_si128(b[i], k)
+    DO8(ENC_ROUND);
+  }
+  k = RKEY(ctx->keyschenc, rounds);
+#define ENC_LAST(i) b[i] = _mm_aesenclast_si128(b[i], k)
+  DO8(ENC_LAST);
+}
+
+AESNI_INLINE void decrypt_8blocks(const RIJNDAEL_context *ctx, __m128i *b) {
+  int rounds = ctx->rounds;
+  __m128i k;
+  int r;
+
+  k = RKEY(ctx->keyschdec, 0);
+  DO8(XOR_KEY);
+  for (r = 1; r < rounds; r++) {
+    k = RKEY(ctx->keyschdec, r);
+#define DEC_ROUND(i) b[i] = _mm_aesdec_si128(b[i], k)
+    DO8(DEC_ROUND);
+  }
+  k = RKEY(ctx->keyschdec, rounds);
+#define DEC_LAST(i) b[i] = _mm_aesdeclast_si128(b[i], k)
+  DO8(DEC_LAST);
+}
+
+/* Increment the big-endian counter block CTR by one.  */
+static inline void ctr_inc(unsigned char *ctr) {
+  u64 low = buf_get_be64(ctr + 8) + 1;
+
+  buf_put_be64(ctr + 8, low);
+  if (!low) buf_put_be64(ctr, buf_get_be64(ctr) + 1);
+}
+
+/* The byte shuffle that converts between a big-endian counter block
+   and a little-endian 128 bit integer.  */
+AESNI_INLINE __m128i bswap128_mask(void) {
+  return _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+}
+
+/* Return Offset_N = Offset_{N-1} xor L_{ntz(N)}.  */
+AESNI_INLINE __m128i ocb_next_offset(gcry_cipher_hd_t c, __m128i offset,
+                                     u64 n) {
+  return _mm_xor_si128(offset, load_block(ocb_get_l(c, n)));
+}
+
+/* Return SubWord(W) if ROT is 0, and RotWord(SubWord(W)) otherwise.  */
+AESNI_INLINE u32 sub_word(u32 w, int rot) {
+  __m128i t = _mm_aeskeygenassist_si128(_mm_set1_epi32(w), 0);
+
+  return rot ? _mm_extract_epi32(t, 1) : _mm_cvtsi128_si32(t);
+}
+
+AESNI_FUNC void _gcry_aes_aesni_do_setkey(RIJNDAEL_context *ctx,
+                                          const byte *key) {
+  static const byte rcon[] = {0x01, 0x02, 0x04, 0x08, 0x10,
+                              0x20, 0x40, 0x80, 0x1b, 0x36};
+  int nk = ctx->rounds - 6;
+  int nw = 4 * (ctx->rounds + 1);
+  u32 w[4 * (MAXROUNDS + 1)];
+  int i;
+
+  /* This is the key expansion of FIPS-197, section 5.2, on words that
+     hold the key bytes in little-endian order, as the AES-NI
+     instructions expect.  */
+  for (i = 0; i < nk; i++) w[i] = buf_get_le32(key + 4 * i);
+  for (i = nk; i < nw; i++) {
+    u32 t = w[i - 1];
+
+    if (i % nk == 0)
+      t = sub_word(t, 1) ^ rcon[i / nk - 1];
+    else if (nk > 6 && i % nk == 4)
+      t = sub_word(t, 0);
+    w[i] = w[i - nk] ^ t;
+  }
+
+  for (i = 0; i < nw; i++) ctx->keyschenc32[i / 4][i % 4] = w[i];
+
+  wipememory(w, sizeof(w));
+}
+
+/* Make a decryption key schedule for the equivalent inverse cipher
+   from the encryption key schedule.  */
+AESNI_FUNC void _gcry_aes_aesni_prepare_decryption(RIJNDAEL_context *ctx) {
+  int rounds = ctx->rounds;
+  int r;
+
+  _mm_store_si128((__m128i *)ctx->keyschdec[0], RKEY(ctx->keyschenc, rounds));
+  for (r = 1; r < rounds; r++)
+    _mm_store_si128((__m128i *)ctx->keyschdec[r],
+                    _mm_aesimc_si128(RKEY(ctx->keyschenc, rounds - r)));
+  _mm_store_si128((__m128i *)ctx->keyschdec[rounds], RKEY(ctx->keyschenc, 0));
+}
+
+AESNI_FUNC unsigned int _gcry_aes_aesni_encrypt(const RIJNDAEL_context *ctx,
+                                                unsigned char *dst,
+                                                const unsigned char *src) {
+  store_block(dst, encrypt_block(ctx, load_block(src)));
+  return 0;
+}
+
+AESNI_FUNC unsigned int _gcry_aes_aesni_decrypt(const RIJNDAEL_context *ctx,
+                                                unsigned char *dst,
+                                                const unsigned char *src) {
+  store_block(dst, decrypt_block(ctx, load_block(src)));
+  return 0;
+}
+
+AESNI_FUNC void _gcry_aes_aesni_cfb_enc(RIJNDAEL_context *ctx,
+                                        unsigned char *outbuf,
+                                        const unsigned char *inbuf,
+                                        unsigned char *iv, size_t nblocks) {
+  __m128i b = load_block(iv);
+
+  for (; nblocks; nblocks--) {
+    b = _mm_xor_si128(encrypt_block(ctx, b), load_block(inbuf));
+    store_block(outbuf, b);
+    inbuf += BLOCKSIZE;
+    outbuf += BLOCKSIZE;
+  }
+
+  store_block(iv, b);
+}
+
+AESNI_FUNC void _gcry_aes_aesni_cbc_enc(RIJNDAEL_context *ctx,
+                                        unsigned char *outbuf,
+                                        const unsigned char *inbuf,
+                                        unsigned char *iv, size_t nblocks,
+                                        int cbc_mac) {
+  __m128i b = load_block(iv);
+
+  for (; nblocks; nblocks--) {
+    b = encrypt_block(ctx, _mm_xor_si128(b, load_block(inbuf)));
+    store_block(outbuf, b);
+    inbuf += BLOCKSIZE;
+    if (!cbc_mac) outbuf += BLOCKSIZE;
+  }
+
+  store_block(iv, b);
+}
+
+AESNI_FUNC void _gcry_aes_aesni_ctr_enc(RIJNDAEL_context *ctx,
+                                        unsigned char *outbuf,
+                                        const unsigned char *inbuf,
+                                        unsigned char *ctr, size_t nblocks) {
+  const __m128i bswap = bswap128_mask();
+  __m128i b[8];
+
+  for (; nblocks >= 8; nblocks -= 8) {
+    /* Unless the low half of the counter wraps, the counter blocks can
+       be computed with 64 bit additions.  */
+    if (buf_get_be64(ctr + 8) <= ~(u64)0 - 8) {
+      __m128i c = _mm_shuffle_epi8(load_block(ctr), bswap);
+
+#define CTR_BLOCK(i) \
+  b[i] = _mm_shuffle_epi8(_mm_add_epi64(c, _mm_set_epi32(0, 0, 0, i)), bswap)
+      DO8(CTR_BLOCK);
+      store_block(ctr, _mm_shuffle_epi8(
+                           _mm_add_epi64(c, _mm_set_epi32(0, 0, 0, 8)), bswap));
+    } else {
+#define CTR_BLOCK_SLOW(i) \
+  b[i] = load_block(ctr); \
+  ctr_inc(ctr)
+      DO8(CTR_BLOCK_SLOW);
+    }
+
+    encrypt_8blocks(ctx, b);
+#define XOR_STORE(i)                                                 \
+  store_block(outbuf + i * BLOCKSIZE,                                \
+              _mm_xor_si128(b[i], load_block(inbuf + i * BLOCKSIZE)))
+    DO8(XOR_STORE);
+    inbuf += 8 * BLOCKSIZE;
+    outbuf += 8 * BLOCKSIZE;
+  }
+
+  for (; nblocks; nblocks--) {
+    b[0] = encrypt_block(ctx, load_block(ctr));
+    ctr_inc(ctr);
+    store_block(outbuf, _mm_xor_si128(b[0], load_block(inbuf)));
+    inbuf += BLOCKSIZE;
+    outbuf += BLOCKSIZE;
+  }
+}
+
+AESNI_FUNC void _gcry_aes_aesni_cfb_dec(RIJNDAEL_context *ctx,
+                                        unsigned char *outbuf,
+                                        const unsigned char *inbuf,
+                                        unsigned char *iv, size_t nblocks) {
+  __m128i last = load_block(iv);
+  __m128i b[8];
+
+  for (; nblocks >= 8; nblocks -= 8) {
+    b[0] = last;
+#define CFB_PREV(i) b[i] = load_block(inbuf + (i - 1) * BLOCKSIZE)
+    CFB_PREV(1);
+    CFB_PREV(2);
+    CFB_PREV(3);
+    CFB_PREV(4);
+    CFB_PREV(5);
+    CFB_PREV(6);
+    CFB_PREV(7);
+    last = load_block(inbuf + 7 * BLOCKSIZE);
+
+    encrypt_8blocks(ctx, b);
+    DO8(XOR_STORE);
+    inbuf += 8 * BLOCKSIZE;
+    outbuf += 8 * BLOCKSIZE;
+  }
+
+  for (; nblocks; nblocks--) {
+    __m128i c = load_block(inbuf);
+
+    store_block(outbuf, _mm_xor_si128(encrypt_block(ctx, last), c));
+    last = c;
+    inbuf += BLOCKSIZE;
+    outbuf += BLOCKSIZE;
+  }
+
+  store_block(iv, last);
+}
+
+AESNI_FUNC void _gcry_aes_aesni_cbc_dec(RIJNDAEL_context *ctx,
+                                        unsigned char *outbuf,
+                                        const unsigned char *inbuf,
+                                        unsigned char *iv, size_t nblocks) {
+  __m128i last = load_block(iv);
+  __m128i b[8], c[8];
+
+  for (; nblocks >= 8; nblocks -= 8) {
+    /* Keep the ciphertext, which is overwritten if OUTBUF is INBUF.  */
+#define LOAD(i) b[i] = load_block(inbuf + i * BLOCKSIZE)
+#define CBC_LOAD(i) c[i] = LOAD(i)
+    DO8(CBC_LOAD);
+
+    decrypt_8blocks(ctx, b);
+    store_block(outbuf, _mm_xor_si128(b[0], last));
+#define CBC_XOR_STORE(i) \
+  store_block(outbuf + i * BLOCKSIZE, _mm_xor_si128(b[i], c[i - 1]))
+    CBC_XOR_STORE(1);
+    CBC_XOR_STORE(2);
+    CBC_XOR_STORE(3);
+    CBC_XOR_STORE(4);
+    CBC_XOR_STORE(5);
+    CBC_XOR_STORE(6);
+    CBC_XOR_STORE(7);
+    last = c[7];
+    inbuf += 8 * BLOCKSIZE;
+    outbuf += 8 * BLOCKSIZE;
+  }
+
+  for (; nblocks; nblocks--) {
+    __m128i c = load_block(inbuf);
+
+    store_block(outbuf, _mm_xor_si128(decrypt_block(ctx, c), last));
+    last = c;
+    inbuf += BLOCKSIZE;
+    outbuf += BLOCKSIZE;
+  }
+
+  store_block(iv, last);
+}
+
+AESNI_FUNC void _gcry_aes_aesni_ocb_crypt(gcry_cipher_hd_t c, void *outbuf_arg,
+                                          const void *inbuf_arg,
+                                          size_t nblocks, int encrypt) {
+  RIJNDAEL_context *ctx = (RIJNDAEL_context *)(void *)&c->context.c;
+  unsigned char *outbuf = (unsigned char *)outbuf_arg;
+  const unsigned char *inbuf = (const unsigned char *)inbuf_arg;
+  u64 n = c->u_mode.ocb.data_nblocks;
+  __m128i offset = load_block(c->u_iv.iv);
+  __m128i checksum = load_block(c->u_ctr.ctr);
+  __m128i b[8], o[8];
+
+  for (; nblocks >= 8; nblocks -= 8) {
+    /* C_i = Offset_i xor ENCIPHER(K, P_i xor Offset_i), and
+       Checksum_i = Checksum_{i-1} xor P_i.  */
+#define OCB_OFFSET(i) o[i] = offset = ocb_next_offset(c, offset, ++n)
+    DO8(OCB_OFFSET);
+    DO8(LOAD);
+    if (encrypt) {
+      checksum = _mm_xor_si128(
+          checksum, _mm_xor_si128(_mm_xor_si128(_mm_xor_si128(b[0], b[1]),
+                                                _mm_xor_si128(b[2], b[3])),
+                                  _mm_xor_si128(_mm_xor_si128(b[4], b[5]),
+                                                _mm_xor_si128(b[6], b[7]))));
+#define XOR_OFFSET(i) b[i] = _mm_xor_si128(b[i], o[i])
+      DO8(XOR_OFFSET);
+      encrypt_8blocks(ctx, b);
+      DO8(XOR_OFFSET);
+    } else {
+      DO8(XOR_OFFSET);
+      decrypt_8blocks(ctx, b);
+      DO8(XOR_OFFSET);
+      checksum = _mm_xor_si128(
+          checksum, _mm_xor_si128(_mm_xor_si128(_mm_xor_si128(b[0], b[1]),
+                                                _mm_xor_si128(b[2], b[3])),
+                                  _mm_xor_si128(_mm_xor_si128(b[4], b[5]),
+                                                _mm_xor_si128(b[6], b[7]))));
+    }
+#define STORE(i) store_block(outbuf + i * BLOCKSIZE, b[i])
+    DO8(STORE);
+    inbuf += 8 * BLOCKSIZE;
+    outbuf += 8 * BLOCKSIZE;
+  }
+
+  for (; nblocks; nblocks--) {
+    offset = ocb_next_offset(c, offset, ++n);
+    b[0] = load_block(inbuf);
+    if (encrypt) {
+      checksum = _mm_xor_si128(checksum, b[0]);
+      b[0] = encrypt_block(ctx, _mm_xor_si128(b[0], offset));
+      b[0] = _mm_xor_si128(b[0], offset);
+    } else {
+      b[0] = decrypt_block(ctx, _mm_xor_si128(b[0], offset));
+      b[0] = _mm_xor_si128(b[0], offset);
+      checksum = _mm_xor_si128(checksum, b[0]);
+    }
+    store_block(outbuf, b[0]);
+    inbuf += BLOCKSIZE;
+    outbuf += BLOCKSIZE;
+  }
+
+  c->u_mode.ocb.data_nblocks = n;
+  store_block(c->u_iv.iv, offset);
+  store_block(c->u_ctr.ctr, checksum);
+}
+
+AESNI_FUNC void _gcry_aes_aesni_ocb_auth(gcry_cipher_hd_t c,
+                                         const void *abuf_arg,
+                                         size_t nblocks) {
+  RIJNDAEL_context *ctx = (RIJNDAEL_context *)(void *)&c->context.c;
+  const unsigned char *inbuf = (const unsigned char *)abuf_arg;
+  u64 n = c->u_mode.ocb.aad_nblocks;
+  __m128i offset = load_block(c->u_mode.ocb.aad_offset);
+  __m128i sum = load_block(c->u_mode.ocb.aad_sum);
+  __m128i b[8];
+
+  for (; nblocks >= 8; nblocks -= 8) {
+    /* Sum_i = Sum_{i-1} xor ENCIPHER(K, A_i xor Offset_i)  */
+#define AUTH_BLOCK(i)                          \
+  offset = ocb_next_offset(c, offset, ++n);   \
+  b[i] = _mm_xor_si128(load_block(inbuf + i * BLOCKSIZE), offset)
+    DO8(AUTH_BLOCK);
+    encrypt_8blocks(ctx, b);
+    sum = _mm_xor_si128(
+        sum, _mm_xor_si128(_mm_xor_si128(_mm_xor_si128(b[0], b[1]),
+                                         _mm_xor_si128(b[2], b[3])),
+                           _mm_xor_si128(_mm_xor_si128(b[4], b[5]),
+                                         _mm_xor_si128(b[6], b[7]))));
+    inbuf += 8 * BLOCKSIZE;
+  }
+
+  for (; nblocks; nblocks--) {
+    offset = ocb_next_offset(c, offset, ++n);
+    b[0] = encrypt_block(ctx, _mm_xor_si128(load_block(inbuf), offset));
+    sum = _mm_xor_si128(sum, b[0]);
+    inbuf += BLOCKSIZE;
+  }
+
+  c->u_mode.ocb.aad_nblocks = n;
+  store_block(c->u_mode.ocb.aad_offset, offset);
+  store_block(c->u_mode.ocb.aad_sum, sum);
+}
+
+#ifdef USE_VAES
+
+/* The VAES variants work on two blocks per 256 bit register, and on
+   sixteen blocks per iteration.  Remaining blocks are left to the
+   AES-NI functions.  */
+#define VAES_FUNC __attribute__((target("aes,vaes,avx2")))
+#define VAES_INLINE VAES_FUNC __attribute__((always_inline)) static inline
+
+/* Round key R of SCHED in both lanes.  */
+#define RKEY2(sched, r) _mm256_broadcastsi128_si256(RKEY(sched, r))
+
+VAES_INLINE __m256i load_2blocks(const void *p) {
+  return _mm256_loadu_si256((const __m256i *)p);
+}
+
+VAES_INLINE void store_2blocks(void *p, __m256i b) {
+  _mm256_storeu_si256((__m256i *)p, b);
+}
+
+VAES_INLINE __m256i make_2blocks(__m128i lo, __m128i hi) {
+  return _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+}
+
+VAES_INLINE void vaes_encrypt_16blocks(const RIJNDAEL_context *ctx,
+                                       __m256i *b) {
+  int rounds = ctx->rounds;
+  __m256i k;
+  int r;
+
+  k = RKEY2(ctx->keyschenc, 0);
+#define XOR_KEY2(i) b[i] = _mm256_xor_si256(b[i], k)
+  DO8(XOR_KEY2);
+  for (r = 1; r < rounds; r++) {
+    k = RKEY2(ctx->keyschenc, r);
+#define ENC_ROUND2(i) b[i] = _mm256_aesenc_epi128(b[i], k)
+    DO8(ENC_ROUND2);
+  }
+  k = RKEY2(ctx->keyschenc, rounds);
+#define ENC_LAST2(i) b[i] = _mm256_aesenclast_epi128(b[i], k)
+  DO8(ENC_LAST2);
+}
+
+VAES_INLINE void vaes_decrypt_16blocks(const RIJNDAEL_context *ctx,
+                                       __m256i *b) {
+  int rounds = ctx->rounds;
+  __m256i k;
+  int r;
+
+  k = RKEY2(ctx->keyschdec, 0);
+  DO8(XOR_KEY2);
+  for (r = 1; r < rounds; r++) {
+    k = RKEY2(ctx->keyschdec, r);
+#define DEC_ROUND2(i) b[i] = _mm256_aesdec_epi128(b[i], k)
+    DO8(DEC_ROUND2);
+  }
+  k = RKEY2(ctx->keyschdec, rounds);
+#define DEC_LAST2(i) b[i] = _mm256_aesdeclast_epi128(b[i], k)
+  DO8(DEC_LAST2);
+}
+
+VAES_FUNC void _gcry_aes_vaes_ctr_enc(RIJNDAEL_context *ctx,
+                                      unsigned char *outbuf,
+                                      const unsigned char *inbuf,
+                                      unsigned char *ctr, size_t nblocks) {
+  const __m256i bswap = _mm256_broadcastsi128_si256(bswap128_mask());
+  __m256i b[8];
+
+  for (; nblocks >= 16; nblocks -= 16) {
+    if (buf_get_be64(ctr + 8) > ~(u64)0 - 16) {
+      _gcry_aes_aesni_ctr_enc(ctx, outbuf, inbuf, ctr, 16);
+    } else {
+      __m256i c = _mm256_broadcastsi128_si256(
+          _mm_shuffle_epi8(load_block(ctr), _mm256_castsi256_si128(bswap)));
+
+      /* Lane j of register i holds the counter plus 2 * i + j.  */
+#define CTR_2BLOCKS(i)                                                   \
+  b[i] = _mm256_shuffle_epi8(                                            \
+      _mm256_add_epi64(c, _mm256_set_epi64x(0, 2 * i + 1, 0, 2 * i)), \
+      bswap)
+      DO8(CTR_2BLOCKS);
+      store_block(ctr, _mm_shuffle_epi8(
+                           _mm_add_epi64(_mm256_castsi256_si128(c),
+                                         _mm_set_epi32(0, 0, 0, 16)),
+                           _mm256_castsi256_si128(bswap)));
+
+      vaes_encrypt_16blocks(ctx, b);
+#define XOR_STORE2(i)                                                        \
+  store_2blocks(outbuf + 2 * i * BLOCKSIZE,                                  \
+                _mm256_xor_si256(b[i], load_2blocks(inbuf + 2 * i * BLOCKSIZE)))
+      DO8(XOR_STORE2);
+    }
+    inbuf += 16 * BLOCKSIZE;
+    outbuf += 16 * BLOCKSIZE;
+  }
+
+  if (nblocks) _gcry_aes_aesni_ctr_enc(ctx, outbuf, inbuf, ctr, nblocks);
+}
+
+VAES_FUNC void _gcry_aes_vaes_cfb_dec(RIJNDAEL_context *ctx,
+                                      unsigned char *outbuf,
+                                      const unsigned char *inbuf,
+                                      unsigned char *iv, size_t nblocks) {
+  __m256i b[8];
+
+  for (; nblocks >= 16; nblocks -= 16) {
+    /* The inputs of the block cipher are the IV and the first fifteen
+       ciphertext blocks.  */
+    b[0] = make_2blocks(load_block(iv), load_block(inbuf));
+#define CFB_PREV2(i) b[i] = load_2blocks(inbuf + (2 * i - 1) * BLOCKSIZE)
+    CFB_PREV2(1);
+    CFB_PREV2(2);
+    CFB_PREV2(3);
+    CFB_PREV2(4);
+    CFB_PREV2(5);
+    CFB_PREV2(6);
+    CFB_PREV2(7);
+    buf_cpy(iv, inbuf + 15 * BLOCKSIZE, BLOCKSIZE);
+
+    vaes_encrypt_16blocks(ctx, b);
+    DO8(XOR_STORE2);
+    inbuf += 16 * BLOCKSIZE;
+    outbuf += 16 * BLOCKSIZE;
+  }
+
+  if (nblocks) _gcry_aes_aesni_cfb_dec(ctx, outbuf, inbuf, iv, nblocks);
+}
+
+VAES_FUNC void _gcry_aes_vaes_ocb_crypt(gcry_cipher_hd_t c, void *outbuf_arg,
+                                        const void *inbuf_arg, size_t nblocks,
+                                        int encrypt) {
+  RIJNDAEL_context *ctx = (RIJNDAEL_context *)(void *)&c->context.c;
+  unsigned char *outbuf = (unsigned char *)outbuf_arg;
+  const unsigned char *inbuf = (const unsigned char *)inbuf_arg;
+  u64 n = c->u_mode.ocb.data_nblocks;
+  __m128i offset = load_block(c->u_iv.iv);
+  __m256i checksum = _mm256_setzero_si256();
+  __m256i b[8], o[8];
+
+  if (nblocks < 16) {
+    _gcry_aes_aesni_ocb_crypt(c, outbuf, inbuf, nblocks, encrypt);
+    return;
+  }
+
+  for (; nblocks >= 16; nblocks -= 16) {
+#define OCB_OFFSET2(i)                             \
+  do {                                             \
+    __m128i lo = ocb_next_offset(c, offset, ++n); \
+    offset = ocb_next_offset(c, lo, ++n);          \
+    o[i] = make_2blocks(lo, offset);               \
+  } while (0)
+    DO8(OCB_OFFSET2);
+#define LOAD2(i) b[i] = load_2blocks(inbuf + 2 * i * BLOCKSIZE)
+    DO8(LOAD2);
+#define XOR_CHECKSUM2(i) checksum = _mm256_xor_si256(checksum, b[i])
+#define XOR_OFFSET2(i) b[i] = _mm256_xor_si256(b[i], o[i])
+    if (encrypt) {
+      DO8(XOR_CHECKSUM2);
+      DO8(XOR_OFFSET2);
+      vaes_encrypt_16blocks(ctx, b);
+      DO8(XOR_OFFSET2);
+    } else {
+      DO8(XOR_OFFSET2);
+      vaes_decrypt_16blocks(ctx, b);
+      DO8(XOR_OFFSET2);
+      DO8(XOR_CHECKSUM2);
+    }
+#define STORE2(i) store_2blocks(outbuf + 2 * i * BLOCKSIZE, b[i])
+    DO8(STORE2);
+    inbuf += 16 * BLOCKSIZE;
+    outbuf += 16 * BLOCKSIZE;
+  }
+
+  c->u_mode.ocb.data_nblocks = n;
+  store_block(c->u_iv.iv, offset);
+  store_block(c->u_ctr.ctr,
+              _mm_xor_si128(load_block(c->u_ctr.ctr),
+                            _mm_xor_si128(_mm256_castsi256_si128(checksum),
+                                          _mm256_extracti128_si256(checksum,
+                                                                   1))));
+
+  if (nblocks) _gcry_aes_aesni_ocb_crypt(c, outbuf, inbuf, nblocks, encrypt);
+}
+
+#endif /*USE_VAES*/
+
+#endif /*USE_AESNI*/
@@ -72,18 +72,29 @@
 #endif
 #endif /*ENABLE_PADLOCK_SUPPORT*/
 
-/* USE_AESNI inidicates whether to compile with Intel AES-NI code.  We
-   need the vector-size attribute which seems to be available since
-   gcc 3.  However, to be on the safe side we require at least gcc 4.  */
+/* USE_AESNI inidicates whether to compile with Intel AES-NI code.  The
+   code uses intrinsics in functions with a target attribute, which
+   needs at least gcc 4.9.  */
 #undef USE_AESNI
 #ifdef ENABLE_AESNI_SUPPORT
 #if ((defined(__i386__) && SIZEOF_UNSIGNED_LONG == 4) || defined(__x86_64__))
-#if __GNUC__ >= 4
+#if defined(__clang__) || __GNUC__ > 4 || \
+    (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)
 #define USE_AESNI 1
 #endif
 #endif
 #endif /* ENABLE_AESNI_SUPPORT */
 
+/* USE_VAES indicates whether to compile the VAES/AVX2 variants of the
+   AES-NI code, which need the VAES intrinsics of gcc 8 or clang 6.  */
+#undef USE_VAES
+#if defined(USE_AESNI) && defined(__x86_64__) && defined(ENABLE_AVX2_SUPPORT)
+#if (defined(__clang__) && __clang_major__ >= 6) || \
+    (!defined(__clang__) && __GNUC__ >= 8)
+#define USE_VAES 1
+#endif
+#endif
+
 /* USE_ARM_CE indicates whether to enable ARMv8 Crypto Extension assembly
  * code. */
 #undef USE_ARM_CE
@@ -139,6 +150,9 @@ typedef struct RIJNDAEL_context_s {
 #ifdef USE_AESNI
   unsigned int use_aesni : 1; /* AES-NI shall be used.  */
 #endif                        /*USE_AESNI*/
+#ifdef USE_VAES
+  unsigned int use_vaes : 1; /* VAES shall be used for bulk modes.  */
+#endif                       /*USE_VAES*/
 #ifdef USE_SSSE3
   unsigned int use_ssse3 : 1; /* SSSE3 shall be used.  */
 #endif                        /*USE_SSSE3*/
@@ -102,6 +102,21 @@ extern void _gcry_aes_aesni_ocb_auth(gcry_cipher_hd_t c, const void *abuf_arg,
                                      size_t nblocks);
 #endif
 
+#ifdef USE_VAES
+/* VAES/AVX2 (AMD64) implementations of the parallel bulk modes */
+extern void _gcry_aes_vaes_ctr_enc(RIJNDAEL_context *ctx,
+                                   unsigned char *outbuf,
+                                   const unsigned char *inbuf,
+                                   unsigned char *ctr, size_t nblocks);
+extern void _gcry_aes_vaes_cfb_dec(RIJNDAEL_context *ctx,
+                                   unsigned char *outbuf,
+                                   const unsigned char *inbuf,
+                                   unsigned char *iv, size_t nblocks);
+extern void _gcry_aes_vaes_ocb_crypt(gcry_cipher_hd_t c, void *outbuf_arg,
+                                     const void *inbuf_arg, size_t nblocks,
+                                     int encrypt);
+#endif
+
 #ifdef USE_SSSE3
 /* SSSE3 (AMD64) vector permutation implementation of AES */
 extern void _gcry_aes_ssse3_do_setkey(RIJNDAEL_context *ctx, const byte *key);
@@ -276,6 +291,9 @@ static gpg_error_t do_setkey(RIJNDAEL_context *ctx, const byte *key,
 #ifdef USE_AESNI
   ctx->use_aesni = 0;
 #endif
+#ifdef USE_VAES
+  ctx->use_vaes = 0;
+#endif
 #ifdef USE_SSSE3
   ctx->use_ssse3 = 0;
 #endif
@@ -293,6 +311,9 @@ static gpg_error_t do_setkey(RIJNDAEL_context *ctx, const byte *key,
     ctx->prefetch_enc_fn = NULL;
     ctx->prefetch_dec_fn = NULL;
     ctx->use_aesni = 1;
+#ifdef USE_VAES
+    if (hwfeatures & HWF_INTEL_VAES) ctx->use_vaes = 1;
+#endif
   }
 #endif
 #ifdef USE_PADLOCK
@@ -803,7 +824,12 @@ void _gcry_aes_ctr_enc(void *context, unsigned char *ctr, void *outbuf_arg,
     ;
 #ifdef USE_AESNI
   else if (ctx->use_aesni) {
-    _gcry_aes_aesni_ctr_enc(ctx, outbuf, inbuf, ctr, nblocks);
+#ifdef USE_VAES
+    if (ctx->use_vaes)
+      _gcry_aes_vaes_ctr_enc(ctx, outbuf, inbuf, ctr, nblocks);
+    else
+#endif
+      _gcry_aes_aesni_ctr_enc(ctx, outbuf, inbuf, ctr, nblocks);
     burn_depth = 0;
   }
 #endif /*USE_AESNI*/
@@ -1040,7 +1066,12 @@ void _gcry_aes_cfb_dec(void *context, unsigned char *iv, void *outbuf_arg,
     ;
 #ifdef USE_AESNI
   else if (ctx->use_aesni) {
-    _gcry_aes_aesni_cfb_dec(ctx, outbuf, inbuf, iv, nblocks);
+#ifdef USE_VAES
+    if (ctx->use_vaes)
+      _gcry_aes_vaes_cfb_dec(ctx, outbuf, inbuf, iv, nblocks);
+    else
+#endif
+      _gcry_aes_aesni_cfb_dec(ctx, outbuf, inbuf, iv, nblocks);
     burn_depth = 0;
   }
 #endif /*USE_AESNI*/
@@ -1146,7 +1177,12 @@ size_t _gcry_aes_ocb_crypt(gcry_cipher_hd_t c, void *outbuf_arg,
     ;
 #ifdef USE_AESNI
   else if (ctx->use_aesni) {
-    _gcry_aes_aesni_ocb_crypt(c, outbuf, inbuf, nblocks, encrypt);
+#ifdef USE_VAES
+    if (ctx->use_vaes)
+      _gcry_aes_vaes_ocb_crypt(c, outbuf, inbuf, nblocks, encrypt);
+    else
+#endif
+      _gcry_aes_aesni_ocb_crypt(c, outbuf, inbuf, nblocks, encrypt);
     burn_depth = 0;
   }
 #endif /*USE_AESNI*/
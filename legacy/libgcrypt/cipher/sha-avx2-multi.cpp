@@ -0,0 +1,580 @@
+/* sha-avx2-multi.cpp  -  Multi-buffer SHA-1, SHA-256 and SHA-512 (AVX2)
+ * Copyright (C) 2017 The NeoPG developers
+ *
+ * This file is part of Libgcrypt.
+ *
+ * Libgcrypt is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * Libgcrypt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Hashing many independent messages at once: every message gets one
+   lane of the AVX2 registers, which holds 8 SHA-1 or SHA-256 states
+   or 4 SHA-512 states.  A lane which has finished its message is
+   refilled with the next one, so the lanes stay busy as long as there
+   are messages left.  This is much faster than hashing the messages
+   one after the other if there are many short messages, for example
+   when computing the fingerprints of a lot of keys.  */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bufhelp.h"
+#include "cipher.h"
+#include "g10lib.h"
+
+/* USE_AVX2_MULTI indicates whether to compile the multi-buffer code.
+   Keep in sync with sha1.cpp, sha256.cpp and sha512.cpp.  */
+#undef USE_AVX2_MULTI
+#if defined(__x86_64__) && defined(ENABLE_AVX2_SUPPORT) && \
+    (defined(__clang__) || __GNUC__ > 4 ||                 \
+     (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define USE_AVX2_MULTI 1
+#endif
+
+#ifdef USE_AVX2_MULTI
+
+#include <immintrin.h>
+
+/* The functions in this file are only called if the CPU supports
+   AVX2, so the instruction set is enabled per function.  */
+#define AVX2_FUNC __attribute__((target("avx2")))
+#define AVX2_INLINE AVX2_FUNC __attribute__((always_inline)) static inline
+
+#define MAX_LANES 8
+#define MAX_BLOCKSIZE 128
+
+/* The state of all lanes, with word I of lane L at index I * LANES +
+   L, so that a vector holds the same word of all lanes.  */
+typedef union {
+  u32 w32[8 * MAX_LANES];
+  u64 w64[8 * MAX_LANES / 2];
+  __m256i v[8];
+} multi_state_t;
+
+/* Hash one block in every lane.  */
+typedef void (*multi_compress_t)(multi_state_t *state,
+                                 const unsigned char *const *blocks);
+
+/* Description of an algorithm for the lane scheduler.  */
+typedef struct {
+  int lanes;     /* Number of lanes.  */
+  int blocksize; /* Block size in bytes.  */
+  int lenbytes;  /* Size of the length field of the padding.  */
+  int wordsize;  /* Size of a state word in bytes.  */
+  int nwords;    /* Number of state words in the digest.  */
+  const void *iv;
+  multi_compress_t compress;
+} multi_spec_t;
+
+/* One lane of the scheduler.  The message is hashed from DATA as long
+   as there are full blocks, then from TAIL, which holds the remaining
+   bytes and the padding.  */
+typedef struct {
+  int msg; /* The message in this lane, or -1 if idle.  */
+  const unsigned char *data;
+  size_t nfull;
+  int ntail;
+  unsigned char *tailptr;
+  unsigned char tail[2 * MAX_BLOCKSIZE];
+} multi_lane_t;
+
+/*
+ * Helper functions.
+ */
+
+AVX2_INLINE __m256i rotl32(__m256i x, int n) {
+  return _mm256_or_si256(_mm256_slli_epi32(x, n), _mm256_srli_epi32(x, 32 - n));
+}
+
+AVX2_INLINE __m256i rotr32(__m256i x, int n) {
+  return _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - n));
+}
+
+AVX2_INLINE __m256i rotr64(__m256i x, int n) {
+  return _mm256_or_si256(_mm256_srli_epi64(x, n), _mm256_slli_epi64(x, 64 - n));
+}
+
+AVX2_INLINE __m256i add3(__m256i a, __m256i b, __m256i c) {
+  return _mm256_add_epi32(_mm256_add_epi32(a, b), c);
+}
+
+/* Load the 32 bytes at offset OFF of each of the 8 blocks and
+   transpose them, so that W[I] holds big-endian word I of all
+   lanes.  */
+AVX2_INLINE void load_words32(__m256i *w, const unsigned char *const *blocks,
+                              int off) {
+  const __m256i bswap =
+      _mm256_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3,
+                      12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+  __m256i r[8], t[8];
+  int i;
+
+  for (i = 0; i < 8; i++)
+    r[i] = _mm256_loadu_si256((const __m256i *)(blocks[i] + off));
+  for (i = 0; i < 8; i += 2) {
+    t[i] = _mm256_unpacklo_epi32(r[i], r[i + 1]);
+    t[i + 1] = _mm256_unpackhi_epi32(r[i], r[i + 1]);
+  }
+  for (i = 0; i < 8; i += 4) {
+    r[i] = _mm256_unpacklo_epi64(t[i], t[i + 2]);
+    r[i + 1] = _mm256_unpackhi_epi64(t[i], t[i + 2]);
+    r[i + 2] = _mm256_unpacklo_epi64(t[i + 1], t[i + 3]);
+    r[i + 3] = _mm256_unpackhi_epi64(t[i + 1], t[i + 3]);
+  }
+  for (i = 0; i < 4; i++) {
+    w[i] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(r[i], r[i + 4], 0x20),
+                               bswap);
+    w[i + 4] = _mm256_shuffle_epi8(
+        _mm256_permute2x128_si256(r[i], r[i + 4], 0x31), bswap);
+  }
+}
+
+/* Load the 32 bytes at offset OFF of each of the 4 blocks and
+   transpose them, so that W[I] holds big-endian word I of all
+   lanes.  */
+AVX2_INLINE void load_words64(__m256i *w, const unsigned char *const *blocks,
+                              int off) {
+  const __m256i bswap =
+      _mm256_set_epi8(8, 9, 10, 11, 12, 13, 14, 15, 0, 1, 2, 3, 4, 5, 6, 7,
+                      8, 9, 10, 11, 12, 13, 14, 15, 0, 1, 2, 3, 4, 5, 6, 7);
+  __m256i r[4], t[4];
+  int i;
+
+  for (i = 0; i < 4; i++)
+    r[i] = _mm256_loadu_si256((const __m256i *)(blocks[i] + off));
+  t[0] = _mm256_unpacklo_epi64(r[0], r[1]);
+  t[1] = _mm256_unpackhi_epi64(r[0], r[1]);
+  t[2] = _mm256_unpacklo_epi64(r[2], r[3]);
+  t[3] = _mm256_unpackhi_epi64(r[2], r[3]);
+  for (i = 0; i < 2; i++) {
+    w[i] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(t[i], t[i + 2], 0x20),
+                               bswap);
+    w[i + 2] = _mm256_shuffle_epi8(
+        _mm256_permute2x128_si256(t[i], t[i + 2], 0x31), bswap);
+  }
+}
+
+/*
+ * SHA-1 with 8 lanes.
+ */
+
+static const u32 sha1_iv[5] = {0x67452301, 0xefcdab89, 0x98badcfe,
+                               0x10325476, 0xc3d2e1f0};
+
+#define SHA1_F1(x, y, z) \
+  _mm256_xor_si256(z, _mm256_and_si256(x, _mm256_xor_si256(y, z)))
+#define SHA1_F2(x, y, z) _mm256_xor_si256(x, _mm256_xor_si256(y, z))
+#define SHA1_F3(x, y, z)                  \
+  _mm256_or_si256(_mm256_and_si256(x, y), \
+                  _mm256_and_si256(z, _mm256_or_si256(x, y)))
+
+/* Compute word I of the message schedule in place.  */
+#define SHA1_W(i)                                              \
+  (w[(i)&15] = rotl32(                                         \
+       _mm256_xor_si256(                                       \
+           _mm256_xor_si256(w[((i)-3) & 15], w[((i)-8) & 15]), \
+           _mm256_xor_si256(w[((i)-14) & 15], w[(i)&15])),     \
+       1))
+
+#define SHA1_R(a, b, c, d, e, f, k, x)                      \
+  do {                                                      \
+    e = _mm256_add_epi32(add3(e, rotl32(a, 5), f(b, c, d)), \
+                         _mm256_add_epi32(k, x));           \
+    b = rotl32(b, 30);                                      \
+  } while (0)
+
+/* Twenty rounds from round I on.  */
+#define SHA1_R20(i, f, kval)                                              \
+  do {                                                                    \
+    const __m256i k = _mm256_set1_epi32(kval);                            \
+    for (j = (i); j < (i) + 20; j += 5) {                                 \
+      SHA1_R(a, b, c, d, e, f, k, j < 16 ? w[j] : SHA1_W(j));             \
+      SHA1_R(e, a, b, c, d, f, k, j + 1 < 16 ? w[j + 1] : SHA1_W(j + 1)); \
+      SHA1_R(d, e, a, b, c, f, k, j + 2 < 16 ? w[j + 2] : SHA1_W(j + 2)); \
+      SHA1_R(c, d, e, a, b, f, k, j + 3 < 16 ? w[j + 3] : SHA1_W(j + 3)); \
+      SHA1_R(b, c, d, e, a, f, k, j + 4 < 16 ? w[j + 4] : SHA1_W(j + 4)); \
+    }                                                                     \
+  } while (0)
+
+AVX2_FUNC static void sha1_compress_x8(multi_state_t *state,
+                                       const unsigned char *const *blocks) {
+  __m256i a, b, c, d, e;
+  __m256i w[16];
+  int j;
+
+  load_words32(w, blocks, 0);
+  load_words32(w + 8, blocks, 32);
+
+  a = state->v[0];
+  b = state->v[1];
+  c = state->v[2];
+  d = state->v[3];
+  e = state->v[4];
+
+  SHA1_R20(0, SHA1_F1, 0x5a827999);
+  SHA1_R20(20, SHA1_F2, 0x6ed9eba1);
+  SHA1_R20(40, SHA1_F3, 0x8f1bbcdc);
+  SHA1_R20(60, SHA1_F2, 0xca62c1d6);
+
+  state->v[0] = _mm256_add_epi32(state->v[0], a);
+  state->v[1] = _mm256_add_epi32(state->v[1], b);
+  state->v[2] = _mm256_add_epi32(state->v[2], c);
+  state->v[3] = _mm256_add_epi32(state->v[3], d);
+  state->v[4] = _mm256_add_epi32(state->v[4], e);
+}
+
+/*
+ * SHA-256 with 8 lanes.
+ */
+
+static const u32 sha256_iv[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372,
+                                 0xa54ff53a, 0x510e527f, 0x9b05688c,
+                                 0x1f83d9ab, 0x5be0cd19};
+
+static const u32 sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+#define SHA2_CH(x, y, z) \
+  _mm256_xor_si256(z, _mm256_and_si256(x, _mm256_xor_si256(y, z)))
+#define SHA2_MAJ(x, y, z)                 \
+  _mm256_or_si256(_mm256_and_si256(x, y), \
+                  _mm256_and_si256(z, _mm256_or_si256(x, y)))
+
+#define SHA256_S0(x) \
+  _mm256_xor_si256(rotr32(x, 2), _mm256_xor_si256(rotr32(x, 13), rotr32(x, 22)))
+#define SHA256_S1(x) \
+  _mm256_xor_si256(rotr32(x, 6), _mm256_xor_si256(rotr32(x, 11), rotr32(x, 25)))
+#define SHA256_s0(x)                                              \
+  _mm256_xor_si256(_mm256_xor_si256(rotr32(x, 7), rotr32(x, 18)), \
+                   _mm256_srli_epi32(x, 3))
+#define SHA256_s1(x)                                               \
+  _mm256_xor_si256(_mm256_xor_si256(rotr32(x, 17), rotr32(x, 19)), \
+                   _mm256_srli_epi32(x, 10))
+
+/* Compute word I of the message schedule in place.  */
+#define SHA256_W(i)                                      \
+  (w[(i)&15] = _mm256_add_epi32(                         \
+       add3(SHA256_s1(w[((i)-2) & 15]), w[((i)-7) & 15], \
+            SHA256_s0(w[((i)-15) & 15])),                \
+       w[(i)&15]))
+
+#define SHA256_R(a, b, c, d, e, f, g, h, i)       \
+  do {                                            \
+    t = add3(h, SHA256_S1(e), SHA2_CH(e, f, g));  \
+    t = add3(t, _mm256_set1_epi32(sha256_k[i]),   \
+             (i) < 16 ? w[i] : SHA256_W(i));      \
+    d = _mm256_add_epi32(d, t);                   \
+    h = add3(t, SHA256_S0(a), SHA2_MAJ(a, b, c)); \
+  } while (0)
+
+AVX2_FUNC static void sha256_compress_x8(multi_state_t *state,
+                                         const unsigned char *const *blocks) {
+  __m256i a, b, c, d, e, f, g, h, t;
+  __m256i w[16];
+  int i;
+
+  load_words32(w, blocks, 0);
+  load_words32(w + 8, blocks, 32);
+
+  a = state->v[0];
+  b = state->v[1];
+  c = state->v[2];
+  d = state->v[3];
+  e = state->v[4];
+  f = state->v[5];
+  g = state->v[6];
+  h = state->v[7];
+
+  for (i = 0; i < 64; i += 8) {
+    SHA256_R(a, b, c, d, e, f, g, h, i);
+    SHA256_R(h, a, b, c, d, e, f, g, i + 1);
+    SHA256_R(g, h, a, b, c, d, e, f, i + 2);
+    SHA256_R(f, g, h, a, b, c, d, e, i + 3);
+    SHA256_R(e, f, g, h, a, b, c, d, i + 4);
+    SHA256_R(d, e, f, g, h, a, b, c, i + 5);
+    SHA256_R(c, d, e, f, g, h, a, b, i + 6);
+    SHA256_R(b, c, d, e, f, g, h, a, i + 7);
+  }
+
+  state->v[0] = _mm256_add_epi32(state->v[0], a);
+  state->v[1] = _mm256_add_epi32(state->v[1], b);
+  state->v[2] = _mm256_add_epi32(state->v[2], c);
+  state->v[3] = _mm256_add_epi32(state->v[3], d);
+  state->v[4] = _mm256_add_epi32(state->v[4], e);
+  state->v[5] = _mm256_add_epi32(state->v[5], f);
+  state->v[6] = _mm256_add_epi32(state->v[6], g);
+  state->v[7] = _mm256_add_epi32(state->v[7], h);
+}
+
+/*
+ * SHA-512 with 4 lanes.
+ */
+
+static const u64 sha512_iv[8] = {
+    U64_C(0x6a09e667f3bcc908), U64_C(0xbb67ae8584caa73b),
+    U64_C(0x3c6ef372fe94f82b), U64_C(0xa54ff53a5f1d36f1),
+    U64_C(0x510e527fade682d1), U64_C(0x9b05688c2b3e6c1f),
+    U64_C(0x1f83d9abfb41bd6b), U64_C(0x5be0cd19137e2179)};
+
+static const u64 sha512_k[80] = {
+    U64_C(0x428a2f98d728ae22), U64_C(0x7137449123ef65cd),
+    U64_C(0xb5c0fbcfec4d3b2f), U64_C(0xe9b5dba58189dbbc),
+    U64_C(0x3956c25bf348b538), U64_C(0x59f111f1b605d019),
+    U64_C(0x923f82a4af194f9b), U64_C(0xab1c5ed5da6d8118),
+    U64_C(0xd807aa98a3030242), U64_C(0x12835b0145706fbe),
+    U64_C(0x243185be4ee4b28c), U64_C(0x550c7dc3d5ffb4e2),
+    U64_C(0x72be5d74f27b896f), U64_C(0x80deb1fe3b1696b1),
+    U64_C(0x9bdc06a725c71235), U64_C(0xc19bf174cf692694),
+    U64_C(0xe49b69c19ef14ad2), U64_C(0xefbe4786384f25e3),
+    U64_C(0x0fc19dc68b8cd5b5), U64_C(0x240ca1cc77ac9c65),
+    U64_C(0x2de92c6f592b0275), U64_C(0x4a7484aa6ea6e483),
+    U64_C(0x5cb0a9dcbd41fbd4), U64_C(0x76f988da831153b5),
+    U64_C(0x983e5152ee66dfab), U64_C(0xa831c66d2db43210),
+    U64_C(0xb00327c898fb213f), U64_C(0xbf597fc7beef0ee4),
+    U64_C(0xc6e00bf33da88fc2), U64_C(0xd5a79147930aa725),
+    U64_C(0x06ca6351e003826f), U64_C(0x142929670a0e6e70),
+    U64_C(0x27b70a8546d22ffc), U64_C(0x2e1b21385c26c926),
+    U64_C(0x4d2c6dfc5ac42aed), U64_C(0x53380d139d95b3df),
+    U64_C(0x650a73548baf63de), U64_C(0x766a0abb3c77b2a8),
+    U64_C(0x81c2c92e47edaee6), U64_C(0x92722c851482353b),
+    U64_C(0xa2bfe8a14cf10364), U64_C(0xa81a664bbc423001),
+    U64_C(0xc24b8b70d0f89791), U64_C(0xc76c51a30654be30),
+    U64_C(0xd192e819d6ef5218), U64_C(0xd69906245565a910),
+    U64_C(0xf40e35855771202a), U64_C(0x106aa07032bbd1b8),
+    U64_C(0x19a4c116b8d2d0c8), U64_C(0x1e376c085141ab53),
+    U64_C(0x2748774cdf8eeb99), U64_C(0x34b0bcb5e19b48a8),
+    U64_C(0x391c0cb3c5c95a63), U64_C(0x4ed8aa4ae3418acb),
+    U64_C(0x5b9cca4f7763e373), U64_C(0x682e6ff3d6b2b8a3),
+    U64_C(0x748f82ee5defb2fc), U64_C(0x78a5636f43172f60),
+    U64_C(0x84c87814a1f0ab72), U64_C(0x8cc702081a6439ec),
+    U64_C(0x90befffa23631e28), U64_C(0xa4506cebde82bde9),
+    U64_C(0xbef9a3f7b2c67915), U64_C(0xc67178f2e372532b),
+    U64_C(0xca273eceea26619c), U64_C(0xd186b8c721c0c207),
+    U64_C(0xeada7dd6cde0eb1e), U64_C(0xf57d4f7fee6ed178),
+    U64_C(0x06f067aa72176fba), U64_C(0x0a637dc5a2c898a6),
+    U64_C(0x113f9804bef90dae), U64_C(0x1b710b35131c471b),
+    U64_C(0x28db77f523047d84), U64_C(0x32caab7b40c72493),
+    U64_C(0x3c9ebe0a15c9bebc), U64_C(0x431d67c49c100d4c),
+    U64_C(0x4cc5d4becb3e42b6), U64_C(0x597f299cfc657e2a),
+    U64_C(0x5fcb6fab3ad6faec), U64_C(0x6c44198c4a475817)};
+
+#define ADD64(a, b) _mm256_add_epi64(a, b)
+
+#define SHA512_S0(x)              \
+  _mm256_xor_si256(rotr64(x, 28), \
+                   _mm256_xor_si256(rotr64(x, 34), rotr64(x, 39)))
+#define SHA512_S1(x)              \
+  _mm256_xor_si256(rotr64(x, 14), \
+                   _mm256_xor_si256(rotr64(x, 18), rotr64(x, 41)))
+#define SHA512_s0(x)                                             \
+  _mm256_xor_si256(_mm256_xor_si256(rotr64(x, 1), rotr64(x, 8)), \
+                   _mm256_srli_epi64(x, 7))
+#define SHA512_s1(x)                                               \
+  _mm256_xor_si256(_mm256_xor_si256(rotr64(x, 19), rotr64(x, 61)), \
+                   _mm256_srli_epi64(x, 6))
+
+/* Compute word I of the message schedule in place.  */
+#define SHA512_W(i)                                                      \
+  (w[(i)&15] = ADD64(ADD64(SHA512_s1(w[((i)-2) & 15]), w[((i)-7) & 15]), \
+                     ADD64(SHA512_s0(w[((i)-15) & 15]), w[(i)&15])))
+
+#define SHA512_R(a, b, c, d, e, f, g, h, i)               \
+  do {                                                    \
+    t = ADD64(ADD64(h, SHA512_S1(e)), SHA2_CH(e, f, g));  \
+    t = ADD64(t, ADD64(_mm256_set1_epi64x(sha512_k[i]),   \
+                       (i) < 16 ? w[i] : SHA512_W(i)));   \
+    d = ADD64(d, t);                                      \
+    h = ADD64(ADD64(t, SHA512_S0(a)), SHA2_MAJ(a, b, c)); \
+  } while (0)
+
+AVX2_FUNC static void sha512_compress_x4(multi_state_t *state,
+                                         const unsigned char *const *blocks) {
+  __m256i a, b, c, d, e, f, g, h, t;
+  __m256i w[16];
+  int i;
+
+  for (i = 0; i < 4; i++) load_words64(w + 4 * i, blocks, 32 * i);
+
+  a = state->v[0];
+  b = state->v[1];
+  c = state->v[2];
+  d = state->v[3];
+  e = state->v[4];
+  f = state->v[5];
+  g = state->v[6];
+  h = state->v[7];
+
+  for (i = 0; i < 80; i += 8) {
+    SHA512_R(a, b, c, d, e, f, g, h, i);
+    SHA512_R(h, a, b, c, d, e, f, g, i + 1);
+    SHA512_R(g, h, a, b, c, d, e, f, i + 2);
+    SHA512_R(f, g, h, a, b, c, d, e, i + 3);
+    SHA512_R(e, f, g, h, a, b, c, d, i + 4);
+    SHA512_R(d, e, f, g, h, a, b, c, i + 5);
+    SHA512_R(c, d, e, f, g, h, a, b, i + 6);
+    SHA512_R(b, c, d, e, f, g, h, a, i + 7);
+  }
+
+  state->v[0] = ADD64(state->v[0], a);
+  state->v[1] = ADD64(state->v[1], b);
+  state->v[2] = ADD64(state->v[2], c);
+  state->v[3] = ADD64(state->v[3], d);
+  state->v[4] = ADD64(state->v[4], e);
+  state->v[5] = ADD64(state->v[5], f);
+  state->v[6] = ADD64(state->v[6], g);
+  state->v[7] = ADD64(state->v[7], h);
+}
+
+/*
+ * The lane scheduler.
+ */
+
+static const multi_spec_t sha1_spec = {8,  64, 8, 4, 5, sha1_iv,
+                                       sha1_compress_x8};
+static const multi_spec_t sha256_spec = {8,  64, 8, 4, 8, sha256_iv,
+                                         sha256_compress_x8};
+static const multi_spec_t sha512_spec = {4,   128, 16, 8, 8, sha512_iv,
+                                         sha512_compress_x4};
+
+/* Put message number MSG from BUF into lane L.  */
+static void start_lane(const multi_spec_t *spec, multi_state_t *state,
+                       multi_lane_t *lane, int l, int msg,
+                       const gcry_buffer_t *buf) {
+  size_t len = buf->len;
+  size_t rest = len % spec->blocksize;
+  unsigned char *end;
+  int i;
+
+  lane->msg = msg;
+  lane->data = (const unsigned char *)buf->data + buf->off;
+  lane->nfull = len / spec->blocksize;
+  lane->ntail = rest + 1 + spec->lenbytes > (size_t)spec->blocksize ? 2 : 1;
+  lane->tailptr = lane->tail;
+
+  memcpy(lane->tail, lane->data + len - rest, rest);
+  lane->tail[rest] = 0x80;
+  end = lane->tail + lane->ntail * spec->blocksize;
+  memset(lane->tail + rest + 1, 0, end - (lane->tail + rest + 1));
+  /* The bit count, which is 128 bit for SHA-512.  */
+  if (spec->lenbytes == 16) buf_put_be64(end - 16, (u64)len >> 61);
+  buf_put_be64(end - 8, (u64)len << 3);
+
+  for (i = 0; i < spec->nwords; i++)
+    if (spec->wordsize == 4)
+      state->w32[i * spec->lanes + l] = ((const u32 *)spec->iv)[i];
+    else
+      state->w64[i * spec->lanes + l] = ((const u64 *)spec->iv)[i];
+}
+
+/* Return the next block of LANE.  */
+static const unsigned char *next_block(const multi_spec_t *spec,
+                                       multi_lane_t *lane) {
+  const unsigned char *p;
+
+  if (lane->nfull) {
+    p = lane->data;
+    lane->data += spec->blocksize;
+    lane->nfull--;
+  } else {
+    p = lane->tailptr;
+    lane->tailptr += spec->blocksize;
+    lane->ntail--;
+  }
+  return p;
+}
+
+/* Store the digest of lane L.  */
+static void put_digest(const multi_spec_t *spec, multi_state_t *state, int l,
+                       unsigned char *digest) {
+  int i;
+
+  for (i = 0; i < spec->nwords; i++)
+    if (spec->wordsize == 4)
+      buf_put_be32(digest + 4 * i, state->w32[i * spec->lanes + l]);
+    else
+      buf_put_be64(digest + 8 * i, state->w64[i * spec->lanes + l]);
+}
+
+static void hash_multi(const multi_spec_t *spec, void *digests,
+                       const gcry_buffer_t *bufs, int n) {
+  static const unsigned char idle_block[MAX_BLOCKSIZE] = {0};
+  const unsigned char *blocks[MAX_LANES];
+  multi_lane_t lane[MAX_LANES];
+  multi_state_t state;
+  size_t dlen = spec->nwords * spec->wordsize;
+  int next = 0;
+  int active = 0;
+  int l;
+
+  for (l = 0; l < spec->lanes; l++) {
+    lane[l].msg = -1;
+    if (next < n) {
+      start_lane(spec, &state, &lane[l], l, next, &bufs[next]);
+      next++;
+      active++;
+    }
+  }
+
+  while (active) {
+    for (l = 0; l < spec->lanes; l++)
+      blocks[l] = lane[l].msg < 0 ? idle_block : next_block(spec, &lane[l]);
+    spec->compress(&state, blocks);
+
+    for (l = 0; l < spec->lanes; l++) {
+      if (lane[l].msg < 0 || lane[l].nfull || lane[l].ntail) continue;
+      put_digest(spec, &state, l,
+                 (unsigned char *)digests + lane[l].msg * dlen);
+      if (next < n) {
+        start_lane(spec, &state, &lane[l], l, next, &bufs[next]);
+        next++;
+      } else {
+        lane[l].msg = -1;
+        active--;
+      }
+    }
+  }
+
+  wipememory(lane, sizeof(lane));
+  wipememory(&state, sizeof(state));
+}
+
+/* Hash the N messages BUFS and store the digests one after the other
+   at DIGESTS.  The CPU must support AVX2.  */
+void _gcry_sha1_hash_multi_avx2(void *digests, const gcry_buffer_t *bufs,
+                                int n) {
+  hash_multi(&sha1_spec, digests, bufs, n);
+}
+
+void _gcry_sha256_hash_multi_avx2(void *digests, const gcry_buffer_t *bufs,
+                                  int n) {
+  hash_multi(&sha256_spec, digests, bufs, n);
+}
+
+void _gcry_sha512_hash_multi_avx2(void *digests, const gcry_buffer_t *bufs,
+                                  int n) {
+  hash_multi(&sha512_spec, digests, bufs, n);
+}
+
+#endif /* USE_AVX2_MULTI */
@@ -0,0 +1,115 @@
+/* sha1-intel-shaext.cpp  -  SHA-1 using the Intel SHA extensions
+ * Copyright (C) 2017 The NeoPG developers
+ *
+ * This file is part of Libgcrypt.
+ *
+ * Libgcrypt is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * Libgcrypt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <stddef.h>
+
+#include "types.h"
+
+/* USE_SHAEXT indicates whether to compile with Intel SHA extension
+   code.  Keep in sync with sha1.cpp.  */
+#undef USE_SHAEXT
+#if (defined(__x86_64__) || defined(__i386__)) &&                      \
+    defined(ENABLE_SHAEXT_SUPPORT) && defined(ENABLE_SSE41_SUPPORT) && \
+    (defined(__clang__) || __GNUC__ > 4 ||                             \
+     (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define USE_SHAEXT 1
+#endif
+
+#ifdef USE_SHAEXT
+
+#include <immintrin.h>
+
+/* Only called if the CPU supports the SHA extensions, so the
+   instructions are enabled for this function only.  */
+#define SHAEXT_FUNC __attribute__((target("sha,sse4.1")))
+
+/* Four rounds with the message words of group G (words 4G to 4G+3).
+   W[G % 4] holds these words; for G >= 4 they are computed from the
+   four previous groups.  E carries the value of E for the next
+   group, which sha1nexte derives from ABCD before the last four
+   rounds.  */
+#define ROUNDS4(g)                                          \
+  do {                                                      \
+    if ((g) >= 4) {                                         \
+      t = _mm_sha1msg1_epu32(w[(g) % 4], w[((g) + 1) % 4]); \
+      t = _mm_xor_si128(t, w[((g) + 2) % 4]);               \
+      w[(g) % 4] = _mm_sha1msg2_epu32(t, w[((g) + 3) % 4]); \
+    }                                                       \
+    if ((g) == 0)                                           \
+      e = _mm_add_epi32(e0, w[0]);                          \
+    else                                                    \
+      e = _mm_sha1nexte_epu32(prev, w[(g) % 4]);            \
+    prev = abcd;                                            \
+    abcd = _mm_sha1rnds4_epu32(abcd, e, (g) / 5);           \
+  } while (0)
+
+/* Hash NBLKS blocks of 64 bytes at DATA into the five state words at
+   STATE.  Returns the number of stack bytes to burn.  */
+SHAEXT_FUNC unsigned int _gcry_sha1_transform_intel_shaext(
+    void *state, const unsigned char *data, size_t nblks) {
+  const __m128i mask =
+      _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+  u32 *h = (u32 *)state;
+  __m128i abcd, abcd_save, e0, e, prev, t;
+  __m128i w[4];
+  int i;
+
+  /* The instructions expect A in the most significant word.  */
+  abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)h), 0x1b);
+  e0 = _mm_set_epi32(h[4], 0, 0, 0);
+
+  for (; nblks; nblks--, data += 64) {
+    abcd_save = abcd;
+    for (i = 0; i < 4; i++)
+      w[i] = _mm_shuffle_epi8(
+          _mm_loadu_si128((const __m128i *)(data + 16 * i)), mask);
+
+    ROUNDS4(0);
+    ROUNDS4(1);
+    ROUNDS4(2);
+    ROUNDS4(3);
+    ROUNDS4(4);
+    ROUNDS4(5);
+    ROUNDS4(6);
+    ROUNDS4(7);
+    ROUNDS4(8);
+    ROUNDS4(9);
+    ROUNDS4(10);
+    ROUNDS4(11);
+    ROUNDS4(12);
+    ROUNDS4(13);
+    ROUNDS4(14);
+    ROUNDS4(15);
+    ROUNDS4(16);
+    ROUNDS4(17);
+    ROUNDS4(18);
+    ROUNDS4(19);
+
+    e0 = _mm_sha1nexte_epu32(prev, e0);
+    abcd = _mm_add_epi32(abcd, abcd_save);
+  }
+
+  _mm_storeu_si128((__m128i *)h, _mm_shuffle_epi32(abcd, 0x1b));
+  h[4] = _mm_extract_epi32(e0, 3);
+
+  return 0;
+}
+
+#endif /* USE_SHAEXT */
@@ -90,6 +90,25 @@
 #endif
 #endif
 
+/* USE_SHAEXT indicates whether to compile with Intel SHA extension
+   code.  */
+#undef USE_SHAEXT
+#if (defined(__x86_64__) || defined(__i386__)) &&                      \
+    defined(ENABLE_SHAEXT_SUPPORT) && defined(ENABLE_SSE41_SUPPORT) && \
+    (defined(__clang__) || __GNUC__ > 4 ||                             \
+     (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define USE_SHAEXT 1
+#endif
+
+/* USE_AVX2_MULTI indicates whether to compile the AVX2 multi-buffer
+   code, which hashes several messages at once.  */
+#undef USE_AVX2_MULTI
+#if defined(__x86_64__) && defined(ENABLE_AVX2_SUPPORT) && \
+    (defined(__clang__) || __GNUC__ > 4 ||                 \
+     (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define USE_AVX2_MULTI 1
+#endif
+
 /* A macro to test whether P is properly aligned for an u32 type.
    Note that config.h provides a suitable replacement for uintptr_t if
    it does not exist in stdint.h.  */
@@ -135,6 +154,10 @@ static void sha1_init(void *context, unsigned int flags) {
 #endif
 #ifdef USE_ARM_CE
   hd->use_arm_ce = (features & HWF_ARM_SHA1) != 0;
+#endif
+#ifdef USE_SHAEXT
+  hd->use_shaext =
+      (features & HWF_INTEL_SHAEXT) && (features & HWF_INTEL_SSE4_1);
 #endif
   (void)features;
 }
@@ -320,11 +343,26 @@ unsigned int _gcry_sha1_transform_amd64_avx_bmi2(void *state,
                                                  size_t nblks) ASM_FUNC_ABI;
 #endif
 
+#ifdef USE_SHAEXT
+unsigned int _gcry_sha1_transform_intel_shaext(void *state,
+                                               const unsigned char *data,
+                                               size_t nblks);
+#endif
+
+#ifdef USE_AVX2_MULTI
+void _gcry_sha1_hash_multi_avx2(void *digests, const gcry_buffer_t *bufs,
+                                int n);
+#endif
+
 static unsigned int transform(void *ctx, const unsigned char *data,
                               size_t nblks) {
   SHA1_CONTEXT *hd = (SHA1_CONTEXT *)ctx;
   unsigned int burn;
 
+#ifdef USE_SHAEXT
+  if (hd->use_shaext)
+    return _gcry_sha1_transform_intel_shaext(&hd->h0, data, nblks);
+#endif
 #ifdef USE_BMI2
   if (hd->use_bmi2)
     return _gcry_sha1_transform_amd64_avx_bmi2(&hd->h0, data, nblks) +
@@ -488,6 +526,34 @@ void _gcry_sha1_hash_buffers(void *outbuf, const gcry_buffer_t *iov,
   memcpy(outbuf, hd.bctx.buf, 20);
 }
 
+/* Hash the N messages in BUFS independently of each other and store
+   the digests one after the other at DIGESTS, which must have room
+   for N * 20 bytes.  */
+void _gcry_sha1_hash_multi(void *digests, const gcry_buffer_t *bufs, int n) {
+  unsigned int features = _gcry_get_hw_features();
+  int i;
+
+#ifdef USE_AVX2_MULTI
+  /* With less than four messages most of the 8 lanes would be idle.
+     The SHA extensions are only slower if all lanes are busy.  */
+  int min_msgs = 4;
+
+#ifdef USE_SHAEXT
+  if (features & HWF_INTEL_SHAEXT) min_msgs = 8;
+#endif
+  if ((features & HWF_INTEL_AVX2) && n >= min_msgs) {
+    _gcry_sha1_hash_multi_avx2(digests, bufs, n);
+    return;
+  }
+#endif
+  (void)features;
+
+  for (i = 0; i < n; i++)
+    _gcry_sha1_hash_buffer((char *)digests + 20 * i,
+                           (const char *)bufs[i].data + bufs[i].off,
+                           bufs[i].len);
+}
+
 /*
      Self-test section.
  */
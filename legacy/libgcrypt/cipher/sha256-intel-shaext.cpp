@@ -0,0 +1,129 @@
+/* sha256-intel-shaext.cpp  -  SHA-256 using the Intel SHA extensions
+ * Copyright (C) 2017 The NeoPG developers
+ *
+ * This file is part of Libgcrypt.
+ *
+ * Libgcrypt is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * Libgcrypt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <stddef.h>
+
+#include "types.h"
+
+/* USE_SHAEXT indicates whether to compile with Intel SHA extension
+   code.  Keep in sync with sha256.cpp.  */
+#undef USE_SHAEXT
+#if (defined(__x86_64__) || defined(__i386__)) &&                      \
+    defined(ENABLE_SHAEXT_SUPPORT) && defined(ENABLE_SSE41_SUPPORT) && \
+    (defined(__clang__) || __GNUC__ > 4 ||                             \
+     (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define USE_SHAEXT 1
+#endif
+
+#ifdef USE_SHAEXT
+
+#include <immintrin.h>
+
+/* Only called if the CPU supports the SHA extensions, so the
+   instructions are enabled for this function only.  */
+#define SHAEXT_FUNC __attribute__((target("sha,sse4.1")))
+
+static const u32 K[64] __attribute__((aligned(16))) = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+/* Four rounds with the message words of group G (words 4G to 4G+3).
+   W[G % 4] holds these words; for G >= 4 they are computed from the
+   four previous groups.  Each sha256rnds2 does two rounds with the
+   low two words of its third operand.  */
+#define ROUNDS4(g)                                                \
+  do {                                                            \
+    if ((g) >= 4) {                                               \
+      t = _mm_sha256msg1_epu32(w[(g) % 4], w[((g) + 1) % 4]);     \
+      u = _mm_alignr_epi8(w[((g) + 3) % 4], w[((g) + 2) % 4], 4); \
+      t = _mm_add_epi32(t, u);                                    \
+      w[(g) % 4] = _mm_sha256msg2_epu32(t, w[((g) + 3) % 4]);     \
+    }                                                             \
+    t = _mm_load_si128((const __m128i *)(K + 4 * (g)));           \
+    t = _mm_add_epi32(t, w[(g) % 4]);                             \
+    cdgh = _mm_sha256rnds2_epu32(cdgh, abef, t);                  \
+    t = _mm_shuffle_epi32(t, 0x0e);                               \
+    abef = _mm_sha256rnds2_epu32(abef, cdgh, t);                  \
+  } while (0)
+
+/* Hash NBLKS blocks of 64 bytes at DATA into the eight state words at
+   STATE.  Returns the number of stack bytes to burn.  */
+SHAEXT_FUNC unsigned int _gcry_sha256_transform_intel_shaext(
+    void *state, const unsigned char *data, size_t nblks) {
+  const __m128i mask =
+      _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+  u32 *h = (u32 *)state;
+  __m128i abef, cdgh, abef_save, cdgh_save, t, u;
+  __m128i w[4];
+  int i;
+
+  /* The instructions keep the state as the words ABEF and CDGH, with
+     A and C in the most significant word.  */
+  t = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)h), 0xb1);
+  cdgh = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)(h + 4)), 0x1b);
+  abef = _mm_alignr_epi8(t, cdgh, 8);
+  cdgh = _mm_blend_epi16(cdgh, t, 0xf0);
+
+  for (; nblks; nblks--, data += 64) {
+    abef_save = abef;
+    cdgh_save = cdgh;
+    for (i = 0; i < 4; i++)
+      w[i] = _mm_shuffle_epi8(
+          _mm_loadu_si128((const __m128i *)(data + 16 * i)), mask);
+
+    ROUNDS4(0);
+    ROUNDS4(1);
+    ROUNDS4(2);
+    ROUNDS4(3);
+    ROUNDS4(4);
+    ROUNDS4(5);
+    ROUNDS4(6);
+    ROUNDS4(7);
+    ROUNDS4(8);
+    ROUNDS4(9);
+    ROUNDS4(10);
+    ROUNDS4(11);
+    ROUNDS4(12);
+    ROUNDS4(13);
+    ROUNDS4(14);
+    ROUNDS4(15);
+
+    abef = _mm_add_epi32(abef, abef_save);
+    cdgh = _mm_add_epi32(cdgh, cdgh_save);
+  }
+
+  t = _mm_shuffle_epi32(abef, 0x1b);
+  cdgh = _mm_shuffle_epi32(cdgh, 0xb1);
+  _mm_storeu_si128((__m128i *)h, _mm_blend_epi16(t, cdgh, 0xf0));
+  _mm_storeu_si128((__m128i *)(h + 4), _mm_alignr_epi8(cdgh, t, 8));
+
+  return 0;
+}
+
+#endif /* USE_SHAEXT */
@@ -90,6 +90,25 @@
 #endif
 #endif
 
+/* USE_SHAEXT indicates whether to compile with Intel SHA extension
+   code.  */
+#undef USE_SHAEXT
+#if (defined(__x86_64__) || defined(__i386__)) &&                      \
+    defined(ENABLE_SHAEXT_SUPPORT) && defined(ENABLE_SSE41_SUPPORT) && \
+    (defined(__clang__) || __GNUC__ > 4 ||                             \
+     (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define USE_SHAEXT 1
+#endif
+
+/* USE_AVX2_MULTI indicates whether to compile the AVX2 multi-buffer
+   code, which hashes several messages at once.  */
+#undef USE_AVX2_MULTI
+#if defined(__x86_64__) && defined(ENABLE_AVX2_SUPPORT) && \
+    (defined(__clang__) || __GNUC__ > 4 ||                 \
+     (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define USE_AVX2_MULTI 1
+#endif
+
 typedef struct {
   gcry_md_block_ctx_t bctx;
   u32 h0, h1, h2, h3, h4, h5, h6, h7;
@@ -105,6 +124,9 @@ typedef struct {
 #ifdef USE_ARM_CE
   unsigned int use_arm_ce : 1;
 #endif
+#ifdef USE_SHAEXT
+  unsigned int use_shaext : 1;
+#endif
 } SHA256_CONTEXT;
 
 static unsigned int transform(void *c, const unsigned char *data, size_t nblks);
@@ -143,6 +165,10 @@ static void sha256_init(void *context, unsigned int flags) {
 #endif
 #ifdef USE_ARM_CE
   hd->use_arm_ce = (features & HWF_ARM_SHA2) != 0;
+#endif
+#ifdef USE_SHAEXT
+  hd->use_shaext =
+      (features & HWF_INTEL_SHAEXT) && (features & HWF_INTEL_SSE4_1);
 #endif
   (void)features;
 }
@@ -181,6 +207,10 @@ static void sha224_init(void *context, unsigned int flags) {
 #endif
 #ifdef USE_ARM_CE
   hd->use_arm_ce = (features & HWF_ARM_SHA2) != 0;
+#endif
+#ifdef USE_SHAEXT
+  hd->use_shaext =
+      (features & HWF_INTEL_SHAEXT) && (features & HWF_INTEL_SSE4_1);
 #endif
   (void)features;
 }
@@ -364,11 +394,27 @@ unsigned int _gcry_sha256_transform_armv8_ce(u32 state[8],
                                              size_t num_blks);
 #endif
 
+#ifdef USE_SHAEXT
+unsigned int _gcry_sha256_transform_intel_shaext(void *state,
+                                                 const unsigned char *data,
+                                                 size_t nblks);
+#endif
+
+#ifdef USE_AVX2_MULTI
+void _gcry_sha256_hash_multi_avx2(void *digests, const gcry_buffer_t *bufs,
+                                  int n);
+#endif
+
 static unsigned int transform(void *ctx, const unsigned char *data,
                               size_t nblks) {
   SHA256_CONTEXT *hd = (SHA256_CONTEXT *)ctx;
   unsigned int burn;
 
+#ifdef USE_SHAEXT
+  if (hd->use_shaext)
+    return _gcry_sha256_transform_intel_shaext(&hd->h0, data, nblks);
+#endif
+
 #ifdef USE_AVX2
   if (hd->use_avx2)
     return _gcry_sha256_transform_amd64_avx2(data, &hd->h0, nblks) +
@@ -503,6 +549,36 @@ void _gcry_sha256_hash_buffers(void *outbuf, const gcry_buffer_t *iov,
   memcpy(outbuf, hd.bctx.buf, 32);
 }
 
+/* Hash the N messages in BUFS independently of each other and store
+   the digests one after the other at DIGESTS, which must have room
+   for N * 32 bytes.  */
+void _gcry_sha256_hash_multi(void *digests, const gcry_buffer_t *bufs,
+                             int n) {
+  unsigned int features = _gcry_get_hw_features();
+  int i;
+
+#ifdef USE_AVX2_MULTI
+  /* With less than four messages most of the 8 lanes would be
+     idle.  */
+  int use_avx2 = (features & HWF_INTEL_AVX2) && n >= 4;
+
+#ifdef USE_SHAEXT
+  /* The SHA extensions are faster than the 8 lanes of AVX2.  */
+  if (features & HWF_INTEL_SHAEXT) use_avx2 = 0;
+#endif
+  if (use_avx2) {
+    _gcry_sha256_hash_multi_avx2(digests, bufs, n);
+    return;
+  }
+#endif
+  (void)features;
+
+  for (i = 0; i < n; i++)
+    _gcry_sha256_hash_buffer((char *)digests + 32 * i,
+                             (const char *)bufs[i].data + bufs[i].off,
+                             bufs[i].len);
+}
+
 /*
      Self-test section.
  */
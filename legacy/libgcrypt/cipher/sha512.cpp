@@ -96,6 +96,15 @@
 #define USE_AVX2 1
 #endif
 
+/* USE_AVX2_MULTI indicates whether to compile the AVX2 multi-buffer
+   code, which hashes several messages at once.  */
+#undef USE_AVX2_MULTI
+#if defined(__x86_64__) && defined(ENABLE_AVX2_SUPPORT) && \
+    (defined(__clang__) || __GNUC__ > 4 ||                 \
+     (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define USE_AVX2_MULTI 1
+#endif
+
 typedef struct { u64 h0, h1, h2, h3, h4, h5, h6, h7; } SHA512_STATE;
 
 typedef struct {
@@ -560,6 +569,11 @@ unsigned int _gcry_sha512_transform_amd64_avx2(const void *input_data,
                                                size_t num_blks) ASM_FUNC_ABI;
 #endif
 
+#ifdef USE_AVX2_MULTI
+void _gcry_sha512_hash_multi_avx2(void *digests, const gcry_buffer_t *bufs,
+                                  int n);
+#endif
+
 static unsigned int transform(void *context, const unsigned char *data,
                               size_t nblks) {
   SHA512_CONTEXT *ctx = (SHA512_CONTEXT *)context;
@@ -712,6 +726,28 @@ void _gcry_sha512_hash_buffers(void *outbuf, const gcry_buffer_t *iov,
   memcpy(outbuf, hd.bctx.buf, 64);
 }
 
+/* Hash the N messages in BUFS independently of each other and store
+   the digests one after the other at DIGESTS, which must have room
+   for N * 64 bytes.  */
+void _gcry_sha512_hash_multi(void *digests, const gcry_buffer_t *bufs,
+                             int n) {
+  unsigned int features = _gcry_get_hw_features();
+  int i;
+
+#ifdef USE_AVX2_MULTI
+  if ((features & HWF_INTEL_AVX2) && n > 1) {
+    _gcry_sha512_hash_multi_avx2(digests, bufs, n);
+    return;
+  }
+#endif
+  (void)features;
+
+  for (i = 0; i < n; i++)
+    _gcry_sha512_hash_buffer((char *)digests + 64 * i,
+                             (const char *)bufs[i].data + bufs[i].off,
+                             bufs[i].len);
+}
+
 /*
      Self-test section.
  */
@@ -0,0 +1,208 @@
+/* mpih-amd64.cpp  -  x86-64 limb kernels for the MPI helper functions
+ * Copyright (C) 2017 The NeoPG developers
+ *
+ * This file is part of Libgcrypt.
+ *
+ * Libgcrypt is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * Libgcrypt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The generic kernels in ../generic recover each carry with a
+   comparison, which costs several instructions per limb.  The kernels
+   here keep the carry in the flags instead.  Add and subtract use adc
+   and sbb, which every x86-64 CPU has.  The multiplications use mulx
+   (BMI2), which does not touch the flags, and adcx and adox (ADX),
+   which propagate two independent carries in CF and OF.  This allows
+   adding the high limb of the previous product and the limb of the
+   result in the same pass.  The loops are unrolled four times after
+   handling SIZE % 4 limbs, and are counted with lea and jrcxz, which
+   leave the flags alone.  All functions require SIZE >= 1, like their
+   generic counterparts.  */
+
+#include <config.h>
+#include "mpi-internal.h"
+
+#ifdef USE_AMD64_MPIH
+
+/* The loops over SIZE % 4 single limbs and then over SIZE / 4 blocks
+   of four limbs, counting REST and BLOCKS (negated) up to zero in
+   rcx.  LIMB(OFF) processes the limb at offset OFF, and ADVANCE(N)
+   moves the pointers by N bytes.  jrcxz only jumps 127 bytes, so the
+   counter is tested at the bottom of each loop.  */
+#define LIMB_LOOPS(limb, advance)         \
+  "movq %[rest], %%rcx\n\t"               \
+  "jmp 2f\n"                              \
+  "1:\n\t" limb("0") advance("8")         \
+  "leaq 1(%%rcx), %%rcx\n"                \
+  "2:\n\t"                                \
+  "jrcxz 3f\n\t"                          \
+  "jmp 1b\n"                              \
+  "3:\n\t"                                \
+  "movq %[blocks], %%rcx\n\t"             \
+  "jmp 5f\n"                              \
+  "4:\n\t" limb("0") limb("8") limb("16") \
+      limb("24") advance("32")            \
+  "leaq 1(%%rcx), %%rcx\n"                \
+  "5:\n\t"                                \
+  "jrcxz 6f\n\t"                          \
+  "jmp 4b\n"                              \
+  "6:\n\t"
+
+#define ADVANCE_2(n)             \
+  "leaq " n "(%[s1]), %[s1]\n\t" \
+  "leaq " n "(%[res]), %[res]\n\t"
+
+#define ADVANCE_3(n)             \
+  "leaq " n "(%[s1]), %[s1]\n\t" \
+  "leaq " n "(%[s2]), %[s2]\n\t" \
+  "leaq " n "(%[res]), %[res]\n\t"
+
+#define ADD_N_LIMB(off)           \
+  "movq " off "(%[s1]), %[t]\n\t" \
+  "adcq " off "(%[s2]), %[t]\n\t" \
+  "movq %[t], " off "(%[res])\n\t"
+
+#define SUB_N_LIMB(off)           \
+  "movq " off "(%[s1]), %[t]\n\t" \
+  "sbbq " off "(%[s2]), %[t]\n\t" \
+  "movq %[t], " off "(%[res])\n\t"
+
+/* The loop of add_n and sub_n, with LIMB one of the macros above.
+   The xor clears CF, which holds the carry between the limbs.  */
+#define ADD_SUB_N(limb)                                                       \
+  __asm__ __volatile__(                                                       \
+      "xorl %k[cy], %k[cy]\n\t" LIMB_LOOPS(limb, ADVANCE_3)                   \
+      "adcq %[cy], %[cy]\n\t"                                                 \
+      : [cy] "=&r"(cy), [t] "=&r"(t), [res] "+r"(res_ptr), [s1] "+r"(s1_ptr), \
+        [s2] "+r"(s2_ptr)                                                     \
+      : [rest] "r"(rest), [blocks] "r"(blocks)                                \
+      : "rcx", "cc", "memory")
+
+/* Add {S1_PTR, SIZE} and {S2_PTR, SIZE} into {RES_PTR, SIZE} and
+   return the carry.  */
+mpi_limb_t _gcry_mpih_add_n_amd64(mpi_ptr_t res_ptr, mpi_ptr_t s1_ptr,
+                                  mpi_ptr_t s2_ptr, mpi_size_t size) {
+  mpi_limb_t cy, t;
+  mpi_limb_t rest = -(mpi_limb_t)(size & 3);
+  mpi_limb_t blocks = -(mpi_limb_t)(size >> 2);
+
+  ADD_SUB_N(ADD_N_LIMB);
+
+  return cy;
+}
+
+/* Subtract {S2_PTR, SIZE} from {S1_PTR, SIZE} into {RES_PTR, SIZE}
+   and return the borrow.  */
+mpi_limb_t _gcry_mpih_sub_n_amd64(mpi_ptr_t res_ptr, mpi_ptr_t s1_ptr,
+                                  mpi_ptr_t s2_ptr, mpi_size_t size) {
+  mpi_limb_t cy, t;
+  mpi_limb_t rest = -(mpi_limb_t)(size & 3);
+  mpi_limb_t blocks = -(mpi_limb_t)(size >> 2);
+
+  ADD_SUB_N(SUB_N_LIMB);
+
+  return cy;
+}
+
+/* One limb of mul_1 at offset OFF: the product of S2_LIMB (in rdx)
+   and the limb of S1 plus the previous high limb CY plus CF.  */
+#define MUL_1_LIMB(off)                    \
+  "mulxq " off "(%[s1]), %[lo], %[hi]\n\t" \
+  "adcq %[cy], %[lo]\n\t"                  \
+  "movq %[lo], " off "(%[res])\n\t"        \
+  "movq %[hi], %[cy]\n\t"
+
+/* Multiply {S1_PTR, S1_SIZE} by S2_LIMB into {RES_PTR, S1_SIZE} and
+   return the high limb.  Needs BMI2.  */
+mpi_limb_t _gcry_mpih_mul_1_mulx(mpi_ptr_t res_ptr, mpi_ptr_t s1_ptr,
+                                 mpi_size_t s1_size, mpi_limb_t s2_limb) {
+  mpi_limb_t cy, lo, hi;
+  mpi_limb_t rest = -(mpi_limb_t)(s1_size & 3);
+  mpi_limb_t blocks = -(mpi_limb_t)(s1_size >> 2);
+
+  __asm__ __volatile__(
+      "xorl %k[cy], %k[cy]\n\t" LIMB_LOOPS(MUL_1_LIMB, ADVANCE_2)
+      "adcq $0, %[cy]\n\t"
+      : [cy] "=&r"(cy), [lo] "=&r"(lo), [hi] "=&r"(hi), [res] "+r"(res_ptr),
+        [s1] "+r"(s1_ptr)
+      : [rest] "r"(rest), [blocks] "r"(blocks), "d"(s2_limb)
+      : "rcx", "cc", "memory");
+
+  return cy;
+}
+
+/* One limb of addmul_1 at offset OFF.  The CF chain adds the previous
+   high limb CY to the low limb of the product, the OF chain adds the
+   limb of the result.  */
+#define ADDMUL_1_LIMB(off)                 \
+  "mulxq " off "(%[s1]), %[lo], %[hi]\n\t" \
+  "adcxq %[cy], %[lo]\n\t"                 \
+  "adoxq " off "(%[res]), %[lo]\n\t"       \
+  "movq %[lo], " off "(%[res])\n\t"        \
+  "movq %[hi], %[cy]\n\t"
+
+/* One limb of submul_1 at offset OFF.  The product limb is computed
+   as in addmul_1 and subtracted from the result limb R using
+   R - P = ~(~R + P), which turns the borrow into the carry of the OF
+   chain.  */
+#define SUBMUL_1_LIMB(off)                 \
+  "mulxq " off "(%[s1]), %[lo], %[hi]\n\t" \
+  "adcxq %[cy], %[lo]\n\t"                 \
+  "movq " off "(%[res]), %[t]\n\t"         \
+  "notq %[t]\n\t"                          \
+  "adoxq %[t], %[lo]\n\t"                  \
+  "notq %[lo]\n\t"                         \
+  "movq %[lo], " off "(%[res])\n\t"        \
+  "movq %[hi], %[cy]\n\t"
+
+/* The loop of addmul_1 and submul_1, with LIMB one of the macros
+   above.  The xor clears CF and OF.  The returned limb is the last
+   high limb plus both carries.  */
+#define MULX_ADX(limb)                                                \
+  __asm__ __volatile__(                                               \
+      "xorl %k[cy], %k[cy]\n\t" LIMB_LOOPS(limb, ADVANCE_2)           \
+      "movl $0, %k[t]\n\t"                                            \
+      "adcxq %[t], %[cy]\n\t"                                         \
+      "adoxq %[t], %[cy]\n\t"                                         \
+      : [cy] "=&r"(cy), [lo] "=&r"(lo), [hi] "=&r"(hi), [t] "=&r"(t), \
+        [res] "+r"(res_ptr), [s1] "+r"(s1_ptr)                        \
+      : [rest] "r"(rest), [blocks] "r"(blocks), "d"(s2_limb)          \
+      : "rcx", "cc", "memory")
+
+/* Add {S1_PTR, S1_SIZE} times S2_LIMB to {RES_PTR, S1_SIZE} and
+   return the carry limb.  Needs BMI2 and ADX.  */
+mpi_limb_t _gcry_mpih_addmul_1_adx(mpi_ptr_t res_ptr, mpi_ptr_t s1_ptr,
+                                   mpi_size_t s1_size, mpi_limb_t s2_limb) {
+  mpi_limb_t cy, lo, hi, t;
+  mpi_limb_t rest = -(mpi_limb_t)(s1_size & 3);
+  mpi_limb_t blocks = -(mpi_limb_t)(s1_size >> 2);
+
+  MULX_ADX(ADDMUL_1_LIMB);
+
+  return cy;
+}
+
+/* Subtract {S1_PTR, S1_SIZE} times S2_LIMB from {RES_PTR, S1_SIZE}
+   and return the borrow limb.  Needs BMI2 and ADX.  */
+mpi_limb_t _gcry_mpih_submul_1_adx(mpi_ptr_t res_ptr, mpi_ptr_t s1_ptr,
+                                   mpi_size_t s1_size, mpi_limb_t s2_limb) {
+  mpi_limb_t cy, lo, hi, t;
+  mpi_limb_t rest = -(mpi_limb_t)(s1_size & 3);
+  mpi_limb_t blocks = -(mpi_limb_t)(s1_size >> 2);
+
+  MULX_ADX(SUBMUL_1_LIMB);
+
+  return cy;
+}
+
+#endif /* USE_AMD64_MPIH */
@@ -38,6 +38,11 @@ mpi_limb_t _gcry_mpih_addmul_1(mpi_ptr_t res_ptr, mpi_ptr_t s1_ptr,
   mpi_limb_t prod_high, prod_low;
   mpi_limb_t x;
 
+#ifdef USE_AMD64_MPIH
+  if (_gcry_mpih_use_adx)
+    return _gcry_mpih_addmul_1_adx(res_ptr, s1_ptr, s1_size, s2_limb);
+#endif
+
   /* The loop counter and index J goes from -SIZE to -1.  This way
    * the loop becomes faster.  */
   j = -s1_size;
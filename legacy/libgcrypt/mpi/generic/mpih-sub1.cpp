@@ -36,6 +36,11 @@ mpi_limb_t _gcry_mpih_sub_n(mpi_ptr_t res_ptr, mpi_ptr_t s1_ptr,
   mpi_limb_t x, y, cy;
   mpi_size_t j;
 
+#ifdef USE_AMD64_MPIH
+  /* The sbb loop needs no special CPU features.  */
+  return _gcry_mpih_sub_n_amd64(res_ptr, s1_ptr, s2_ptr, size);
+#endif
+
   /* The loop counter and index J goes from -SIZE to -1.  This way
      the loop becomes faster.  */
   j = -size;
@@ -227,6 +227,35 @@ void _gcry_mpih_mul_karatsuba_case(mpi_ptr_t prodp, mpi_ptr_t up,
 mpi_limb_t _gcry_mpih_mul_1(mpi_ptr_t res_ptr, mpi_ptr_t s1_ptr,
                             mpi_size_t s1_size, mpi_limb_t s2_limb);
 
+/*-- amd64/mpih-amd64.cpp --*/
+
+/* USE_AMD64_MPIH indicates whether to compile the x86-64 limb
+   kernels.  They need 64 bit limbs and pointers, and GCC style inline
+   assembly.  */
+#undef USE_AMD64_MPIH
+#if defined(__x86_64__) && !defined(__ILP32__) && \
+    BYTES_PER_MPI_LIMB == 8 && defined(__GNUC__)
+#define USE_AMD64_MPIH 1
+#endif
+
+#ifdef USE_AMD64_MPIH
+/* Set by _gcry_mpi_init if the CPU has BMI2, respectively BMI2 and
+   ADX, to select the kernels below.  */
+extern int _gcry_mpih_use_mulx;
+extern int _gcry_mpih_use_adx;
+
+mpi_limb_t _gcry_mpih_add_n_amd64(mpi_ptr_t res_ptr, mpi_ptr_t s1_ptr,
+                                  mpi_ptr_t s2_ptr, mpi_size_t size);
+mpi_limb_t _gcry_mpih_sub_n_amd64(mpi_ptr_t res_ptr, mpi_ptr_t s1_ptr,
+                                  mpi_ptr_t s2_ptr, mpi_size_t size);
+mpi_limb_t _gcry_mpih_mul_1_mulx(mpi_ptr_t res_ptr, mpi_ptr_t s1_ptr,
+                                 mpi_size_t s1_size, mpi_limb_t s2_limb);
+mpi_limb_t _gcry_mpih_addmul_1_adx(mpi_ptr_t res_ptr, mpi_ptr_t s1_ptr,
+                                   mpi_size_t s1_size, mpi_limb_t s2_limb);
+mpi_limb_t _gcry_mpih_submul_1_adx(mpi_ptr_t res_ptr, mpi_ptr_t s1_ptr,
+                                   mpi_size_t s1_size, mpi_limb_t s2_limb);
+#endif /*USE_AMD64_MPIH*/
+
 /*-- mpih-div.c --*/
 mpi_limb_t _gcry_mpih_mod_1(mpi_ptr_t dividend_ptr, mpi_size_t dividend_size,
                             mpi_limb_t divisor_limb);
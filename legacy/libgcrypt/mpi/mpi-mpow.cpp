@@ -59,6 +59,9 @@ static int build_index(gcry_mpi_t *exparray, int k, int i, int t) {
 
 /****************
  * RES = (BASE[0] ^ EXP[0]) *  (BASE[1] ^ EXP[1]) * ... * mod M
+ *
+ * For an odd M, the squarings and multiplications are done in
+ * Montgomery form, which avoids a division for each of them.
  */
 void _gcry_mpi_mulpowm(gcry_mpi_t res, gcry_mpi_t *basearray,
                        gcry_mpi_t *exparray, gcry_mpi_t m) {
@@ -67,6 +70,7 @@ void _gcry_mpi_mulpowm(gcry_mpi_t res, gcry_mpi_t *basearray,
   int i, j, idx;
   gcry_mpi_t *G; /* table with precomputed values of size 2^k */
   gcry_mpi_t tmp;
+  mpi_mont_t mont;
 #ifdef USE_BARRETT
   gcry_mpi_t barrett_y, barrett_r1, barrett_r2;
   int barrett_k;
@@ -89,12 +93,17 @@ void _gcry_mpi_mulpowm(gcry_mpi_t res, gcry_mpi_t *basearray,
 #ifdef USE_BARRETT
   barrett_y = init_barrett(m, &barrett_k, &barrett_r1, &barrett_r2);
 #endif
+  mont = mpi_mont_init(m);
   /* and calculate */
   tmp = mpi_alloc(mpi_get_nlimbs(m) + 1);
   mpi_set_ui(res, 1);
+  if (mont) mpi_mont_to(res, res, mont);
   for (i = 1; i <= t; i++) {
-    barrett_mulm(tmp, res, res, m, barrett_y, barrett_k, barrett_r1,
-                 barrett_r2);
+    if (mont)
+      mpi_mont_mul(tmp, res, res, mont);
+    else
+      barrett_mulm(tmp, res, res, m, barrett_y, barrett_k, barrett_r1,
+                   barrett_r2);
     idx = build_index(exparray, k, i, t);
     gcry_assert(idx >= 0 && idx < (1 << k));
     if (!G[idx]) {
@@ -112,13 +121,19 @@ void _gcry_mpi_mulpowm(gcry_mpi_t res, gcry_mpi_t *basearray,
         }
         if (!G[idx]) G[idx] = mpi_alloc(0);
       }
+      if (mont) mpi_mont_to(G[idx], G[idx], mont);
     }
-    barrett_mulm(res, tmp, G[idx], m, barrett_y, barrett_k, barrett_r1,
-                 barrett_r2);
+    if (mont)
+      mpi_mont_mul(res, tmp, G[idx], mont);
+    else
+      barrett_mulm(res, tmp, G[idx], m, barrett_y, barrett_k, barrett_r1,
+                   barrett_r2);
   }
+  if (mont) mpi_mont_from(res, res, mont);
 
   /* cleanup */
   mpi_free(tmp);
+  mpi_mont_free(mont);
 #ifdef USE_BARRETT
   mpi_free(barrett_y);
   mpi_free(barrett_r1);
@@ -44,8 +44,8 @@
 /****************
  * RES = BASE ^ EXPO mod MOD
  */
-void _gcry_mpi_powm(gcry_mpi_t res, gcry_mpi_t base, gcry_mpi_t expo,
-                    gcry_mpi_t mod) {
+static void powm_classic(gcry_mpi_t res, gcry_mpi_t base, gcry_mpi_t expo,
+                         gcry_mpi_t mod) {
   /* Pointer to the limbs of the arguments, their size and signs. */
   mpi_ptr_t rp, ep, mp, bp;
   mpi_size_t esize, msize, bsize, rsize;
@@ -359,8 +359,8 @@ static void mul_mod(mpi_ptr_t xp, mpi_size_t *xsize_p, mpi_ptr_t rp,
  *   Handbook of Applied Cryptography
  *       Algorithm 14.83: Modified left-to-right k-ary exponentiation
  */
-void _gcry_mpi_powm(gcry_mpi_t res, gcry_mpi_t base, gcry_mpi_t expo,
-                    gcry_mpi_t mod) {
+static void powm_classic(gcry_mpi_t res, gcry_mpi_t base, gcry_mpi_t expo,
+                         gcry_mpi_t mod) {
   /* Pointer to the limbs of the arguments, their size and signs. */
   mpi_ptr_t rp, ep, mp, bp;
   mpi_size_t esize, msize, bsize, rsize;
@@ -688,4 +688,332 @@ leave:
   if (ep_marker) _gcry_mpi_free_limb_space(ep_marker, ep_nlimbs);
   if (xp_marker) _gcry_mpi_free_limb_space(xp_marker, xp_nlimbs);
 }
-#endif
+#endif /*USE_ALGORITHM_SIMPLE_EXPONENTIATION*/
+
+/* Context used with Montgomery multiplication.  Values in Montgomery
+   form are stored as U * R mod M with R = 2^(N * BITS_PER_MPI_LIMB),
+   and the product of two of them is reduced by dividing by R, which
+   for an odd M only needs multiplications and no division.  The
+   scratch space makes a context usable by one thread at a time.  */
+struct mont_ctx_s {
+  gcry_mpi_t m;    /* A copy of the modulus.  */
+  mpi_size_t n;    /* Number of limbs of M.  */
+  int secure;      /* M is in secure memory.  */
+  mpi_limb_t minv; /* -1 / M mod 2^BITS_PER_MPI_LIMB.  */
+  mpi_ptr_t rr;    /* R^2 mod M, N limbs.  */
+  mpi_ptr_t tp;    /* Product, 2 * N limbs.  */
+  mpi_ptr_t tspace; /* Scratch for Karatsuba squaring, 2 * N limbs.  */
+  struct karatsuba_ctx karactx;
+};
+
+/* Set {RP, N} to {TP, 2 * N} / R mod M.  {TP, 2 * N} must be less
+   than M * R, and is destroyed.  The carry of adding Q * M at limb I
+   belongs to limb I + N.  It is kept in TP[I], which is zero
+   afterwards, and all carries are added at the end.  The final
+   subtraction of M is done with masks, not with a branch.  */
+static void mont_redc(mpi_ptr_t rp, mpi_ptr_t tp, mpi_mont_t ctx) {
+  mpi_size_t n = ctx->n;
+  mpi_ptr_t mp = ctx->m->d;
+  mpi_limb_t cy, borrow, mask;
+  mpi_size_t i;
+
+  for (i = 0; i < n; i++)
+    tp[i] = _gcry_mpih_addmul_1(tp + i, mp, n, tp[i] * ctx->minv);
+  cy = _gcry_mpih_add_n(rp, tp + n, tp, n);
+
+  /* The sum is less than 2 * M.  Subtract M if it did not fit into N
+     limbs or if the subtraction does not borrow.  */
+  borrow = _gcry_mpih_sub_n(tp, rp, mp, n);
+  mask = 0UL - (cy | (borrow ^ 1));
+  for (i = 0; i < n; i++) rp[i] = (rp[i] & ~mask) | (tp[i] & mask);
+}
+
+/* Set {RP, N} to {AP, N} * {BP, N} / R mod M.  The inputs must be
+   less than M.  RP may be the same as AP or BP.  */
+static void mont_mul(mpi_ptr_t rp, mpi_ptr_t ap, mpi_ptr_t bp,
+                     mpi_mont_t ctx) {
+  mpi_size_t n = ctx->n;
+  mpi_ptr_t tp = ctx->tp;
+  mpi_size_t i;
+
+  if (ap == bp) {
+    if (n < KARATSUBA_THRESHOLD)
+      _gcry_mpih_sqr_n_basecase(tp, ap, n);
+    else
+      _gcry_mpih_sqr_n(tp, ap, n, ctx->tspace);
+  } else if (n < KARATSUBA_THRESHOLD) {
+    /* Unlike _gcry_mpih_mul, this does not branch on the limbs of BP.  */
+    tp[n] = _gcry_mpih_mul_1(tp, ap, n, bp[0]);
+    for (i = 1; i < n; i++)
+      tp[n + i] = _gcry_mpih_addmul_1(tp + i, ap, n, bp[i]);
+  } else
+    _gcry_mpih_mul_karatsuba_case(tp, ap, n, bp, n, &ctx->karactx);
+
+  mont_redc(rp, tp, ctx);
+}
+
+/* Set {RP, N} to {AP, N} / R mod M, i.e. convert out of Montgomery
+   form.  */
+static void mont_reduce(mpi_ptr_t rp, mpi_ptr_t ap, mpi_mont_t ctx) {
+  MPN_COPY(ctx->tp, ap, ctx->n);
+  MPN_ZERO(ctx->tp + ctx->n, ctx->n);
+  mont_redc(rp, ctx->tp, ctx);
+}
+
+/* Make sure that A has room for N limbs, with the limbs above
+   A->NLIMBS cleared, and return them.  The value of A is unchanged.  */
+static mpi_ptr_t mont_limbs(gcry_mpi_t a, mpi_size_t n) {
+  RESIZE_IF_NEEDED(a, n);
+  if (a->nlimbs < n) MPN_ZERO(a->d + a->nlimbs, n - a->nlimbs);
+  return a->d;
+}
+
+/* Set the MPI W to the N limbs at WP.  */
+static void mont_set(gcry_mpi_t w, mpi_ptr_t wp, mpi_size_t n) {
+  if (w->d != wp) {
+    RESIZE_IF_NEEDED(w, n);
+    MPN_COPY(w->d, wp, n);
+  }
+  MPN_NORMALIZE(w->d, n);
+  w->nlimbs = n;
+  w->sign = 0;
+}
+
+/* Return a new context for Montgomery multiplication modulo M, or
+   NULL if M is not positive and odd.  The context needs to be
+   released using _gcry_mpi_mont_free.  */
+mpi_mont_t _gcry_mpi_mont_init(gcry_mpi_t m) {
+  mpi_mont_t ctx;
+  mpi_limb_t m0, inv;
+  gcry_mpi_t tmp;
+  mpi_size_t n;
+  int i;
+
+  mpi_normalize(m);
+  n = m->nlimbs;
+  if (!n || m->sign || !(m->d[0] & 1)) return NULL;
+
+  ctx = (mpi_mont_t)xcalloc(1, sizeof *ctx);
+  ctx->m = mpi_copy(m);
+  ctx->n = n;
+  ctx->secure = mpi_is_secure(m);
+
+  /* Newton's iteration doubles the number of correct low bits of the
+     inverse in each step, starting with 3 as M0 * M0 = 1 mod 8.  */
+  m0 = m->d[0];
+  inv = m0;
+  for (i = 0; i < 5; i++) inv *= 2 - m0 * inv;
+  ctx->minv = 0UL - inv;
+
+  tmp = ctx->secure ? mpi_alloc_secure(2 * n + 1) : mpi_alloc(2 * n + 1);
+  mpi_set_ui(tmp, 1);
+  mpi_lshift_limbs(tmp, 2 * n);
+  mpi_fdiv_r(tmp, tmp, m);
+  ctx->rr = mpi_alloc_limb_space(n, ctx->secure);
+  MPN_ZERO(ctx->rr, n);
+  MPN_COPY(ctx->rr, tmp->d, tmp->nlimbs);
+  mpi_free(tmp);
+
+  ctx->tp = mpi_alloc_limb_space(2 * n, ctx->secure);
+  ctx->tspace = mpi_alloc_limb_space(2 * n, ctx->secure);
+
+  return ctx;
+}
+
+void _gcry_mpi_mont_free(mpi_mont_t ctx) {
+  if (ctx) {
+    mpi_size_t n = ctx->n;
+
+    _gcry_mpih_release_karatsuba_ctx(&ctx->karactx);
+    _gcry_mpi_free_limb_space(ctx->tspace, 2 * n);
+    _gcry_mpi_free_limb_space(ctx->tp, 2 * n);
+    _gcry_mpi_free_limb_space(ctx->rr, n);
+    mpi_free(ctx->m);
+    xfree(ctx);
+  }
+}
+
+/* W = U * R mod M, the Montgomery form of U.  U may be any value,
+   including a negative one.  */
+void _gcry_mpi_mont_to(gcry_mpi_t w, gcry_mpi_t u, mpi_mont_t ctx) {
+  mpi_size_t n = ctx->n;
+
+  mpi_ptr_t wp;
+
+  mpi_fdiv_r(w, u, ctx->m);
+  wp = mont_limbs(w, n);
+  mont_mul(wp, wp, ctx->rr, ctx);
+  mont_set(w, wp, n);
+}
+
+/* W = U / R mod M, the value of U in Montgomery form.  */
+void _gcry_mpi_mont_from(gcry_mpi_t w, gcry_mpi_t u, mpi_mont_t ctx) {
+  mpi_size_t n = ctx->n;
+
+  mpi_ptr_t wp;
+
+  mpi_set(w, u);
+  wp = mont_limbs(w, n);
+  mont_reduce(wp, wp, ctx);
+  mont_set(w, wp, n);
+}
+
+/* W = U * V / R mod M, the Montgomery product of U and V, which must
+   be in Montgomery form.  */
+void _gcry_mpi_mont_mul(gcry_mpi_t w, gcry_mpi_t u, gcry_mpi_t v,
+                        mpi_mont_t ctx) {
+  mpi_size_t n = ctx->n;
+  mpi_ptr_t up = mont_limbs(u, n);
+  mpi_ptr_t vp = mont_limbs(v, n);
+
+  RESIZE_IF_NEEDED(w, n);
+  mont_mul(w->d, up, vp, ctx);
+  mont_set(w, w->d, n);
+}
+
+/* Return the W bits of the exponent {EP, ESIZE} at bit POS.  Bits
+   above the exponent are zero.  */
+static unsigned int mont_window(mpi_ptr_t ep, mpi_size_t esize,
+                                unsigned int pos, int w) {
+  mpi_size_t i = pos / BITS_PER_MPI_LIMB;
+  unsigned int sh = pos % BITS_PER_MPI_LIMB;
+  mpi_limb_t v;
+
+  v = i < esize ? ep[i] >> sh : 0;
+  if (sh + w > BITS_PER_MPI_LIMB && i + 1 < esize)
+    v |= ep[i + 1] << (BITS_PER_MPI_LIMB - sh);
+  return v & ((1 << w) - 1);
+}
+
+/* Copy entry IDX of the table at TABLE with SIZE entries of N limbs
+   to RP.  All entries are read, so that the memory access pattern
+   does not depend on IDX.  */
+static void mont_select(mpi_ptr_t rp, mpi_ptr_t table, int size, mpi_size_t n,
+                        unsigned int idx) {
+  mpi_limb_t mask;
+  mpi_size_t i;
+  int k;
+
+  MPN_ZERO(rp, n);
+  for (k = 0; k < size; k++) {
+    mask = 0UL - (mpi_limb_t)((unsigned int)k == idx);
+    for (i = 0; i < n; i++) rp[i] |= table[k * n + i] & mask;
+  }
+}
+
+/****************
+ * RES = BASE ^ EXPO mod M, with the modulus M of CTX.
+ *
+ * The exponent is processed from the top in fixed windows of W bits.
+ * Each window costs W squarings and one multiplication with the table
+ * entry BASE^window, which is read with mont_select.  The sequence of
+ * operations and the memory accesses thus only depend on the length
+ * of the exponent.  For an exponent in secure memory, the length is
+ * rounded up to whole limbs.  A single limb exponent not in secure
+ * memory is assumed to be public (like an RSA exponent), and uses
+ * plain square and multiply.
+ */
+void _gcry_mpi_powm_mont(gcry_mpi_t res, gcry_mpi_t base, gcry_mpi_t expo,
+                         mpi_mont_t ctx) {
+  mpi_size_t n = ctx->n;
+  mpi_ptr_t ep = expo->d;
+  mpi_size_t esize = expo->nlimbs;
+  int esec = mpi_is_secure(expo);
+  int sec = esec || mpi_is_secure(base) || ctx->secure;
+  int negative_result;
+  unsigned int nbits, pos;
+  int W, tsize, i, j;
+  mpi_ptr_t table, xp, sp;
+  gcry_mpi_t b;
+
+  MPN_NORMALIZE(ep, esize);
+  if (!esize) {
+    /* Exponent is zero, result is 1 mod M, i.e., 1 or 0 depending
+       on if M equals 1.  */
+    mpi_set_ui(res, (n == 1 && ctx->m->d[0] == 1) ? 0 : 1);
+    return;
+  }
+
+  nbits = esec ? esize * BITS_PER_MPI_LIMB : mpi_get_nbits(expo);
+  if (nbits > 512)
+    W = 5;
+  else if (nbits > 256)
+    W = 4;
+  else if (nbits > 128)
+    W = 3;
+  else if (nbits > 64)
+    W = 2;
+  else
+    W = 1;
+  tsize = 1 << W;
+
+  /* TABLE[I] = BASE^I * R mod M, with the absolute value of BASE.  */
+  b = sec ? mpi_alloc_secure(n) : mpi_alloc(n);
+  mpi_set(b, base);
+  negative_result = b->sign && (ep[0] & 1);
+  b->sign = 0;
+  if (mpi_cmp(b, ctx->m) >= 0) mpi_fdiv_r(b, b, ctx->m);
+
+  table = mpi_alloc_limb_space(tsize * n, sec);
+  xp = mpi_alloc_limb_space(n, sec);
+  sp = mpi_alloc_limb_space(n, sec);
+  mont_reduce(table, ctx->rr, ctx);
+  mont_mul(table + n, mont_limbs(b, n), ctx->rr, ctx);
+  for (i = 2; i < tsize; i++)
+    mont_mul(table + i * n, table + (i - 1) * n, table + n, ctx);
+
+  if (esize == 1 && !esec) {
+    MPN_COPY(xp, table + n, n);
+    for (i = nbits - 2; i >= 0; i--) {
+      mont_mul(xp, xp, xp, ctx);
+      if ((ep[0] >> i) & 1) mont_mul(xp, xp, table + n, ctx);
+    }
+  } else {
+    pos = (nbits + W - 1) / W * W - W;
+    mont_select(xp, table, tsize, n, mont_window(ep, esize, pos, W));
+    while (pos) {
+      pos -= W;
+      for (j = 0; j < W; j++) mont_mul(xp, xp, xp, ctx);
+      mont_select(sp, table, tsize, n, mont_window(ep, esize, pos, W));
+      mont_mul(xp, xp, sp, ctx);
+    }
+  }
+
+  mont_reduce(xp, xp, ctx);
+
+  /* Fixup for negative results.  */
+  i = n;
+  MPN_NORMALIZE(xp, i);
+  if (negative_result && i) _gcry_mpih_sub_n(xp, ctx->m->d, xp, n);
+  mont_set(res, xp, n);
+
+  _gcry_mpi_free_limb_space(table, sec ? tsize * n : 0);
+  _gcry_mpi_free_limb_space(xp, sec ? n : 0);
+  _gcry_mpi_free_limb_space(sp, sec ? n : 0);
+  mpi_free(b);
+}
+
+/****************
+ * RES = BASE ^ EXPO mod MOD
+ *
+ * Odd moduli, as used by RSA, ElGamal and DSA, use Montgomery
+ * multiplication, the others the classic division based code.  The
+ * context is set up for each call.  For a 2048 bit modulus this takes
+ * about 4% of an exponentiation with the public exponent 65537, and
+ * much less for a secret exponent.  Callers doing several
+ * exponentiations modulo the same number can keep a context and use
+ * _gcry_mpi_powm_mont instead.
+ */
+void _gcry_mpi_powm(gcry_mpi_t res, gcry_mpi_t base, gcry_mpi_t expo,
+                    gcry_mpi_t mod) {
+  mpi_mont_t ctx;
+
+  if (!mod->nlimbs) _gcry_divide_by_zero();
+
+  ctx = mpi_mont_init(mod);
+  if (ctx) {
+    _gcry_mpi_powm_mont(res, base, expo, ctx);
+    mpi_mont_free(ctx);
+  } else
+    powm_classic(res, base, expo, mod);
+}
@@ -49,6 +49,39 @@
       _gcry_mpih_sqr_n(prodp, up, size, tspace);   \
   } while (0);
 
+/* The Karatsuba code below is used by the Montgomery exponentiation in
+ * mpi-pow.c, which must not branch on secret values.  Thus it does not
+ * compare its operands and always propagates carries over the full
+ * length, using the two helpers below.
+ */
+
+/* Add S2_LIMB to {S1_PTR, SIZE} and store the result at RES_PTR.
+ * Return the carry.  Unlike _gcry_mpih_add_1, the loop does not stop
+ * when the carry is used up.  */
+static mpi_limb_t add_1_all(mpi_ptr_t res_ptr, mpi_ptr_t s1_ptr,
+                            mpi_size_t size, mpi_limb_t s2_limb) {
+  mpi_limb_t x, cy = s2_limb;
+  mpi_size_t i;
+
+  for (i = 0; i < size; i++) {
+    x = s1_ptr[i] + cy;
+    cy = x < cy;
+    res_ptr[i] = x;
+  }
+  return cy;
+}
+
+/* Replace {P, SIZE} by B^SIZE - {P, SIZE} if NEG is 1, leave it as it
+ * is if NEG is 0.  The result is stored modulo B^SIZE, and the return
+ * value is its high limb (1 if NEG is 1 and P is zero).  */
+static mpi_limb_t negate_if(mpi_ptr_t p, mpi_size_t size, mpi_limb_t neg) {
+  mpi_limb_t mask = 0UL - neg;
+  mpi_size_t i;
+
+  for (i = 0; i < size; i++) p[i] ^= mask;
+  return add_1_all(p, p, size, neg);
+}
+
 /* Multiply the natural numbers u (pointed to by UP) and v (pointed to by VP),
  * both with SIZE limbs, and store the result at PRODP.  2 * SIZE limbs are
  * always stored.  Return the most significant limb.
@@ -70,19 +103,12 @@ static mpi_limb_t mul_n_basecase(mpi_ptr_t prodp, mpi_ptr_t up, mpi_ptr_t vp,
                                  mpi_size_t size) {
   mpi_size_t i;
   mpi_limb_t cy;
-  mpi_limb_t v_limb;
 
   /* Multiply by the first limb in V separately, as the result can be
-   * stored (not added) to PROD.  We also avoid a loop for zeroing.  */
-  v_limb = vp[0];
-  if (v_limb <= 1) {
-    if (v_limb == 1)
-      MPN_COPY(prodp, up, size);
-    else
-      MPN_ZERO(prodp, size);
-    cy = 0;
-  } else
-    cy = _gcry_mpih_mul_1(prodp, up, size, v_limb);
+   * stored (not added) to PROD.  We also avoid a loop for zeroing.
+   * Limbs of V equal to 0 or 1 are not special cased, so that the
+   * time does not depend on V.  */
+  cy = _gcry_mpih_mul_1(prodp, up, size, vp[0]);
 
   prodp[size] = cy;
   prodp++;
@@ -90,12 +116,7 @@ static mpi_limb_t mul_n_basecase(mpi_ptr_t prodp, mpi_ptr_t up, mpi_ptr_t vp,
   /* For each iteration in the outer loop, multiply one limb from
    * U with one limb from V, and add it to PROD.  */
   for (i = 1; i < size; i++) {
-    v_limb = vp[i];
-    if (v_limb <= 1) {
-      cy = 0;
-      if (v_limb == 1) cy = _gcry_mpih_add_n(prodp, prodp, up, size);
-    } else
-      cy = _gcry_mpih_addmul_1(prodp, up, size, v_limb);
+    cy = _gcry_mpih_addmul_1(prodp, up, size, vp[i]);
 
     prodp[size] = cy;
     prodp++;
@@ -143,7 +164,7 @@ static void mul_n(mpi_ptr_t prodp, mpi_ptr_t up, mpi_ptr_t vp, mpi_size_t size,
      */
     mpi_size_t hsize = size >> 1;
     mpi_limb_t cy;
-    int negflg;
+    mpi_limb_t negflg;
 
     /* Product H.	   ________________  ________________
      *		  |_____U1 x V1____||____U0 x V0_____|
@@ -154,21 +175,16 @@ static void mul_n(mpi_ptr_t prodp, mpi_ptr_t up, mpi_ptr_t vp, mpi_size_t size,
 
     /* Product M.	   ________________
      *		  |_(U1-U0)(V0-V1)_|
+     * The absolute values of the differences are computed by negating
+     * them if the subtraction borrows.  M is negative if exactly one of
+     * them borrows, or if none does.
      */
-    if (_gcry_mpih_cmp(up + hsize, up, hsize) >= 0) {
-      _gcry_mpih_sub_n(prodp, up + hsize, up, hsize);
-      negflg = 0;
-    } else {
-      _gcry_mpih_sub_n(prodp, up, up + hsize, hsize);
-      negflg = 1;
-    }
-    if (_gcry_mpih_cmp(vp + hsize, vp, hsize) >= 0) {
-      _gcry_mpih_sub_n(prodp + hsize, vp + hsize, vp, hsize);
-      negflg ^= 1;
-    } else {
-      _gcry_mpih_sub_n(prodp + hsize, vp, vp + hsize, hsize);
-      /* No change of NEGFLG.  */
-    }
+    cy = _gcry_mpih_sub_n(prodp, up + hsize, up, hsize);
+    negate_if(prodp, hsize, cy);
+    negflg = cy ^ 1;
+    cy = _gcry_mpih_sub_n(prodp + hsize, vp + hsize, vp, hsize);
+    negate_if(prodp + hsize, hsize, cy);
+    negflg ^= cy;
     /* Read temporary operands from low part of PROD.
      * Put result in low part of TSPACE using upper part of TSPACE
      * as new TSPACE.
@@ -180,11 +196,10 @@ static void mul_n(mpi_ptr_t prodp, mpi_ptr_t up, mpi_ptr_t vp, mpi_size_t size,
     cy = _gcry_mpih_add_n(prodp + size, prodp + size, prodp + size + hsize,
                           hsize);
 
-    /* Add product M (if NEGFLG M is a negative number) */
-    if (negflg)
-      cy -= _gcry_mpih_sub_n(prodp + hsize, prodp + hsize, tspace, size);
-    else
-      cy += _gcry_mpih_add_n(prodp + hsize, prodp + hsize, tspace, size);
+    /* Add product M (if NEGFLG M is a negative number).  A negative M
+     * is added as B^SIZE - |M|, and the B^SIZE is taken back from CY.  */
+    cy += negate_if(tspace, size, negflg) - negflg;
+    cy += _gcry_mpih_add_n(prodp + hsize, prodp + hsize, tspace, size);
 
     /* Product L.	   ________________  ________________
      *		  |________________||____U0 x V0_____|
@@ -197,47 +212,58 @@ static void mul_n(mpi_ptr_t prodp, mpi_ptr_t up, mpi_ptr_t vp, mpi_size_t size,
     /* Add/copy Product L (twice) */
 
     cy += _gcry_mpih_add_n(prodp + hsize, prodp + hsize, tspace, size);
-    if (cy)
-      _gcry_mpih_add_1(prodp + hsize + size, prodp + hsize + size, hsize, cy);
+    add_1_all(prodp + hsize + size, prodp + hsize + size, hsize, cy);
 
     MPN_COPY(prodp, tspace, hsize);
     cy = _gcry_mpih_add_n(prodp + hsize, prodp + hsize, tspace + hsize, hsize);
-    if (cy) _gcry_mpih_add_1(prodp + size, prodp + size, size, 1);
+    add_1_all(prodp + size, prodp + size, size, cy);
   }
 }
 
+/* Square the natural number u (pointed to by UP) with SIZE limbs and
+ * store the 2 * SIZE limbs of the result at PRODP, which must be
+ * distinct from UP.
+ *
+ * The products U[i] * U[j] with i < j appear twice in the square.
+ * They are summed up once, doubled with a shift, and then the squares
+ * U[i] * U[i] are added.  This needs about half the multiplications
+ * of a general product, and no branches on the value of U.
+ */
 void _gcry_mpih_sqr_n_basecase(mpi_ptr_t prodp, mpi_ptr_t up, mpi_size_t size) {
   mpi_size_t i;
   mpi_limb_t cy_limb;
-  mpi_limb_t v_limb;
-
-  /* Multiply by the first limb in V separately, as the result can be
-   * stored (not added) to PROD.  We also avoid a loop for zeroing.  */
-  v_limb = up[0];
-  if (v_limb <= 1) {
-    if (v_limb == 1)
-      MPN_COPY(prodp, up, size);
-    else
-      MPN_ZERO(prodp, size);
-    cy_limb = 0;
-  } else
-    cy_limb = _gcry_mpih_mul_1(prodp, up, size, v_limb);
-
-  prodp[size] = cy_limb;
-  prodp++;
+  mpi_limb_t hi, lo, x0, x1, c0, c1;
 
-  /* For each iteration in the outer loop, multiply one limb from
-   * U with one limb from V, and add it to PROD.  */
-  for (i = 1; i < size; i++) {
-    v_limb = up[i];
-    if (v_limb <= 1) {
-      cy_limb = 0;
-      if (v_limb == 1) cy_limb = _gcry_mpih_add_n(prodp, prodp, up, size);
-    } else
-      cy_limb = _gcry_mpih_addmul_1(prodp, up, size, v_limb);
+  if (size == 1) {
+    umul_ppmm(prodp[1], prodp[0], up[0], up[0]);
+    return;
+  }
 
-    prodp[size] = cy_limb;
-    prodp++;
+  prodp[0] = 0;
+  prodp[size] = _gcry_mpih_mul_1(prodp + 1, up + 1, size - 1, up[0]);
+  for (i = 1; i < size - 1; i++)
+    prodp[size + i] = _gcry_mpih_addmul_1(prodp + 2 * i + 1, up + i + 1,
+                                          size - i - 1, up[i]);
+  prodp[2 * size - 1] = 0;
+
+  _gcry_mpih_lshift(prodp, prodp, 2 * size, 1);
+
+  cy_limb = 0;
+  for (i = 0; i < size; i++) {
+    umul_ppmm(hi, lo, up[i], up[i]);
+    /* HI is at most 2^BITS_PER_MPI_LIMB - 2, so this can't overflow.  */
+    add_ssaaaa(hi, lo, hi, lo, 0, cy_limb);
+
+    x0 = prodp[2 * i] + lo;
+    c0 = x0 < lo;
+    x1 = prodp[2 * i + 1] + hi;
+    c1 = x1 < hi;
+    x1 += c0;
+    c1 += x1 < c0;
+
+    prodp[2 * i] = x0;
+    prodp[2 * i + 1] = x1;
+    cy_limb = c1;
   }
 }
 
@@ -277,10 +303,8 @@ void _gcry_mpih_sqr_n(mpi_ptr_t prodp, mpi_ptr_t up, mpi_size_t size,
     /* Product M.	   ________________
      *		  |_(U1-U0)(U0-U1)_|
      */
-    if (_gcry_mpih_cmp(up + hsize, up, hsize) >= 0)
-      _gcry_mpih_sub_n(prodp, up + hsize, up, hsize);
-    else
-      _gcry_mpih_sub_n(prodp, up, up + hsize, hsize);
+    cy = _gcry_mpih_sub_n(prodp, up + hsize, up, hsize);
+    negate_if(prodp, hsize, cy);
 
     /* Read temporary operands from low part of PROD.
      * Put result in low part of TSPACE using upper part of TSPACE
@@ -304,12 +328,11 @@ void _gcry_mpih_sqr_n(mpi_ptr_t prodp, mpi_ptr_t up, mpi_size_t size,
 
     /* Add/copy Product L (twice).	*/
     cy += _gcry_mpih_add_n(prodp + hsize, prodp + hsize, tspace, size);
-    if (cy)
-      _gcry_mpih_add_1(prodp + hsize + size, prodp + hsize + size, hsize, cy);
+    add_1_all(prodp + hsize + size, prodp + hsize + size, hsize, cy);
 
     MPN_COPY(prodp, tspace, hsize);
     cy = _gcry_mpih_add_n(prodp + hsize, prodp + hsize, tspace + hsize, hsize);
-    if (cy) _gcry_mpih_add_1(prodp + size, prodp + size, size, 1);
+    add_1_all(prodp + size, prodp + size, size, cy);
   }
 }
 
@@ -30,7 +30,20 @@
 /* Constants allocated right away at startup.  */
 static gcry_mpi_t constants[MPI_NUMBER_OF_CONSTANTS];
 
-const char *_gcry_mpi_get_hw_config(void) { return ""; }
+#ifdef USE_AMD64_MPIH
+int _gcry_mpih_use_mulx;
+int _gcry_mpih_use_adx;
+#endif
+
+const char *_gcry_mpi_get_hw_config(void) {
+#ifdef USE_AMD64_MPIH
+  if (_gcry_mpih_use_adx) return "amd64-adx";
+  if (_gcry_mpih_use_mulx) return "amd64-mulx";
+  return "amd64";
+#else
+  return "";
+#endif
+}
 
 /* Initialize the MPI subsystem.  This is called early and allows to
    do some initialization without taking care of threading issues.  */
@@ -38,6 +51,17 @@ gpg_error_t _gcry_mpi_init(void) {
   int idx;
   unsigned long value;
 
+#ifdef USE_AMD64_MPIH
+  {
+    unsigned int hwf = _gcry_get_hw_features();
+
+    _gcry_mpih_use_mulx = !!(hwf & HWF_INTEL_BMI2);
+    _gcry_mpih_use_adx =
+        (hwf & (HWF_INTEL_BMI2 | HWF_INTEL_ADX)) ==
+        (HWF_INTEL_BMI2 | HWF_INTEL_ADX);
+  }
+#endif
+
   for (idx = 0; idx < MPI_NUMBER_OF_CONSTANTS; idx++) {
     switch (idx) {
       case MPI_C_ZERO:
@@ -109,16 +109,19 @@ void _gcry_rmd160_hash_buffer(void *outbuf, const void *buffer, size_t length);
 void _gcry_sha1_hash_buffer(void *outbuf, const void *buffer, size_t length);
 void _gcry_sha1_hash_buffers(void *outbuf, const gcry_buffer_t *iov,
                              int iovcnt);
+void _gcry_sha1_hash_multi(void *digests, const gcry_buffer_t *bufs, int n);
 
 /*-- sha256.c --*/
 void _gcry_sha256_hash_buffer(void *outbuf, const void *buffer, size_t length);
 void _gcry_sha256_hash_buffers(void *outbuf, const gcry_buffer_t *iov,
                                int iovcnt);
+void _gcry_sha256_hash_multi(void *digests, const gcry_buffer_t *bufs, int n);
 
 /*-- sha512.c --*/
 void _gcry_sha512_hash_buffer(void *outbuf, const void *buffer, size_t length);
 void _gcry_sha512_hash_buffers(void *outbuf, const gcry_buffer_t *iov,
                                int iovcnt);
+void _gcry_sha512_hash_multi(void *digests, const gcry_buffer_t *bufs, int n);
 
 /*-- blake2.c --*/
 gpg_error_t _gcry_blake2_init_with_key(void *ctx, unsigned int flags,
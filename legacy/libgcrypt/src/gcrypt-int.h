@@ -114,6 +114,9 @@ void _gcry_md_hash_buffer(int algo, void *digest, const void *buffer,
                           size_t length);
 gpg_error_t _gcry_md_hash_buffers(int algo, unsigned int flags, void *digest,
                                   const gcry_buffer_t *iov, int iovcnt);
+gpg_error_t _gcry_md_hash_buffers_multi(int algo, unsigned int flags,
+                                        void *digests,
+                                        const gcry_buffer_t *bufs, int n);
 int _gcry_md_get_algo(gcry_md_hd_t hd);
 unsigned int _gcry_md_get_algo_dlen(int algo);
 int _gcry_md_is_enabled(gcry_md_hd_t a, int algo);
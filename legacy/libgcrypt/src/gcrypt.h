@@ -1123,6 +1123,14 @@ void gcry_md_hash_buffer(int algo, void *digest, const void *buffer,
 gpg_error_t gcry_md_hash_buffers(int algo, unsigned int flags, void *digest,
                                  const gcry_buffer_t *iov, int iovcnt);
 
+/* Hash each of the N buffers in BUFS as a message of its own and
+   store the N digests one after the other at DIGESTS.  This is faster
+   than hashing them one by one, as several messages may be hashed in
+   parallel.  FLAGS must be 0.  */
+gpg_error_t gcry_md_hash_buffers_multi(int algo, unsigned int flags,
+                                       void *digests,
+                                       const gcry_buffer_t *bufs, int n);
+
 /* Retrieve the algorithm used with HD.  This does not work reliable
    if more than one algorithm is enabled in HD. */
 int gcry_md_get_algo(gcry_md_hd_t hd);
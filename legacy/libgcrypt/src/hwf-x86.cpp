@@ -278,11 +278,17 @@ static unsigned int detect_x86_gnuc(void) {
    * Source: http://www.sandpile.org/x86/cpuid.htm  */
   if (max_cpuid_level >= 7 && (features & 0x00000001)) {
     /* Get CPUID:7 contains further Intel feature flags. */
-    get_cpuid(7, NULL, &features, NULL, NULL);
+    get_cpuid(7, NULL, &features, &features2, NULL);
 
     /* Test bit 8 for BMI2.  */
     if (features & 0x00000100) result |= HWF_INTEL_BMI2;
 
+    /* Test bit 19 for ADX (adcx and adox).  */
+    if (features & 0x00080000) result |= HWF_INTEL_ADX;
+
+    /* Test bit 29 for the SHA extensions.  */
+    if (features & 0x20000000) result |= HWF_INTEL_SHAEXT;
+
 #ifdef ENABLE_AVX2_SUPPORT
     /* Test bit 5 for AVX2.  */
     if (features & 0x00000020)
@@ -290,6 +296,10 @@ static unsigned int detect_x86_gnuc(void) {
 
     if ((result & HWF_INTEL_AVX2) && !avoid_vpgather)
       result |= HWF_INTEL_FAST_VPGATHER;
+
+    /* Test bit 9 of ECX for VAES, which we only use with AVX2.  */
+    if ((features2 & 0x00000200) && (result & HWF_INTEL_AVX2))
+      result |= HWF_INTEL_VAES;
 #endif /*ENABLE_AVX_SUPPORT*/
   }
 
@@ -188,6 +188,27 @@ void _gcry_mpi_mod_barrett(gcry_mpi_t r, gcry_mpi_t x, mpi_barrett_t ctx);
 void _gcry_mpi_mul_barrett(gcry_mpi_t w, gcry_mpi_t u, gcry_mpi_t v,
                            mpi_barrett_t ctx);
 
+/*-- mpi-pow.c --*/
+#define mpi_mont_init(m) _gcry_mpi_mont_init((m))
+#define mpi_mont_free(c) _gcry_mpi_mont_free((c))
+#define mpi_mont_to(w, u, c) _gcry_mpi_mont_to((w), (u), (c))
+#define mpi_mont_from(w, u, c) _gcry_mpi_mont_from((w), (u), (c))
+#define mpi_mont_mul(w, u, v, c) _gcry_mpi_mont_mul((w), (u), (v), (c))
+#define mpi_powm_mont(r, b, e, c) _gcry_mpi_powm_mont((r), (b), (e), (c))
+
+/* Context used with Montgomery multiplication.  */
+struct mont_ctx_s;
+typedef struct mont_ctx_s *mpi_mont_t;
+
+mpi_mont_t _gcry_mpi_mont_init(gcry_mpi_t m);
+void _gcry_mpi_mont_free(mpi_mont_t ctx);
+void _gcry_mpi_mont_to(gcry_mpi_t w, gcry_mpi_t u, mpi_mont_t ctx);
+void _gcry_mpi_mont_from(gcry_mpi_t w, gcry_mpi_t u, mpi_mont_t ctx);
+void _gcry_mpi_mont_mul(gcry_mpi_t w, gcry_mpi_t u, gcry_mpi_t v,
+                        mpi_mont_t ctx);
+void _gcry_mpi_powm_mont(gcry_mpi_t res, gcry_mpi_t base, gcry_mpi_t expo,
+                         mpi_mont_t ctx);
+
 /*-- mpi-mpow.c --*/
 #define mpi_mulpowm(a, b, c, d) _gcry_mpi_mulpowm((a), (b), (c), (d))
 void _gcry_mpi_mulpowm(gcry_mpi_t res, gcry_mpi_t *basearray,
@@ -686,6 +686,12 @@ gpg_error_t gcry_md_hash_buffers(int algo, unsigned int flags, void *digest,
   return _gcry_md_hash_buffers(algo, flags, digest, iov, iovcnt);
 }
 
+gpg_error_t gcry_md_hash_buffers_multi(int algo, unsigned int flags,
+                                       void *digests,
+                                       const gcry_buffer_t *bufs, int n) {
+  return _gcry_md_hash_buffers_multi(algo, flags, digests, bufs, n);
+}
+
 int gcry_md_get_algo(gcry_md_hd_t hd) { return _gcry_md_get_algo(hd); }
 
 unsigned int gcry_md_get_algo_dlen(int algo) {
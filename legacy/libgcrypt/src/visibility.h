@@ -78,6 +78,7 @@ MARK_VISIBLEX(gcry_md_get_algo)
 MARK_VISIBLEX(gcry_md_get_algo_dlen)
 MARK_VISIBLEX(gcry_md_hash_buffer)
 MARK_VISIBLEX(gcry_md_hash_buffers)
+MARK_VISIBLEX(gcry_md_hash_buffers_multi)
 MARK_VISIBLEX(gcry_md_info)
 MARK_VISIBLEX(gcry_md_is_enabled)
 MARK_VISIBLEX(gcry_md_is_secure)
@@ -3,8 +3,32 @@
 #include "gtest/gtest.h"
 
 int hmac_main(int argc, char* argv[]);
+int t_aes_main(int argc, char* argv[]);
+int t_crc_ghash_main(int argc, char* argv[]);
+int t_hash_multi_main(int argc, char* argv[]);
+int t_mpi_arith_main(int argc, char* argv[]);
 
 TEST(GcryptTest, hmac) {
   int result = hmac_main(0, NULL);
   ASSERT_EQ(result, 0);
 }
+
+TEST(GcryptTest, aes) {
+  int result = t_aes_main(0, NULL);
+  ASSERT_EQ(result, 0);
+}
+
+TEST(GcryptTest, crc_ghash) {
+  int result = t_crc_ghash_main(0, NULL);
+  ASSERT_EQ(result, 0);
+}
+
+TEST(GcryptTest, hash_multi) {
+  int result = t_hash_multi_main(0, NULL);
+  ASSERT_EQ(result, 0);
+}
+
+TEST(GcryptTest, mpi_arith) {
+  int result = t_mpi_arith_main(0, NULL);
+  ASSERT_EQ(result, 0);
+}
@@ -0,0 +1,574 @@
+/* t-aes.cpp - Check the AES modes against known answers
+ * Copyright (C) 2017 The NeoPG developers
+ *
+ * This file is part of Libgcrypt.
+ *
+ * Libgcrypt is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * Libgcrypt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* AES is checked for all key sizes in the modes with bulk
+   implementations (ECB, CBC, CFB, CTR and OCB), against the vectors
+   of NIST SP 800-38A and RFC 7253.  The bulk code (AES-NI or the
+   table-based code, depending on the CPU) processes up to 16 blocks
+   at once, so messages of 1 to NBLOCKS blocks are also encrypted and
+   decrypted, in one call and in pieces.  Their ciphertexts are
+   checked against SHA-256 digests computed with OpenSSL, which
+   includes counters that wrap around in CTR mode.  */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PGM "t-aes"
+#include "t-common.h"
+
+#define NBLOCKS 40
+
+/* The sizes of the pieces in which the long messages are processed.
+   They add up to NBLOCKS.  */
+static const int pieces[] = {1, 17, 2, 9, 3, 8};
+
+/* NIST SP 800-38A, appendix F.  */
+static const struct {
+  int algo;
+  const char *key;
+} sp800_keys[] = {
+    {GCRY_CIPHER_AES,
+     "\x2b\x7e\x15\x16\x28\xae\xd2\xa6\xab\xf7\x15\x88\x09\xcf\x4f\x3c"},
+    {GCRY_CIPHER_AES192,
+     "\x8e\x73\xb0\xf7\xda\x0e\x64\x52\xc8\x10\xf3\x2b\x80\x90\x79\xe5"
+     "\x62\xf8\xea\xd2\x52\x2c\x6b\x7b"},
+    {GCRY_CIPHER_AES256,
+     "\x60\x3d\xeb\x10\x15\xca\x71\xbe\x2b\x73\xae\xf0\x85\x7d\x77\x81"
+     "\x1f\x35\x2c\x07\x3b\x61\x08\xd7\x2d\x98\x10\xa3\x09\x14\xdf\xf4"}};
+
+static const char sp800_plaintext[] =
+    "\x6b\xc1\xbe\xe2\x2e\x40\x9f\x96\xe9\x3d\x7e\x11\x73\x93\x17\x2a"
+    "\xae\x2d\x8a\x57\x1e\x03\xac\x9c\x9e\xb7\x6f\xac\x45\xaf\x8e\x51"
+    "\x30\xc8\x1c\x46\xa3\x5c\xe4\x11\xe5\xfb\xc1\x19\x1a\x0a\x52\xef"
+    "\xf6\x9f\x24\x45\xdf\x4f\x9b\x17\xad\x2b\x41\x7b\xe6\x6c\x37\x10";
+
+static const struct {
+  int mode;
+  int algo;
+  const char *ciphertext;
+} sp800_vectors[] = {
+    {GCRY_CIPHER_MODE_ECB, GCRY_CIPHER_AES,
+     "\x3a\xd7\x7b\xb4\x0d\x7a\x36\x60\xa8\x9e\xca\xf3\x24\x66\xef\x97"
+     "\xf5\xd3\xd5\x85\x03\xb9\x69\x9d\xe7\x85\x89\x5a\x96\xfd\xba\xaf"
+     "\x43\xb1\xcd\x7f\x59\x8e\xce\x23\x88\x1b\x00\xe3\xed\x03\x06\x88"
+     "\x7b\x0c\x78\x5e\x27\xe8\xad\x3f\x82\x23\x20\x71\x04\x72\x5d\xd4"},
+    {GCRY_CIPHER_MODE_ECB, GCRY_CIPHER_AES192,
+     "\xbd\x33\x4f\x1d\x6e\x45\xf2\x5f\xf7\x12\xa2\x14\x57\x1f\xa5\xcc"
+     "\x97\x41\x04\x84\x6d\x0a\xd3\xad\x77\x34\xec\xb3\xec\xee\x4e\xef"
+     "\xef\x7a\xfd\x22\x70\xe2\xe6\x0a\xdc\xe0\xba\x2f\xac\xe6\x44\x4e"
+     "\x9a\x4b\x41\xba\x73\x8d\x6c\x72\xfb\x16\x69\x16\x03\xc1\x8e\x0e"},
+    {GCRY_CIPHER_MODE_ECB, GCRY_CIPHER_AES256,
+     "\xf3\xee\xd1\xbd\xb5\xd2\xa0\x3c\x06\x4b\x5a\x7e\x3d\xb1\x81\xf8"
+     "\x59\x1c\xcb\x10\xd4\x10\xed\x26\xdc\x5b\xa7\x4a\x31\x36\x28\x70"
+     "\xb6\xed\x21\xb9\x9c\xa6\xf4\xf9\xf1\x53\xe7\xb1\xbe\xaf\xed\x1d"
+     "\x23\x30\x4b\x7a\x39\xf9\xf3\xff\x06\x7d\x8d\x8f\x9e\x24\xec\xc7"},
+    {GCRY_CIPHER_MODE_CBC, GCRY_CIPHER_AES,
+     "\x76\x49\xab\xac\x81\x19\xb2\x46\xce\xe9\x8e\x9b\x12\xe9\x19\x7d"
+     "\x50\x86\xcb\x9b\x50\x72\x19\xee\x95\xdb\x11\x3a\x91\x76\x78\xb2"
+     "\x73\xbe\xd6\xb8\xe3\xc1\x74\x3b\x71\x16\xe6\x9e\x22\x22\x95\x16"
+     "\x3f\xf1\xca\xa1\x68\x1f\xac\x09\x12\x0e\xca\x30\x75\x86\xe1\xa7"},
+    {GCRY_CIPHER_MODE_CBC, GCRY_CIPHER_AES192,
+     "\x4f\x02\x1d\xb2\x43\xbc\x63\x3d\x71\x78\x18\x3a\x9f\xa0\x71\xe8"
+     "\xb4\xd9\xad\xa9\xad\x7d\xed\xf4\xe5\xe7\x38\x76\x3f\x69\x14\x5a"
+     "\x57\x1b\x24\x20\x12\xfb\x7a\xe0\x7f\xa9\xba\xac\x3d\xf1\x02\xe0"
+     "\x08\xb0\xe2\x79\x88\x59\x88\x81\xd9\x20\xa9\xe6\x4f\x56\x15\xcd"},
+    {GCRY_CIPHER_MODE_CBC, GCRY_CIPHER_AES256,
+     "\xf5\x8c\x4c\x04\xd6\xe5\xf1\xba\x77\x9e\xab\xfb\x5f\x7b\xfb\xd6"
+     "\x9c\xfc\x4e\x96\x7e\xdb\x80\x8d\x67\x9f\x77\x7b\xc6\x70\x2c\x7d"
+     "\x39\xf2\x33\x69\xa9\xd9\xba\xcf\xa5\x30\xe2\x63\x04\x23\x14\x61"
+     "\xb2\xeb\x05\xe2\xc3\x9b\xe9\xfc\xda\x6c\x19\x07\x8c\x6a\x9d\x1b"},
+    {GCRY_CIPHER_MODE_CFB, GCRY_CIPHER_AES,
+     "\x3b\x3f\xd9\x2e\xb7\x2d\xad\x20\x33\x34\x49\xf8\xe8\x3c\xfb\x4a"
+     "\xc8\xa6\x45\x37\xa0\xb3\xa9\x3f\xcd\xe3\xcd\xad\x9f\x1c\xe5\x8b"
+     "\x26\x75\x1f\x67\xa3\xcb\xb1\x40\xb1\x80\x8c\xf1\x87\xa4\xf4\xdf"
+     "\xc0\x4b\x05\x35\x7c\x5d\x1c\x0e\xea\xc4\xc6\x6f\x9f\xf7\xf2\xe6"},
+    {GCRY_CIPHER_MODE_CFB, GCRY_CIPHER_AES192,
+     "\xcd\xc8\x0d\x6f\xdd\xf1\x8c\xab\x34\xc2\x59\x09\xc9\x9a\x41\x74"
+     "\x67\xce\x7f\x7f\x81\x17\x36\x21\x96\x1a\x2b\x70\x17\x1d\x3d\x7a"
+     "\x2e\x1e\x8a\x1d\xd5\x9b\x88\xb1\xc8\xe6\x0f\xed\x1e\xfa\xc4\xc9"
+     "\xc0\x5f\x9f\x9c\xa9\x83\x4f\xa0\x42\xae\x8f\xba\x58\x4b\x09\xff"},
+    {GCRY_CIPHER_MODE_CFB, GCRY_CIPHER_AES256,
+     "\xdc\x7e\x84\xbf\xda\x79\x16\x4b\x7e\xcd\x84\x86\x98\x5d\x38\x60"
+     "\x39\xff\xed\x14\x3b\x28\xb1\xc8\x32\x11\x3c\x63\x31\xe5\x40\x7b"
+     "\xdf\x10\x13\x24\x15\xe5\x4b\x92\xa1\x3e\xd0\xa8\x26\x7a\xe2\xf9"
+     "\x75\xa3\x85\x74\x1a\xb9\xce\xf8\x20\x31\x62\x3d\x55\xb1\xe4\x71"},
+    {GCRY_CIPHER_MODE_CTR, GCRY_CIPHER_AES,
+     "\x87\x4d\x61\x91\xb6\x20\xe3\x26\x1b\xef\x68\x64\x99\x0d\xb6\xce"
+     "\x98\x06\xf6\x6b\x79\x70\xfd\xff\x86\x17\x18\x7b\xb9\xff\xfd\xff"
+     "\x5a\xe4\xdf\x3e\xdb\xd5\xd3\x5e\x5b\x4f\x09\x02\x0d\xb0\x3e\xab"
+     "\x1e\x03\x1d\xda\x2f\xbe\x03\xd1\x79\x21\x70\xa0\xf3\x00\x9c\xee"},
+    {GCRY_CIPHER_MODE_CTR, GCRY_CIPHER_AES192,
+     "\x1a\xbc\x93\x24\x17\x52\x1c\xa2\x4f\x2b\x04\x59\xfe\x7e\x6e\x0b"
+     "\x09\x03\x39\xec\x0a\xa6\xfa\xef\xd5\xcc\xc2\xc6\xf4\xce\x8e\x94"
+     "\x1e\x36\xb2\x6b\xd1\xeb\xc6\x70\xd1\xbd\x1d\x66\x56\x20\xab\xf7"
+     "\x4f\x78\xa7\xf6\xd2\x98\x09\x58\x5a\x97\xda\xec\x58\xc6\xb0\x50"},
+    {GCRY_CIPHER_MODE_CTR, GCRY_CIPHER_AES256,
+     "\x60\x1e\xc3\x13\x77\x57\x89\xa5\xb7\xa7\xf5\x04\xbb\xf3\xd2\x28"
+     "\xf4\x43\xe3\xca\x4d\x62\xb5\x9a\xca\x84\xe9\x90\xca\xca\xf5\xc5"
+     "\x2b\x09\x30\xda\xa2\x3d\xe9\x4c\xe8\x70\x17\xba\x2d\x84\x98\x8d"
+     "\xdf\xc9\xc5\x8d\xb6\x7a\xad\xa6\x13\xc2\xdd\x08\x45\x79\x41\xa6"},
+};
+
+/* The IVs of the CBC and CFB modes, and the initial counter of the
+   CTR mode, for the vectors above and the long messages.  */
+static const unsigned char iv_default[16] = {
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+    0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f};
+static const unsigned char ctr_default[16] = {
+    0xf0, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7,
+    0xf8, 0xf9, 0xfa, 0xfb, 0xfc, 0xfd, 0xfe, 0xff};
+
+/* The SHA-256 digests of the long messages.  If CTR is not NULL, it
+   is the initial counter instead of CTR_DEFAULT.  The counters wrap
+   around all 128 bit, the low 64 bit and the low 32 bit.  */
+static const struct {
+  int mode;
+  int algo;
+  const char *ctr;
+  const char *digest;
+} long_vectors[] = {
+    {GCRY_CIPHER_MODE_ECB, GCRY_CIPHER_AES, NULL,
+     "\x15\x50\x82\x5e\xa7\xe9\x58\x58\xa1\xf7\x70\x6d\x46\xe8\x20\x3a"
+     "\x5a\xa8\x98\x38\x36\x60\xdb\xae\x02\x35\x45\x81\xeb\x62\xfa\x2a"},
+    {GCRY_CIPHER_MODE_ECB, GCRY_CIPHER_AES192, NULL,
+     "\xc4\x78\x24\xe5\x6d\x17\xca\xea\xe3\x9a\x38\x59\xe5\x96\xf8\xa7"
+     "\xe4\x7d\x1b\xcb\x6b\x21\x6a\xf1\xc6\xff\x8b\x48\xd3\x88\x7d\xcc"},
+    {GCRY_CIPHER_MODE_ECB, GCRY_CIPHER_AES256, NULL,
+     "\xc6\x5e\xa7\xa0\xa6\xaf\xa3\x9c\xe2\x0c\x3e\x0f\x26\xc5\xee\x2a"
+     "\x6f\xa4\x18\x96\x0c\xa8\x61\x78\x2b\xee\x0c\x98\x33\x8e\x7c\x72"},
+    {GCRY_CIPHER_MODE_CBC, GCRY_CIPHER_AES, NULL,
+     "\xaa\x87\x2e\xe5\x25\x6a\xb0\x40\x56\xf7\xd9\x1b\xaa\x12\xe2\x2c"
+     "\x7c\x7a\x73\x2b\xaa\x20\xad\x40\x6c\x9c\x15\x99\x30\x5e\x8c\xbb"},
+    {GCRY_CIPHER_MODE_CBC, GCRY_CIPHER_AES192, NULL,
+     "\xa6\x51\x97\x50\x10\xd5\xbc\xb1\xc8\xcf\x56\xe8\xe7\x55\x9e\xb0"
+     "\x02\x60\xdf\xa5\x30\xa1\x83\xc2\x51\x2c\x01\x53\x1d\x23\x8e\xb6"},
+    {GCRY_CIPHER_MODE_CBC, GCRY_CIPHER_AES256, NULL,
+     "\x20\x5c\x9a\xae\x18\xa9\xcf\x52\xbd\x80\xa6\xfb\x03\x24\x1b\x90"
+     "\x91\xc0\x2e\x56\xf2\xb8\xa2\x9b\x1e\x2a\x1f\xe2\xe5\xbd\xca\x2d"},
+    {GCRY_CIPHER_MODE_CFB, GCRY_CIPHER_AES, NULL,
+     "\x32\xcc\x5f\x5f\xc2\xfa\x8b\xf4\x44\x07\x01\x70\xed\x7b\xa9\x6d"
+     "\xdb\xc5\xac\xcd\x61\x35\x14\xee\xd4\xd0\x44\xe5\x64\xbc\xc5\x1b"},
+    {GCRY_CIPHER_MODE_CFB, GCRY_CIPHER_AES192, NULL,
+     "\x5a\xff\x77\x31\xcf\x19\x7e\xbd\xc3\xa4\xc0\x7d\xd5\x3c\x25\x7e"
+     "\x50\xe5\xcc\xf5\x26\x3c\xc2\x48\xe5\x1b\x90\x2c\x76\x41\xd4\xef"},
+    {GCRY_CIPHER_MODE_CFB, GCRY_CIPHER_AES256, NULL,
+     "\xb5\x28\x42\x59\xbe\xbc\xd2\x4f\xc0\x99\x94\xbd\xd5\xde\xcd\xbb"
+     "\x14\xe9\x4e\x7d\x73\x31\xae\xe5\xff\xca\xe0\x9a\x64\x1e\xdb\xed"},
+    {GCRY_CIPHER_MODE_CTR, GCRY_CIPHER_AES, NULL,
+     "\xa7\x58\x58\xd7\x39\x38\x15\x0d\x0e\x4d\x84\xa0\x12\x34\xd6\x8c"
+     "\x83\xf3\x3b\x0b\x60\x83\x1a\xb6\xa4\x60\x73\x32\xfe\x71\xf2\xad"},
+    {GCRY_CIPHER_MODE_CTR, GCRY_CIPHER_AES192, NULL,
+     "\xaa\x6c\x8f\x89\x41\x77\xf1\x77\x7d\x57\xb2\xf5\xf5\xe4\x20\xd4"
+     "\x60\xdc\x88\xb5\x10\xfb\xb8\x35\x5e\xd4\x24\x4b\xba\xef\x73\xe4"},
+    {GCRY_CIPHER_MODE_CTR, GCRY_CIPHER_AES256, NULL,
+     "\x66\x8f\xa0\xfd\x98\x23\x1a\x0c\xea\x5d\x91\x5f\x44\x16\x73\x03"
+     "\xba\xcc\x9f\x08\x19\x71\x99\xba\xa0\x3d\x88\xed\xbe\x45\xae\x5c"},
+    {GCRY_CIPHER_MODE_CTR, GCRY_CIPHER_AES,
+     "\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xf3",
+     "\x3f\x91\x88\xf9\xa6\x41\x55\x6c\x1d\xc0\x2e\xbd\xb6\x29\x61\xbf"
+     "\xcf\xfd\x08\xe4\x44\x7e\x43\x35\x08\x33\x11\x6a\x27\x28\xd8\x25"},
+    {GCRY_CIPHER_MODE_CTR, GCRY_CIPHER_AES,
+     "\x00\x00\x00\x00\x00\x00\x00\x42\xff\xff\xff\xff\xff\xff\xff\xf3",
+     "\xf2\x37\x97\xb5\x6c\xdb\xf0\x72\x70\x8f\xfd\x53\x8a\x54\xd8\xff"
+     "\xb0\xa2\xb6\x03\x50\xd9\xcc\x74\x0e\x31\xc1\x19\xc0\x40\xa1\x9d"},
+    {GCRY_CIPHER_MODE_CTR, GCRY_CIPHER_AES,
+     "\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x42\xff\xff\xff\xf3",
+     "\x2d\xe3\xaf\x4d\xbc\x63\x84\x66\x83\xea\x40\x51\x14\x36\x3a\x8a"
+     "\xbf\x16\xe0\x16\xeb\xed\xa4\x17\x26\x1d\x02\xdd\x21\x9b\xc2\xbf"},
+};
+
+/* RFC 7253, appendix A: the nonce ends in NONCE, and the first ALEN
+   and PLEN bytes of 00 01 02 ... are the associated data and the
+   plaintext.  */
+static const struct {
+  int nonce;
+  int alen;
+  int plen;
+  const char *ciphertext; /* Followed by the tag.  */
+} ocb_vectors[] = {
+    {0, 0, 0,
+     "\x78\x54\x07\xbf\xff\xc8\xad\x9e\xdc\xc5\x52\x0a\xc9\x11\x1e\xe6"},
+    {1, 8, 8,
+     "\x68\x20\xb3\x65\x7b\x6f\x61\x5a\x57\x25\xbd\xa0\xd3\xb4\xeb\x3a"
+     "\x25\x7c\x9a\xf1\xf8\xf0\x30\x09"},
+    {2, 8, 0,
+     "\x81\x01\x7f\x82\x03\xf0\x81\x27\x71\x52\xfa\xde\x69\x4a\x0a\x00"},
+    {3, 0, 8,
+     "\x45\xdd\x69\xf8\xf5\xaa\xe7\x24\x14\x05\x4c\xd1\xf3\x5d\x82\x76"
+     "\x0b\x2c\xd0\x0d\x2f\x99\xbf\xa9"},
+    {4, 16, 16,
+     "\x57\x1d\x53\x5b\x60\xb2\x77\x18\x8b\xe5\x14\x71\x70\xa9\xa2\x2c"
+     "\x3a\xd7\xa4\xff\x38\x35\xb8\xc5\x70\x1c\x1c\xce\xc8\xfc\x33\x58"},
+    {5, 16, 0,
+     "\x8c\xf7\x61\xb6\x90\x2e\xf7\x64\x46\x2a\xd8\x64\x98\xca\x6b\x97"},
+    {6, 0, 16,
+     "\x5c\xe8\x8e\xc2\xe0\x69\x27\x06\xa9\x15\xc0\x0a\xeb\x8b\x23\x96"
+     "\xf4\x0e\x1c\x74\x3f\x52\x43\x6b\xdf\x06\xd8\xfa\x1e\xca\x34\x3d"},
+    {7, 24, 24,
+     "\x1c\xa2\x20\x73\x08\xc8\x7c\x01\x07\x56\x10\x4d\x88\x40\xce\x19"
+     "\x52\xf0\x96\x73\xa4\x48\xa1\x22\xc9\x2c\x62\x24\x10\x51\xf5\x73"
+     "\x56\xd7\xf3\xc9\x0b\xb0\xe0\x7f"},
+    {8, 24, 0,
+     "\x6d\xc2\x25\xa0\x71\xfc\x1b\x9f\x7c\x69\xf9\x3b\x0f\x1e\x10\xde"},
+    {9, 0, 24,
+     "\x22\x1b\xd0\xde\x7f\xa6\xfe\x99\x3e\xcc\xd7\x69\x46\x0a\x0a\xf2"
+     "\xd6\xcd\xed\x0c\x39\x5b\x1c\x3c\xe7\x25\xf3\x24\x94\xb9\xf9\x14"
+     "\xd8\x5c\x0b\x1e\xb3\x83\x57\xff"},
+    {10, 32, 32,
+     "\xbd\x6f\x6c\x49\x62\x01\xc6\x92\x96\xc1\x1e\xfd\x13\x8a\x46\x7a"
+     "\xbd\x3c\x70\x79\x24\xb9\x64\xde\xaf\xfc\x40\x31\x9a\xf5\xa4\x85"
+     "\x40\xfb\xba\x18\x6c\x55\x53\xc6\x8a\xd9\xf5\x92\xa7\x9a\x42\x40"},
+    {11, 32, 0,
+     "\xfe\x80\x69\x0b\xee\x8a\x48\x5d\x11\xf3\x29\x65\xbc\x9d\x2a\x32"},
+    {12, 0, 32,
+     "\x29\x42\xbf\xc7\x73\xbd\xa2\x3c\xab\xc6\xac\xfd\x9b\xfd\x58\x35"
+     "\xbd\x30\x0f\x09\x73\x79\x2e\xf4\x60\x40\xc5\x3f\x14\x32\xbc\xdf"
+     "\xb5\xe1\xdd\xe3\xbc\x18\xa5\xf8\x40\xb5\x2e\x65\x34\x44\xd5\xdf"},
+    {13, 40, 40,
+     "\xd5\xca\x91\x74\x84\x10\xc1\x75\x1f\xf8\xa2\xf6\x18\x25\x5b\x68"
+     "\xa0\xa1\x2e\x09\x3f\xf4\x54\x60\x6e\x59\xf9\xc1\xd0\xdd\xc5\x4b"
+     "\x65\xe8\x62\x8e\x56\x8b\xad\x7a\xed\x07\xba\x06\xa4\xa6\x94\x83"
+     "\xa7\x03\x54\x90\xc5\x76\x9e\x60"},
+    {14, 40, 0,
+     "\xc5\xcd\x9d\x18\x50\xc1\x41\xe3\x58\x64\x99\x94\xee\x70\x1b\x68"},
+    {15, 0, 40,
+     "\x44\x12\x92\x34\x93\xc5\x7d\x5d\xe0\xd7\x00\xf7\x53\xcc\xe0\xd1"
+     "\xd2\xd9\x50\x60\x12\x2e\x9f\x15\xa5\xdd\xbf\xc5\x78\x7e\x50\xb5"
+     "\xcc\x55\xee\x50\x7b\xcb\x08\x4e\x47\x9a\xd3\x63\xac\x36\x6b\x95"
+     "\xa9\x8c\xa5\xf3\x00\x0b\x14\x79"},
+};
+
+/* The SHA-256 digests of the long messages and their tags in OCB
+   mode.  */
+static const struct {
+  int algo;
+  const char *digest;
+} ocb_long_vectors[] = {
+    {GCRY_CIPHER_AES,
+     "\x51\x61\xe3\x88\x0d\xd0\x55\xe2\x81\xf2\x9e\x5f\x77\x98\xf2\x02"
+     "\x5f\x69\x43\x87\x30\x36\x80\x10\x54\xe5\xbe\x61\x55\x19\xef\x6f"},
+    {GCRY_CIPHER_AES192,
+     "\xb8\x8f\xbc\x5f\x78\x95\x1c\xc2\xe1\x4d\xb7\x68\xb7\xcb\x00\x7e"
+     "\x45\xf1\x25\xb9\x64\x98\x8b\xf4\xd0\x78\xd5\x16\xfd\x46\xf2\xa7"},
+    {GCRY_CIPHER_AES256,
+     "\xa4\xed\x91\xc0\xb1\x85\x01\x3b\x2b\x4e\xfc\xbb\x9a\x6e\xe7\x7d"
+     "\xf9\x31\x48\xec\x37\xba\x9a\x6e\x32\x83\x68\x2f\x4d\x43\x38\x91"},
+};
+
+static unsigned char plaintext[NBLOCKS * 16];
+
+static void make_plaintext(void) {
+  int i;
+
+  for (i = 0; i < NBLOCKS * 16; i++)
+    plaintext[i] = (i * 37 + (i >> 8) * 101 + 11) & 0xff;
+}
+
+static const char *mode_name(int mode) {
+  switch (mode) {
+    case GCRY_CIPHER_MODE_ECB:
+      return "ECB";
+    case GCRY_CIPHER_MODE_CBC:
+      return "CBC";
+    case GCRY_CIPHER_MODE_CFB:
+      return "CFB";
+    case GCRY_CIPHER_MODE_CTR:
+      return "CTR";
+    case GCRY_CIPHER_MODE_OCB:
+      return "OCB";
+    default:
+      return "?";
+  }
+}
+
+static gcry_cipher_hd_t open_cipher(int algo, int mode, const void *key) {
+  gcry_cipher_hd_t hd;
+  gpg_error_t err;
+
+  err = gcry_cipher_open(&hd, algo, mode, 0);
+  if (err) {
+    fail("algo %d, %s: gcry_cipher_open failed: %s\n", algo, mode_name(mode),
+         gpg_strerror(err));
+    return NULL;
+  }
+  err = gcry_cipher_setkey(hd, key, gcry_cipher_get_algo_keylen(algo));
+  if (err) {
+    fail("algo %d, %s: gcry_cipher_setkey failed: %s\n", algo,
+         mode_name(mode), gpg_strerror(err));
+    gcry_cipher_close(hd);
+    return NULL;
+  }
+  return hd;
+}
+
+/* Start a new message with the IV or counter IV.  */
+static void start(gcry_cipher_hd_t hd, int mode, const void *iv) {
+  gpg_error_t err = 0;
+
+  if (mode == GCRY_CIPHER_MODE_CTR)
+    err = gcry_cipher_setctr(hd, iv, 16);
+  else if (mode != GCRY_CIPHER_MODE_ECB)
+    err = gcry_cipher_setiv(hd, iv, 16);
+  if (err)
+    fail("%s: setting the IV failed: %s\n", mode_name(mode),
+         gpg_strerror(err));
+}
+
+static void crypt_blocks(gcry_cipher_hd_t hd, int decrypt,
+                         unsigned char *out, const unsigned char *in,
+                         size_t len) {
+  gpg_error_t err;
+
+  if (decrypt)
+    err = gcry_cipher_decrypt(hd, out, len, in, len);
+  else
+    err = gcry_cipher_encrypt(hd, out, len, in, len);
+  if (err)
+    fail("%s of %u bytes failed: %s\n", decrypt ? "decryption" : "encryption",
+         (unsigned int)len, gpg_strerror(err));
+}
+
+static void check_sp800(void) {
+  unsigned char out[64];
+  const unsigned char *pt = (const unsigned char *)sp800_plaintext;
+  gcry_cipher_hd_t hd;
+  const void *key;
+  const void *iv;
+  int i, j, n;
+
+  for (i = 0; i < DIM(sp800_vectors); i++) {
+    const unsigned char *ct =
+        (const unsigned char *)sp800_vectors[i].ciphertext;
+    int mode = sp800_vectors[i].mode;
+    int algo = sp800_vectors[i].algo;
+
+    key = NULL;
+    for (j = 0; j < DIM(sp800_keys); j++)
+      if (sp800_keys[j].algo == algo) key = sp800_keys[j].key;
+    iv = mode == GCRY_CIPHER_MODE_CTR ? ctr_default : iv_default;
+
+    hd = open_cipher(algo, mode, key);
+    if (!hd) continue;
+
+    for (n = 16; n <= 64; n += 16) {
+      start(hd, mode, iv);
+      crypt_blocks(hd, 0, out, pt, n);
+      if (memcmp(out, ct, n))
+        fail("algo %d, %s, %d bytes: encryption failed\n", algo,
+             mode_name(mode), n);
+
+      start(hd, mode, iv);
+      crypt_blocks(hd, 1, out, ct, n);
+      if (memcmp(out, pt, n))
+        fail("algo %d, %s, %d bytes: decryption failed\n", algo,
+             mode_name(mode), n);
+    }
+    gcry_cipher_close(hd);
+  }
+}
+
+static void check_long(int mode, int algo, const void *iv,
+                       const void *digest) {
+  static unsigned char ct[NBLOCKS * 16], out[NBLOCKS * 16];
+  unsigned char key[32], d[32];
+  gcry_cipher_hd_t hd;
+  int i, n, off, decrypt;
+
+  for (i = 0; i < 32; i++) key[i] = i;
+  hd = open_cipher(algo, mode, key);
+  if (!hd) return;
+
+  start(hd, mode, iv);
+  crypt_blocks(hd, 0, ct, plaintext, sizeof ct);
+  gcry_md_hash_buffer(GCRY_MD_SHA256, d, ct, sizeof ct);
+  if (memcmp(d, digest, 32)) {
+    fail("algo %d, %s, %d blocks: encryption failed\n", algo,
+         mode_name(mode), NBLOCKS);
+    gcry_cipher_close(hd);
+    return;
+  }
+
+  /* A shorter message is a prefix of the long one.  */
+  for (n = 1; n <= NBLOCKS; n++) {
+    start(hd, mode, iv);
+    crypt_blocks(hd, 0, out, plaintext, n * 16);
+    if (memcmp(out, ct, n * 16))
+      fail("algo %d, %s, %d blocks: encryption failed\n", algo,
+           mode_name(mode), n);
+
+    /* In place.  */
+    start(hd, mode, iv);
+    memcpy(out, ct, n * 16);
+    crypt_blocks(hd, 1, out, out, n * 16);
+    if (memcmp(out, plaintext, n * 16))
+      fail("algo %d, %s, %d blocks: decryption failed\n", algo,
+           mode_name(mode), n);
+  }
+
+  for (decrypt = 0; decrypt < 2; decrypt++) {
+    start(hd, mode, iv);
+    for (i = off = 0; i < DIM(pieces); off += pieces[i++])
+      crypt_blocks(hd, decrypt, out + off * 16,
+                   (decrypt ? ct : plaintext) + off * 16, pieces[i] * 16);
+    if (memcmp(out, decrypt ? plaintext : ct, sizeof out))
+      fail("algo %d, %s: %s in pieces failed\n", algo, mode_name(mode),
+           decrypt ? "decryption" : "encryption");
+  }
+
+  gcry_cipher_close(hd);
+}
+
+/* Start an OCB message with NONCE and the associated data A.  If LAST
+   is set, the next call to en- or decrypt is the final one.  */
+static void start_ocb(gcry_cipher_hd_t hd, const unsigned char *nonce,
+                      const unsigned char *a, size_t alen, int last) {
+  gpg_error_t err;
+
+  err = gcry_cipher_setiv(hd, nonce, 12);
+  if (!err) err = gcry_cipher_authenticate(hd, a, alen);
+  if (!err && last) err = gcry_cipher_final(hd);
+  if (err) fail("OCB: starting a message failed: %s\n", gpg_strerror(err));
+}
+
+static void check_ocb(void) {
+  unsigned char nonce[12] = {0xbb, 0xaa, 0x99, 0x88, 0x77, 0x66,
+                             0x55, 0x44, 0x33, 0x22, 0x11, 0x00};
+  unsigned char data[64], out[64 + 16];
+  gcry_cipher_hd_t hd;
+  gpg_error_t err;
+  int i;
+
+  for (i = 0; i < sizeof data; i++) data[i] = i;
+  hd = open_cipher(GCRY_CIPHER_AES, GCRY_CIPHER_MODE_OCB, data);
+  if (!hd) return;
+
+  for (i = 0; i < DIM(ocb_vectors); i++) {
+    const unsigned char *ct = (const unsigned char *)ocb_vectors[i].ciphertext;
+    int plen = ocb_vectors[i].plen;
+
+    nonce[11] = ocb_vectors[i].nonce;
+    start_ocb(hd, nonce, data, ocb_vectors[i].alen, 1);
+    crypt_blocks(hd, 0, out, data, plen);
+    err = gcry_cipher_gettag(hd, out + plen, 16);
+    if (err || memcmp(out, ct, plen + 16))
+      fail("OCB, vector %d: encryption failed\n", i);
+
+    start_ocb(hd, nonce, data, ocb_vectors[i].alen, 1);
+    crypt_blocks(hd, 1, out, ct, plen);
+    err = gcry_cipher_checktag(hd, ct + plen, 16);
+    if (err || memcmp(out, data, plen))
+      fail("OCB, vector %d: decryption failed\n", i);
+  }
+
+  gcry_cipher_close(hd);
+}
+
+static void check_ocb_long(int algo, const void *digest) {
+  static unsigned char ct[NBLOCKS * 16 + 16], out[NBLOCKS * 16];
+  const unsigned char *a = plaintext + 100;
+  unsigned char key[32], nonce[12], d[32];
+  gcry_cipher_hd_t hd;
+  gpg_error_t err;
+  int i, n, off, decrypt;
+
+  for (i = 0; i < 32; i++) key[i] = i;
+  for (i = 0; i < 12; i++) nonce[i] = 0xa0 + i;
+  hd = open_cipher(algo, GCRY_CIPHER_MODE_OCB, key);
+  if (!hd) return;
+
+  start_ocb(hd, nonce, a, 24, 1);
+  crypt_blocks(hd, 0, ct, plaintext, NBLOCKS * 16);
+  err = gcry_cipher_gettag(hd, ct + NBLOCKS * 16, 16);
+  gcry_md_hash_buffer(GCRY_MD_SHA256, d, ct, sizeof ct);
+  if (err || memcmp(d, digest, 32)) {
+    fail("algo %d, OCB, %d blocks: encryption failed\n", algo, NBLOCKS);
+    gcry_cipher_close(hd);
+    return;
+  }
+
+  /* The ciphertext of a shorter message is a prefix of the long one,
+     but its tag is different.  */
+  for (n = 1; n <= NBLOCKS; n++) {
+    start_ocb(hd, nonce, a, 24, 1);
+    crypt_blocks(hd, 0, out, plaintext, n * 16);
+    if (memcmp(out, ct, n * 16))
+      fail("algo %d, OCB, %d blocks: encryption failed\n", algo, n);
+
+    /* In place.  */
+    start_ocb(hd, nonce, a, 24, 1);
+    memcpy(out, ct, n * 16);
+    crypt_blocks(hd, 1, out, out, n * 16);
+    if (memcmp(out, plaintext, n * 16))
+      fail("algo %d, OCB, %d blocks: decryption failed\n", algo, n);
+  }
+
+  for (decrypt = 0; decrypt < 2; decrypt++) {
+    start_ocb(hd, nonce, a, 24, 0);
+    for (i = off = 0; i < DIM(pieces); off += pieces[i++]) {
+      if (i == DIM(pieces) - 1) gcry_cipher_final(hd);
+      crypt_blocks(hd, decrypt, out + off * 16,
+                   (decrypt ? ct : plaintext) + off * 16, pieces[i] * 16);
+    }
+    if (decrypt)
+      err = gcry_cipher_checktag(hd, ct + NBLOCKS * 16, 16);
+    else
+      err = gcry_cipher_gettag(hd, d, 16);
+    if (err || memcmp(out, decrypt ? plaintext : ct, sizeof out) ||
+        (!decrypt && memcmp(d, ct + NBLOCKS * 16, 16)))
+      fail("algo %d, OCB: %s in pieces failed\n", algo,
+           decrypt ? "decryption" : "encryption");
+  }
+
+  gcry_cipher_close(hd);
+}
+
+int t_aes_main(int argc, char **argv) {
+  const void *iv;
+  int i;
+
+  if (argc > 1 && !strcmp(argv[1], "--verbose"))
+    verbose = 1;
+  else if (argc > 1 && !strcmp(argv[1], "--debug"))
+    verbose = debug = 1;
+
+  xgcry_control(GCRYCTL_DISABLE_SECMEM, 0);
+  xgcry_control(GCRYCTL_INITIALIZATION_FINISHED, 0);
+  if (debug) xgcry_control(GCRYCTL_SET_DEBUG_FLAGS, 1u, 0);
+
+  make_plaintext();
+  check_sp800();
+  for (i = 0; i < DIM(long_vectors); i++) {
+    iv = long_vectors[i].ctr;
+    if (!iv)
+      iv = long_vectors[i].mode == GCRY_CIPHER_MODE_CTR ? ctr_default
+                                                         : iv_default;
+    check_long(long_vectors[i].mode, long_vectors[i].algo, iv,
+               long_vectors[i].digest);
+  }
+  check_ocb();
+  for (i = 0; i < DIM(ocb_long_vectors); i++)
+    check_ocb_long(ocb_long_vectors[i].algo, ocb_long_vectors[i].digest);
+
+  return error_count ? 1 : 0;
+}
@@ -0,0 +1,246 @@
+/* t-crc-ghash.cpp - Cross-check CRC and GHASH against bitwise code
+ * Copyright (C) 2017 The NeoPG developers
+ *
+ * This file is part of Libgcrypt.
+ *
+ * Libgcrypt is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * Libgcrypt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The CRC and GHASH implementations in use (PCLMUL or the table-based
+   code, depending on the CPU) are compared against straightforward
+   bitwise implementations, for all input lengths up to a few hundred
+   bytes and with the input split into random pieces.  */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PGM "t-crc-ghash"
+#include "t-common.h"
+
+#define MAXLEN 600
+
+static unsigned int rand_state = 1;
+
+static unsigned int my_rand(void) {
+  rand_state = rand_state * 1103515245 + 12345;
+  return (rand_state >> 16) & 0x7fff;
+}
+
+static void fill_random(unsigned char *buf, size_t len) {
+  size_t i;
+
+  for (i = 0; i < len; i++) buf[i] = my_rand();
+}
+
+/* Bitwise CRC-24 of RFC 4880, section 6.1.  */
+static unsigned long ref_crc24(const unsigned char *buf, size_t len) {
+  unsigned long crc = 0xb704ce;
+  size_t i;
+  int j;
+
+  for (i = 0; i < len; i++) {
+    crc ^= (unsigned long)buf[i] << 16;
+    for (j = 0; j < 8; j++) {
+      crc <<= 1;
+      if (crc & 0x1000000) crc ^= 0x1864cfb;
+    }
+  }
+  return crc & 0xffffff;
+}
+
+/* Bitwise reflected CRC-32.  The variant of RFC 1510 does not invert
+   the initial value and the result.  */
+static unsigned long ref_crc32(const unsigned char *buf, size_t len,
+                               int rfc1510) {
+  unsigned long crc = rfc1510 ? 0 : 0xffffffff;
+  size_t i;
+  int j;
+
+  for (i = 0; i < len; i++) {
+    crc ^= buf[i];
+    for (j = 0; j < 8; j++) crc = (crc >> 1) ^ ((crc & 1) ? 0xedb88320 : 0);
+  }
+  return rfc1510 ? crc : crc ^ 0xffffffff;
+}
+
+static void check_crc(void) {
+  static const struct {
+    int algo;
+    int len;
+  } algos[] = {{GCRY_MD_CRC24_RFC2440, 3},
+               {GCRY_MD_CRC32, 4},
+               {GCRY_MD_CRC32_RFC1510, 4}};
+  unsigned char buf[MAXLEN];
+  unsigned char expect[4];
+  unsigned long crc;
+  gcry_md_hd_t hd;
+  gpg_error_t err;
+  size_t len, pos, n;
+  int i, j;
+
+  fill_random(buf, sizeof(buf));
+
+  for (i = 0; i < DIM(algos); i++) {
+    err = gcry_md_open(&hd, algos[i].algo, 0);
+    if (err) {
+      fail("algo %d, gcry_md_open failed: %s\n", algos[i].algo,
+           gpg_strerror(err));
+      continue;
+    }
+
+    for (len = 0; len <= MAXLEN; len++) {
+      if (algos[i].algo == GCRY_MD_CRC24_RFC2440)
+        crc = ref_crc24(buf, len);
+      else
+        crc = ref_crc32(buf, len, algos[i].algo == GCRY_MD_CRC32_RFC1510);
+      for (j = 0; j < algos[i].len; j++)
+        expect[j] = crc >> (8 * (algos[i].len - 1 - j));
+
+      /* Once in one piece, and once in random pieces.  */
+      for (j = 0; j < 2; j++) {
+        gcry_md_reset(hd);
+        for (pos = 0; pos < len; pos += n) {
+          n = j ? my_rand() % (len - pos) + 1 : len - pos;
+          gcry_md_write(hd, buf + pos, n);
+        }
+        if (memcmp(gcry_md_read(hd, 0), expect, algos[i].len))
+          fail("algo %d, length %u, split %d: CRC does not match\n",
+               algos[i].algo, (unsigned int)len, j);
+      }
+    }
+
+    gcry_md_close(hd);
+  }
+}
+
+/* Multiply X by Y in GF(2^128) as defined for GCM, bit by bit.  */
+static void ref_gf_mul(unsigned char *x, const unsigned char *y) {
+  unsigned char z[16], v[16];
+  int i, j, carry;
+
+  memset(z, 0, 16);
+  memcpy(v, y, 16);
+  for (i = 0; i < 128; i++) {
+    if (x[i / 8] & (0x80 >> (i % 8)))
+      for (j = 0; j < 16; j++) z[j] ^= v[j];
+    carry = v[15] & 1;
+    for (j = 15; j > 0; j--) v[j] = (v[j] >> 1) | (v[j - 1] << 7);
+    v[0] >>= 1;
+    if (carry) v[0] ^= 0xe1;
+  }
+  memcpy(x, z, 16);
+}
+
+static void ref_ghash(unsigned char *hash, const unsigned char *h,
+                      const unsigned char *buf, size_t len) {
+  size_t i;
+
+  for (; len; buf += i, len -= i) {
+    for (i = 0; i < 16 && i < len; i++) hash[i] ^= buf[i];
+    ref_gf_mul(hash, h);
+  }
+}
+
+/* Compute the GCM tag for AAD and the ciphertext BUF, using a 96 bit
+   IV.  */
+static void ref_gcm_tag(unsigned char *tag, const unsigned char *key,
+                        const unsigned char *iv, const unsigned char *aad,
+                        size_t aadlen, const unsigned char *buf,
+                        size_t len) {
+  unsigned char h[16], j0[16], lens[16];
+  gcry_cipher_hd_t hd;
+  int i;
+
+  if (gcry_cipher_open(&hd, GCRY_CIPHER_AES128, GCRY_CIPHER_MODE_ECB, 0) ||
+      gcry_cipher_setkey(hd, key, 16))
+    die("gcry_cipher_open for ECB failed\n");
+  memset(h, 0, 16);
+  gcry_cipher_encrypt(hd, h, 16, NULL, 0);
+  memcpy(j0, iv, 12);
+  j0[12] = j0[13] = j0[14] = 0;
+  j0[15] = 1;
+  gcry_cipher_encrypt(hd, j0, 16, NULL, 0);
+  gcry_cipher_close(hd);
+
+  for (i = 0; i < 8; i++) {
+    lens[i] = ((unsigned long long)aadlen * 8) >> (56 - 8 * i);
+    lens[8 + i] = ((unsigned long long)len * 8) >> (56 - 8 * i);
+  }
+
+  memset(tag, 0, 16);
+  ref_ghash(tag, h, aad, aadlen);
+  ref_ghash(tag, h, buf, len);
+  ref_ghash(tag, h, lens, 16);
+  for (i = 0; i < 16; i++) tag[i] ^= j0[i];
+}
+
+static void check_ghash(void) {
+  unsigned char key[16], iv[12], tag[16], expect[16];
+  unsigned char aad[MAXLEN / 2], buf[MAXLEN / 2], out[MAXLEN / 2];
+  gcry_cipher_hd_t hd;
+  gpg_error_t err;
+  size_t aadlen, len, pos, n;
+
+  for (len = 0; len <= sizeof(buf); len++) {
+    /* Vary the AAD length as well, including partial blocks.  */
+    aadlen = (len * 7) % (sizeof(aad) + 1);
+    fill_random(key, sizeof(key));
+    fill_random(iv, sizeof(iv));
+    fill_random(aad, aadlen);
+    fill_random(buf, len);
+
+    err = gcry_cipher_open(&hd, GCRY_CIPHER_AES128, GCRY_CIPHER_MODE_GCM, 0);
+    if (!err) err = gcry_cipher_setkey(hd, key, sizeof(key));
+    if (!err) err = gcry_cipher_setiv(hd, iv, sizeof(iv));
+    if (!err) err = gcry_cipher_authenticate(hd, aad, aadlen);
+    /* Only the last piece may be a partial block.  */
+    for (pos = 0; !err && pos < len; pos += n) {
+      n = (my_rand() % 8) * 16;
+      if (!n || n > len - pos) n = len - pos;
+      err = gcry_cipher_encrypt(hd, out + pos, n, buf + pos, n);
+    }
+    if (!err) err = gcry_cipher_gettag(hd, tag, sizeof(tag));
+    gcry_cipher_close(hd);
+    if (err) {
+      fail("length %u: GCM failed: %s\n", (unsigned int)len,
+           gpg_strerror(err));
+      continue;
+    }
+
+    ref_gcm_tag(expect, key, iv, aad, aadlen, out, len);
+    if (memcmp(tag, expect, sizeof(tag)))
+      fail("length %u, AAD length %u: GCM tag does not match\n",
+           (unsigned int)len, (unsigned int)aadlen);
+  }
+}
+
+int t_crc_ghash_main(int argc, char **argv) {
+  if (argc > 1 && !strcmp(argv[1], "--verbose"))
+    verbose = 1;
+  else if (argc > 1 && !strcmp(argv[1], "--debug"))
+    verbose = debug = 1;
+
+  xgcry_control(GCRYCTL_DISABLE_SECMEM, 0);
+  xgcry_control(GCRYCTL_INITIALIZATION_FINISHED, 0);
+  if (debug) xgcry_control(GCRYCTL_SET_DEBUG_FLAGS, 1u, 0);
+  check_crc();
+  check_ghash();
+
+  return error_count ? 1 : 0;
+}
@@ -0,0 +1,107 @@
+/* t-hash-multi.cpp - Check gcry_md_hash_buffers_multi
+ * Copyright (C) 2017 The NeoPG developers
+ *
+ * This file is part of Libgcrypt.
+ *
+ * Libgcrypt is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * Libgcrypt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The digests of many messages hashed at once (in parallel lanes,
+   depending on the CPU) are compared against the digests of the
+   messages hashed one by one.  The message lengths vary, so that the
+   lanes finish at different times and cover all cases of padding.  */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PGM "t-hash-multi"
+#include "t-common.h"
+
+#define MAXMSGS 100
+#define MAXLEN 1000
+
+static unsigned int rand_state = 1;
+
+static unsigned int my_rand(void) {
+  rand_state = rand_state * 1103515245 + 12345;
+  return (rand_state >> 16) & 0x7fff;
+}
+
+static void check_algo(int algo) {
+  static unsigned char data[MAXMSGS * MAXLEN];
+  static unsigned char digests[MAXMSGS * 64];
+  gcry_buffer_t bufs[MAXMSGS];
+  unsigned char expect[64];
+  unsigned int dlen = gcry_md_get_algo_dlen(algo);
+  gpg_error_t err;
+  size_t i;
+  int n, j;
+
+  for (i = 0; i < sizeof(data); i++) data[i] = my_rand();
+
+  for (n = 0; n <= MAXMSGS; n += n < 20 ? 1 : 40) {
+    for (j = 0; j < n; j++) {
+      bufs[j].size = MAXLEN;
+      bufs[j].off = my_rand() % 16;
+      bufs[j].data = data + j * MAXLEN;
+      /* Mostly short messages, and some long ones.  */
+      bufs[j].len = my_rand() % (j % 7 ? 300 : MAXLEN - 16);
+    }
+
+    memset(digests, 0, sizeof(digests));
+    err = gcry_md_hash_buffers_multi(algo, 0, digests, bufs, n);
+    if (err) {
+      fail("algo %d, %d messages: gcry_md_hash_buffers_multi failed: %s\n",
+           algo, n, gpg_strerror(err));
+      continue;
+    }
+
+    for (j = 0; j < n; j++) {
+      gcry_md_hash_buffer(algo, expect,
+                          (unsigned char *)bufs[j].data + bufs[j].off,
+                          bufs[j].len);
+      if (memcmp(digests + j * dlen, expect, dlen))
+        fail("algo %d, %d messages: digest %d (length %u) does not match\n",
+             algo, n, j, (unsigned int)bufs[j].len);
+    }
+  }
+
+  err = gcry_md_hash_buffers_multi(algo, 1, digests, bufs, 1);
+  if (err != GPG_ERR_INV_ARG)
+    fail("algo %d: invalid flags not detected\n", algo);
+}
+
+int t_hash_multi_main(int argc, char **argv) {
+  static const int algos[] = {GCRY_MD_SHA1, GCRY_MD_SHA256, GCRY_MD_SHA512,
+                              GCRY_MD_RMD160};
+  int i;
+
+  if (argc > 1 && !strcmp(argv[1], "--verbose"))
+    verbose = 1;
+  else if (argc > 1 && !strcmp(argv[1], "--debug"))
+    verbose = debug = 1;
+
+  xgcry_control(GCRYCTL_DISABLE_SECMEM, 0);
+  xgcry_control(GCRYCTL_INITIALIZATION_FINISHED, 0);
+  if (debug) xgcry_control(GCRYCTL_SET_DEBUG_FLAGS, 1u, 0);
+
+  for (i = 0; i < DIM(algos); i++) check_algo(algos[i]);
+
+  return error_count ? 1 : 0;
+}
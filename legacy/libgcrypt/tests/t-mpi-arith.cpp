@@ -0,0 +1,193 @@
+/* t-mpi-arith.cpp - Check the MPI arithmetic on many operand sizes
+ * Copyright (C) 2017 The NeoPG developers
+ *
+ * This file is part of Libgcrypt.
+ *
+ * Libgcrypt is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * Libgcrypt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Addition, subtraction, multiplication, division and modular
+   exponentiation are checked against each other on random numbers of
+   many sizes.  Each identity runs through a different mix of the limb
+   kernels (add_n, sub_n, mul_1, addmul_1, submul_1), which are
+   selected by the CPU features, so a wrong carry in any of them shows
+   up as a mismatch.  Numbers with all bits set are included because
+   they produce the longest carry chains.  Modular exponentiation with
+   an odd modulus (done in Montgomery form) is compared with the one
+   modulo twice the modulus (done with divisions).  */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PGM "t-mpi-arith"
+#include "t-common.h"
+
+static gcry_mpi_t random_mpi(unsigned int nbits, int ones) {
+  gcry_mpi_t a = gcry_mpi_new(nbits);
+
+  if (ones) {
+    /* 2^nbits - 1 */
+    gcry_mpi_set_ui(a, 0);
+    gcry_mpi_set_bit(a, nbits);
+    gcry_mpi_sub_ui(a, a, 1);
+  } else {
+    gcry_mpi_randomize(a, nbits);
+    gcry_mpi_set_bit(a, nbits - 1);
+  }
+  return a;
+}
+
+static void check_equal(const char *what, unsigned int nbits, gcry_mpi_t x,
+                        gcry_mpi_t y) {
+  if (gcry_mpi_cmp(x, y)) {
+    fail("%s with %u bits failed\n", what, nbits);
+    if (verbose) {
+      gcry_log_debugmpi("got ", x);
+      gcry_log_debugmpi("want", y);
+    }
+  }
+}
+
+static void check_size(unsigned int nbits, int ones) {
+  gcry_mpi_t a = random_mpi(nbits, ones);
+  gcry_mpi_t b = random_mpi(nbits / 2 + 7, 0);
+  gcry_mpi_t c = random_mpi(nbits + 64, ones);
+  gcry_mpi_t m = random_mpi(nbits / 2 + 64, 0);
+  gcry_mpi_t x = gcry_mpi_new(0);
+  gcry_mpi_t y = gcry_mpi_new(0);
+  gcry_mpi_t z = gcry_mpi_new(0);
+  gcry_mpi_t e = gcry_mpi_set_ui(NULL, 3);
+
+  /* (a + c) - c = a */
+  gcry_mpi_add(x, a, c);
+  gcry_mpi_sub(x, x, c);
+  check_equal("add/sub", nbits, x, a);
+
+  /* a * (b + c) = a * b + a * c */
+  gcry_mpi_add(x, b, c);
+  gcry_mpi_mul(x, a, x);
+  gcry_mpi_mul(y, a, b);
+  gcry_mpi_mul(z, a, c);
+  gcry_mpi_add(y, y, z);
+  check_equal("mul", nbits, x, y);
+
+  /* a * 0xffff...ff = a * 2^64 - a, with a single limb multiplier */
+  gcry_mpi_mul_ui(x, a, ~0UL);
+  gcry_mpi_mul_2exp(y, a, 8 * sizeof(unsigned long));
+  gcry_mpi_sub(y, y, a);
+  check_equal("mul_ui", nbits, x, y);
+
+  /* (a * c) / c = a, remainder 0 */
+  gcry_mpi_mul(x, a, c);
+  gcry_mpi_div(y, z, x, c, 0);
+  check_equal("div", nbits, y, a);
+  if (gcry_mpi_cmp_ui(z, 0)) fail("div with %u bits: remainder\n", nbits);
+
+  /* (a * c + b) mod c = b, as b < c */
+  gcry_mpi_add(x, x, b);
+  gcry_mpi_mod(x, x, c);
+  check_equal("mod", nbits, x, b);
+
+  /* a^3 mod m = a * a * a mod m */
+  gcry_mpi_powm(x, a, e, m);
+  gcry_mpi_mulm(y, a, a, m);
+  gcry_mpi_mulm(y, y, a, m);
+  check_equal("powm", nbits, x, y);
+
+  gcry_mpi_release(a);
+  gcry_mpi_release(b);
+  gcry_mpi_release(c);
+  gcry_mpi_release(m);
+  gcry_mpi_release(x);
+  gcry_mpi_release(y);
+  gcry_mpi_release(z);
+  gcry_mpi_release(e);
+}
+
+/* BASE^E mod M for an odd M, against BASE^E mod 2M reduced mod M.
+   Both signs of BASE and exponents of EBITS and of whole limbs are
+   checked.  With SECURE, the exponent is allocated with
+   gcry_mpi_snew, which makes powm treat it as secret.  */
+static void check_powm(unsigned int nbits, unsigned int ebits, int secure) {
+  gcry_mpi_t base = random_mpi(nbits + 10, 0);
+  gcry_mpi_t e = secure ? gcry_mpi_snew(ebits) : gcry_mpi_new(ebits);
+  gcry_mpi_t m = random_mpi(nbits, 0);
+  gcry_mpi_t m2 = gcry_mpi_new(0);
+  gcry_mpi_t x = gcry_mpi_new(0);
+  gcry_mpi_t y = gcry_mpi_new(0);
+  int i;
+
+  gcry_mpi_randomize(e, ebits);
+  gcry_mpi_set_bit(e, ebits - 1);
+  if (secure && !gcry_mpi_get_flag(e, GCRYMPI_FLAG_SECURE))
+    fail("powm with %u bits: exponent not secure\n", nbits);
+  gcry_mpi_set_bit(m, 0);
+  gcry_mpi_add(m2, m, m);
+  for (i = 0; i < 4; i++) {
+    gcry_mpi_powm(x, base, e, m);
+    gcry_mpi_powm(y, base, e, m2);
+    gcry_mpi_mod(y, y, m);
+    check_equal("powm odd modulus", nbits, x, y);
+
+    /* Odd exponents give a negative result for a negative base.  */
+    gcry_mpi_set_bit(e, 0);
+    gcry_mpi_neg(base, base);
+    if (i == 1) gcry_mpi_set_bit(e, (ebits + 63) / 64 * 64 - 1);
+  }
+
+  gcry_mpi_release(base);
+  gcry_mpi_release(e);
+  gcry_mpi_release(m);
+  gcry_mpi_release(m2);
+  gcry_mpi_release(x);
+  gcry_mpi_release(y);
+}
+
+int t_mpi_arith_main(int argc, char **argv) {
+  unsigned int nbits;
+  int i;
+
+  if (argc > 1 && !strcmp(argv[1], "--verbose"))
+    verbose = 1;
+  else if (argc > 1 && !strcmp(argv[1], "--debug"))
+    verbose = debug = 1;
+
+  xgcry_control(GCRYCTL_DISABLE_SECMEM, 0);
+  xgcry_control(GCRYCTL_INITIALIZATION_FINISHED, 0);
+  if (debug) xgcry_control(GCRYCTL_SET_DEBUG_FLAGS, 1u, 0);
+
+  /* All sizes up to 40 limbs (covering each remainder of the
+     unrolled loops), then the sizes of RSA and DSA keys.  */
+  for (nbits = 64; nbits <= 40 * 64; nbits += 64)
+    for (i = 0; i < 4; i++) check_size(nbits - 13 * i, i == 3);
+  for (nbits = 1024; nbits <= 8192; nbits *= 2) {
+    check_size(nbits, 0);
+    check_size(nbits, 1);
+  }
+
+  /* Moduli below and above the Karatsuba threshold, with exponents
+     for each window size.  */
+  for (nbits = 64; nbits <= 2048; nbits += nbits < 1200 ? 55 : 512)
+    for (i = 1; i <= 1024; i *= 4) {
+      check_powm(nbits, i + 3, 0);
+      check_powm(nbits, i + 3, 1);
+    }
+
+  return error_count ? 1 : 0;
+}
@@ -0,0 +1,140 @@
+/* Parallel tree hash
+   Copyright 2017 The NeoPG developers
+
+   NeoPG is released under the Simplified BSD License (see license.txt)
+*/
+
+#include <neopg/crypto/tree_hash.h>
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+
+namespace NeoPG {
+namespace Crypto {
+
+namespace {
+
+size_t read_fully(std::istream& in, std::vector<uint8_t>& buf) {
+  in.read((char*)buf.data(), buf.size());
+  return in.gcount();
+}
+
+}  // namespace
+
+TreeHash::TreeHash(const std::string& algo, size_t chunk_size,
+                   unsigned int threads)
+    : m_algo(algo), m_chunk_size(chunk_size), m_threads(threads) {
+  if (m_chunk_size == 0)
+    throw std::logic_error("tree hash chunk size must not be 0");
+  if (m_threads == 0)
+    m_threads = std::max(1U, std::thread::hardware_concurrency());
+
+  /* Look up the algorithm here, so that the threads can't fail.  */
+  m_output_length =
+      Botan::HashFunction::create_or_throw(m_algo)->output_length();
+}
+
+std::string TreeHash::name() const {
+  return "Tree(" + m_algo + "," + std::to_string(m_chunk_size) + ")";
+}
+
+void TreeHash::hash_leaves(const uint8_t* data, size_t len,
+                           std::vector<uint8_t>& leaves) {
+  const size_t count = (len + m_chunk_size - 1) / m_chunk_size;
+  const size_t offset = leaves.size();
+  leaves.resize(offset + count * m_output_length);
+  const unsigned int threads =
+      (unsigned int)std::min<size_t>(m_threads, count);
+
+  auto worker = [&](size_t first) {
+    std::unique_ptr<Botan::HashFunction> hash =
+        Botan::HashFunction::create_or_throw(m_algo);
+    for (size_t idx = first; idx < count; idx += threads) {
+      size_t start = idx * m_chunk_size;
+      hash->update(0x00);
+      hash->update(data + start, std::min(m_chunk_size, len - start));
+      hash->final(&leaves[offset + idx * m_output_length]);
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (unsigned int i = 1; i < threads; i++) workers.emplace_back(worker, i);
+  worker(0);
+  for (auto& thread : workers) thread.join();
+}
+
+void TreeHash::hash_tree(const uint8_t* leaves, size_t count, uint8_t* out,
+                         Botan::HashFunction& hash) {
+  if (count == 1) {
+    memcpy(out, leaves, m_output_length);
+    return;
+  }
+
+  size_t split = 1;
+  while (2 * split < count) split *= 2;
+
+  std::vector<uint8_t> children(2 * m_output_length);
+  hash_tree(leaves, split, &children[0], hash);
+  hash_tree(leaves + split * m_output_length, count - split,
+            &children[m_output_length], hash);
+  hash.update(0x01);
+  hash.update(children.data(), children.size());
+  hash.final(out);
+}
+
+std::vector<uint8_t> TreeHash::root(const std::vector<uint8_t>& leaves) {
+  std::unique_ptr<Botan::HashFunction> hash =
+      Botan::HashFunction::create_or_throw(m_algo);
+  std::vector<uint8_t> out(m_output_length);
+  if (leaves.empty())
+    hash->final(out.data());
+  else
+    hash_tree(leaves.data(), leaves.size() / m_output_length, out.data(),
+              *hash);
+  return out;
+}
+
+std::vector<uint8_t> TreeHash::process(const uint8_t* data, size_t len) {
+  std::vector<uint8_t> leaves;
+  hash_leaves(data, len, leaves);
+  return root(leaves);
+}
+
+std::vector<uint8_t> TreeHash::process(std::istream& in) {
+  /* Batches are a multiple of the chunk size, so that only the last
+     chunk of the input can be short.  */
+  std::vector<uint8_t> current(batch_size());
+  std::vector<uint8_t> next(batch_size());
+  std::vector<uint8_t> leaves;
+
+  size_t len = read_fully(in, current);
+  while (len > 0) {
+    size_t next_len = 0;
+    std::thread reader([&]() { next_len = read_fully(in, next); });
+    hash_leaves(current.data(), len, leaves);
+    reader.join();
+
+    current.swap(next);
+    len = next_len;
+  }
+
+  if (in.bad()) throw std::runtime_error("read error");
+  return root(leaves);
+}
+
+std::vector<uint8_t> TreeHash::process(InputSource& in) {
+  if (in.block_size() % m_chunk_size)
+    throw std::logic_error("block size is not a multiple of the chunk size");
+
+  std::vector<uint8_t> leaves;
+  const uint8_t* data;
+  size_t len;
+  while (in.next(data, len)) hash_leaves(data, len, leaves);
+  return root(leaves);
+}
+
+}  // namespace Crypto
+}  // namespace NeoPG
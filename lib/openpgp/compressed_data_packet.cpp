@@ -4,6 +4,9 @@
    NeoPG is released under the Simplified BSD License (see license.txt)
 */
 
+#include <botan/compression.h>
+#include <botan/exceptn.h>
+
 #include <neopg/openpgp/compressed_data_packet.h>
 #include <neopg/openpgp/header.h>
 #include <neopg/utils/stream.h>
@@ -12,7 +15,7 @@ namespace NeoPG {
 namespace OpenPGP {
 
 void CompressedDataPacket::write_body(std::ostream& out) const {
-  out << (uint8_t)compression_algorithm();
+  out.put((uint8_t)compression_algorithm());
   write_compressed_data(out);
 }
 
@@ -20,12 +23,20 @@ PacketType CompressedDataPacket::type() const {
   return PacketType::CompressedData;
 }
 
+uint32_t CompressedDataPacket::body_length() const {
+  return 1 + compressed_data_length();
+}
+
 /* Uncompressed Data Packet */
 
 void UncompressedDataPacket::write_compressed_data(std::ostream& out) const {
   out.write((char*)m_data.data(), m_data.size());
 }
 
+uint32_t UncompressedDataPacket::compressed_data_length() const {
+  return m_data.size();
+}
+
 CompressionAlgorithm UncompressedDataPacket::compression_algorithm() const {
   return CompressionAlgorithm::Uncompressed;
 }
@@ -37,6 +48,10 @@ void DeflateCompressedDataPacket::write_compressed_data(
   out.write((char*)m_data.data(), m_data.size());
 }
 
+uint32_t DeflateCompressedDataPacket::compressed_data_length() const {
+  return m_data.size();
+}
+
 CompressionAlgorithm DeflateCompressedDataPacket::compression_algorithm()
     const {
   return CompressionAlgorithm::Deflate;
@@ -48,6 +63,10 @@ void ZlibCompressedDataPacket::write_compressed_data(std::ostream& out) const {
   out.write((char*)m_data.data(), m_data.size());
 }
 
+uint32_t ZlibCompressedDataPacket::compressed_data_length() const {
+  return m_data.size();
+}
+
 CompressionAlgorithm ZlibCompressedDataPacket::compression_algorithm() const {
   return CompressionAlgorithm::Zlib;
 }
@@ -58,9 +77,83 @@ void Bzip2CompressedDataPacket::write_compressed_data(std::ostream& out) const {
   out.write((char*)m_data.data(), m_data.size());
 }
 
+uint32_t Bzip2CompressedDataPacket::compressed_data_length() const {
+  return m_data.size();
+}
+
 CompressionAlgorithm Bzip2CompressedDataPacket::compression_algorithm() const {
   return CompressionAlgorithm::Bzip2;
 }
 
+/* Streaming Compressed Data Packets */
+
+static const char* botan_compressor_name(CompressionAlgorithm algo) {
+  switch (algo) {
+    case CompressionAlgorithm::Uncompressed:
+      return nullptr;
+    case CompressionAlgorithm::Deflate:
+      return "deflate";
+    case CompressionAlgorithm::Zlib:
+      return "zlib";
+    case CompressionAlgorithm::Bzip2:
+      return "bzip2";
+    default:
+      throw std::logic_error("Unsupported compression algorithm");
+  }
+}
+
+void StreamingCompressedDataPacket::write_compressed_data(
+    std::ostream& out) const {
+  std::unique_ptr<Botan::Compression_Algorithm> compressor;
+  const char* name = botan_compressor_name(compression_algorithm());
+  if (name) {
+    compressor.reset(Botan::make_compressor(name));
+    if (!compressor) throw Botan::Lookup_Error("Compression", name, "");
+    compressor->start(m_level);
+  }
+
+  /* The compressor replaces the input in buf with its output, so a
+     single buffer is used throughout.  */
+  Botan::secure_vector<uint8_t> buf;
+  while (m_source) {
+    buf.resize(block_size);
+    m_source.read((char*)buf.data(), buf.size());
+    buf.resize(m_source.gcount());
+    if (buf.empty()) break;
+    if (compressor) compressor->update(buf);
+    out.write((char*)buf.data(), buf.size());
+  }
+
+  if (compressor) {
+    buf.clear();
+    compressor->finish(buf);
+    out.write((char*)buf.data(), buf.size());
+  }
+}
+
+uint32_t StreamingCompressedDataPacket::compressed_data_length() const {
+  throw std::logic_error("Length of streaming packet is not known");
+}
+
+CompressionAlgorithm StreamingUncompressedDataPacket::compression_algorithm()
+    const {
+  return CompressionAlgorithm::Uncompressed;
+}
+
+CompressionAlgorithm
+StreamingDeflateCompressedDataPacket::compression_algorithm() const {
+  return CompressionAlgorithm::Deflate;
+}
+
+CompressionAlgorithm StreamingZlibCompressedDataPacket::compression_algorithm()
+    const {
+  return CompressionAlgorithm::Zlib;
+}
+
+CompressionAlgorithm StreamingBzip2CompressedDataPacket::compression_algorithm()
+    const {
+  return CompressionAlgorithm::Bzip2;
+}
+
 }  // namespace OpenPGP
 }  // namespace NeoPG
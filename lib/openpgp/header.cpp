@@ -51,22 +51,31 @@ void OldPacketHeader::write(std::ostream& out) {
   if (lentype == PacketLengthType::Default)
     lentype = best_length_type(m_length);
 
+  /* The header is assembled first, so it can be written in one go.  */
+  uint8_t buf[5];
+  size_t len;
   uint8_t tag = 0x80 | ((uint8_t)m_packet_type << 2);
   switch (lentype) {
     case PacketLengthType::OneOctet:
-      out << (uint8_t)(tag | 0x00) << ((uint8_t)(m_length & 0xff));
+      buf[0] = tag | 0x00;
+      buf[1] = m_length & 0xff;
+      len = 2;
       break;
 
     case PacketLengthType::TwoOctet:
-      out << (uint8_t)(tag | 0x01) << ((uint8_t)((m_length >> 8) & 0xff))
-          << ((uint8_t)(m_length & 0xff));
+      buf[0] = tag | 0x01;
+      buf[1] = (m_length >> 8) & 0xff;
+      buf[2] = m_length & 0xff;
+      len = 3;
       break;
 
     case PacketLengthType::FourOctet:
-      out << (uint8_t)(tag | 0x02) << ((uint8_t)((m_length >> 24) & 0xff))
-          << ((uint8_t)((m_length >> 16) & 0xff))
-          << ((uint8_t)((m_length >> 8) & 0xff))
-          << ((uint8_t)(m_length & 0xff));
+      buf[0] = tag | 0x02;
+      buf[1] = (m_length >> 24) & 0xff;
+      buf[2] = (m_length >> 16) & 0xff;
+      buf[3] = (m_length >> 8) & 0xff;
+      buf[4] = m_length & 0xff;
+      len = 5;
       break;
 
     case PacketLengthType::Indeterminate:
@@ -75,10 +84,12 @@ void OldPacketHeader::write(std::ostream& out) {
 
     // LCOV_EXCL_START
     case PacketLengthType::Default:
+    default:
       throw std::logic_error(
           "Unspecific packet length type (shouldn't happen).");
       // LCOV_EXCL_STOP
   }
+  out.write((char*)buf, len);
 }
 
 void NewPacketTag::set_packet_type(PacketType packet_type) {
@@ -90,11 +101,12 @@ NewPacketTag::NewPacketTag(PacketType packet_type) {
   set_packet_type(packet_type);
 }
 
-void NewPacketTag::write(std::ostream& out) {
-  uint8_t tag = 0x80 | 0x40 | (uint8_t)m_packet_type;
-  out << (uint8_t)tag;
+uint8_t NewPacketTag::encode() const {
+  return 0x80 | 0x40 | (uint8_t)m_packet_type;
 }
 
+void NewPacketTag::write(std::ostream& out) { out.put(encode()); }
+
 void NewPacketLength::verify_length(uint32_t length,
                                     PacketLengthType length_type) {
   if (length_type == PacketLengthType::OneOctet and not(length <= 0xbf)) {
@@ -131,44 +143,78 @@ NewPacketLength::NewPacketLength(uint32_t length,
   set_length(length, length_type);
 }
 
-void NewPacketLength::write(std::ostream& out) {
+uint32_t NewPacketLength::encoded_size() const {
   PacketLengthType lentype = m_length_type;
   if (lentype == PacketLengthType::Default)
     lentype = best_length_type(m_length);
 
   switch (lentype) {
     case PacketLengthType::OneOctet:
-      out << (uint8_t)m_length;
-      break;
+    case PacketLengthType::Partial:
+      return 1;
+    case PacketLengthType::TwoOctet:
+      return 2;
+    case PacketLengthType::FiveOctet:
+      return 5;
+    // LCOV_EXCL_START
+    case PacketLengthType::Default:
+    default:
+      throw std::logic_error(
+          "Unspecific packet length type (shouldn't happen).");
+      // LCOV_EXCL_STOP
+  }
+}
+
+size_t NewPacketLength::encode(uint8_t* buf) const {
+  PacketLengthType lentype = m_length_type;
+  if (lentype == PacketLengthType::Default)
+    lentype = best_length_type(m_length);
+
+  switch (lentype) {
+    case PacketLengthType::OneOctet:
+      buf[0] = (uint8_t)m_length;
+      return 1;
 
     case PacketLengthType::TwoOctet: {
       uint32_t adj_length = m_length - 192;
-      out << (uint8_t)(((adj_length >> 8) & 0x1f) + 0xc0)
-          << ((uint8_t)(adj_length & 0xff));
-    } break;
+      buf[0] = ((adj_length >> 8) & 0x1f) + 0xc0;
+      buf[1] = adj_length & 0xff;
+      return 2;
+    }
 
     case PacketLengthType::FourOctet:
-      out << (uint8_t)0xff << ((uint8_t)((m_length >> 24) & 0xff))
-          << ((uint8_t)((m_length >> 16) & 0xff))
-          << ((uint8_t)((m_length >> 8) & 0xff))
-          << ((uint8_t)(m_length & 0xff));
-      break;
+      buf[0] = 0xff;
+      buf[1] = (m_length >> 24) & 0xff;
+      buf[2] = (m_length >> 16) & 0xff;
+      buf[3] = (m_length >> 8) & 0xff;
+      buf[4] = m_length & 0xff;
+      return 5;
 
     case PacketLengthType::Partial: {
       uint8_t exp = __builtin_ctz(m_length);
-      out << (uint8_t)((exp & 0x1f) + 0xe0);
-    } break;
+      buf[0] = (exp & 0x1f) + 0xe0;
+      return 1;
+    }
     // LCOV_EXCL_START
     case PacketLengthType::Default:
+    default:
       throw std::logic_error(
           "Unspecific packet length type (shouldn't happen).");
       // LCOV_EXCL_STOP
   }
 }
 
+void NewPacketLength::write(std::ostream& out) {
+  uint8_t buf[5];
+  size_t len = encode(buf);
+  out.write((char*)buf, len);
+}
+
 void NewPacketHeader::write(std::ostream& out) {
-  m_tag.write(out);
-  m_length.write(out);
+  uint8_t buf[6];
+  buf[0] = m_tag.encode();
+  size_t len = 1 + m_length.encode(buf + 1);
+  out.write((char*)buf, len);
 }
 
 }  // namespace OpenPGP
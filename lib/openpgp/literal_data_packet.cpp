@@ -11,24 +11,31 @@ namespace NeoPG {
 namespace OpenPGP {
 
 void LiteralDataPacket::write_body(std::ostream& out) const {
-  out << (uint8_t)m_data_type;
-
   if (m_filename.length() > 255) {
     throw std::logic_error("filename too long");
   }
 
-  out << (uint8_t)m_filename.size();
+  uint8_t head[2] = {(uint8_t)m_data_type, (uint8_t)m_filename.size()};
+  out.write((char*)head, sizeof(head));
   out.write(m_filename.data(), m_filename.size());
 
-  out << ((uint8_t)((m_timestamp >> 24) & 0xff))
-      << ((uint8_t)((m_timestamp >> 16) & 0xff))
-      << ((uint8_t)((m_timestamp >> 8) & 0xff))
-      << ((uint8_t)(m_timestamp & 0xff));
+  uint8_t timestamp[4] = {(uint8_t)((m_timestamp >> 24) & 0xff),
+                          (uint8_t)((m_timestamp >> 16) & 0xff),
+                          (uint8_t)((m_timestamp >> 8) & 0xff),
+                          (uint8_t)(m_timestamp & 0xff)};
+  out.write((char*)timestamp, sizeof(timestamp));
 
   out.write((char*)m_data.data(), m_data.size());
 }
 
 PacketType LiteralDataPacket::type() const { return PacketType::LiteralData; }
 
+uint32_t LiteralDataPacket::body_length() const {
+  if (m_filename.length() > 255) {
+    throw std::logic_error("filename too long");
+  }
+  return 1 + 1 + m_filename.size() + 4 + m_data.size();
+}
+
 }  // namespace OpenPGP
 }  // namespace NeoPG
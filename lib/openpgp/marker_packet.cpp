@@ -10,12 +10,12 @@ namespace NeoPG {
 namespace OpenPGP {
 
 void MarkerPacket::write_body(std::ostream& out) const {
-  out << (uint8_t)0x50;
-  out << (uint8_t)0x47;
-  out << (uint8_t)0x50;
+  out.write("\x50\x47\x50", 3);
 }
 
 PacketType MarkerPacket::type() const { return PacketType::Marker; }
 
+uint32_t MarkerPacket::body_length() const { return 3; }
+
 }  // namespace OpenPGP
 }  // namespace NeoPG
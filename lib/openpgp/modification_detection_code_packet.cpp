@@ -22,5 +22,9 @@ PacketType ModificationDetectionCodePacket::type() const {
   return PacketType::ModificationDetectionCode;
 }
 
+uint32_t ModificationDetectionCodePacket::body_length() const {
+  return m_data.size();
+}
+
 }  // namespace OpenPGP
 }  // namespace NeoPG
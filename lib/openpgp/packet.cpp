@@ -5,6 +5,7 @@
 */
 
 #include <neopg/openpgp/packet.h>
+#include <neopg/openpgp/partial_length_stream.h>
 #include <neopg/utils/stream.h>
 
 namespace NeoPG {
@@ -13,15 +14,23 @@ namespace OpenPGP {
 void Packet::write(std::ostream& out) const {
   if (m_header) {
     m_header->write(out);
+  } else if (not has_body_length()) {
+    PartialLengthStream partial(out, type());
+    write_body(partial);
+    partial.close();
+    return;
   } else {
-    CountingStream cnt;
-    write_body(cnt);
-    uint32_t len = cnt.bytes_written();
-    NewPacketHeader default_header(type(), len);
+    NewPacketHeader default_header(type(), body_length());
     default_header.write(out);
   }
   write_body(out);
 }
 
+uint32_t Packet::body_length() const {
+  CountingStream cnt;
+  write_body(cnt);
+  return cnt.bytes_written();
+}
+
 }  // namespace OpenPGP
 }  // namespace NeoPG
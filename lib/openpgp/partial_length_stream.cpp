@@ -0,0 +1,97 @@
+/* OpenPGP format
+   Copyright 2017 The NeoPG developers
+
+   NeoPG is released under the Simplified BSD License (see license.txt)
+*/
+
+#include <neopg/openpgp/partial_length_stream.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace NeoPG {
+namespace OpenPGP {
+
+PartialLengthStreamBuf::PartialLengthStreamBuf(std::ostream& out,
+                                               PacketType packet_type,
+                                               uint32_t chunk_size)
+    : m_out(out) {
+  NewPacketLength::verify_length(chunk_size, PacketLengthType::Partial);
+  if (chunk_size < min_chunk_size)
+    throw std::logic_error("Partial packet length chunk size too small");
+
+  m_buffer.resize(chunk_size);
+  setp(m_buffer.data(), m_buffer.data() + m_buffer.size());
+
+  NewPacketTag tag(packet_type);
+  tag.write(m_out);
+}
+
+void PartialLengthStreamBuf::write_chunk(const char* data, uint32_t length,
+                                         PacketLengthType length_type) {
+  NewPacketLength len(length, length_type);
+  len.write(m_out);
+  m_out.write(data, length);
+}
+
+void PartialLengthStreamBuf::close() {
+  if (m_closed) return;
+  m_closed = true;
+
+  /* The last length must not be a partial length.  It may be zero if the
+     body ended on a chunk boundary.  */
+  write_chunk(pbase(), pptr() - pbase(), PacketLengthType::Default);
+  setp(nullptr, nullptr);
+}
+
+std::streamsize PartialLengthStreamBuf::xsputn(const char_type* s,
+                                               std::streamsize n) {
+  if (m_closed) return 0;
+
+  const std::streamsize chunk_size = m_buffer.size();
+  std::streamsize done = 0;
+  while (done < n) {
+    if (pptr() == epptr()) {
+      write_chunk(pbase(), chunk_size, PacketLengthType::Partial);
+      setp(m_buffer.data(), m_buffer.data() + m_buffer.size());
+    }
+    if (pptr() == pbase() and n - done >= chunk_size) {
+      /* Write full chunks directly from the caller's buffer.  */
+      write_chunk(s + done, chunk_size, PacketLengthType::Partial);
+      done += chunk_size;
+      continue;
+    }
+    std::streamsize len = std::min<std::streamsize>(n - done, epptr() - pptr());
+    std::memcpy(pptr(), s + done, len);
+    pbump(len);
+    done += len;
+  }
+  return n;
+}
+
+PartialLengthStreamBuf::int_type PartialLengthStreamBuf::overflow(
+    int_type ch) {
+  if (m_closed) return traits_type::eof();
+  if (traits_type::eq_int_type(ch, traits_type::eof()))
+    return traits_type::not_eof(ch);
+
+  if (pptr() == epptr()) {
+    write_chunk(pbase(), m_buffer.size(), PacketLengthType::Partial);
+    setp(m_buffer.data(), m_buffer.data() + m_buffer.size());
+  }
+  *pptr() = traits_type::to_char_type(ch);
+  pbump(1);
+  return ch;
+}
+
+PartialLengthStream::PartialLengthStream(std::ostream& out,
+                                         PacketType packet_type,
+                                         uint32_t chunk_size)
+    : std::ios(0),
+      std::ostream(&m_partial_length_stream_buf),
+      m_partial_length_stream_buf(out, packet_type, chunk_size) {}
+
+void PartialLengthStream::close() { m_partial_length_stream_buf.close(); }
+
+}  // namespace OpenPGP
+}  // namespace NeoPG
@@ -18,5 +18,9 @@ PacketType SymmetricallyEncryptedDataPacket::type() const {
   return PacketType::SymmetricallyEncryptedData;
 }
 
+uint32_t SymmetricallyEncryptedDataPacket::body_length() const {
+  return m_data.size();
+}
+
 }  // namespace OpenPGP
 }  // namespace NeoPG
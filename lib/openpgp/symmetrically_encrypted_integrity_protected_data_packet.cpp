@@ -12,7 +12,7 @@ namespace OpenPGP {
 
 void SymmetricallyEncryptedIntegrityProtectedDataPacket::write_body(
     std::ostream& out) const {
-  out << (uint8_t)0x01;
+  out.put(0x01);
   out.write((char*)m_data.data(), m_data.size());
 }
 
@@ -20,5 +20,10 @@ PacketType SymmetricallyEncryptedIntegrityProtectedDataPacket::type() const {
   return PacketType::SymmetricallyEncryptedIntegrityProtectedData;
 }
 
+uint32_t SymmetricallyEncryptedIntegrityProtectedDataPacket::body_length()
+    const {
+  return 1 + m_data.size();
+}
+
 }  // namespace OpenPGP
 }  // namespace NeoPG
@@ -16,5 +16,7 @@ void TrustPacket::write_body(std::ostream& out) const {
 
 PacketType TrustPacket::type() const { return PacketType::Trust; }
 
+uint32_t TrustPacket::body_length() const { return m_data.size(); }
+
 }  // namespace OpenPGP
 }  // namespace NeoPG
@@ -6,20 +6,18 @@
 
 #include <neopg/openpgp/header.h>
 #include <neopg/openpgp/user_attribute_packet.h>
-#include <neopg/utils/stream.h>
 
 namespace NeoPG {
 namespace OpenPGP {
 
 void UserAttributePacket::write_body(std::ostream& out) const {
-  CountingStream cnt;
-  write_attribute(cnt);
   /* We have to add 1 for the subpacket type.  */
-  uint32_t len = 1 + cnt.bytes_written();
-  NewPacketLength subpacket_length(len);
+  NewPacketLength subpacket_length(1 + attribute_length());
 
-  subpacket_length.write(out);
-  out << (uint8_t)attribute_type();
+  uint8_t buf[6];
+  size_t len = subpacket_length.encode(buf);
+  buf[len++] = (uint8_t)attribute_type();
+  out.write((char*)buf, len);
   write_attribute(out);
 }
 
@@ -27,21 +25,33 @@ PacketType UserAttributePacket::type() const {
   return PacketType::UserAttribute;
 }
 
+uint32_t UserAttributePacket::body_length() const {
+  NewPacketLength subpacket_length(1 + attribute_length());
+  return subpacket_length.encoded_size() + subpacket_length.m_length;
+}
+
 /* Image Subpacket */
 
 void ImageAttributeSubpacket::write_attribute(std::ostream& out) const {
-  /* Little-endian image header length ("historical accident").  */
-  out << (uint8_t)0x10 << (uint8_t)0x00;
-  /* Image header version.  */
-  out << (uint8_t)0x01;
-  /* Encoding.  */
-  out << (uint8_t)ImageEncoding::JPEG;
-  /* Reserved.  */
-  out << std::string(12, '\x00');
+  uint8_t header[16] = {
+      /* Little-endian image header length ("historical accident").  */
+      0x10, 0x00,
+      /* Image header version.  */
+      0x01,
+      /* Encoding.  */
+      (uint8_t)ImageEncoding::JPEG,
+      /* Reserved (the rest).  */
+  };
+  out.write((char*)header, sizeof(header));
 
   out.write((char*)m_data.data(), m_data.size());
 }
 
+uint32_t ImageAttributeSubpacket::attribute_length() const {
+  /* The image header is 16 octets.  */
+  return 16 + m_data.size();
+}
+
 UserAttributeType ImageAttributeSubpacket::attribute_type() const {
   return UserAttributeType::Image;
 }
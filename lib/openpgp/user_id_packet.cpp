@@ -15,5 +15,7 @@ void UserIdPacket::write_body(std::ostream& out) const {
 
 PacketType UserIdPacket::type() const { return PacketType::UserID; }
 
+uint32_t UserIdPacket::body_length() const { return m_content.size(); }
+
 }  // namespace OpenPGP
 }  // namespace NeoPG
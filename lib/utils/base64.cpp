@@ -0,0 +1,354 @@
+/* Base64 encoding
+   Copyright 2017 The NeoPG developers
+
+   NeoPG is released under the Simplified BSD License (see license.txt)
+*/
+
+#include <neopg/utils/base64.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define NEOPG_BASE64_X86 1
+#include <immintrin.h>
+#endif
+
+namespace NeoPG {
+
+namespace {
+
+const char base64_chars[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+struct Base64DecodeTable {
+  int8_t table[256];
+
+  Base64DecodeTable() {
+    for (int i = 0; i < 256; i++) table[i] = -1;
+    for (int i = 0; i < 64; i++) table[(uint8_t)base64_chars[i]] = i;
+  }
+};
+
+const Base64DecodeTable base64_decode_table;
+
+/* The vector kernels process as many complete blocks as possible and
+   return the number of input octets (characters) consumed.  The rest is
+   handled by the scalar code.  The encoder kernels load 16 octets per
+   12 octets of input, so they are also told how much of the input can
+   be read safely beyond len.  */
+
+typedef size_t (*encode_kernel_t)(const uint8_t* in, size_t len,
+                                  size_t readable, char* out);
+typedef size_t (*decode_kernel_t)(const char* in, size_t len, uint8_t* out);
+
+size_t encode_kernel_none(const uint8_t*, size_t, size_t, char*) { return 0; }
+
+size_t decode_kernel_none(const char*, size_t, uint8_t*) { return 0; }
+
+#ifdef NEOPG_BASE64_X86
+
+/* The SIMD algorithms are described by Wojciech Muła and Daniel Lemire,
+   "Faster Base64 Encoding and Decoding using AVX2 Instructions" (2018),
+   and http://0x80.pl/notesen/2016-01-12-sse-base64-encoding.html.  */
+
+__attribute__((target("ssse3"))) inline __m128i encode_ssse3_block(
+    __m128i in) {
+  in = _mm_shuffle_epi8(
+      in, _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+
+  /* Split the 24-bit groups into four 6-bit indices.  */
+  const __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+  const __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+  const __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+  const __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+  const __m128i indices = _mm_or_si128(t1, t3);
+
+  /* Translate the indices to ASCII by adding a per-range offset.  */
+  __m128i reduced = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+  const __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+  reduced = _mm_or_si128(reduced, _mm_and_si128(less, _mm_set1_epi8(13)));
+  const __m128i shift_lut = _mm_setr_epi8(
+      'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+      '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+  return _mm_add_epi8(_mm_shuffle_epi8(shift_lut, reduced), indices);
+}
+
+__attribute__((target("ssse3"))) size_t encode_kernel_ssse3(const uint8_t* in,
+                                                            size_t len,
+                                                            size_t readable,
+                                                            char* out) {
+  size_t done = 0;
+  while (done + 12 <= len and done + 16 <= readable) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(in + done));
+    _mm_storeu_si128((__m128i*)out, encode_ssse3_block(v));
+    done += 12;
+    out += 16;
+  }
+  return done;
+}
+
+__attribute__((target("avx2"))) size_t encode_kernel_avx2(const uint8_t* in,
+                                                          size_t len,
+                                                          size_t readable,
+                                                          char* out) {
+  const __m256i shuffle = _mm256_setr_epi8(
+      1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10, 1, 0, 2, 1, 4, 3, 5,
+      4, 7, 6, 8, 7, 10, 9, 11, 10);
+  const __m256i shift_lut = _mm256_setr_epi8(
+      'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+      '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+      'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+      '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+
+  size_t done = 0;
+  while (done + 24 <= len and done + 28 <= readable) {
+    /* Each 128-bit lane holds 12 octets of input.  */
+    __m256i v = _mm256_inserti128_si256(
+        _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(in + done))),
+        _mm_loadu_si128((const __m128i*)(in + done + 12)), 1);
+    v = _mm256_shuffle_epi8(v, shuffle);
+
+    const __m256i t0 = _mm256_and_si256(v, _mm256_set1_epi32(0x0fc0fc00));
+    const __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+    const __m256i t2 = _mm256_and_si256(v, _mm256_set1_epi32(0x003f03f0));
+    const __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+    const __m256i indices = _mm256_or_si256(t1, t3);
+
+    __m256i reduced = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+    const __m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+    reduced =
+        _mm256_or_si256(reduced, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+    const __m256i result =
+        _mm256_add_epi8(_mm256_shuffle_epi8(shift_lut, reduced), indices);
+
+    _mm256_storeu_si256((__m256i*)out, result);
+    done += 24;
+    out += 32;
+  }
+  return done +
+         encode_kernel_ssse3(in + done, len - done, readable - done, out);
+}
+
+/* Translate 16 characters to their 6-bit values.  Returns false if any
+   character is not in the base64 alphabet (including padding).  */
+__attribute__((target("ssse3"))) inline bool decode_ssse3_translate(
+    __m128i& str) {
+  const __m128i lut_lo =
+      _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                    0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+  const __m128i lut_hi =
+      _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10,
+                    0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+  const __m128i lut_roll =
+      _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+  const __m128i mask_2f = _mm_set1_epi8(0x2f);
+
+  const __m128i hi_nibbles =
+      _mm_and_si128(_mm_srli_epi32(str, 4), mask_2f);
+  const __m128i lo_nibbles = _mm_and_si128(str, mask_2f);
+  const __m128i hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+  const __m128i lo = _mm_shuffle_epi8(lut_lo, lo_nibbles);
+  const __m128i invalid =
+      _mm_cmpeq_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128());
+  if (_mm_movemask_epi8(invalid) != 0xffff) return false;
+
+  const __m128i eq_2f = _mm_cmpeq_epi8(str, mask_2f);
+  const __m128i roll =
+      _mm_shuffle_epi8(lut_roll, _mm_add_epi8(eq_2f, hi_nibbles));
+  str = _mm_add_epi8(str, roll);
+  return true;
+}
+
+__attribute__((target("ssse3"))) size_t decode_kernel_ssse3(const char* in,
+                                                            size_t len,
+                                                            uint8_t* out) {
+  size_t done = 0;
+  /* Each block stores 16 octets, of which 12 are valid.  Keeping 24
+     characters back guarantees that the store stays within the output
+     even if the input ends with padding.  */
+  while (done + 24 <= len) {
+    __m128i str = _mm_loadu_si128((const __m128i*)(in + done));
+    if (not decode_ssse3_translate(str)) break;
+
+    /* Pack four 6-bit values into three octets.  */
+    const __m128i merged =
+        _mm_maddubs_epi16(str, _mm_set1_epi32(0x01400140));
+    __m128i packed = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+    packed = _mm_shuffle_epi8(packed,
+                              _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14,
+                                            13, 12, -1, -1, -1, -1));
+    _mm_storeu_si128((__m128i*)out, packed);
+    done += 16;
+    out += 12;
+  }
+  return done;
+}
+
+__attribute__((target("avx2"))) size_t decode_kernel_avx2(const char* in,
+                                                          size_t len,
+                                                          uint8_t* out) {
+  const __m256i lut_lo = _mm256_setr_epi8(
+      0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1a,
+      0x1b, 0x1b, 0x1b, 0x1a, 0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+      0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+  const __m256i lut_hi = _mm256_setr_epi8(
+      0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10,
+      0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+      0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+  const __m256i lut_roll = _mm256_setr_epi8(
+      0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0, 0, 16, 19, 4,
+      -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+  const __m256i mask_2f = _mm256_set1_epi8(0x2f);
+  const __m256i shuffle = _mm256_setr_epi8(
+      2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1, 2, 1, 0, 6, 5,
+      4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+
+  size_t done = 0;
+  /* Each block stores 32 octets, of which 24 are valid.  */
+  while (done + 48 <= len) {
+    __m256i str = _mm256_loadu_si256((const __m256i*)(in + done));
+
+    const __m256i hi_nibbles =
+        _mm256_and_si256(_mm256_srli_epi32(str, 4), mask_2f);
+    const __m256i lo_nibbles = _mm256_and_si256(str, mask_2f);
+    const __m256i hi = _mm256_shuffle_epi8(lut_hi, hi_nibbles);
+    const __m256i lo = _mm256_shuffle_epi8(lut_lo, lo_nibbles);
+    if (not _mm256_testz_si256(lo, hi)) break;
+
+    const __m256i eq_2f = _mm256_cmpeq_epi8(str, mask_2f);
+    const __m256i roll =
+        _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(eq_2f, hi_nibbles));
+    str = _mm256_add_epi8(str, roll);
+
+    const __m256i merged =
+        _mm256_maddubs_epi16(str, _mm256_set1_epi32(0x01400140));
+    __m256i packed = _mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000));
+    packed = _mm256_shuffle_epi8(packed, shuffle);
+    /* Move the 12 valid octets of each lane together.  */
+    packed = _mm256_permutevar8x32_epi32(
+        packed, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+    _mm256_storeu_si256((__m256i*)out, packed);
+    done += 32;
+    out += 24;
+  }
+  return done + decode_kernel_ssse3(in + done, len - done, out);
+}
+
+#endif
+
+struct Base64Kernels {
+  encode_kernel_t encode = encode_kernel_none;
+  decode_kernel_t decode = decode_kernel_none;
+
+  Base64Kernels() {
+#ifdef NEOPG_BASE64_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+      encode = encode_kernel_avx2;
+      decode = decode_kernel_avx2;
+    } else if (__builtin_cpu_supports("ssse3")) {
+      encode = encode_kernel_ssse3;
+      decode = decode_kernel_ssse3;
+    }
+#endif
+  }
+};
+
+const Base64Kernels base64_kernels;
+
+/* Encode len octets (the whole input of which readable octets can be
+   accessed) without line breaks.  */
+size_t encode_block(const uint8_t* in, size_t len, size_t readable,
+                    char* out) {
+  size_t done = base64_kernels.encode(in, len, readable, out);
+  char* o = out + done / 3 * 4;
+
+  for (; done + 3 <= len; done += 3) {
+    uint32_t group = (in[done] << 16) | (in[done + 1] << 8) | in[done + 2];
+    *o++ = base64_chars[(group >> 18) & 0x3f];
+    *o++ = base64_chars[(group >> 12) & 0x3f];
+    *o++ = base64_chars[(group >> 6) & 0x3f];
+    *o++ = base64_chars[group & 0x3f];
+  }
+  if (done < len) {
+    uint32_t group = in[done] << 16;
+    if (done + 1 < len) group |= in[done + 1] << 8;
+    *o++ = base64_chars[(group >> 18) & 0x3f];
+    *o++ = base64_chars[(group >> 12) & 0x3f];
+    *o++ = (done + 1 < len) ? base64_chars[(group >> 6) & 0x3f] : '=';
+    *o++ = '=';
+  }
+  return o - out;
+}
+
+}  // namespace
+
+size_t base64_encoded_size(size_t len, size_t line_length) {
+  size_t chars = (len + 2) / 3 * 4;
+  if (line_length) chars += (chars + line_length - 1) / line_length;
+  return chars;
+}
+
+size_t base64_encode(const uint8_t* in, size_t len, char* out,
+                     size_t line_length) {
+  if (line_length == 0) return encode_block(in, len, len, out);
+
+  if (line_length % 4)
+    throw std::logic_error("base64 line length must be a multiple of 4");
+
+  const size_t line_octets = line_length / 4 * 3;
+  char* o = out;
+  size_t done = 0;
+  while (done < len) {
+    size_t octets = std::min(line_octets, len - done);
+    o += encode_block(in + done, octets, len - done, o);
+    *o++ = '\n';
+    done += octets;
+  }
+  return o - out;
+}
+
+size_t base64_decode(const char* in, size_t len, uint8_t* out) {
+  /* Strip the padding.  */
+  size_t pad = 0;
+  while (len > 0 and pad < 2 and in[len - 1] == '=') {
+    len--;
+    pad++;
+  }
+  if (pad and (len + pad) % 4)
+    throw std::invalid_argument("invalid base64 padding");
+
+  const int8_t* table = base64_decode_table.table;
+  size_t done = base64_kernels.decode(in, len, out);
+  uint8_t* o = out + done / 4 * 3;
+
+  for (; done + 4 <= len; done += 4) {
+    int8_t a = table[(uint8_t)in[done]];
+    int8_t b = table[(uint8_t)in[done + 1]];
+    int8_t c = table[(uint8_t)in[done + 2]];
+    int8_t d = table[(uint8_t)in[done + 3]];
+    if ((a | b | c | d) < 0)
+      throw std::invalid_argument("invalid base64 character");
+    uint32_t group = (a << 18) | (b << 12) | (c << 6) | d;
+    *o++ = (group >> 16) & 0xff;
+    *o++ = (group >> 8) & 0xff;
+    *o++ = group & 0xff;
+  }
+
+  size_t rest = len - done;
+  if (rest == 1) throw std::invalid_argument("truncated base64 input");
+  if (rest > 1) {
+    int8_t a = table[(uint8_t)in[done]];
+    int8_t b = table[(uint8_t)in[done + 1]];
+    int8_t c = (rest == 3) ? table[(uint8_t)in[done + 2]] : 0;
+    if ((a | b | c) < 0)
+      throw std::invalid_argument("invalid base64 character");
+    uint32_t group = (a << 18) | (b << 12) | (c << 6);
+    *o++ = (group >> 16) & 0xff;
+    if (rest == 3) *o++ = (group >> 8) & 0xff;
+  }
+  return o - out;
+}
+
+}  // namespace NeoPG
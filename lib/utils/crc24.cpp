@@ -0,0 +1,72 @@
+/* CRC24 checksum
+   Copyright 2017 The NeoPG developers
+
+   NeoPG is released under the Simplified BSD License (see license.txt)
+*/
+
+#include <neopg/utils/crc24.h>
+
+namespace NeoPG {
+
+namespace {
+
+/* The generator polynomial, left-aligned in 32 bits.  */
+const uint32_t CRC24_POLY = 0x864cfb << 8;
+
+/* table[k][i] is the CRC register after feeding the octet i followed by
+   k zero octets into an empty register.  */
+struct Crc24Table {
+  uint32_t table[8][256];
+
+  Crc24Table() {
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t crc = i << 24;
+      for (int j = 0; j < 8; j++)
+        crc = (crc & 0x80000000) ? (crc << 1) ^ CRC24_POLY : (crc << 1);
+      table[0][i] = crc;
+    }
+    for (int k = 1; k < 8; k++)
+      for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = table[k - 1][i];
+        table[k][i] = (crc << 8) ^ table[0][crc >> 24];
+      }
+  }
+};
+
+const Crc24Table crc24_table;
+
+inline uint32_t load_be32(const uint8_t* p) {
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+         ((uint32_t)p[2] << 8) | p[3];
+}
+
+}  // namespace
+
+void Crc24::update(const uint8_t* data, size_t len) {
+  const auto& t = crc24_table.table;
+  uint32_t crc = m_crc;
+
+  while (len >= 8) {
+    uint32_t a = crc ^ load_be32(data);
+    uint32_t b = load_be32(data + 4);
+    crc = t[7][a >> 24] ^ t[6][(a >> 16) & 0xff] ^ t[5][(a >> 8) & 0xff] ^
+          t[4][a & 0xff] ^ t[3][b >> 24] ^ t[2][(b >> 16) & 0xff] ^
+          t[1][(b >> 8) & 0xff] ^ t[0][b & 0xff];
+    data += 8;
+    len -= 8;
+  }
+  while (len--) crc = (crc << 8) ^ t[0][(crc >> 24) ^ *data++];
+
+  m_crc = crc;
+}
+
+uint32_t Crc24::value() const { return m_crc >> 8; }
+
+void Crc24::final(uint8_t* out) const {
+  uint32_t crc = value();
+  out[0] = (crc >> 16) & 0xff;
+  out[1] = (crc >> 8) & 0xff;
+  out[2] = crc & 0xff;
+}
+
+}  // namespace NeoPG
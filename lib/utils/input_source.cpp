@@ -0,0 +1,94 @@
+/* Input sources
+   Copyright 2017 The NeoPG developers
+
+   NeoPG is released under the Simplified BSD License (see license.txt)
+*/
+
+#include <neopg/utils/input_source.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <stdexcept>
+#include <system_error>
+
+namespace NeoPG {
+
+InputSource::InputSource(const std::string& filename, size_t block_size)
+    : m_block_size(block_size) {
+  if (filename == "-")
+    m_fd = STDIN_FILENO;
+  else {
+    m_fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (m_fd < 0)
+      throw std::system_error(errno, std::generic_category(), filename);
+    m_owned = true;
+  }
+  init();
+}
+
+InputSource::InputSource(int fd, size_t block_size)
+    : m_fd(fd), m_block_size(block_size) {
+  init();
+}
+
+InputSource::~InputSource() {
+  if (m_map) munmap((void*)m_map, m_map_size);
+  if (m_owned) ::close(m_fd);
+}
+
+void InputSource::init() {
+  if (m_block_size == 0) {
+    if (m_owned) ::close(m_fd);
+    throw std::logic_error("input block size must not be 0");
+  }
+
+  struct stat st;
+  if (fstat(m_fd, &st) == 0 and S_ISREG(st.st_mode) and st.st_size > 0) {
+    off_t offset = lseek(m_fd, 0, SEEK_CUR);
+    void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+    if (offset >= 0 and map != MAP_FAILED) {
+      posix_madvise(map, st.st_size, POSIX_MADV_SEQUENTIAL);
+      m_map = (const uint8_t*)map;
+      m_map_size = st.st_size;
+      m_pos = std::min<size_t>(offset, m_map_size);
+      return;
+    }
+    if (map != MAP_FAILED) munmap(map, st.st_size);
+  }
+
+  /* Fall back to reading.  */
+  m_buffer.resize(m_block_size);
+}
+
+bool InputSource::next(const uint8_t*& data, size_t& len) {
+  if (m_map) {
+    if (m_pos >= m_map_size) return false;
+    data = m_map + m_pos;
+    len = std::min(m_block_size, m_map_size - m_pos);
+    m_pos += len;
+    return true;
+  }
+
+  /* Fill the whole buffer, so that only the last span is short.  */
+  size_t filled = 0;
+  while (filled < m_block_size) {
+    ssize_t got = ::read(m_fd, &m_buffer[filled], m_block_size - filled);
+    if (got < 0) {
+      if (errno == EINTR) continue;
+      throw std::system_error(errno, std::generic_category(), "read");
+    }
+    if (got == 0) break;
+    filled += got;
+  }
+  if (filled == 0) return false;
+  data = m_buffer.data();
+  len = filled;
+  return true;
+}
+
+}  // namespace NeoPG
@@ -6,6 +6,9 @@
 
 #include <neopg/utils/stream.h>
 
+#include <algorithm>
+#include <cstring>
+
 namespace NeoPG {
 
 uint32_t CountingStreamBuf::bytes_written() { return m_bytes_written; }
@@ -29,4 +32,76 @@ uint32_t CountingStream::bytes_written() {
   return m_counting_stream_buf.bytes_written();
 }
 
+ByteBufferStreamBuf::ByteBufferStreamBuf(std::vector<uint8_t>& buffer)
+    : m_vector(&buffer), m_offset(buffer.size()) {
+  m_begin = (char*)m_vector->data();
+  setp(m_begin + m_offset, m_begin + m_offset);
+}
+
+ByteBufferStreamBuf::ByteBufferStreamBuf(uint8_t* data, size_t size)
+    : m_begin((char*)data) {
+  setp(m_begin, m_begin + size);
+}
+
+ByteBufferStreamBuf::~ByteBufferStreamBuf() { sync(); }
+
+size_t ByteBufferStreamBuf::offset() { return pptr() - m_begin; }
+
+size_t ByteBufferStreamBuf::bytes_written() { return offset() - m_offset; }
+
+bool ByteBufferStreamBuf::grow(size_t n) {
+  if (not m_vector) return false;
+
+  size_t used = offset();
+  size_t size = std::max<size_t>(2 * m_vector->size(), 256);
+  size = std::max(size, used + n);
+  m_vector->resize(size);
+  m_begin = (char*)m_vector->data();
+  setp(m_begin + used, m_begin + size);
+  return true;
+}
+
+std::streamsize ByteBufferStreamBuf::xsputn(const char_type* s,
+                                            std::streamsize n) {
+  if (epptr() - pptr() < n and not grow(n)) n = epptr() - pptr();
+  if (n == 0) return 0;
+  std::memcpy(pptr(), s, n);
+  /* pbump takes an int, so advance through setp instead.  */
+  setp(pptr() + n, epptr());
+  return n;
+}
+
+ByteBufferStreamBuf::int_type ByteBufferStreamBuf::overflow(int_type ch) {
+  if (traits_type::eq_int_type(ch, traits_type::eof()))
+    return traits_type::not_eof(ch);
+  if (pptr() == epptr() and not grow(1)) return traits_type::eof();
+  *pptr() = traits_type::to_char_type(ch);
+  setp(pptr() + 1, epptr());
+  return ch;
+}
+
+int ByteBufferStreamBuf::sync() {
+  if (m_vector) {
+    size_t used = offset();
+    m_vector->resize(used);
+    m_begin = (char*)m_vector->data();
+    setp(m_begin + used, m_begin + used);
+  }
+  return 0;
+}
+
+ByteBufferStream::ByteBufferStream(std::vector<uint8_t>& buffer)
+    : std::ios(0),
+      std::ostream(&m_byte_buffer_stream_buf),
+      m_byte_buffer_stream_buf(buffer) {}
+
+ByteBufferStream::ByteBufferStream(uint8_t* data, size_t size)
+    : std::ios(0),
+      std::ostream(&m_byte_buffer_stream_buf),
+      m_byte_buffer_stream_buf(data, size) {}
+
+size_t ByteBufferStream::bytes_written() {
+  return m_byte_buffer_stream_buf.bytes_written();
+}
+
 }  // namespace NeoPG
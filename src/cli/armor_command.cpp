@@ -4,64 +4,214 @@
    NeoPG is released under the Simplified BSD License (see license.txt)
 */
 
+#include <cstring>
 #include <iostream>
+#include <memory>
+#include <vector>
 
+#include <botan/exceptn.h>
 #include <botan/filters.h>
 
 #include <neopg/cli/armor_command.h>
+#include <neopg/utils/base64.h>
+#include <neopg/utils/crc24.h>
 
 namespace NeoPG {
 namespace CLI {
 
+namespace {
+
+const size_t PGP_WIDTH{64};
+
+/* Input is processed in blocks of complete lines (48 octets each).  */
+const size_t BLOCK_LINES{1024};
+
+/* Fill buf as far as possible, so that only the last block of the input
+   can end with a partial line.  */
+size_t read_block(Botan::DataSource& in, uint8_t* buf, size_t size) {
+  size_t len = 0;
+  while (len < size) {
+    size_t got = in.read(buf + len, size - len);
+    if (got == 0) break;
+    len += got;
+  }
+  return len;
+}
+
+void write(Botan::Filter& sink, const std::string& str) {
+  sink.write((const uint8_t*)str.data(), str.size());
+}
+
+/* Decodes the lines of an armored message.  Base64 data is collected
+   without line breaks and decoded in large batches.  */
+class ArmorDecoder {
+ public:
+  ArmorDecoder(Botan::Filter& sink, bool check_crc24)
+      : m_sink(sink), m_check_crc24(check_crc24) {}
+
+  void line(const char* str, size_t len) {
+    while (len > 0 and (str[len - 1] == '\r' or str[len - 1] == ' ' or
+                        str[len - 1] == '\t'))
+      len--;
+
+    if (m_state == State::Begin) {
+      if (len == 0) return;
+      if (starts_with(str, len, "-----BEGIN ")) {
+        m_state = State::Headers;
+        return;
+      }
+      /* Without an armor header line, the input is plain base64.  */
+      m_state = State::Body;
+    }
+
+    if (m_state == State::Headers) {
+      if (len == 0) {
+        m_state = State::Body;
+        return;
+      }
+      if (memchr(str, ':', len)) return;
+      m_state = State::Body;
+    }
+
+    if (m_state == State::Body) {
+      if (starts_with(str, len, "-----END")) {
+        finish();
+        return;
+      }
+      if (len == 5 and str[0] == '=') {
+        decode(true);
+        uint8_t crc[3 + 2];
+        if (base64_decode(str + 1, 4, crc) != 3)
+          throw Botan::Decoding_Error("invalid armor checksum");
+        m_crc24_found = true;
+        m_crc24_expected = (crc[0] << 16) | (crc[1] << 8) | crc[2];
+        return;
+      }
+      m_text.insert(m_text.end(), str, str + len);
+      /* Padding ends the base64 data.  */
+      if (memchr(str, '=', len))
+        decode(true);
+      else if (m_text.size() >= BLOCK_LINES * PGP_WIDTH)
+        decode(false);
+    }
+  }
+
+  void finish() {
+    if (m_state == State::Done) return;
+    decode(true);
+    if (m_check_crc24 and m_crc24_found and
+        m_crc24.value() != m_crc24_expected)
+      throw Botan::Decoding_Error("armor checksum mismatch");
+    m_state = State::Done;
+  }
+
+ private:
+  enum class State { Begin, Headers, Body, Done };
+
+  static bool starts_with(const char* str, size_t len, const char* prefix) {
+    size_t prefix_len = strlen(prefix);
+    return len >= prefix_len and memcmp(str, prefix, prefix_len) == 0;
+  }
+
+  /* Decode the collected text.  Unless final is set, a partial group
+     of up to three characters is kept for the next batch.  */
+  void decode(bool final) {
+    size_t len = final ? m_text.size() : m_text.size() / 4 * 4;
+    if (len == 0) return;
+    m_data.resize(len / 4 * 3 + 2);
+    size_t out = base64_decode(m_text.data(), len, m_data.data());
+    m_crc24.update(m_data.data(), out);
+    m_sink.write(m_data.data(), out);
+    m_text.erase(m_text.begin(), m_text.begin() + len);
+  }
+
+  Botan::Filter& m_sink;
+  bool m_check_crc24;
+  State m_state{State::Begin};
+  std::vector<char> m_text;
+  std::vector<uint8_t> m_data;
+  Crc24 m_crc24;
+  bool m_crc24_found{false};
+  uint32_t m_crc24_expected{0};
+};
+
+}  // namespace
+
 void ArmorCommand::encode() {
   bool has_title = !m_title.empty();
 
   if (m_files.empty()) m_files.emplace_back("-");
 
-  for (auto& file : m_files) {
-    Botan::Filter* sink = (file == "-")
-                              ? new Botan::DataSink_Stream(std::cout)
-                              : new Botan::DataSink_Stream(file + ".asc", true);
-
-    const int PGP_WIDTH{64};
-    Botan::Pipe pipe(new Botan::Fork(
-        new Botan::Chain(new Botan::Base64_Encoder(true, PGP_WIDTH), sink),
-        new Botan::Chain(new Botan::Hash_Filter("CRC24"),
-                         new Botan::Base64_Encoder())));
-
-    if (has_title) {
-      std::stringstream header_;
-      header_ << "-----BEGIN " << m_title << "-----\n\n";
-      const auto header = header_.str();
-      sink->write((uint8_t*)header.data(), header.size());
-    }
+  /* The base64 encoding, the line breaks and the checksum are computed in
+     a single pass over each block of input.  */
+  const size_t block_size = BLOCK_LINES * PGP_WIDTH / 4 * 3;
+  std::vector<uint8_t> data(block_size);
+  std::vector<char> text(base64_encoded_size(block_size, PGP_WIDTH));
 
-    if (file == "-") {
-      Botan::DataSource_Stream in{std::cin};
-      pipe.process_msg(in);
-    } else {
-      Botan::DataSource_Stream in{file};
-      pipe.process_msg(in);
+  for (auto& file : m_files) {
+    std::unique_ptr<Botan::DataSink_Stream> sink(
+        (file == "-") ? new Botan::DataSink_Stream(std::cout)
+                      : new Botan::DataSink_Stream(file + ".asc", true));
+    std::unique_ptr<Botan::DataSource_Stream> in(
+        (file == "-") ? new Botan::DataSource_Stream(std::cin)
+                      : new Botan::DataSource_Stream(file, true));
+
+    if (has_title) write(*sink, "-----BEGIN " + m_title + "-----\n\n");
+
+    Crc24 crc24;
+    size_t len;
+    while ((len = read_block(*in, data.data(), data.size())) > 0) {
+      crc24.update(data.data(), len);
+      size_t chars = base64_encode(data.data(), len, text.data(), PGP_WIDTH);
+      sink->write((const uint8_t*)text.data(), chars);
     }
 
     if (m_crc24) {
-      std::stringstream crc_;
-      crc_ << "=" << pipe.read_all_as_string(1) << "\n";
-      const auto crc = crc_.str();
-      sink->write((uint8_t*)crc.data(), crc.size());
+      uint8_t crc[3];
+      char crc_text[4];
+      crc24.final(crc);
+      base64_encode(crc, sizeof(crc), crc_text);
+      write(*sink, "=" + std::string(crc_text, sizeof(crc_text)) + "\n");
     }
 
-    if (has_title) {
-      std::stringstream footer_;
-      footer_ << "-----END " << m_title << "-----\n";
-      const auto footer = footer_.str();
-      sink->write((uint8_t*)footer.data(), footer.size());
-    }
+    if (has_title) write(*sink, "-----END " + m_title + "-----\n");
   }
 }
 
 void ArmorCommand::decode() {
-  // TODO
+  if (m_files.empty()) m_files.emplace_back("-");
+
+  Botan::DataSink_Stream sink(std::cout);
+  std::vector<char> buf(BLOCK_LINES * (PGP_WIDTH + 1));
+
+  for (auto& file : m_files) {
+    std::unique_ptr<Botan::DataSource_Stream> in(
+        (file == "-") ? new Botan::DataSource_Stream(std::cin)
+                      : new Botan::DataSource_Stream(file, true));
+    ArmorDecoder decoder(sink, m_crc24);
+
+    /* Number of octets of an incomplete line at the start of buf.  */
+    size_t carry = 0;
+    while (true) {
+      if (carry == buf.size()) buf.resize(2 * buf.size());
+      size_t len =
+          in->read((uint8_t*)buf.data() + carry, buf.size() - carry);
+      if (len == 0) break;
+      len += carry;
+
+      const char* start = buf.data();
+      const char* end = buf.data() + len;
+      const char* eol;
+      while ((eol = (const char*)memchr(start, '\n', end - start))) {
+        decoder.line(start, eol - start);
+        start = eol + 1;
+      }
+      carry = end - start;
+      memmove(buf.data(), start, carry);
+    }
+    if (carry) decoder.line(buf.data(), carry);
+    decoder.finish();
+  }
 }
 
 void ArmorCommand::run() {
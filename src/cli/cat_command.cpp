@@ -6,26 +6,20 @@
 
 #include <iostream>
 
-#include <botan/filters.h>
-
 #include <neopg/cli/cat_command.h>
+#include <neopg/utils/input_source.h>
 
 namespace NeoPG {
 namespace CLI {
 
 void CatCommand::run() {
-  Botan::Pipe pipe(new Botan::DataSink_Stream(std::cout));
-
   if (m_files.empty()) m_files.emplace_back("-");
 
   for (auto& file : m_files) {
-    if (file == "-") {
-      Botan::DataSource_Stream in{std::cin};
-      pipe.process_msg(in);
-    } else {
-      Botan::DataSource_Stream in{file};
-      pipe.process_msg(in);
-    }
+    InputSource in{file};
+    const uint8_t* data;
+    size_t len;
+    while (in.next(data, len)) std::cout.write((const char*)data, len);
   }
 }
 
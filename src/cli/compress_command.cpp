@@ -4,14 +4,22 @@
    NeoPG is released under the Simplified BSD License (see license.txt)
 */
 
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
-#include <botan/comp_filter.h>
 #include <botan/compression.h>
 #include <botan/filters.h>
 
 #include <neopg/cli/compress_command.h>
+#include <neopg/utils/input_source.h>
 
 namespace NeoPG {
 namespace CLI {
@@ -40,6 +48,118 @@ const std::map<std::string, std::string> algo_to_suffix = {
     {"Bzip2_Compression", ".bz2"},
     {"Lzma_Compression", ".xz"}};
 
+namespace {
+
+/* Size of the independently compressed blocks in parallel mode.  */
+const size_t PARALLEL_BLOCK_SIZE{1024 * 1024};
+
+/* Compresses blocks of the input on a pool of threads and writes the
+   results in order.  Each block becomes a complete gzip member or bzip2
+   stream, and the concatenation of these is a valid compressed file.  At
+   most two blocks per thread are kept in memory.  */
+class ParallelCompressor {
+ public:
+  ParallelCompressor(const std::string& algo, size_t level,
+                     unsigned int threads)
+      : m_algo(algo), m_level(level) {
+    for (unsigned int i = 0; i < threads; i++)
+      m_workers.emplace_back(&ParallelCompressor::worker, this);
+  }
+
+  ~ParallelCompressor() {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_stop = true;
+      m_todo.clear();
+    }
+    m_work_cond.notify_all();
+    for (auto& thread : m_workers) thread.join();
+  }
+
+  void process(InputSource& in, Botan::Filter& sink) {
+    std::deque<std::shared_ptr<Block>> pending;
+    auto write_front = [&]() {
+      std::shared_ptr<Block> block = pending.front();
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done_cond.wait(lock, [&]() { return block->done; });
+      }
+      pending.pop_front();
+      if (block->error) std::rethrow_exception(block->error);
+      sink.write(block->data.data(), block->data.size());
+    };
+
+    auto submit = [&](const uint8_t* data, size_t len) {
+      auto block = std::make_shared<Block>();
+      block->data.assign(data, data + len);
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_todo.push_back(block);
+      }
+      m_work_cond.notify_one();
+
+      pending.push_back(block);
+      if (pending.size() >= 2 * m_workers.size()) write_front();
+    };
+
+    const uint8_t* data;
+    size_t len;
+    size_t blocks = 0;
+    for (; in.next(data, len); blocks++) submit(data, len);
+    /* An empty input still yields one (empty) compressed block.  */
+    if (blocks == 0) submit(nullptr, 0);
+    while (!pending.empty()) write_front();
+  }
+
+ private:
+  struct Block {
+    Botan::secure_vector<uint8_t> data;
+    bool done{false};
+    std::exception_ptr error;
+  };
+
+  void worker() {
+    std::unique_ptr<Botan::Compression_Algorithm> compressor{
+        Botan::make_compressor(m_algo)};
+
+    while (true) {
+      std::shared_ptr<Block> block;
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_work_cond.wait(lock, [&]() { return m_stop or !m_todo.empty(); });
+        if (m_stop) return;
+        block = m_todo.front();
+        m_todo.pop_front();
+      }
+
+      std::exception_ptr error;
+      try {
+        compressor->start(m_level);
+        compressor->finish(block->data);
+      } catch (...) {
+        error = std::current_exception();
+      }
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        block->error = error;
+        block->done = true;
+      }
+      m_done_cond.notify_all();
+    }
+  }
+
+  const std::string m_algo;
+  const size_t m_level;
+  std::mutex m_mutex;
+  std::condition_variable m_work_cond;
+  std::condition_variable m_done_cond;
+  std::deque<std::shared_ptr<Block>> m_todo;
+  bool m_stop{false};
+  std::vector<std::thread> m_workers;
+};
+
+}  // namespace
+
 void CompressCommand::run() {
   bool multi_files = false;
 
@@ -52,19 +172,60 @@ void CompressCommand::run() {
   if (!compressor) throw Botan::Lookup_Error("Compression", m_algo, "");
   const std::string suffix(algo_to_suffix.at(compressor->name()));
 
+  std::unique_ptr<Botan::Decompression_Algorithm> decompressor;
+  if (m_decode) {
+    decompressor.reset(Botan::make_decompressor(m_algo));
+    if (!decompressor) throw Botan::Lookup_Error("Compression", m_algo, "");
+  }
+
+  std::unique_ptr<ParallelCompressor> parallel;
+  if (!m_decode and m_threads != 1) {
+    if (compressor->name() != "Gzip_Compression" and
+        compressor->name() != "Bzip2_Compression")
+      throw Botan::Invalid_Argument("--threads requires gzip or bzip2");
+    unsigned int threads =
+        m_threads ? m_threads : std::thread::hardware_concurrency();
+    parallel.reset(
+        new ParallelCompressor(m_algo, m_level, std::max(1U, threads)));
+  }
+
+  /* The input is passed to the (de)compressor block by block, without
+     going through a stream buffer.  */
+  Botan::secure_vector<uint8_t> buffer;
   for (auto& file : m_files) {
-    std::unique_ptr<Botan::DataSource_Stream> source{
-        (file == "-") ? new Botan::DataSource_Stream{std::cin}
-                      : new Botan::DataSource_Stream{file}};
-    Botan::Filter* compress =
-        m_decode
-            ? (Botan::Filter*)new Botan::Decompression_Filter(m_algo)
-            : (Botan::Filter*)new Botan::Compression_Filter(m_algo, m_level);
-    Botan::Filter* sink = (file == "-")
-                              ? new Botan::DataSink_Stream(std::cout)
-                              : new Botan::DataSink_Stream(file + suffix, true);
-    Botan::Pipe pipe{compress, sink};
-    pipe.process_msg(*source);
+    InputSource in{file, parallel ? PARALLEL_BLOCK_SIZE
+                                  : InputSource::default_block_size};
+    std::unique_ptr<Botan::DataSink_Stream> sink{
+        (file == "-") ? new Botan::DataSink_Stream(std::cout)
+                      : new Botan::DataSink_Stream(file + suffix, true)};
+
+    if (parallel) {
+      parallel->process(in, *sink);
+      continue;
+    }
+
+    if (m_decode)
+      decompressor->start();
+    else
+      compressor->start(m_level);
+
+    const uint8_t* data;
+    size_t len;
+    while (in.next(data, len)) {
+      buffer.assign(data, data + len);
+      if (m_decode)
+        decompressor->update(buffer);
+      else
+        compressor->update(buffer);
+      sink->write(buffer.data(), buffer.size());
+    }
+
+    buffer.clear();
+    if (m_decode)
+      decompressor->finish(buffer);
+    else
+      compressor->finish(buffer);
+    sink->write(buffer.data(), buffer.size());
   }
 }
 
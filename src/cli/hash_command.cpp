@@ -4,12 +4,21 @@
    NeoPG is released under the Simplified BSD License (see license.txt)
 */
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
-#include <botan/filters.h>
 #include <botan/hash.h>
+#include <botan/hex.h>
 
 #include <neopg/cli/hash_command.h>
+#include <neopg/utils/input_source.h>
 
 namespace NeoPG {
 namespace CLI {
@@ -107,6 +116,98 @@ void ListHashCommand::run() {
 #endif
 }
 
+namespace {
+
+Botan::secure_vector<uint8_t> hash_file(Botan::HashFunction& hash,
+                                        const std::string& file) {
+  InputSource in{file};
+  const uint8_t* data;
+  size_t len;
+  while (in.next(data, len)) hash.update(data, len);
+  return hash.final();
+}
+
+}  // namespace
+
+void HashCommand::run_parallel() {
+  struct Result {
+    bool done{false};
+    std::string digest;
+    std::exception_ptr error;
+  };
+  std::vector<Result> results(m_files.size());
+  std::mutex mutex;
+  std::condition_variable cond;
+  std::atomic<size_t> next{0};
+
+  std::unique_ptr<Botan::HashFunction> prototype =
+      Botan::HashFunction::create_or_throw(m_algo);
+
+  auto worker = [&]() {
+    std::unique_ptr<Botan::HashFunction> hash(prototype->clone());
+    size_t idx;
+    while ((idx = next++) < m_files.size()) {
+      std::string digest;
+      std::exception_ptr error;
+      try {
+        digest = Botan::hex_encode(hash_file(*hash, m_files[idx]), false);
+      } catch (...) {
+        error = std::current_exception();
+      }
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        results[idx].digest = std::move(digest);
+        results[idx].error = error;
+        results[idx].done = true;
+      }
+      cond.notify_all();
+    }
+  };
+
+  unsigned int jobs = m_jobs ? m_jobs : std::thread::hardware_concurrency();
+  jobs = std::max(1U, std::min<unsigned int>(jobs, m_files.size()));
+  std::vector<std::thread> workers;
+  for (unsigned int i = 0; i < jobs; i++) workers.emplace_back(worker);
+
+  /* Print the results in the order of the command line as soon as they
+     are available.  Like in sequential mode, the first error stops the
+     output.  */
+  std::exception_ptr error;
+  for (size_t idx = 0; idx < m_files.size(); idx++) {
+    std::unique_lock<std::mutex> lock(mutex);
+    cond.wait(lock, [&]() { return results[idx].done; });
+    if (results[idx].error) {
+      error = results[idx].error;
+      next = m_files.size();
+      break;
+    }
+    std::cout << results[idx].digest << " " << m_files[idx] << "\n";
+  }
+
+  for (auto& thread : workers) thread.join();
+  if (error) std::rethrow_exception(error);
+}
+
+void HashCommand::run_tree(bool multi_files) {
+  /* Unless requested otherwise, all CPUs work on each file in turn.  */
+  Crypto::TreeHash tree(m_algo, m_chunk_size,
+                        m_cmd.count("--jobs") ? m_jobs : 0);
+
+  for (auto& file : m_files) {
+    InputSource in{file, tree.batch_size()};
+    std::vector<uint8_t> digest = tree.process(in);
+
+    /* The label makes sure that the result is not confused with the
+       plain digest of the file.  */
+    if (m_raw)
+      std::cout.write((const char*)digest.data(), digest.size());
+    else
+      std::cout << tree.name() << ":" << Botan::hex_encode(digest, false);
+    if (multi_files) std::cout << " " << file;
+    if (!m_raw) std::cout << "\n";
+  }
+}
+
 void HashCommand::run() {
   bool multi_files = false;
 
@@ -119,19 +220,25 @@ void HashCommand::run() {
     multi_files = true;
   }
 
-  Botan::Pipe pipe{
-      new Botan::Hash_Filter(m_algo),
-      m_raw ? nullptr : new Botan::Hex_Encoder(Botan::Hex_Encoder::Lowercase),
-      new Botan::DataSink_Stream(std::cout)};
+  if (m_tree) {
+    run_tree(multi_files);
+    return;
+  }
+
+  if (multi_files and m_jobs != 1) {
+    run_parallel();
+    return;
+  }
+
+  std::unique_ptr<Botan::HashFunction> hash =
+      Botan::HashFunction::create_or_throw(m_algo);
 
   for (auto& file : m_files) {
-    if (file == "-") {
-      Botan::DataSource_Stream in{std::cin};
-      pipe.process_msg(in);
-    } else {
-      Botan::DataSource_Stream in{file};
-      pipe.process_msg(in);
-    }
+    auto digest = hash_file(*hash, file);
+    if (m_raw)
+      std::cout.write((const char*)digest.data(), digest.size());
+    else
+      std::cout << Botan::hex_encode(digest, false);
     if (multi_files) std::cout << " " << file << "\n";
   }
 }
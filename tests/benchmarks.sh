@@ -4,3 +4,33 @@ bench 'dd if=/dev/urandom bs=4M count=50 | gpg2 --print-md SHA1' 'dd if=/dev/ura
 dd if=/dev/urandom bs=4M count=10 | src/neopg gpg2 --compress-algo zip --encrypt -r obama  | src/neopg gpg2 --decrypt > /dev/null
 dd if=/dev/urandom bs=4M count=10 | src/neopg gpg2 --compress-algo zlib --encrypt -r obama  | src/neopg gpg2 --decrypt > /dev/null
 dd if=/dev/urandom bs=4M count=10 | src/neopg gpg2 --compress-algo bzip2 --encrypt -r obama  | src/neopg gpg2 --decrypt > /dev/null
+
+tests/bench-packet 1000000
+
+# Decompression of a highly compressible 1 GB message.  dd reports the
+# throughput of the decrypted output.
+for algo in zip zlib bzip2; do
+  dd if=/dev/zero bs=4M count=256 | src/neopg gpg2 --compress-algo $algo --encrypt -r obama > zeros-$algo.gpg
+  src/neopg gpg2 --decrypt zeros-$algo.gpg | dd of=/dev/null bs=4M
+  src/neopg gpg2 --compress-window 1048576 --decrypt zeros-$algo.gpg | dd of=/dev/null bs=4M
+  rm -f zeros-$algo.gpg
+done
+
+# Parallel block compression against the single-threaded path.
+seq 1 50000000 > compress-input
+for algo in gzip bzip2; do
+  bench "src/neopg compress --algo $algo < compress-input > /dev/null" "src/neopg compress --algo $algo --threads 0 < compress-input > /dev/null"
+done
+rm -f compress-input
+
+# SHA-1 and SHA-2 with SHA-NI, with the AVX2 lanes and with the generic
+# code.  The multi-buffer lines measure gcry_md_hash_buffers_multi.
+tests/bench-sha
+tests/bench-sha --disable-hwf intel-shaext
+tests/bench-sha --disable-hwf intel-shaext --disable-hwf intel-avx2
+
+# RSA with the mulx/adcx/adox limb kernels, with mulx only and with the
+# generic multiplication kernels.
+tests/bench-rsa
+tests/bench-rsa --disable-hwf intel-adx
+tests/bench-rsa --disable-hwf intel-bmi2
@@ -0,0 +1,71 @@
+/* Microbenchmark for packet serialization
+   Copyright 2017 The NeoPG developers
+
+   NeoPG is released under the Simplified BSD License (see license.txt)
+*/
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include <neopg/openpgp/trust_packet.h>
+#include <neopg/openpgp/user_id_packet.h>
+#include <neopg/utils/stream.h>
+
+using namespace NeoPG;
+
+/* Each iteration writes two packets.  */
+template <typename Fnc>
+static void bench(const std::string& name, size_t count, Fnc fnc) {
+  auto start = std::chrono::steady_clock::now();
+  size_t bytes = fnc(count);
+  auto stop = std::chrono::steady_clock::now();
+  double ns = std::chrono::duration<double, std::nano>(stop - start).count();
+  std::cout << name << ": " << (ns / (2 * count)) << " ns/packet, " << bytes
+            << " bytes" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+  size_t count = 1000000;
+  if (argc > 1) count = std::strtoul(argv[1], nullptr, 10);
+
+  OpenPGP::UserIdPacket uid;
+  uid.m_content = "John Doe <john.doe@example.com>";
+  OpenPGP::TrustPacket trust;
+  trust.m_data = {0x00, 0x00};
+
+  bench("uid+trust stringstream", count, [&](size_t n) {
+    std::stringstream out;
+    for (size_t i = 0; i < n; i++) {
+      uid.write(out);
+      trust.write(out);
+    }
+    return out.str().size();
+  });
+
+  bench("uid+trust vector", count, [&](size_t n) {
+    std::vector<uint8_t> buffer;
+    {
+      ByteBufferStream out(buffer);
+      for (size_t i = 0; i < n; i++) {
+        uid.write(out);
+        trust.write(out);
+      }
+    }
+    return buffer.size();
+  });
+
+  bench("uid+trust span", count, [&](size_t n) {
+    std::vector<uint8_t> span(n * 40);
+    ByteBufferStream out(span.data(), span.size());
+    for (size_t i = 0; i < n; i++) {
+      uid.write(out);
+      trust.write(out);
+    }
+    return out.bytes_written();
+  });
+
+  return 0;
+}
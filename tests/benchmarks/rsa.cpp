@@ -0,0 +1,113 @@
+/* Microbenchmark for RSA in libgcrypt
+   Copyright 2017 The NeoPG developers
+
+   NeoPG is released under the Simplified BSD License (see license.txt)
+*/
+
+/* Usage: bench-rsa [--disable-hwf NAME]... [SECONDS]
+
+   Measures RSA-2048 and RSA-4096 signing, verification and
+   decryption, which exercise the limb kernels of the MPI layer.  The
+   kernels can be compared by disabling the hardware features they
+   need, for example "--disable-hwf intel-adx" for the mulx kernels
+   and "--disable-hwf intel-bmi2" for the generic ones.  */
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+#include <iostream>
+#include <string>
+
+#include <gcrypt.h>
+
+template <typename Fnc>
+static void bench(const std::string& name, double seconds, Fnc fnc) {
+  auto start = std::chrono::steady_clock::now();
+  double s;
+  int ops = 0;
+  do {
+    fnc();
+    ops++;
+    s = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                      start)
+            .count();
+  } while (s < seconds);
+  std::cout << name << ": " << (ops / s) << " ops/s" << std::endl;
+}
+
+static gcry_sexp_t genkey(unsigned int nbits) {
+  gcry_sexp_t parms, key;
+
+  gcry_sexp_build(&parms, NULL, "(genkey (rsa (nbits %u)))", nbits);
+  if (gcry_pk_genkey(&key, parms)) {
+    std::cerr << "generating an RSA-" << nbits << " key failed" << std::endl;
+    std::exit(1);
+  }
+  gcry_sexp_release(parms);
+  return key;
+}
+
+int main(int argc, char* argv[]) {
+  double seconds = 2;
+  int i;
+
+  for (i = 1; i < argc; i++) {
+    if (!std::strcmp(argv[i], "--disable-hwf") && i + 1 < argc) {
+      if (gcry_control(GCRYCTL_DISABLE_HWF, argv[++i], NULL)) {
+        std::cerr << "unknown hardware feature " << argv[i] << std::endl;
+        return 1;
+      }
+    } else
+      seconds = std::strtod(argv[i], nullptr);
+  }
+
+  gcry_control(GCRYCTL_DISABLE_SECMEM, 0);
+  gcry_control(GCRYCTL_INITIALIZATION_FINISHED, 0);
+
+  unsigned char hash[32];
+  for (auto& c : hash) c = std::rand();
+
+  for (unsigned int nbits : {2048, 4096}) {
+    std::string name = "RSA-" + std::to_string(nbits);
+    gcry_sexp_t key = genkey(nbits);
+    gcry_sexp_t pub = gcry_sexp_find_token(key, "public-key", 0);
+    gcry_sexp_t sec = gcry_sexp_find_token(key, "private-key", 0);
+    gcry_sexp_t data, msg, sig, enc, plain;
+
+    gcry_sexp_build(&data, NULL, "(data (flags pkcs1) (hash sha256 %b))",
+                    (int)sizeof(hash), hash);
+    gcry_sexp_build(&msg, NULL, "(data (flags pkcs1) (value %b))",
+                    (int)sizeof(hash), hash);
+    gcry_pk_sign(&sig, data, sec);
+    gcry_pk_encrypt(&enc, msg, pub);
+
+    bench(name + " sign", seconds, [&]() {
+      gcry_sexp_t s;
+      gcry_pk_sign(&s, data, sec);
+      gcry_sexp_release(s);
+    });
+
+    bench(name + " verify", seconds, [&]() {
+      if (gcry_pk_verify(sig, data, pub)) {
+        std::cerr << name << " verification failed" << std::endl;
+        std::exit(1);
+      }
+    });
+
+    bench(name + " decrypt", seconds, [&]() {
+      gcry_pk_decrypt(&plain, enc, sec);
+      gcry_sexp_release(plain);
+    });
+
+    gcry_sexp_release(enc);
+    gcry_sexp_release(sig);
+    gcry_sexp_release(msg);
+    gcry_sexp_release(data);
+    gcry_sexp_release(sec);
+    gcry_sexp_release(pub);
+    gcry_sexp_release(key);
+  }
+
+  return 0;
+}
@@ -0,0 +1,105 @@
+/* Microbenchmark for the SHA-1 and SHA-2 backends of libgcrypt
+   Copyright 2017 The NeoPG developers
+
+   NeoPG is released under the Simplified BSD License (see license.txt)
+*/
+
+/* Usage: bench-sha [--disable-hwf NAME]... [MIB]
+
+   Measures the throughput of hashing one long message, of hashing
+   many short messages (the size of a public key packet) one by one,
+   and of hashing them with gcry_md_hash_buffers_multi.  Each backend
+   can be measured by disabling the hardware features of the faster
+   ones, for example "--disable-hwf intel-shaext" for the AVX2 lanes
+   and "--disable-hwf intel-avx2" in addition for the generic code.  */
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <gcrypt.h>
+
+template <typename Fnc>
+static void bench(const std::string& name, size_t bytes, Fnc fnc) {
+  auto start = std::chrono::steady_clock::now();
+  fnc();
+  auto stop = std::chrono::steady_clock::now();
+  double s = std::chrono::duration<double>(stop - start).count();
+  std::cout << name << ": " << (bytes / s / (1024 * 1024)) << " MiB/s"
+            << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+  size_t mib = 256;
+  int i;
+
+  for (i = 1; i < argc; i++) {
+    if (!std::strcmp(argv[i], "--disable-hwf") && i + 1 < argc) {
+      if (gcry_control(GCRYCTL_DISABLE_HWF, argv[++i], NULL)) {
+        std::cerr << "unknown hardware feature " << argv[i] << std::endl;
+        return 1;
+      }
+    } else
+      mib = std::strtoul(argv[i], nullptr, 10);
+  }
+
+  gcry_control(GCRYCTL_DISABLE_SECMEM, 0);
+  gcry_control(GCRYCTL_INITIALIZATION_FINISHED, 0);
+
+  const size_t total = mib * 1024 * 1024;
+  const size_t chunk = 1024 * 1024;
+  std::vector<unsigned char> data(chunk);
+  for (auto& c : data) c = std::rand();
+
+  /* A 2048 bit RSA key packet is about 270 bytes.  */
+  const size_t msglen = 270;
+  const size_t nmsgs = chunk / msglen;
+  std::vector<gcry_buffer_t> bufs(nmsgs);
+  for (size_t j = 0; j < nmsgs; j++) {
+    bufs[j].size = msglen;
+    bufs[j].off = 0;
+    bufs[j].len = msglen;
+    bufs[j].data = data.data() + j * msglen;
+  }
+
+  static const struct {
+    const char* name;
+    int algo;
+  } algos[] = {{"SHA-1", GCRY_MD_SHA1},
+               {"SHA-256", GCRY_MD_SHA256},
+               {"SHA-512", GCRY_MD_SHA512}};
+
+  for (const auto& algo : algos) {
+    std::string name(algo.name);
+    unsigned int dlen = gcry_md_get_algo_dlen(algo.algo);
+    std::vector<unsigned char> digests(nmsgs * dlen);
+
+    bench(name + " long message", total, [&]() {
+      gcry_md_hd_t hd;
+      gcry_md_open(&hd, algo.algo, 0);
+      for (size_t done = 0; done < total; done += chunk)
+        gcry_md_write(hd, data.data(), chunk);
+      gcry_md_read(hd, 0);
+      gcry_md_close(hd);
+    });
+
+    bench(name + " short messages", total / chunk * nmsgs * msglen, [&]() {
+      for (size_t done = 0; done < total; done += chunk)
+        for (size_t j = 0; j < nmsgs; j++)
+          gcry_md_hash_buffer(algo.algo, digests.data() + j * dlen,
+                              bufs[j].data, msglen);
+    });
+
+    bench(name + " short messages (multi)", total / chunk * nmsgs * msglen,
+          [&]() {
+            for (size_t done = 0; done < total; done += chunk)
+              gcry_md_hash_buffers_multi(algo.algo, 0, digests.data(),
+                                         bufs.data(), nmsgs);
+          });
+  }
+
+  return 0;
+}
@@ -0,0 +1,73 @@
+/* Tests for the tree hash
+   Copyright 2017 The NeoPG developers
+
+   NeoPG is released under the Simplified BSD License (see license.txt)
+*/
+
+#include <neopg/crypto/tree_hash.h>
+#include "gtest/gtest.h"
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace NeoPG;
+
+namespace NeoPG {
+
+typedef std::vector<uint8_t> Digest;
+
+static Digest sha256(const Digest& data) {
+  auto hash = Botan::HashFunction::create_or_throw("SHA-256");
+  hash->update(data.data(), data.size());
+  Digest out(hash->output_length());
+  hash->final(out.data());
+  return out;
+}
+
+static Digest hash_of(uint8_t prefix, const Digest& a, const Digest& b) {
+  Digest data{prefix};
+  data.insert(data.end(), a.begin(), a.end());
+  data.insert(data.end(), b.begin(), b.end());
+  return sha256(data);
+}
+
+/* The definition from RFC 6962, section 2.1.  */
+static Digest merkle_tree_hash(const std::vector<Digest>& chunks) {
+  if (chunks.empty()) return sha256({});
+  if (chunks.size() == 1) return hash_of(0x00, chunks[0], {});
+  size_t k = 1;
+  while (2 * k < chunks.size()) k *= 2;
+  std::vector<Digest> left(chunks.begin(), chunks.begin() + k);
+  std::vector<Digest> right(chunks.begin() + k, chunks.end());
+  return hash_of(0x01, merkle_tree_hash(left), merkle_tree_hash(right));
+}
+
+TEST(NeoPGTest, crypto_tree_hash_test) {
+  std::string data;
+  for (int i = 0; i < 100; i++) data += (char)(i * 13 + 7);
+
+  {
+    Crypto::TreeHash tree("SHA-256", 4096, 2);
+    ASSERT_EQ(tree.name(), "Tree(SHA-256,4096)");
+  }
+
+  for (size_t len : {0, 1, 4, 5, 16, 17, 31, 64, 100}) {
+    std::vector<Digest> chunks;
+    for (size_t pos = 0; pos < len; pos += 4) {
+      size_t end = std::min(pos + 4, len);
+      chunks.emplace_back(data.begin() + pos, data.begin() + end);
+    }
+    Digest expected = merkle_tree_hash(chunks);
+
+    for (unsigned int threads : {1, 3, 8}) {
+      Crypto::TreeHash tree("SHA-256", 4, threads);
+      ASSERT_EQ(tree.process((const uint8_t*)data.data(), len), expected);
+      std::stringstream stream(data.substr(0, len));
+      ASSERT_EQ(tree.process(stream), expected);
+    }
+  }
+
+  ASSERT_THROW(Crypto::TreeHash("SHA-256", 0), std::logic_error);
+}
+}
@@ -4,6 +4,8 @@
 
 #include <neopg/openpgp/compressed_data_packet.h>
 
+#include <botan/compression.h>
+
 #include <memory>
 
 using namespace NeoPG;
@@ -44,4 +46,66 @@ TEST(NeoPGTest, openpg_compressed_data_packet_test) {
                                      "\x03",
                                      3));
   }
+
+  {
+    std::stringstream in("Hello");
+    std::stringstream out;
+    OpenPGP::StreamingUncompressedDataPacket packet(in);
+    packet.write(out);
+    ASSERT_EQ(out.str(), std::string("\xC8\x06"
+                                     "\x00"
+                                     "Hello",
+                                     8));
+  }
+
+  {
+    /* Data larger than one partial length chunk, and than one block.  */
+    std::string data;
+    uint32_t seed = 1;
+    for (int i = 0; i < 100000; i++) {
+      seed = seed * 1103515245 + 12345;
+      data += std::to_string(seed >> 20);
+    }
+    std::stringstream in(data);
+    std::stringstream out;
+    OpenPGP::StreamingDeflateCompressedDataPacket packet(in);
+    packet.write(out);
+
+    /* Reassemble the body from the partial lengths.  */
+    std::string result = out.str();
+    ASSERT_EQ(result[0], '\xC8');
+    size_t pos = 1;
+    std::string body;
+    for (;;) {
+      uint8_t len0 = result[pos++];
+      if (len0 >= 0xe0 and len0 < 0xff) {
+        size_t len = 1 << (len0 & 0x1f);
+        body += result.substr(pos, len);
+        pos += len;
+        continue;
+      }
+      size_t len;
+      if (len0 < 0xc0)
+        len = len0;
+      else if (len0 < 0xe0)
+        len = ((len0 - 0xc0) << 8) + (uint8_t)result[pos++] + 192;
+      else {
+        ASSERT_TRUE(false) << "unexpected five octet length";
+        return;
+      }
+      body += result.substr(pos, len);
+      pos += len;
+      break;
+    }
+    ASSERT_EQ(pos, result.size());
+    ASSERT_GT(body.size(), 8192);
+    ASSERT_EQ(body[0], '\x01');
+
+    std::unique_ptr<Botan::Decompression_Algorithm> decompressor{
+        Botan::make_decompressor("deflate")};
+    decompressor->start();
+    Botan::secure_vector<uint8_t> buf(body.begin() + 1, body.end());
+    decompressor->finish(buf);
+    ASSERT_EQ(std::string((char*)buf.data(), buf.size()), data);
+  }
 }
@@ -46,6 +46,7 @@ TEST(NeoPGTest, openpg_test) {
     std::stringstream out;
     OpenPGP::LiteralDataPacket packet;
     packet.m_filename = "test_test_hello.world";
+    ASSERT_EQ(packet.body_length(), 27);
     packet.write(out);
     ASSERT_EQ(out.str(), std::string("\xCB\x1B"
                                      "b\x15test_test_hello.world\0\0\0\0",
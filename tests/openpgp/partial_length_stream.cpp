@@ -0,0 +1,63 @@
+#include <sstream>
+
+#include "gtest/gtest.h"
+
+#include <neopg/openpgp/partial_length_stream.h>
+
+#include <memory>
+
+using namespace NeoPG;
+
+TEST(NeoPGTest, openpg_partial_length_stream_test) {
+  {
+    std::stringstream out;
+    OpenPGP::PartialLengthStream stream(out, OpenPGP::PacketType::LiteralData);
+    stream.close();
+    ASSERT_EQ(out.str(), std::string("\xCB\x00", 2));
+  }
+
+  {
+    std::stringstream out;
+    OpenPGP::PartialLengthStream stream(out, OpenPGP::PacketType::LiteralData);
+    stream << "Hello";
+    stream.close();
+    ASSERT_EQ(out.str(), std::string("\xCB\x05"
+                                     "Hello"));
+  }
+
+  {
+    /* Single octets, a direct write of a full chunk and a buffered rest,
+       ending on a chunk boundary.  */
+    std::stringstream out;
+    OpenPGP::PartialLengthStream stream(out, OpenPGP::PacketType::LiteralData,
+                                        512);
+    for (int i = 0; i < 512; i++) stream.put('a');
+    stream << std::string(1024, 'b');
+    stream.close();
+    ASSERT_EQ(out.str(), std::string("\xCB\xE9", 2) + std::string(512, 'a') +
+                             std::string("\xE9", 1) + std::string(512, 'b') +
+                             std::string("\xE9", 1) + std::string(512, 'b') +
+                             std::string("\x00", 1));
+  }
+
+  {
+    std::stringstream out;
+    OpenPGP::PartialLengthStream stream(out, OpenPGP::PacketType::LiteralData,
+                                        512);
+    stream << std::string(700, 'c');
+    stream.close();
+    ASSERT_EQ(out.str(), std::string("\xCB\xE9", 2) + std::string(512, 'c') +
+                             std::string("\xBC", 1) + std::string(188, 'c'));
+  }
+
+  /* Failures.  */
+  {
+    std::stringstream out;
+    ASSERT_THROW(OpenPGP::PartialLengthStream stream(
+                     out, OpenPGP::PacketType::LiteralData, 256),
+                 std::logic_error);
+    ASSERT_THROW(OpenPGP::PartialLengthStream stream(
+                     out, OpenPGP::PacketType::LiteralData, 1000),
+                 std::logic_error);
+  }
+}
@@ -35,6 +35,7 @@ TEST(NeoPGTest, openpg_user_attribute_packet_test) {
     std::stringstream out;
     OpenPGP::ImageAttributeSubpacket packet;
     packet.m_data = small_jpeg;
+    ASSERT_EQ(packet.body_length(), 125);
     packet.write(out);
     ASSERT_EQ(out.str(),
               std::string("\xD1\x7D"
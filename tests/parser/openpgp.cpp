@@ -5,8 +5,9 @@
 */
 
 #include <neopg/parser/openpgp.h>
+#include <sstream>
 #include <tao/pegtl.hpp>
-#include <tao/pegtl/argv_input.hpp>
+#include <vector>
 #include "gtest/gtest.h"
 
 using namespace NeoPG;
@@ -14,15 +15,130 @@ using namespace tao::neopg_pegtl;
 
 namespace NeoPG {
 
+struct CollectingSink : Parser::OpenPGP::RawPacketSink {
+  std::vector<OpenPGP::PacketType> m_types;
+  std::vector<std::string> m_bodies;
+  size_t m_pieces = 0;
+  bool m_open = false;
+
+  void start_packet(const OpenPGP::PacketHeader& header) override {
+    ASSERT_FALSE(m_open);
+    m_open = true;
+    m_types.push_back(header.type());
+    m_bodies.emplace_back();
+  }
+  void continue_packet(const char* data, std::size_t length) override {
+    ASSERT_TRUE(m_open);
+    m_bodies.back().append(data, length);
+    m_pieces++;
+  }
+  void finish_packet() override {
+    ASSERT_TRUE(m_open);
+    m_open = false;
+  }
+};
+
 TEST(NeoPGTest, parser_openpgp_test) {
   {
-    std::string t = "\x80\x80\x80";
-    string_input<> in(t, "parser_openpgp_test");
+    /* Old format marker packet, new format user ID packet, and an empty
+       old format trust packet with a two octet length.  */
+    std::string t("\xa8\x03PGP\xcd\x03"
+                  "abc\xb1\x00\x00",
+                  13);
+    CollectingSink sink;
+    Parser::OpenPGP::parse_packets(t.data(), t.size(), sink);
 
-    Parser::OpenPGP::state st;
-    parse<Parser::OpenPGP::grammar, Parser::OpenPGP::action>(in, st);
+    ASSERT_FALSE(sink.m_open);
+    ASSERT_EQ(sink.m_types.size(), 3);
+    ASSERT_EQ(sink.m_types[0], OpenPGP::PacketType::Marker);
+    ASSERT_EQ(sink.m_bodies[0], "PGP");
+    ASSERT_EQ(sink.m_types[1], OpenPGP::PacketType::UserID);
+    ASSERT_EQ(sink.m_bodies[1], "abc");
+    ASSERT_EQ(sink.m_types[2], OpenPGP::PacketType::Trust);
+    ASSERT_EQ(sink.m_bodies[2], "");
+  }
 
-    ASSERT_EQ(st.packets.size(), 3);
+  {
+    /* Partial body lengths: 2 + 1 + 3 octets.  */
+    std::string t("\xcb\xe1"
+                  "ab\xe0"
+                  "c\x03"
+                  "def");
+    CollectingSink sink;
+    Parser::OpenPGP::parse_packets(t.data(), t.size(), sink);
+
+    ASSERT_EQ(sink.m_types.size(), 1);
+    ASSERT_EQ(sink.m_types[0], OpenPGP::PacketType::LiteralData);
+    ASSERT_EQ(sink.m_bodies[0], "abcdef");
+    ASSERT_EQ(sink.m_pieces, 3);
+  }
+
+  {
+    /* A large packet read through a small stream buffer is delivered in
+       pieces no larger than the buffer.  */
+    std::string body(100000, 'x');
+    std::string t("\xcb\xff\x00\x01\x86\xa0", 6);
+    t += body;
+    t += "\xca\x03PGP";
+    std::stringstream stream(t);
+    CollectingSink sink;
+    Parser::OpenPGP::parse_packets(stream, sink, 1024);
+
+    ASSERT_EQ(sink.m_types.size(), 2);
+    ASSERT_EQ(sink.m_bodies[0], body);
+    ASSERT_GE(sink.m_pieces, 100000 / 1024);
+    ASSERT_EQ(sink.m_types[1], OpenPGP::PacketType::Marker);
+    ASSERT_EQ(sink.m_bodies[1], "PGP");
+  }
+
+  {
+    /* Partial body chunks of 1024 and 2048 octets read through a stream
+       buffer of 1024 octets.  */
+    std::string body;
+    for (int i = 0; i < 1024 + 2048 + 1024 + 5; i++) body += 'a' + i % 26;
+    std::string t("\xcb\xea", 2);
+    t += body.substr(0, 1024);
+    t += "\xeb";
+    t += body.substr(1024, 2048);
+    t += "\xea";
+    t += body.substr(3072, 1024);
+    t += "\x05";
+    t += body.substr(4096);
+    t += "\xca\x03PGP";
+    std::stringstream stream(t);
+    CollectingSink sink;
+    Parser::OpenPGP::parse_packets(stream, sink, 1024);
+
+    ASSERT_EQ(sink.m_types.size(), 2);
+    ASSERT_EQ(sink.m_types[0], OpenPGP::PacketType::LiteralData);
+    ASSERT_EQ(sink.m_bodies[0], body);
+    ASSERT_EQ(sink.m_types[1], OpenPGP::PacketType::Marker);
+    ASSERT_EQ(sink.m_bodies[1], "PGP");
+  }
+
+  {
+    /* Truncated body.  */
+    std::string t("\xca\x03PG");
+    CollectingSink sink;
+    ASSERT_THROW(Parser::OpenPGP::parse_packets(t.data(), t.size(), sink),
+                 parse_error);
+  }
+
+  {
+    /* Invalid tag.  */
+    std::string t("\x00\x00", 2);
+    CollectingSink sink;
+    ASSERT_THROW(Parser::OpenPGP::parse_packets(t.data(), t.size(), sink),
+                 parse_error);
+  }
+
+  {
+    /* Indeterminate length is rejected.  */
+    std::string t("\xab"
+                  "abc");
+    CollectingSink sink;
+    ASSERT_THROW(Parser::OpenPGP::parse_packets(t.data(), t.size(), sink),
+                 parse_error);
   }
 }
 }
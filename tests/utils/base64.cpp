@@ -0,0 +1,103 @@
+/* Tests for base64
+   Copyright 2017 The NeoPG developers
+
+   NeoPG is released under the Simplified BSD License (see license.txt)
+*/
+
+#include <neopg/utils/base64.h>
+#include "gtest/gtest.h"
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace NeoPG;
+
+namespace NeoPG {
+
+static std::string base64_reference(const std::string& data) {
+  static const char chars[] =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  std::string out;
+  uint32_t bits = 0;
+  int nbits = 0;
+  for (unsigned char c : data) {
+    bits = (bits << 8) | c;
+    nbits += 8;
+    while (nbits >= 6) {
+      nbits -= 6;
+      out += chars[(bits >> nbits) & 0x3f];
+    }
+  }
+  if (nbits) out += chars[(bits << (6 - nbits)) & 0x3f];
+  while (out.size() % 4) out += '=';
+  return out;
+}
+
+static std::string encode(const std::string& data, size_t line_length = 0) {
+  std::string out(base64_encoded_size(data.size(), line_length), '\0');
+  size_t len = base64_encode((const uint8_t*)data.data(), data.size(),
+                             &out[0], line_length);
+  EXPECT_EQ(len, out.size());
+  return out;
+}
+
+static std::string decode(const std::string& text) {
+  std::vector<uint8_t> out(text.size() / 4 * 3 + 2);
+  size_t len = base64_decode(text.data(), text.size(), out.data());
+  return std::string((const char*)out.data(), len);
+}
+
+TEST(NeoPGTest, utils_base64_test) {
+  {
+    ASSERT_EQ(encode(""), "");
+    ASSERT_EQ(encode("f"), "Zg==");
+    ASSERT_EQ(encode("fo"), "Zm8=");
+    ASSERT_EQ(encode("foo"), "Zm9v");
+    ASSERT_EQ(encode("foobar"), "Zm9vYmFy");
+    ASSERT_EQ(decode("Zg=="), "f");
+    ASSERT_EQ(decode("Zm8"), "fo");
+    ASSERT_EQ(decode("Zm9vYmFy"), "foobar");
+  }
+
+  {
+    /* Long enough for the vector code, at all lengths and alignments.  */
+    std::string data;
+    uint32_t x = 1;
+    for (int i = 0; i < 300; i++) {
+      x = x * 1103515245 + 12345;
+      data += (char)(x >> 16);
+    }
+    for (size_t len = 0; len <= data.size(); len++) {
+      std::string part = data.substr(data.size() - len);
+      std::string ref = base64_reference(part);
+      ASSERT_EQ(encode(part), ref);
+      ASSERT_EQ(decode(ref), part);
+    }
+  }
+
+  {
+    std::string data(100, '\xfb');
+    std::string lines = encode(data, 64);
+    std::string ref = base64_reference(data);
+    ASSERT_EQ(lines, ref.substr(0, 64) + "\n" + ref.substr(64, 64) + "\n" +
+                         ref.substr(128) + "\n");
+    ASSERT_EQ(encode(std::string(48, 'x'), 64).size(), 65);
+    ASSERT_THROW(encode(data, 63), std::logic_error);
+  }
+
+  {
+    /* Invalid characters are found wherever they are.  */
+    std::string text = base64_reference(std::string(200, 'a'));
+    for (size_t pos = 0; pos < text.size() - 4; pos++) {
+      std::string bad = text;
+      bad[pos] = '*';
+      ASSERT_THROW(decode(bad), std::invalid_argument);
+      bad[pos] = '=';
+      ASSERT_THROW(decode(bad), std::invalid_argument);
+    }
+    ASSERT_THROW(decode("Zm9vY"), std::invalid_argument);
+    ASSERT_THROW(decode("Zm9=="), std::invalid_argument);
+  }
+}
+}
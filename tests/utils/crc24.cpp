@@ -0,0 +1,59 @@
+/* Tests for CRC24
+   Copyright 2017 The NeoPG developers
+
+   NeoPG is released under the Simplified BSD License (see license.txt)
+*/
+
+#include <neopg/utils/crc24.h>
+#include "gtest/gtest.h"
+
+#include <string>
+
+using namespace NeoPG;
+
+namespace NeoPG {
+
+static uint32_t crc24_bitwise(const std::string& data) {
+  uint32_t crc = 0xb704ce;
+  for (unsigned char c : data) {
+    crc ^= c << 16;
+    for (int i = 0; i < 8; i++) {
+      crc <<= 1;
+      if (crc & 0x1000000) crc ^= 0x1864cfb;
+    }
+  }
+  return crc & 0xffffff;
+}
+
+TEST(NeoPGTest, utils_crc24_test) {
+  {
+    Crc24 crc;
+    ASSERT_EQ(crc.value(), 0xb704ce);
+  }
+  {
+    Crc24 crc;
+    std::string data = "123456789";
+    crc.update((const uint8_t*)data.data(), data.size());
+    ASSERT_EQ(crc.value(), 0x21cf02);
+    uint8_t out[3];
+    crc.final(out);
+    ASSERT_EQ(out[0], 0x21);
+    ASSERT_EQ(out[1], 0xcf);
+    ASSERT_EQ(out[2], 0x02);
+  }
+  {
+    /* All lengths and split points against a bitwise implementation.  */
+    std::string data;
+    for (int i = 0; i < 100; i++) data += (char)(i * 37 + 11);
+    for (size_t len = 0; len <= data.size(); len++) {
+      std::string part = data.substr(0, len);
+      for (size_t split = 0; split <= len; split += 7) {
+        Crc24 crc;
+        crc.update((const uint8_t*)part.data(), split);
+        crc.update((const uint8_t*)part.data() + split, len - split);
+        ASSERT_EQ(crc.value(), crc24_bitwise(part));
+      }
+    }
+  }
+}
+}
@@ -0,0 +1,95 @@
+/* Tests for input sources
+   Copyright 2017 The NeoPG developers
+
+   NeoPG is released under the Simplified BSD License (see license.txt)
+*/
+
+#include <neopg/utils/input_source.h>
+#include "gtest/gtest.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <system_error>
+
+using namespace NeoPG;
+
+namespace NeoPG {
+
+static std::string read_all(InputSource& in, size_t& spans) {
+  std::string result;
+  const uint8_t* data;
+  size_t len;
+  spans = 0;
+  while (in.next(data, len)) {
+    EXPECT_LE(len, in.block_size());
+    /* Only the last span may be short.  */
+    EXPECT_EQ(result.size() % in.block_size(), 0);
+    result.append((const char*)data, len);
+    spans++;
+  }
+  return result;
+}
+
+TEST(NeoPGTest, utils_input_source_test) {
+  std::string content;
+  for (int i = 0; i < 1000; i++) content += (char)(i * 7);
+
+  char filename[] = "/tmp/neopg-input-XXXXXX";
+  int fd = mkstemp(filename);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(write(fd, content.data(), content.size()), content.size());
+  close(fd);
+
+  {
+    /* Regular files are mapped.  */
+    InputSource in(filename, 300);
+    ASSERT_TRUE(in.mapped());
+    size_t spans;
+    ASSERT_EQ(read_all(in, spans), content);
+    ASSERT_EQ(spans, 4);
+  }
+
+  {
+    /* Reading starts at the current offset.  */
+    int fd = open(filename, O_RDONLY);
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(lseek(fd, 100, SEEK_SET), 100);
+    InputSource in(fd, 256);
+    size_t spans;
+    ASSERT_EQ(read_all(in, spans), content.substr(100));
+    close(fd);
+  }
+
+  {
+    /* Pipes are read in full blocks, even if written in small pieces.  */
+    int fds[2];
+    ASSERT_EQ(pipe(fds), 0);
+    for (size_t pos = 0; pos < content.size(); pos += 10)
+      ASSERT_EQ(write(fds[1], content.data() + pos, 10), 10);
+    close(fds[1]);
+    InputSource in(fds[0], 256);
+    ASSERT_FALSE(in.mapped());
+    size_t spans;
+    ASSERT_EQ(read_all(in, spans), content);
+    ASSERT_EQ(spans, 4);
+    close(fds[0]);
+  }
+
+  {
+    /* Empty files.  */
+    std::ofstream(filename, std::ios::trunc);
+    InputSource in(filename);
+    size_t spans;
+    ASSERT_EQ(read_all(in, spans), "");
+    ASSERT_EQ(spans, 0);
+  }
+
+  unlink(filename);
+  ASSERT_THROW(InputSource in(filename), std::system_error);
+  ASSERT_THROW(InputSource in(STDIN_FILENO, 0), std::logic_error);
+}
+}
@@ -35,5 +35,29 @@ TEST(NeoPGTest, utils_stream_test) {
     out.write("Test", 4);
     ASSERT_EQ(out.bytes_written(), 11);
   }
+  {
+    std::vector<uint8_t> buffer{'x'};
+    {
+      ByteBufferStream out(buffer);
+      ASSERT_EQ(out.bytes_written(), 0);
+      out.put(0x41);
+      out << "NeoPG";
+      out.write(std::string(1000, 'y').data(), 1000);
+      ASSERT_EQ(out.bytes_written(), 1006);
+    }
+    ASSERT_EQ(buffer.size(), 1007);
+    ASSERT_EQ(std::string((char*)buffer.data(), 7), "xANeoPG");
+    ASSERT_EQ(buffer[1006], 'y');
+  }
+  {
+    uint8_t span[4];
+    ByteBufferStream out(span, sizeof(span));
+    out.write("Tes", 3);
+    ASSERT_TRUE(out.good());
+    ASSERT_EQ(out.bytes_written(), 3);
+    out.write("ts", 2);
+    ASSERT_FALSE(out.good());
+    ASSERT_EQ(std::string((char*)span, 4), "Test");
+  }
 }
 }